@@ -82,6 +82,13 @@ if (SAIGA_WITH_OPENAL)
     PackageHelper(Opus ${OPUS_FOUND} "${OPUS_INCLUDE_DIRS}" "${OPUS_LIBRARIES}")
 endif ()
 
+#bzip2 for compressed dataset files
+find_package(BZip2 QUIET)
+if (BZIP2_FOUND)
+    SET(SAIGA_USE_BZIP2 1)
+endif ()
+PackageHelper(BZip2 ${BZIP2_FOUND} "${BZIP2_INCLUDE_DIR}" "${BZIP2_LIBRARIES}")
+
 if (SAIGA_WITH_FREEIMAGE)
     find_package(FreeImage QUIET)
     PackageHelper(FreeImage ${FREEIMAGE_FOUND} "${FREEIMAGE_INCLUDE_DIRS}" "${FREEIMAGE_LIBRARIES}")
@@ -0,0 +1,105 @@
+/**
+ * Copyright (c) 2021 Darius Rückert
+ * Licensed under the MIT License.
+ * See LICENSE file for more information.
+ */
+
+#include "saiga/core/Core.h"
+#include "saiga/core/image/imageTransformations.h"
+#include "saiga/core/time/all.h"
+#include "saiga/core/util/CpuFeatures.h"
+#include "saiga/core/util/Thread/omp.h"
+#include "saiga/core/util/table.h"
+
+#include <functional>
+
+using namespace Saiga;
+using namespace Saiga::ImageTransformation;
+
+long sink = 0;
+
+// Some pseudo random pattern which is not constant over the rows
+template <typename T>
+void Fill(ImageView<T> img)
+{
+    for (int i = 0; i < img.size(); ++i)
+    {
+        img.data8[i] = (i * 7 + i / 13) & 0xFF;
+    }
+}
+
+void Benchmark(ImageDimensions dims, int its)
+{
+    TemplatedImage<ucvec4> rgba(dims), rgba2(dims), half(dims.h / 2, dims.w / 2);
+    TemplatedImage<ucvec3> rgb1(dims), rgb2(dims);
+    TemplatedImage<unsigned char> gray(dims), gray2(dims);
+    TemplatedImage<float> grayf(dims), depth(dims);
+    TemplatedImage<uint16_t> depth16(dims);
+
+    Fill<ucvec4>(rgba);
+    Fill<ucvec3>(rgb1);
+    Fill<ucvec3>(rgb2);
+    Fill<unsigned char>(gray2);
+    Fill<uint16_t>(depth16);
+    for (int i = 0; i < dims.h; ++i)
+    {
+        for (int j = 0; j < dims.w; ++j)
+        {
+            depth(i, j) = ((i + j) % 800) * 0.01f;
+        }
+    }
+    RGBAToGray8(rgba, gray);
+
+    std::vector<std::pair<std::string, std::function<void()>>> functions = {
+        {"RGBAToGray8", [&]() { RGBAToGray8(rgba, gray); }},
+        {"RGBAToGrayF", [&]() { RGBAToGrayF(rgba, grayf); }},
+        {"Gray8ToRGBA", [&]() { Gray8ToRGBA(gray, rgba2); }},
+        {"ScaleDown2", [&]() { ScaleDown2(rgba, half); }},
+        {"depthToRGBA float", [&]() { depthToRGBA(depth, rgba2, 0, 7); }},
+        {"depthToRGBA uint16", [&]() { depthToRGBA(depth16, rgba2, 0, 20000); }},
+        {"AbsolutePixelError3", [&]() { sink += AbsolutePixelError(rgb1, rgb2)(0, 0); }},
+        {"AbsolutePixelError1", [&]() { sink += AbsolutePixelError(gray, gray2)(0, 0); }},
+        {"L1Difference3", [&]() { sink += L1Difference(rgb1, rgb2); }},
+        {"L1Difference1", [&]() { sink += L1Difference(gray, gray2); }},
+    };
+
+    int threads = OMP::getMaxThreads();
+    std::cout << "Resolution " << dims.w << "x" << dims.h << " (median time in ms)" << std::endl;
+    Table table({22, 10, 10, 14});
+    table.setFloatPrecision(3);
+    table << "Function"
+          << "Scalar"
+          << "AVX2"
+          << "AVX2 " + std::to_string(threads) + " thr.";
+    for (auto& [name, f] : functions)
+    {
+        OMP::setNumThreads(1);
+        SetImageKernel(ImageKernel::Scalar);
+        float t_scalar = measureObject(its, f).median;
+        SetImageKernel(ImageKernel::AVX2);
+        float t_simd = measureObject(its, f).median;
+        OMP::setNumThreads(threads);
+        float t_parallel = measureObject(its, f).median;
+        table << name << t_scalar << t_simd << t_parallel;
+    }
+    std::cout << std::endl;
+}
+
+int main(int, char**)
+{
+    catchSegFaults();
+
+    std::cout << GetCpuFeatures() << std::endl;
+    if (SupportedImageKernel(ImageKernel::AVX2) != ImageKernel::AVX2)
+    {
+        std::cout << "AVX2 is not supported. The AVX2 columns use the scalar kernels." << std::endl;
+    }
+
+    Benchmark({480, 640}, 50);
+    Benchmark({720, 1280}, 30);
+    Benchmark({1080, 1920}, 20);
+    Benchmark({2160, 3840}, 10);
+
+    std::cout << "Done." << std::endl;
+    return 0;
+}
@@ -30,7 +30,7 @@ int main(int argc, char* args[])
     auto triangles = mesh.TriangleSoup();
 
 
-    AccelerationStructure::ObjectMedianBVH bf(triangles);
+    AccelerationStructure::SAHBVH bf(triangles);
 
     std::cout << "Num triangles = " << triangles.size() << std::endl;
 
@@ -46,8 +46,6 @@ int main(int argc, char* args[])
             {
                 img(i, j) = ucvec3(255, 0, 0);
 
-                //                vec3 dir = camera.inverseprojectToWorldSpace(vec2(j, i), 1, w, h);
-                //                Ray ray(normalize(dir), camera.getPosition());
                 Ray ray = camera.PixelRay(vec2(j, i), w, h, false);
 
                 auto inter = bf.getClosest(ray);
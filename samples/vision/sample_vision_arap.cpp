@@ -59,7 +59,7 @@ void test_to_file(const OptimizationOptions& options, const std::string& file, i
         {
             PLYLoader pl(file);
 
-            TriangleMesh<VertexNC, uint32_t> baseMesh = pl.mesh;
+            TriangleMesh<VertexNC, uint32_t> baseMesh = pl.mesh.Mesh<VertexNC, uint32_t>();
 
             ArabMesh mesh;
             triangleMeshToOpenMesh(baseMesh, mesh);
@@ -159,7 +159,7 @@ int main(int, char**)
     TriangleMesh<VertexNC, uint32_t> baseMesh;
     //    ol.toTriangleMesh(baseMesh);
 
-    baseMesh = pl.mesh;
+    baseMesh = pl.mesh.Mesh<VertexNC, uint32_t>();
 
 
 
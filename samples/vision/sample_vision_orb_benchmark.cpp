@@ -0,0 +1,184 @@
+/**
+ * Copyright (c) 2021 Darius Rückert
+ * Licensed under the MIT License.
+ * See LICENSE file for more information.
+ */
+
+#include "saiga/core/Core.h"
+#include "saiga/core/time/all.h"
+#include "saiga/vision/features/FastDetector.h"
+#include "saiga/vision/features/HammingMatcher.h"
+#include "saiga/vision/features/ORBExtractor.h"
+
+#ifdef SAIGA_USE_OPENCV
+#    include "saiga/vision/opencv/opencv.h"
+
+#    include <opencv2/features2d/features2d.hpp>
+#endif
+
+using namespace Saiga;
+
+const int th_fast     = 20;
+const int th_fast_min = 7;
+const int cell_size   = 30;
+const int border      = 16;
+
+// The cell layout of the ORBExtractor.
+struct Cells
+{
+    Cells(int rows, int cols)
+    {
+        width  = cols - 2 * border;
+        height = rows - 2 * border;
+        n_cols = width / cell_size;
+        n_rows = height / cell_size;
+        w_cell = iCeil(float(width) / n_cols);
+        h_cell = iCeil(float(height) / n_rows);
+    }
+    int width, height;
+    int n_cols, n_rows;
+    int w_cell, h_cell;
+};
+
+#ifdef SAIGA_USE_OPENCV
+// The previous implementation: one cv::FAST call per cell with a fallback to the low threshold.
+void DetectCellsOpenCV(ImageView<unsigned char> image, std::vector<KeyPoint<float>>& keypoints)
+{
+    keypoints.clear();
+    Cells cells(image.rows, image.cols);
+    cv::Mat mat = ImageViewToMat(image);
+
+    for (int i = 0; i < cells.n_rows; i++)
+    {
+        const int iniY = border + i * cells.h_cell;
+        const int maxY = std::min(iniY + cells.h_cell + 6, image.rows - border);
+        if (iniY >= image.rows - border - 3) continue;
+
+        for (int j = 0; j < cells.n_cols; j++)
+        {
+            const int iniX = border + j * cells.w_cell;
+            const int maxX = std::min(iniX + cells.w_cell + 6, image.cols - border);
+            if (iniX >= image.cols - border - 6) continue;
+
+            std::vector<cv::KeyPoint> cv_keys;
+            cv::FAST(mat.rowRange(iniY, maxY).colRange(iniX, maxX), cv_keys, th_fast, true);
+            if (cv_keys.empty())
+            {
+                cv::FAST(mat.rowRange(iniY, maxY).colRange(iniX, maxX), cv_keys, th_fast_min, true);
+            }
+
+            for (auto& cvkp : cv_keys)
+            {
+                keypoints.emplace_back(cvkp.pt.x + j * cells.w_cell, cvkp.pt.y + i * cells.h_cell, cvkp.size,
+                                       cvkp.angle, cvkp.response);
+            }
+        }
+    }
+}
+#endif
+
+// The native implementation: one pass with the low threshold and a per cell selection afterwards.
+void DetectCellsNative(ImageView<unsigned char> image, FastDetector& fast, std::vector<int>& cell_high_count,
+                       std::vector<KeyPoint<float>>& keypoints)
+{
+    keypoints.clear();
+    Cells cells(image.rows, image.cols);
+
+    fast.Detect(image.subImageView(border, border, cells.height, cells.width), th_fast_min, true, keypoints);
+
+    auto cell_index = [&](const KeyPoint<float>& kp) {
+        int cx = std::min((int(kp.point.x()) - 3) / cells.w_cell, cells.n_cols - 1);
+        int cy = std::min((int(kp.point.y()) - 3) / cells.h_cell, cells.n_rows - 1);
+        return cy * cells.n_cols + cx;
+    };
+
+    cell_high_count.assign(cells.n_rows * cells.n_cols, 0);
+    for (auto& kp : keypoints)
+    {
+        if (kp.response >= th_fast) cell_high_count[cell_index(kp)]++;
+    }
+
+    int n = 0;
+    for (auto& kp : keypoints)
+    {
+        if (kp.response >= th_fast || cell_high_count[cell_index(kp)] == 0) keypoints[n++] = kp;
+    }
+    keypoints.resize(n);
+}
+
+int main(int argc, char** argv)
+{
+    initSaigaSampleNoWindow();
+
+    std::string file = argc > 1 ? argv[1] : "textures/landscape.jpg";
+    TemplatedImage<ucvec4> input(file);
+    TemplatedImage<unsigned char> gray(input.h, input.w);
+    ImageTransformation::RGBAToGray8(input.getImageView(), gray.getImageView());
+    std::cout << "Image " << file << " " << gray.w << "x" << gray.h << std::endl;
+
+    const int its = 50;
+    std::vector<KeyPoint<float>> keypoints;
+
+    {
+        FastDetector fast;
+        std::vector<int> cell_high_count;
+        auto st =
+            measureObject(its, [&]() { DetectCellsNative(gray.getImageView(), fast, cell_high_count, keypoints); });
+        std::cout << "FAST native  " << keypoints.size() << " keypoints. Median " << st.median << " ms" << std::endl;
+    }
+
+#ifdef SAIGA_USE_OPENCV
+    {
+        cv::setNumThreads(1);
+        auto st = measureObject(its, [&]() { DetectCellsOpenCV(gray.getImageView(), keypoints); });
+        std::cout << "FAST OpenCV  " << keypoints.size() << " keypoints. Median " << st.median << " ms" << std::endl;
+    }
+#else
+    std::cout << "FAST OpenCV  skipped (compiled without OpenCV)" << std::endl;
+#endif
+
+    for (int threads : {1, 4})
+    {
+        ORBExtractor extractor(1000, 1.2, 8, th_fast, th_fast_min, threads);
+        std::vector<DescriptorORB> descriptors;
+        auto st = measureObject(its, [&]() { extractor.Detect(gray.getImageView(), keypoints, descriptors); });
+        std::cout << "ORBExtractor " << keypoints.size() << " keypoints, " << threads << " threads. Median "
+                  << st.median << " ms" << std::endl;
+    }
+
+    {
+        // A multi-camera rig with 4 frames
+        std::vector<ImageView<unsigned char>> frames(4, gray.getImageView());
+        std::vector<std::vector<KeyPoint<float>>> frame_keypoints;
+        std::vector<std::vector<DescriptorORB>> frame_descriptors;
+
+        ORBExtractor extractor(1000, 1.2, 8, th_fast, th_fast_min, 4);
+        auto st = measureObject(its, [&]() { extractor.DetectBatch(frames, frame_keypoints, frame_descriptors); });
+        std::cout << "ORBExtractor batch of " << frames.size() << " images, 4 threads. Median " << st.median << " ms"
+                  << std::endl;
+    }
+
+    {
+        // Frame to frame matching of the keypoints found above
+        ORBExtractor extractor(1000, 1.2, 8, th_fast, th_fast_min, 1);
+        std::vector<DescriptorORB> descriptors;
+        extractor.Detect(gray.getImageView(), keypoints, descriptors);
+        HammingDescriptorSet train(descriptors);
+
+        using Kernel = HammingMatcher::Kernel;
+        for (auto kernel : {Kernel::Scalar, Kernel::AVX2, Kernel::AVX512})
+        {
+            HammingMatcher matcher(kernel, 1);
+            std::vector<HammingMatch> knn;
+            auto st = measureObject(its, [&]() { matcher.MatchKnn(descriptors, train, 2, knn); });
+            std::cout << "HammingMatcher knn2 " << descriptors.size() << "x" << descriptors.size() << ", kernel "
+                      << (int)matcher.UsedKernel() << ". Median " << st.median << " ms" << std::endl;
+        }
+
+        BruteForceMatcher<DescriptorORB> matcher;
+        auto st = measureObject(its, [&]() { matcher.matchKnn2(descriptors, descriptors); });
+        std::cout << "BruteForceMatcher knn2. Median " << st.median << " ms" << std::endl;
+    }
+
+    return 0;
+}
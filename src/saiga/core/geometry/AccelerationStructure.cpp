@@ -5,12 +5,145 @@
  */
 #include "AccelerationStructure.h"
 
+#include "saiga/core/math/imath.h"
+#include "saiga/core/util/assert.h"
+
 #include "algorithm"
 
+#if defined(__SSE2__)
+#    include <immintrin.h>
+#endif
+
 namespace Saiga
 {
 namespace AccelerationStructure
 {
+// Maximum number of entries on the traversal stack. The builders limit the depth of the binary tree to 96 levels.
+// Each level of the collapsed tree postpones at most 3 children.
+static constexpr int maxStackSize = 3 * 96 + 1;
+
+// Surface area of a box (up to a factor of 2)
+static float HalfArea(const AABB& box)
+{
+    vec3 s = box.Size();
+    return s.x() * s.y() + s.y() * s.z() + s.z() * s.x();
+}
+
+// Slab test of one ray against the four children of a node.
+// Returns a bit mask of the children which are hit in the interval [0, t_max] and writes the entry distances.
+// The argument order of the min/max operations matches the SSE instructions, so that all paths return the same
+// result for NaNs (a ray parallel to a box face).
+inline int IntersectChildren(const QBVHNode& n, const vec3& origin, const vec3& inv_dir, float t_max, float* t_near)
+{
+#if defined(__SSE2__)
+    __m128 t_min = _mm_set1_ps(-std::numeric_limits<float>::infinity());
+    __m128 t_far = _mm_set1_ps(std::numeric_limits<float>::infinity());
+    for (int d = 0; d < 3; ++d)
+    {
+        __m128 o  = _mm_set1_ps(origin[d]);
+        __m128 id = _mm_set1_ps(inv_dir[d]);
+        __m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(n.bmin[d]), o), id);
+        __m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(n.bmax[d]), o), id);
+        t_min     = _mm_max_ps(_mm_min_ps(t1, t0), t_min);
+        t_far     = _mm_min_ps(_mm_max_ps(t1, t0), t_far);
+    }
+    _mm_storeu_ps(t_near, t_min);
+
+    __m128 hit = _mm_and_ps(_mm_cmpge_ps(t_far, _mm_setzero_ps()), _mm_cmple_ps(t_min, t_far));
+    hit        = _mm_and_ps(hit, _mm_cmple_ps(t_min, _mm_set1_ps(t_max)));
+    __m128i valid =
+        _mm_cmpgt_epi32(_mm_load_si128(reinterpret_cast<const __m128i*>(n.count)), _mm_set1_epi32(-1));
+    return _mm_movemask_ps(_mm_and_ps(hit, _mm_castsi128_ps(valid)));
+#else
+    int mask = 0;
+    for (int i = 0; i < 4; ++i)
+    {
+        float t_min = -std::numeric_limits<float>::infinity();
+        float t_far = std::numeric_limits<float>::infinity();
+        for (int d = 0; d < 3; ++d)
+        {
+            float t0 = (n.bmin[d][i] - origin[d]) * inv_dir[d];
+            float t1 = (n.bmax[d][i] - origin[d]) * inv_dir[d];
+            t_min    = std::max(t_min, std::min(t0, t1));
+            t_far    = std::min(t_far, std::max(t0, t1));
+        }
+        t_near[i] = t_min;
+        bool hit  = n.count[i] >= 0 && t_far >= 0 && t_min <= t_far && t_min <= t_max;
+        mask |= int(hit) << i;
+    }
+    return mask;
+#endif
+}
+
+// Slab test of the rays of a packet (SoA layout) against child i of a node.
+// Returns a bit mask of the rays which hit the box in the interval [0, t_max[r]] and writes the entry distances.
+// With AVX all 8 rays are tested at once, with SSE in two halves.
+inline uint32_t IntersectChildPacket(const QBVHNode& n, int i, const float (*origin)[BVH::packetSize],
+                                     const float (*inv_dir)[BVH::packetSize], const float* t_max, float* t_near)
+{
+    static_assert(BVH::packetSize == 8, "The SIMD paths process 8 rays.");
+#if defined(__AVX__)
+    __m256 t_min = _mm256_set1_ps(-std::numeric_limits<float>::infinity());
+    __m256 t_far = _mm256_set1_ps(std::numeric_limits<float>::infinity());
+    for (int d = 0; d < 3; ++d)
+    {
+        __m256 o  = _mm256_load_ps(origin[d]);
+        __m256 id = _mm256_load_ps(inv_dir[d]);
+        __m256 t0 = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(n.bmin[d][i]), o), id);
+        __m256 t1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(n.bmax[d][i]), o), id);
+        t_min     = _mm256_max_ps(_mm256_min_ps(t1, t0), t_min);
+        t_far     = _mm256_min_ps(_mm256_max_ps(t1, t0), t_far);
+    }
+    _mm256_store_ps(t_near, t_min);
+
+    __m256 hit = _mm256_and_ps(_mm256_cmp_ps(t_far, _mm256_setzero_ps(), _CMP_GE_OQ),
+                               _mm256_cmp_ps(t_min, t_far, _CMP_LE_OQ));
+    hit        = _mm256_and_ps(hit, _mm256_cmp_ps(t_min, _mm256_load_ps(t_max), _CMP_LE_OQ));
+    return _mm256_movemask_ps(hit);
+#elif defined(__SSE2__)
+    uint32_t mask = 0;
+    for (int h = 0; h < BVH::packetSize; h += 4)
+    {
+        __m128 t_min = _mm_set1_ps(-std::numeric_limits<float>::infinity());
+        __m128 t_far = _mm_set1_ps(std::numeric_limits<float>::infinity());
+        for (int d = 0; d < 3; ++d)
+        {
+            __m128 o  = _mm_load_ps(origin[d] + h);
+            __m128 id = _mm_load_ps(inv_dir[d] + h);
+            __m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(n.bmin[d][i]), o), id);
+            __m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(n.bmax[d][i]), o), id);
+            t_min     = _mm_max_ps(_mm_min_ps(t1, t0), t_min);
+            t_far     = _mm_min_ps(_mm_max_ps(t1, t0), t_far);
+        }
+        _mm_store_ps(t_near + h, t_min);
+
+        __m128 hit = _mm_and_ps(_mm_cmpge_ps(t_far, _mm_setzero_ps()), _mm_cmple_ps(t_min, t_far));
+        hit        = _mm_and_ps(hit, _mm_cmple_ps(t_min, _mm_load_ps(t_max + h)));
+        mask |= uint32_t(_mm_movemask_ps(hit)) << h;
+    }
+    return mask;
+#else
+    uint32_t mask = 0;
+    for (int r = 0; r < BVH::packetSize; ++r)
+    {
+        float t_min = -std::numeric_limits<float>::infinity();
+        float t_far = std::numeric_limits<float>::infinity();
+        for (int d = 0; d < 3; ++d)
+        {
+            float t0 = (n.bmin[d][i] - origin[d][r]) * inv_dir[d][r];
+            float t1 = (n.bmax[d][i] - origin[d][r]) * inv_dir[d][r];
+            t_min    = std::max(t_min, std::min(t0, t1));
+            t_far    = std::min(t_far, std::max(t0, t1));
+        }
+        t_near[r] = t_min;
+        bool hit  = t_far >= 0 && t_min <= t_far && t_min <= t_max[r];
+        mask |= uint32_t(hit) << r;
+    }
+    return mask;
+#endif
+}
+
+
 BruteForce::BruteForce(const std::vector<Saiga::Triangle>& triangles) : triangles(triangles) {}
 
 RayTriangleIntersection BruteForce::getClosest(const Ray& ray) const
@@ -58,29 +191,283 @@ BVH::BVH(const std::vector<Saiga::Triangle>& triangles)
 
 RayTriangleIntersection BVH::getClosest(const Ray& ray) const
 {
-    Intersection::RayTriangleIntersection result;
-    if (!nodes.empty()) getClosest(0, ray, result);
+    RayTriangleIntersection result;
+    if (qnodes.empty()) return result;
+
+    vec3 inv_dir = 1.0f / ray.direction.array();
+
+    std::pair<int, float> stack[maxStackSize];
+    int stack_size      = 0;
+    stack[stack_size++] = {0, -std::numeric_limits<float>::infinity()};
+
+    while (stack_size > 0)
+    {
+        auto [node, t] = stack[--stack_size];
+
+        // The node is further than the closest hit
+        if (t > result.t) continue;
+
+        const QBVHNode& n = qnodes[node];
+        float t_near[4];
+        int mask = IntersectChildren(n, ray.origin, inv_dir, result.t, t_near);
+
+        // Leaf children are intersected directly. Inner children are pushed far to near.
+        std::pair<int, float> inner[4];
+        int num_inner = 0;
+        for (int i = 0; i < 4; ++i)
+        {
+            if (!(mask & (1 << i))) continue;
+            if (n.count[i] > 0)
+            {
+                for (int j = n.child[i]; j < n.child[i] + n.count[i]; ++j)
+                {
+                    auto inter = Intersection::RayTriangle(ray, triangles[j].first, triangle_epsilon);
+                    if (inter && inter < result)
+                    {
+                        inter.triangleIndex = triangles[j].second;
+                        result              = inter;
+                    }
+                }
+            }
+            else
+            {
+                int k = num_inner++;
+                for (; k > 0 && inner[k - 1].second < t_near[i]; --k)
+                {
+                    inner[k] = inner[k - 1];
+                }
+                inner[k] = {n.child[i], t_near[i]};
+            }
+        }
+        SAIGA_DEBUG_ASSERT(stack_size + num_inner <= maxStackSize);
+        for (int i = 0; i < num_inner; ++i)
+        {
+            stack[stack_size++] = inner[i];
+        }
+    }
     return result;
 }
 
 std::vector<Intersection::RayTriangleIntersection> BVH::getAll(const Ray& ray) const
 {
     std::vector<RayTriangleIntersection> result;
-    if (!nodes.empty()) getAll(0, ray, result);
+    if (qnodes.empty()) return result;
+
+    vec3 inv_dir = 1.0f / ray.direction.array();
+
+    int stack[maxStackSize];
+    int stack_size      = 0;
+    stack[stack_size++] = 0;
+
+    while (stack_size > 0)
+    {
+        const QBVHNode& n = qnodes[stack[--stack_size]];
+        float t_near[4];
+        int mask = IntersectChildren(n, ray.origin, inv_dir, std::numeric_limits<float>::infinity(), t_near);
+
+        for (int i = 0; i < 4; ++i)
+        {
+            if (!(mask & (1 << i))) continue;
+            if (n.count[i] > 0)
+            {
+                for (int j = n.child[i]; j < n.child[i] + n.count[i]; ++j)
+                {
+                    auto inter = Intersection::RayTriangle(ray, triangles[j].first, triangle_epsilon);
+                    if (inter)
+                    {
+                        inter.triangleIndex = triangles[j].second;
+                        result.push_back(inter);
+                    }
+                }
+            }
+            else
+            {
+                SAIGA_DEBUG_ASSERT(stack_size < maxStackSize);
+                stack[stack_size++] = n.child[i];
+            }
+        }
+    }
     return result;
 }
 
 std::pair<float, int> BVH::ClosestPoint(const vec3& p) const
 {
     std::pair<float, int> result = {std::numeric_limits<float>::infinity(), -1};
-    if (!nodes.empty())
+    if (qnodes.empty()) return result;
+
+    std::pair<int, float> stack[maxStackSize];
+    int stack_size      = 0;
+    stack[stack_size++] = {0, 0};
+
+    while (stack_size > 0)
     {
-        ClosestPoint(0, p, result);
-        result.first = sqrt(result.first);
+        auto [node, dist] = stack[--stack_size];
+        if (dist >= result.first) continue;
+
+        const QBVHNode& n = qnodes[node];
+
+        // Squared distance to the four child boxes
+        float d[4];
+        for (int i = 0; i < 4; ++i)
+        {
+            d[i] = 0;
+            for (int a = 0; a < 3; ++a)
+            {
+                float da = std::max({n.bmin[a][i] - p[a], 0.f, p[a] - n.bmax[a][i]});
+                d[i] += da * da;
+            }
+        }
+
+        // go into the closest box first
+        std::pair<int, float> inner[4];
+        int num_inner = 0;
+        for (int i = 0; i < 4; ++i)
+        {
+            if (n.count[i] < 0 || d[i] >= result.first) continue;
+            if (n.count[i] > 0)
+            {
+                // Leaf node -> compute triangle distance
+                for (int j = n.child[i]; j < n.child[i] + n.count[i]; ++j)
+                {
+                    auto& tri = triangles[j].first;
+                    float td  = tri.Distance(p);
+                    td        = td * td;
+                    if (td < result.first)
+                    {
+                        result.first  = td;
+                        result.second = triangles[j].second;
+                    }
+                }
+            }
+            else
+            {
+                int k = num_inner++;
+                for (; k > 0 && inner[k - 1].second < d[i]; --k)
+                {
+                    inner[k] = inner[k - 1];
+                }
+                inner[k] = {n.child[i], d[i]};
+            }
+        }
+        SAIGA_DEBUG_ASSERT(stack_size + num_inner <= maxStackSize);
+        for (int i = 0; i < num_inner; ++i)
+        {
+            stack[stack_size++] = inner[i];
+        }
     }
+
+    result.first = sqrt(result.first);
     return result;
 }
 
+void BVH::getClosest(ArrayView<const Ray> rays, ArrayView<RayTriangleIntersection> result, int threads) const
+{
+    SAIGA_ASSERT(rays.size() == result.size());
+    int n           = rays.size();
+    int num_packets = iDivUp(n, packetSize);
+
+#pragma omp parallel for num_threads(threads) schedule(dynamic, 16)
+    for (int p = 0; p < num_packets; ++p)
+    {
+        int begin = p * packetSize;
+        int end   = std::min(begin + packetSize, n);
+        getClosestPacket(rays.data() + begin, result.data() + begin, end - begin);
+    }
+}
+
+void BVH::getClosestPacket(const Ray* rays, RayTriangleIntersection* result, int n) const
+{
+    for (int r = 0; r < n; ++r)
+    {
+        result[r] = RayTriangleIntersection();
+    }
+    if (qnodes.empty()) return;
+
+    // The rays in SoA layout. Unused slots of a partial packet are never hit, because they are not in the ray mask.
+    alignas(32) float origin[3][packetSize]  = {};
+    alignas(32) float inv_dir[3][packetSize] = {};
+    alignas(32) float t_max[packetSize];
+    for (int r = 0; r < packetSize; ++r)
+    {
+        t_max[r] = r < n ? result[r].t : -std::numeric_limits<float>::infinity();
+    }
+    for (int r = 0; r < n; ++r)
+    {
+        for (int d = 0; d < 3; ++d)
+        {
+            origin[d][r]  = rays[r].origin[d];
+            inv_dir[d][r] = 1.0f / rays[r].direction[d];
+        }
+    }
+
+    // Each stack entry stores a node and the rays which have hit its box
+    std::pair<int, uint32_t> stack[maxStackSize];
+    int stack_size      = 0;
+    stack[stack_size++] = {0, (1u << n) - 1};
+
+    while (stack_size > 0)
+    {
+        auto [node, ray_mask] = stack[--stack_size];
+        const QBVHNode& q     = qnodes[node];
+
+        std::pair<int, float> inner[4];
+        uint32_t inner_mask[4];
+        int num_inner = 0;
+        for (int i = 0; i < 4; ++i)
+        {
+            if (q.count[i] < 0) continue;
+
+            // Rays which hit child i
+            alignas(32) float t_near[packetSize];
+            uint32_t child_mask = IntersectChildPacket(q, i, origin, inv_dir, t_max, t_near) & ray_mask;
+            if (!child_mask) continue;
+
+            if (q.count[i] > 0)
+            {
+                for (int j = q.child[i]; j < q.child[i] + q.count[i]; ++j)
+                {
+                    auto& tri = triangles[j].first;
+                    for (int r = 0; r < packetSize; ++r)
+                    {
+                        if (!(child_mask & (1u << r))) continue;
+                        auto inter = Intersection::RayTriangle(rays[r], tri, triangle_epsilon);
+                        if (inter && inter < result[r])
+                        {
+                            inter.triangleIndex = triangles[j].second;
+                            result[r]           = inter;
+                            t_max[r]            = inter.t;
+                        }
+                    }
+                }
+            }
+            else
+            {
+                // The smallest entry distance of the rays which hit the box
+                float child_t = std::numeric_limits<float>::infinity();
+                for (int r = 0; r < packetSize; ++r)
+                {
+                    if (child_mask & (1u << r)) child_t = std::min(child_t, t_near[r]);
+                }
+
+                // sort far to near
+                int k = num_inner++;
+                for (; k > 0 && inner[k - 1].second < child_t; --k)
+                {
+                    inner[k]      = inner[k - 1];
+                    inner_mask[k] = inner_mask[k - 1];
+                }
+                inner[k]      = {q.child[i], child_t};
+                inner_mask[k] = child_mask;
+            }
+        }
+        SAIGA_DEBUG_ASSERT(stack_size + num_inner <= maxStackSize);
+        for (int i = 0; i < num_inner; ++i)
+        {
+            stack[stack_size++] = {inner[i].first, inner_mask[i]};
+        }
+    }
+}
+
 AABB BVH::computeBox(int start, int end) const
 {
     AABB box;
@@ -103,128 +490,99 @@ void BVH::sortByAxis(int start, int end, int axis)
     std::sort(triangles.begin() + start, triangles.begin() + end, SortTriangleByAxis(axis));
 }
 
-void BVH::getClosest(int node, const Ray& ray, Intersection::RayTriangleIntersection& result) const
+void BVH::collapse()
 {
-    const BVHNode& n = nodes[node];
-
-    float aabbT;
-
-    // The ray missed the box
-    if (!Intersection::RayAABB(ray, n.box, aabbT)) return;
-
-    // The node is further than the closest hit
-    if (aabbT > result.t) return;
-
-    if (n._inner)
+    qnodes.clear();
+    if (!nodes.empty())
     {
-        getClosest(n._left, ray, result);
-        getClosest(n._right, ray, result);
+        qnodes.reserve(nodes.size() / 2 + 1);
+        collapse(0);
     }
-    else
+    nodes.clear();
+    nodes.shrink_to_fit();
+}
+
+int BVH::collapse(int node)
+{
+    // Pull up the grandchildren until the node has 4 children. The child with the largest surface is opened first.
+    int children[4];
+    int num_children = 0;
+    if (nodes[node]._inner)
     {
-        // Leaf node -> intersect with triangles
-        for (uint32_t i = n._left; i < n._right; ++i)
+        children[num_children++] = nodes[node]._left;
+        children[num_children++] = nodes[node]._right;
+        while (num_children < 4)
         {
-            auto inter = Intersection::RayTriangle(ray, triangles[i].first, triangle_epsilon);
-            if (inter && inter < result)
+            int best        = -1;
+            float best_area = -1;
+            for (int i = 0; i < num_children; ++i)
             {
-                inter.triangleIndex = triangles[i].second;
-                result              = inter;
+                auto& c = nodes[children[i]];
+                if (c._inner && HalfArea(c.box) > best_area)
+                {
+                    best      = i;
+                    best_area = HalfArea(c.box);
+                }
             }
+            if (best == -1) break;
+            auto& c                  = nodes[children[best]];
+            children[best]           = c._left;
+            children[num_children++] = c._right;
         }
     }
-}
-
-void BVH::getAll(int node, const Ray& ray, std::vector<Intersection::RayTriangleIntersection>& result) const
-{
-    const BVHNode& n = nodes[node];
-
-    float aabbT;
-
-    if (!Intersection::RayAABB(ray, n.box, aabbT))
+    else
     {
-        // The ray missed the box
-        return;
+        // The root is a leaf
+        children[num_children++] = node;
     }
 
-    if (n._inner)
-    {
-        getAll(n._left, ray, result);
-        getAll(n._right, ray, result);
-    }
-    else
+    int id = qnodes.size();
+    qnodes.push_back({});
+
+    for (int i = 0; i < 4; ++i)
     {
-        // Leaf node -> intersect with triangles
-        for (uint32_t i = n._left; i < n._right; ++i)
+        QBVHNode& q = qnodes[id];
+        if (i >= num_children)
         {
-            auto inter = Intersection::RayTriangle(ray, triangles[i].first, triangle_epsilon);
-            if (inter)
+            for (int d = 0; d < 3; ++d)
             {
-                inter.triangleIndex = triangles[i].second;
-                result.push_back(inter);
+                q.bmin[d][i] = 0;
+                q.bmax[d][i] = 0;
             }
+            q.child[i] = 0;
+            q.count[i] = -1;
+            continue;
         }
-    }
-}
-
-void BVH::ClosestPoint(int node, const vec3& p, std::pair<float, int>& result) const
-{
-    const BVHNode& n = nodes[node];
 
-
-    if (n._inner)
-    {
-        auto& l = nodes[n._left];
-        auto& r = nodes[n._right];
-
-        auto ld = l.box.DistanceSquared(p);
-        auto rd = r.box.DistanceSquared(p);
-
-        // go into closest box first
-        if (ld < rd)
+        auto& c = nodes[children[i]];
+        for (int d = 0; d < 3; ++d)
         {
-            if (ld < result.first)
-            {
-                ClosestPoint(n._left, p, result);
-            }
-            if (rd < result.first)
-            {
-                ClosestPoint(n._right, p, result);
-            }
+            q.bmin[d][i] = c.box.min[d];
+            q.bmax[d][i] = c.box.max[d];
         }
-        else
+
+        if (c._inner)
         {
-            if (rd < result.first)
-            {
-                ClosestPoint(n._right, p, result);
-            }
-            if (ld < result.first)
-            {
-                ClosestPoint(n._left, p, result);
-            }
+            // the reference to q might be broken after this call
+            int child_id          = collapse(children[i]);
+            qnodes[id].child[i] = child_id;
+            qnodes[id].count[i] = 0;
         }
-    }
-    else
-    {
-        // Leaf node -> compute triangle distance
-        for (uint32_t i = n._left; i < n._right; ++i)
+        else
         {
-            auto& tri = triangles[i].first;
-            auto d    = tri.Distance(p);
-            d         = d * d;
-            if (d < result.first)
-            {
-                result.first  = d;
-                result.second = triangles[i].second;
-            }
+            q.child[i] = c._left;
+            q.count[i] = c._right - c._left;
         }
     }
+    return id;
 }
 
 void ObjectMedianBVH::construct()
 {
+    nodes.clear();
     nodes.reserve(triangles.size());
-    construct(0, triangles.size());
+    if (!triangles.empty()) construct(0, triangles.size());
+    collapse();
 }
 
 int ObjectMedianBVH::construct(int start, int end)
@@ -246,9 +604,11 @@ int ObjectMedianBVH::construct(int start, int end)
     {
         node._inner = 1;
         int axis    = node.box.maxDimension();
-        sortByAxis(start, end, axis);
+        int mid     = (start + end) / 2;
 
-        int mid = (start + end) / 2;
+        // Only the median is required, the halves don't have to be sorted
+        std::nth_element(triangles.begin() + start, triangles.begin() + mid, triangles.begin() + end,
+                         SortTriangleByAxis(axis));
 
         int l = construct(start, mid);
         int r = construct(mid, end);
@@ -262,6 +622,192 @@ int ObjectMedianBVH::construct(int start, int end)
     return nodeid;
 }
 
+void SAHBVH::construct()
+{
+    SAIGA_ASSERT(leafTriangles >= 1);
+
+    // Number of bins per axis
+    constexpr int num_bins = 16;
+    // Nodes deeper than this are split at the object median. This bounds the depth of the tree for degenerate input.
+    constexpr int max_sah_depth = 64;
+
+    int n = triangles.size();
+    nodes.clear();
+    if (n == 0)
+    {
+        collapse();
+        return;
+    }
+
+    // The bounding box and center of each triangle. The references are partitioned during the build and the
+    // triangles are reordered at the end.
+    struct Reference
+    {
+        AABB box;
+        vec3 center;
+        int id;
+    };
+    std::vector<Reference> refs(n);
+
+#pragma omp parallel for num_threads(threads)
+    for (int i = 0; i < n; ++i)
+    {
+        auto& t = triangles[i].first;
+        AABB box(t.a, t.a);
+        box.growBox(t.b);
+        box.growBox(t.c);
+        refs[i] = {box, 0.5f * (box.min + box.max), i};
+    }
+
+    struct Task
+    {
+        int node, start, end, depth;
+    };
+    std::vector<Task> tasks = {{0, 0, n, 0}}, next_tasks;
+    std::vector<int> split;
+    nodes.resize(1);
+
+    while (!tasks.empty())
+    {
+        split.resize(tasks.size());
+
+        // Compute the box and the split position (-1 for leaves) of every node of the current level
+#pragma omp parallel for num_threads(threads) schedule(dynamic, 1)
+        for (int t = 0; t < (int)tasks.size(); ++t)
+        {
+            auto task = tasks[t];
+            int count = task.end - task.start;
+
+            AABB box, center_box;
+            box.makeNegative();
+            center_box.makeNegative();
+            for (int i = task.start; i < task.end; ++i)
+            {
+                box.growBox(refs[i].box);
+                center_box.growBox(refs[i].center);
+            }
+            nodes[task.node].box = AABB(box.min - vec3(bvh_epsilon, bvh_epsilon, bvh_epsilon),
+                                        box.max + vec3(bvh_epsilon, bvh_epsilon, bvh_epsilon));
+
+            if (count <= leafTriangles)
+            {
+                split[t] = -1;
+                continue;
+            }
+
+            int best_axis   = -1;
+            int best_bin    = 0;
+            float best_cost = std::numeric_limits<float>::infinity();
+
+            if (task.depth < max_sah_depth)
+            {
+                for (int axis = 0; axis < 3; ++axis)
+                {
+                    float extent = center_box.max[axis] - center_box.min[axis];
+                    if (!(extent > 0)) continue;
+                    float scale = num_bins / extent;
+
+                    AABB bin_box[num_bins];
+                    int bin_count[num_bins] = {};
+                    for (auto& b : bin_box) b.makeNegative();
+
+                    for (int i = task.start; i < task.end; ++i)
+                    {
+                        int b = std::min(int((refs[i].center[axis] - center_box.min[axis]) * scale), num_bins - 1);
+                        bin_box[b].growBox(refs[i].box);
+                        bin_count[b]++;
+                    }
+
+                    // Sweep from the right to compute the cost of the right side of each split
+                    float right_cost[num_bins];
+                    AABB acc;
+                    acc.makeNegative();
+                    int acc_count = 0;
+                    for (int b = num_bins - 1; b > 0; --b)
+                    {
+                        acc.growBox(bin_box[b]);
+                        acc_count += bin_count[b];
+                        right_cost[b] = acc_count > 0 ? acc_count * HalfArea(acc) : 0;
+                    }
+
+                    // Sweep from the left. Split b puts the bins [0, b) to the left child.
+                    acc.makeNegative();
+                    acc_count = 0;
+                    for (int b = 1; b < num_bins; ++b)
+                    {
+                        acc.growBox(bin_box[b - 1]);
+                        acc_count += bin_count[b - 1];
+                        if (acc_count == 0 || acc_count == count) continue;
+                        float cost = acc_count * HalfArea(acc) + right_cost[b];
+                        if (cost < best_cost)
+                        {
+                            best_cost = cost;
+                            best_axis = axis;
+                            best_bin  = b;
+                        }
+                    }
+                }
+            }
+
+            int mid;
+            if (best_axis >= 0)
+            {
+                float scale = num_bins / (center_box.max[best_axis] - center_box.min[best_axis]);
+                float cmin  = center_box.min[best_axis];
+                auto it = std::partition(refs.begin() + task.start, refs.begin() + task.end, [&](const Reference& r) {
+                    return std::min(int((r.center[best_axis] - cmin) * scale), num_bins - 1) < best_bin;
+                });
+                mid     = it - refs.begin();
+            }
+            else
+            {
+                // All centers are equal or the tree is too deep -> object median
+                int axis = center_box.maxDimension();
+                mid      = (task.start + task.end) / 2;
+                std::nth_element(refs.begin() + task.start, refs.begin() + mid, refs.begin() + task.end,
+                                 [axis](const Reference& a, const Reference& b) { return a.center[axis] < b.center[axis]; });
+            }
+            split[t] = mid;
+        }
+
+        // Create the child nodes and the tasks of the next level
+        next_tasks.clear();
+        for (int t = 0; t < (int)tasks.size(); ++t)
+        {
+            auto task  = tasks[t];
+            auto& node = nodes[task.node];
+            if (split[t] < 0)
+            {
+                node._inner = 0;
+                node._left  = task.start;
+                node._right = task.end;
+            }
+            else
+            {
+                int l       = nodes.size();
+                node._inner = 1;
+                node._left  = l;
+                node._right = l + 1;
+                next_tasks.push_back({l, task.start, split[t], task.depth + 1});
+                next_tasks.push_back({l + 1, split[t], task.end, task.depth + 1});
+                nodes.resize(nodes.size() + 2);
+            }
+        }
+        std::swap(tasks, next_tasks);
+    }
+
+    // Reorder the triangles to leaf order
+    std::vector<std::pair<Triangle, int>> sorted(n);
+#pragma omp parallel for num_threads(threads)
+    for (int i = 0; i < n; ++i)
+    {
+        sorted[i] = triangles[refs[i].id];
+    }
+    triangles.swap(sorted);
+
+    collapse();
+}
+
 
 }  // namespace AccelerationStructure
 }  // namespace Saiga
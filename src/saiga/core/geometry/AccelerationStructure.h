@@ -8,6 +8,7 @@
 
 #include "saiga/config.h"
 #include "saiga/core/math/math.h"
+#include "saiga/core/util/DataStructures/ArrayView.h"
 
 #include "aabb.h"
 #include "intersection.h"
@@ -51,6 +52,7 @@ class SAIGA_CORE_API BruteForce : public Base
 };
 
 
+// Binary node created by the BVH builders.
 struct BVHNode
 {
     AABB box;
@@ -63,6 +65,23 @@ struct BVHNode
     uint32_t _right;
 };
 
+// 4-wide node used for the traversal. The binary tree is collapsed after construction so that every node has up to
+// four children. The boxes of the children are stored in SoA layout and are tested against a ray with one SSE
+// instruction per axis and operation.
+struct alignas(64) QBVHNode
+{
+    float bmin[3][4];
+    float bmax[3][4];
+
+    // Inner child: index of the child node
+    // Leaf child: index of the first triangle
+    int32_t child[4];
+
+    // Number of triangles of a leaf child.
+    // 0 for inner children and -1 for empty slots.
+    int32_t count[4];
+};
+
 class SAIGA_CORE_API BVH : public Base
 {
    public:
@@ -78,6 +97,9 @@ class SAIGA_CORE_API BVH : public Base
         int axis;
     };
 
+    // Number of rays which are traversed together by the packet traversal.
+    static constexpr int packetSize = 8;
+
     BVH() {}
     BVH(const std::vector<Triangle>& triangles);
     virtual ~BVH() {}
@@ -89,17 +111,33 @@ class SAIGA_CORE_API BVH : public Base
     virtual std::vector<RayTriangleIntersection> getAll(const Ray& ray) const override;
     virtual std::pair<float, int> ClosestPoint(const vec3& p) const;
 
+    // Closest intersection of many rays. result[i] is the intersection of rays[i].
+    // Consecutive rays are grouped into packets of 'packetSize' rays which traverse the tree together. The box tests
+    // of a packet are done with SIMD over the rays, the triangle tests per ray. For coherent rays, for example
+    // neighboring pixels of a camera image, the speed is about the same as calling getClosest(ray) for each ray.
+    // The packets are distributed to 'threads' OpenMP threads.
+    void getClosest(ArrayView<const Ray> rays, ArrayView<RayTriangleIntersection> result, int threads = 1) const;
+
+    int NumNodes() const { return qnodes.size(); }
+
    protected:
     std::vector<std::pair<Triangle, int>> triangles;
+
+    // The binary tree created by construct(). Cleared by collapse().
     std::vector<BVHNode> nodes;
 
+    // The 4-wide tree used for traversal. The root is qnodes[0].
+    std::vector<QBVHNode> qnodes;
+
     AABB computeBox(int start, int end) const;
     void sortByAxis(int start, int end, int axis);
 
-    // Recursive traversal
-    void getClosest(int node, const Ray& ray, RayTriangleIntersection& result) const;
-    void getAll(int node, const Ray& ray, std::vector<RayTriangleIntersection>& result) const;
-    void ClosestPoint(int node, const vec3& p, std::pair<float, int>& result) const;
+    // Converts the binary tree in 'nodes' to the 4-wide tree in 'qnodes'.
+    // Must be called at the end of construct().
+    void collapse();
+    int collapse(int node);
+
+    void getClosestPacket(const Ray* rays, RayTriangleIntersection* result, int n) const;
 };
 
 class SAIGA_CORE_API ObjectMedianBVH : public BVH
@@ -119,5 +157,32 @@ class SAIGA_CORE_API ObjectMedianBVH : public BVH
     int construct(int start, int end);
 };
 
+/**
+ * BVH built with the surface area heuristic (SAH).
+ *
+ * The triangle centers of a node are binned into a fixed number of bins along each axis and the node is split at
+ * the bin border with the lowest SAH cost. The tree is built breadth first. All nodes of one level are split in
+ * parallel by 'threads' OpenMP threads.
+ *
+ * Compared to the ObjectMedianBVH the construction is faster (no sorting) and the tree is better adapted to meshes
+ * with non-uniform triangle sizes.
+ */
+class SAIGA_CORE_API SAHBVH : public BVH
+{
+   public:
+    SAHBVH() {}
+    SAHBVH(const std::vector<Triangle>& triangles, int leafTriangles = 4, int threads = 1)
+        : BVH(triangles), leafTriangles(leafTriangles), threads(threads)
+    {
+        construct();
+    }
+    virtual ~SAHBVH() {}
+
+   protected:
+    int leafTriangles;
+    int threads;
+    void construct() override;
+};
+
 }  // namespace AccelerationStructure
 }  // namespace Saiga
@@ -8,6 +8,9 @@
 
 #include "saiga/config.h"
 #include "saiga/core/math/math.h"
+#include "saiga/core/util/DataStructures/ArrayView.h"
+#include "saiga/core/util/Thread/omp.h"
+#include "saiga/core/util/assert.h"
 
 #include <algorithm>
 #include <iostream>
@@ -17,267 +20,350 @@ namespace Saiga
 {
 // D : Dimension. for example D=3 for 3 dimensional points
 // point_t : should be a vector type. for example vec2 or vec3
+//
+// The tree is an implicit, complete binary tree stored in an array. The children of node i are 2i+1 and 2i+2, so
+// only the split plane of each inner node is stored. All leaves are on the same level and contain between
+// leaf_size/2 and leaf_size points. The points are stored in leaf order in one packed array.
+//
+// The tree is built level by level. The nodes of one level are split in parallel with std::nth_element at the
+// median of the axis with the largest extent.
+//
+// The batched queries are distributed to 'threads' OpenMP threads and write to caller-provided output buffers.
+// All query functions are const and can be called concurrently.
 template <int D, typename point_t>
 class SAIGA_TEMPLATE KDTree
 {
    public:
     // create an empty tree
     KDTree() {}
-    KDTree(const std::vector<point_t>& points);
+    KDTree(ArrayView<const point_t> points, int leaf_size = 8, int threads = 1);
+    KDTree(const std::vector<point_t>& points, int leaf_size = 8, int threads = 1)
+        : KDTree(ArrayView<const point_t>(points.data(), points.size()), leaf_size, threads)
+    {
+    }
+
+    int size() const { return points.size(); }
 
     // returns the nearest point in this tree to the searchpoint
-    int NearestNeighborSearch(const point_t& searchPoint);
+    // -1 if the tree is empty
+    int NearestNeighborSearch(const point_t& searchPoint) const;
 
     // returns the k nearest points in this tree to the searchpoint
-    std::vector<int> KNearestNeighborSearch(const point_t& searchPoint, int k);
+    // The result is sorted by distance and has min(k, size()) elements.
+    std::vector<int> KNearestNeighborSearch(const point_t& searchPoint, int k) const;
 
+    // All points with a distance smaller than radius sorted by index.
+    std::vector<int> RadiusSearch(const point_t& searchPoint, float radius) const;
 
-    std::vector<int> RadiusSearch(const point_t& searchPoint, float radius);
+    // ============== Batched queries ==============
 
+    // The k nearest neighbors of each query point sorted by distance.
+    // indices[i * k + j] is the j-th neighbor of query i. The optional squared_distances has the same layout.
+    // If the tree has less than k points the remaining entries are -1 (and infinity).
+    void KNearestNeighborSearch(ArrayView<const point_t> queries, int k, int* indices,
+                                float* squared_distances = nullptr, int threads = 1) const;
 
+    // The neighbors of query i are indices[offsets[i]] ... indices[offsets[i+1]-1] sorted by index.
+    void RadiusSearch(ArrayView<const point_t> queries, float radius, std::vector<int>& offsets,
+                      std::vector<int>& indices, int threads = 1) const;
 
-   private:
-    typedef int index_t;
-    typedef unsigned int axis_t;
-    typedef std::vector<std::pair<float, index_t>> queue_t;
+    // Writes the k nearest neighbors into 'indices' (and 'squared_distances' if not null).
+    // Returns the number of found neighbors.
+    int KNearestNeighborSearch(const point_t& searchPoint, int k, int* indices, float* squared_distances) const;
+
+    // Appends the indices of all points with a distance smaller than radius to 'result' (unsorted).
+    void RadiusSearch(const point_t& searchPoint, float radius, std::vector<int>& result) const;
 
-    struct kd_node_t
+   private:
+    struct Node
     {
-        point_t p;
-        int initial_index;
-        index_t left = -1, right = -1;
+        float split;
+        int axis;
     };
 
-    std::vector<kd_node_t> nodes;
-    index_t rootNode = -1;
-
-    index_t sortByAxis(index_t startIndex, index_t endIndex, axis_t axis);
-    index_t make_tree(index_t startIndex, index_t endIndex, axis_t currentAxis);
+    // The inner nodes of the implicit tree
+    std::vector<Node> nodes;
+    int levels = 0;
 
-    // rekursive helper functions for nearest neighbour lookup
-    void NearestNeighborSearch(index_t currentNode, const point_t& searchPoint, axis_t currentAxis, index_t& bestNode,
-                               float& bestDist);
+    // points[i] is the point with original index indices[i]. Sorted by leaf.
+    std::vector<point_t> points;
+    std::vector<int> indices;
 
-    void KNearestNeighborSearch(index_t currentNode, const point_t& searchPoint, int k, axis_t currentAxis,
-                                queue_t& queue);
+    int NumLeaves() const { return 1 << levels; }
 
-    void RadiusSearch(index_t currentNode, const point_t& searchPoint, float r, axis_t currentAxis,
-                      std::vector<int>& result);
+    // The point range [begin, end) of leaf l
+    int LeafBegin(int l) const { return (int64_t(l) * size()) >> levels; }
 
-    float addToQueue(queue_t& queue, index_t currentNode, float distance);
-    float distance(point_t a, point_t b);
-    void printPoints(index_t startIndex, index_t endIndex);
-};
+    template <typename LeafFunction>
+    void Traverse(const point_t& searchPoint, float& maxDist, LeafFunction leaf_function) const;
 
-template <int D, typename point_t>
-KDTree<D, point_t>::KDTree(const std::vector<point_t>& points)
-{
-    nodes.resize(points.size());
-    for (int i = 0; i < points.size(); ++i)
+    float distance(const point_t& a, const point_t& b) const
     {
-        nodes[i].p             = points[i];
-        nodes[i].initial_index = i;
+        // use the squared distance so we don't have to calculate the sqrt
+        point_t tmp = a - b;
+        return dot(tmp, tmp);
     }
-    rootNode = make_tree(0, nodes.size(), 0);
-}
-
-template <int D, typename point_t>
-typename KDTree<D, point_t>::index_t KDTree<D, point_t>::sortByAxis(index_t startIndex, index_t endIndex, axis_t axis)
-{
-    auto cmp = [axis](const kd_node_t& a, const kd_node_t& b) -> bool { return a.p[axis] < b.p[axis]; };
-    std::sort(nodes.begin() + startIndex, nodes.begin() + endIndex, cmp);
-    // return the median point
-    return (startIndex + endIndex) / 2;
-}
+};
 
 template <int D, typename point_t>
-typename KDTree<D, point_t>::index_t KDTree<D, point_t>::make_tree(index_t startIndex, index_t endIndex,
-                                                                   axis_t currentAxis)
+KDTree<D, point_t>::KDTree(ArrayView<const point_t> input, int leaf_size, int threads)
 {
-    if (startIndex == endIndex) return -1;
-    if (startIndex + 1 == endIndex) return startIndex;
+    SAIGA_ASSERT(leaf_size >= 1);
+    int n = input.size();
 
-    index_t median = sortByAxis(startIndex, endIndex, currentAxis);
-    currentAxis    = (currentAxis + 1) % D;
+    struct Entry
+    {
+        point_t p;
+        int index;
+    };
+    std::vector<Entry> entries(n);
+    for (int i = 0; i < n; ++i)
+    {
+        entries[i] = {input[i], i};
+    }
 
+    levels = 0;
+    while (levels < 30 && ((int64_t(n) + (int64_t(1) << levels) - 1) >> levels) > leaf_size)
+    {
+        levels++;
+    }
+    nodes.resize(NumLeaves() - 1);
 
-    nodes[median].left  = make_tree(startIndex, median, currentAxis);
-    nodes[median].right = make_tree(median + 1, endIndex, currentAxis);
+    for (int level = 0; level < levels; ++level)
+    {
+        int first = (1 << level) - 1;
+        int count = 1 << level;
 
-    return median;
-}
+#pragma omp parallel for num_threads(threads) schedule(dynamic, 1)
+        for (int i = 0; i < count; ++i)
+        {
+            // The range of node i on this level and the start of its right child
+            int begin = (int64_t(i) * n) >> level;
+            int end   = (int64_t(i + 1) * n) >> level;
+            int mid   = (int64_t(2 * i + 1) * n) >> (level + 1);
+
+            point_t bmin = entries[begin].p;
+            point_t bmax = entries[begin].p;
+            for (int j = begin + 1; j < end; ++j)
+            {
+                for (int d = 0; d < D; ++d)
+                {
+                    bmin[d] = std::min(bmin[d], entries[j].p[d]);
+                    bmax[d] = std::max(bmax[d], entries[j].p[d]);
+                }
+            }
+            int axis = 0;
+            for (int d = 1; d < D; ++d)
+            {
+                if (bmax[d] - bmin[d] > bmax[axis] - bmin[axis]) axis = d;
+            }
+
+            std::nth_element(entries.begin() + begin, entries.begin() + mid, entries.begin() + end,
+                             [axis](const Entry& a, const Entry& b) { return a.p[axis] < b.p[axis]; });
+
+            nodes[first + i] = {float(entries[mid].p[axis]), axis};
+        }
+    }
 
-template <int D, typename point_t>
-int KDTree<D, point_t>::NearestNeighborSearch(const point_t& searchPoint)
-{
-    KDTree::index_t bestNode;
-    float bestDist = std::numeric_limits<float>::infinity();
-    NearestNeighborSearch(rootNode, searchPoint, 0, bestNode, bestDist);
-    return nodes[bestNode].initial_index;
+    points.resize(n);
+    indices.resize(n);
+    for (int i = 0; i < n; ++i)
+    {
+        points[i]  = entries[i].p;
+        indices[i] = entries[i].index;
+    }
 }
 
-
 template <int D, typename point_t>
-void KDTree<D, point_t>::NearestNeighborSearch(index_t currentNode, const point_t& searchPoint, axis_t currentAxis,
-                                               index_t& bestNode, float& bestDist)
+template <typename LeafFunction>
+void KDTree<D, point_t>::Traverse(const point_t& searchPoint, float& maxDist, LeafFunction leaf_function) const
 {
-    if (currentNode == -1) return;
+    if (points.empty()) return;
 
-    // calculate distance to current point and update the current best
-    float d = distance(nodes[currentNode].p, searchPoint);
-    if (d < bestDist)
+    // Subtrees which have not been visited yet and the squared distance to their split plane.
+    // There is at most one entry per level.
+    struct StackEntry
     {
-        bestDist = d;
-        bestNode = currentNode;
-    }
-
-    // exact match (can't get any better)
-    if (d == 0) return;
+        int node;
+        float dist;
+    };
+    StackEntry stack[32];
+    int stack_size = 0;
 
-    // the (signed) distance of the searchpoint to the current split axis
-    float dAxis = nodes[currentNode].p[currentAxis] - searchPoint[currentAxis];
-    // the actual distance to the point is squared so we also need to square the distance to the axis
-    float dAxisSquared = dAxis * dAxis;
+    int num_inner = nodes.size();
 
-    currentAxis = (currentAxis + 1) % D;
+    stack[stack_size++] = {0, 0};
 
-    // first traverse the subtree in which the point lays
-    NearestNeighborSearch(dAxis > 0 ? nodes[currentNode].left : nodes[currentNode].right, searchPoint, currentAxis,
-                          bestNode, bestDist);
+    while (stack_size > 0)
+    {
+        auto [node, dist] = stack[--stack_size];
+        if (dist >= maxDist) continue;
 
-    // when the distance to the axis is greater than the current distance
-    // we don't need to traverse the other sub tree
-    if (dAxisSquared >= bestDist) return;
+        // Descend to the leaf which contains the search point
+        while (node < num_inner)
+        {
+            auto& n     = nodes[node];
+            float dAxis = searchPoint[n.axis] - n.split;
+            int near    = 2 * node + (dAxis < 0 ? 1 : 2);
+            int far     = 2 * node + (dAxis < 0 ? 2 : 1);
+
+            // the actual distance to the point is squared so we also need to square the distance to the axis
+            float dAxisSquared = dAxis * dAxis;
+            if (dAxisSquared < maxDist) stack[stack_size++] = {far, dAxisSquared};
+            node = near;
+        }
 
-    // there may be a better point in this subtree
-    NearestNeighborSearch(dAxis > 0 ? nodes[currentNode].right : nodes[currentNode].left, searchPoint, currentAxis,
-                          bestNode, bestDist);
+        int leaf = node - num_inner;
+        leaf_function(LeafBegin(leaf), LeafBegin(leaf + 1));
+    }
 }
 
+template <int D, typename point_t>
+int KDTree<D, point_t>::NearestNeighborSearch(const point_t& searchPoint) const
+{
+    int result = -1;
+    KNearestNeighborSearch(searchPoint, 1, &result, nullptr);
+    return result;
+}
 
 template <int D, typename point_t>
-std::vector<int> KDTree<D, point_t>::KNearestNeighborSearch(const point_t& searchPoint, int k)
+int KDTree<D, point_t>::KNearestNeighborSearch(const point_t& searchPoint, int k, int* result,
+                                               float* squared_distances) const
 {
-    queue_t queue(k);
-    for (auto& p : queue)
+    SAIGA_ASSERT(k >= 1);
+
+    // The k best points sorted by distance
+    std::pair<float, int> stack_queue[16];
+    std::vector<std::pair<float, int>> heap_queue;
+    std::pair<float, int>* queue = stack_queue;
+    if (k > 16)
     {
-        p.second = -1;
-        p.first  = 1e10;
+        heap_queue.resize(k);
+        queue = heap_queue.data();
     }
-    KNearestNeighborSearch(rootNode, searchPoint, k, 0, queue);
+    int found = 0;
+
+    float maxDist = std::numeric_limits<float>::infinity();
+    Traverse(searchPoint, maxDist, [&](int begin, int end) {
+        for (int j = begin; j < end; ++j)
+        {
+            float d = distance(points[j], searchPoint);
+            if (d >= maxDist) continue;
+
+            // insertion into the sorted queue
+            int i = std::min(found, k - 1);
+            for (; i > 0 && queue[i - 1].first > d; --i)
+            {
+                queue[i] = queue[i - 1];
+            }
+            queue[i] = {d, j};
+            found    = std::min(found + 1, k);
+            if (found == k) maxDist = queue[k - 1].first;
+        }
+    });
 
-    std::vector<int> points;
-    for (auto& p : queue)
+    for (int i = 0; i < k; ++i)
     {
-        if (p.second != -1)
+        result[i] = i < found ? indices[queue[i].second] : -1;
+        if (squared_distances)
         {
-            points.push_back(nodes[p.second].initial_index);
+            squared_distances[i] = i < found ? queue[i].first : std::numeric_limits<float>::infinity();
         }
     }
-    return points;
+    return found;
 }
 
-
 template <int D, typename point_t>
-void KDTree<D, point_t>::KNearestNeighborSearch(index_t currentNode, const point_t& searchPoint, int k,
-                                                axis_t currentAxis, queue_t& queue)
+std::vector<int> KDTree<D, point_t>::KNearestNeighborSearch(const point_t& searchPoint, int k) const
 {
-    if (currentNode == -1) return;
-
-    // calculate distance to current point and update the current best
-    float d     = distance(nodes[currentNode].p, searchPoint);
-    float lastD = addToQueue(queue, currentNode, d);
-
-
-    // the (signed) distance of the searchpoint to the current split axis
-    float dAxis = nodes[currentNode].p[currentAxis] - searchPoint[currentAxis];
-    // the actual distance to the point is squared so we also need to square the distance to the axis
-    float dAxisSquared = dAxis * dAxis;
-
-    currentAxis = (currentAxis + 1) % D;
-
-    // first traverse the subtree in which the point lays
-    KNearestNeighborSearch(dAxis > 0 ? nodes[currentNode].left : nodes[currentNode].right, searchPoint, k, currentAxis,
-                           queue);
-
-    // when the distance to the axis is greater than the current distance
-    // we don't need to traverse the other sub tree
-    if (dAxisSquared >= lastD) return;
-
-    // there may be a better point in this subtree
-    KNearestNeighborSearch(dAxis > 0 ? nodes[currentNode].right : nodes[currentNode].left, searchPoint, k, currentAxis,
-                           queue);
-
-    //    nearestNeighbour(dAxis > 0 ? nodes[currentNode].right : nodes[currentNode].left, searchPoint, currentAxis
-    //    ,bestNode,  bestDist);
+    std::vector<int> result(k);
+    int found = KNearestNeighborSearch(searchPoint, k, result.data(), nullptr);
+    result.resize(found);
+    return result;
 }
 
 template <int D, typename point_t>
-float KDTree<D, point_t>::addToQueue(queue_t& queue, index_t currentNode, float distance)
+void KDTree<D, point_t>::RadiusSearch(const point_t& searchPoint, float r, std::vector<int>& result) const
 {
-    float lastD = queue[queue.size() - 1].first;
-    if (distance >= lastD) return lastD;
-
-    queue[queue.size() - 1].first  = distance;
-    queue[queue.size() - 1].second = currentNode;
-
-    std::sort(queue.begin(), queue.end());
-
-
-    return queue[queue.size() - 1].first;
+    float r2 = r * r;
+    Traverse(searchPoint, r2, [&](int begin, int end) {
+        for (int j = begin; j < end; ++j)
+        {
+            if (distance(points[j], searchPoint) < r2) result.push_back(indices[j]);
+        }
+    });
 }
 
-
 template <int D, typename point_t>
-void KDTree<D, point_t>::RadiusSearch(index_t currentNode, const point_t& searchPoint, float r, axis_t currentAxis,
-                                      std::vector<int>& result)
+std::vector<int> KDTree<D, point_t>::RadiusSearch(const point_t& searchPoint, float r) const
 {
-    if (currentNode == -1) return;
+    std::vector<int> result;
+    RadiusSearch(searchPoint, r, result);
+    std::sort(result.begin(), result.end());
+    return result;
+}
 
-    // calculate distance to current point and update the current best
-    float d = distance(nodes[currentNode].p, searchPoint);
-    if (d < r)
+template <int D, typename point_t>
+void KDTree<D, point_t>::KNearestNeighborSearch(ArrayView<const point_t> queries, int k, int* result,
+                                                float* squared_distances, int threads) const
+{
+    int n = queries.size();
+#pragma omp parallel for num_threads(threads) schedule(dynamic, 64)
+    for (int i = 0; i < n; ++i)
     {
-        result.push_back(nodes[currentNode].initial_index);
+        KNearestNeighborSearch(queries[i], k, result + int64_t(i) * k,
+                               squared_distances ? squared_distances + int64_t(i) * k : nullptr);
     }
-
-
-    // the (signed) distance of the searchpoint to the current split axis
-    float dAxis = nodes[currentNode].p[currentAxis] - searchPoint[currentAxis];
-    // the actual distance to the point is squared so we also need to square the distance to the axis
-    float dAxisSquared = dAxis * dAxis;
-
-    currentAxis = (currentAxis + 1) % D;
-
-    // first traverse the subtree in which the point lies
-    RadiusSearch(dAxis > 0 ? nodes[currentNode].left : nodes[currentNode].right, searchPoint, r, currentAxis, result);
-
-    // when the distance to the axis is greater than the current distance
-    // we don't need to traverse the other sub tree
-    if (dAxisSquared >= r) return;
-
-    // there may be a better point in this subtree
-    RadiusSearch(dAxis > 0 ? nodes[currentNode].right : nodes[currentNode].left, searchPoint, r, currentAxis, result);
 }
 
-
 template <int D, typename point_t>
-std::vector<int> KDTree<D, point_t>::RadiusSearch(const point_t& searchPoint, float r)
+void KDTree<D, point_t>::RadiusSearch(ArrayView<const point_t> queries, float radius, std::vector<int>& offsets,
+                                      std::vector<int>& result, int threads) const
 {
-    std::vector<int> points;
-    RadiusSearch(rootNode, searchPoint, r * r, 0, points);
-    std::sort(points.begin(), points.end());
-    return points;
-}
+    int n = queries.size();
+    offsets.resize(n + 1);
+    offsets[0] = 0;
 
+    // Each thread processes a contiguous block of queries into a local buffer.
+    // The buffers are then copied to the output in query order.
+    std::vector<std::vector<int>> local(threads);
+    std::vector<int> local_offset(threads + 1, 0);
 
+#pragma omp parallel num_threads(threads)
+    {
+        int tid          = OMP::getThreadNum();
+        int num_threads  = OMP::getNumThreads();
+        int64_t q_begin  = int64_t(tid) * n / num_threads;
+        int64_t q_end    = int64_t(tid + 1) * n / num_threads;
+        auto& local_list = local[tid];
+        local_list.clear();
+
+        for (int64_t i = q_begin; i < q_end; ++i)
+        {
+            int start = local_list.size();
+            RadiusSearch(queries[i], radius, local_list);
+            std::sort(local_list.begin() + start, local_list.end());
+            // store the local end. made global after the prefix sum
+            offsets[i + 1] = local_list.size();
+        }
+        local_offset[tid + 1] = local_list.size();
 
-template <int D, typename point_t>
-float KDTree<D, point_t>::distance(point_t a, point_t b)
-{
-    // use the squared distance so we don't have to calculate the sqrt
-    point_t tmp = a - b;
-    return dot(tmp, tmp);
+#pragma omp barrier
+#pragma omp single
+        {
+            for (int t = 0; t < num_threads; ++t)
+            {
+                local_offset[t + 1] += local_offset[t];
+            }
+            result.resize(local_offset[num_threads]);
+        }
+
+        for (int64_t i = q_begin; i < q_end; ++i)
+        {
+            offsets[i + 1] += local_offset[tid];
+        }
+        std::copy(local_list.begin(), local_list.end(), result.begin() + local_offset[tid]);
+    }
 }
 
 }  // namespace Saiga
@@ -7,16 +7,445 @@
 #include "imageTransformations.h"
 
 #include "saiga/colorize.h"
+#include "saiga/core/util/CpuFeatures.h"
 #include "saiga/core/util/color.h"
 
 #include "internal/noGraphicsAPI.h"
 
 #include "templatedImage.h"
 
+#include <atomic>
+
+#if defined(SAIGA_HAS_TARGET_ATTRIBUTE) || defined(__AVX2__)
+#    include <immintrin.h>
+#    define SAIGA_IMAGE_AVX2
+#endif
+
 namespace Saiga
 {
 namespace ImageTransformation
 {
+namespace
+{
+// const vec3 rgbToGray(0.2126f, 0.7152f, 0.0722f);
+const vec3 rgbToGray(0.299f, 0.587f, 0.114f);  // opencv values
+
+// ======================== Scalar row kernels ========================
+
+inline float NormalizeDepth(float d, float min_d, float max_d)
+{
+    d = (d - min_d) / (max_d - min_d);
+    // Same comparisons as _mm256_max_ps and _mm256_min_ps, which map nan to 0.
+    d = d > 0 ? d : 0;
+    return d < 1 ? d : 1;
+}
+
+template <typename T>
+void DepthToRGBAScalar(const T* src, ucvec4* dst, int n, float min_d, float max_d)
+{
+    for (int j = 0; j < n; ++j)
+    {
+        unsigned char c = NormalizeDepth(src[j], min_d, max_d) * 255;
+        dst[j]          = ucvec4(c, c, c, 255);
+    }
+}
+
+void RGBAToGray8Scalar(const ucvec4* src, unsigned char* dst, int n)
+{
+    for (int j = 0; j < n; ++j)
+    {
+        vec3 vf(src[j][0], src[j][1], src[j][2]);
+        dst[j] = dot(rgbToGray, vf);
+    }
+}
+
+void RGBAToGrayFScalar(const ucvec4* src, float* dst, int n, float scale)
+{
+    for (int j = 0; j < n; ++j)
+    {
+        vec3 vf(src[j][0], src[j][1], src[j][2]);
+        dst[j] = dot(rgbToGray, vf) * scale;
+    }
+}
+
+void Gray8ToRGBAScalar(const unsigned char* src, ucvec4* dst, int n, unsigned char alpha)
+{
+    for (int j = 0; j < n; ++j)
+    {
+        dst[j] = ucvec4(src[j], src[j], src[j], alpha);
+    }
+}
+
+// 'src0' and 'src1' are the two source rows of the output row 'dst'.
+void ScaleDown2Scalar(const ucvec4* src0, const ucvec4* src1, ucvec4* dst, int n)
+{
+    for (int j = 0; j < n; ++j)
+    {
+        ivec4 sum = src0[2 * j].cast<int>() + src1[2 * j].cast<int>() + src0[2 * j + 1].cast<int>() +
+                    src1[2 * j + 1].cast<int>();
+        sum /= 4;
+        dst[j] = sum.cast<unsigned char>();
+    }
+}
+
+void AbsolutePixelErrorRGBScalar(const ucvec3* src1, const ucvec3* src2, unsigned char* dst, int n)
+{
+    for (int j = 0; j < n; ++j)
+    {
+        dst[j] = (src1[j].cast<int>() - src2[j].cast<int>()).array().abs().maxCoeff();
+    }
+}
+
+void AbsolutePixelErrorScalar(const unsigned char* src1, const unsigned char* src2, unsigned char* dst, int n)
+{
+    for (int j = 0; j < n; ++j)
+    {
+        dst[j] = std::abs(int(src1[j]) - int(src2[j]));
+    }
+}
+
+// Sum of the absolute differences of n bytes. Used for all channel counts.
+long L1DifferenceScalar(const unsigned char* src1, const unsigned char* src2, int n)
+{
+    long result = 0;
+    for (int j = 0; j < n; ++j)
+    {
+        result += std::abs(int(src1[j]) - int(src2[j]));
+    }
+    return result;
+}
+
+// ======================== AVX2 row kernels ========================
+// The kernels process the largest multiple of the vector width and call the scalar kernel on the rest.
+
+#if defined(SAIGA_IMAGE_AVX2)
+
+// Maps 8 depth values to 8 gray rgba pixels.
+SAIGA_TARGET_AVX2 inline __m256i DepthToRGBA8(__m256 d, __m256 min_d, __m256 range)
+{
+    d           = _mm256_div_ps(_mm256_sub_ps(d, min_d), range);
+    d           = _mm256_min_ps(_mm256_max_ps(d, _mm256_setzero_ps()), _mm256_set1_ps(1));
+    __m256i c   = _mm256_cvttps_epi32(_mm256_mul_ps(d, _mm256_set1_ps(255)));
+    __m256i rgb = _mm256_mullo_epi32(c, _mm256_set1_epi32(0x010101));
+    return _mm256_or_si256(rgb, _mm256_set1_epi32(int(0xFF000000)));
+}
+
+SAIGA_TARGET_AVX2 void DepthToRGBAAVX2(const float* src, ucvec4* dst, int n, float min_d, float max_d)
+{
+    __m256 vmin   = _mm256_set1_ps(min_d);
+    __m256 vrange = _mm256_set1_ps(max_d - min_d);
+    int j         = 0;
+    for (; j + 8 <= n; j += 8)
+    {
+        __m256 d = _mm256_loadu_ps(src + j);
+        _mm256_storeu_si256((__m256i*)(dst + j), DepthToRGBA8(d, vmin, vrange));
+    }
+    DepthToRGBAScalar(src + j, dst + j, n - j, min_d, max_d);
+}
+
+SAIGA_TARGET_AVX2 void DepthToRGBAAVX2(const uint16_t* src, ucvec4* dst, int n, float min_d, float max_d)
+{
+    __m256 vmin   = _mm256_set1_ps(min_d);
+    __m256 vrange = _mm256_set1_ps(max_d - min_d);
+    int j         = 0;
+    for (; j + 8 <= n; j += 8)
+    {
+        __m256i d16 = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(src + j)));
+        _mm256_storeu_si256((__m256i*)(dst + j), DepthToRGBA8(_mm256_cvtepi32_ps(d16), vmin, vrange));
+    }
+    DepthToRGBAScalar(src + j, dst + j, n - j, min_d, max_d);
+}
+
+// Gray value of 8 rgba pixels.
+SAIGA_TARGET_AVX2 inline __m256 Gray8Pixels(const ucvec4* src)
+{
+    __m256i p    = _mm256_loadu_si256((const __m256i*)src);
+    __m256i mask = _mm256_set1_epi32(0xFF);
+    __m256 r     = _mm256_cvtepi32_ps(_mm256_and_si256(p, mask));
+    __m256 g     = _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(p, 8), mask));
+    __m256 b     = _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(p, 16), mask));
+
+    // Same order as dot() in the scalar kernel
+    __m256 gray = _mm256_add_ps(_mm256_mul_ps(r, _mm256_set1_ps(rgbToGray(0))),
+                                _mm256_mul_ps(g, _mm256_set1_ps(rgbToGray(1))));
+    return _mm256_add_ps(gray, _mm256_mul_ps(b, _mm256_set1_ps(rgbToGray(2))));
+}
+
+SAIGA_TARGET_AVX2 void RGBAToGray8AVX2(const ucvec4* src, unsigned char* dst, int n)
+{
+    int j = 0;
+    for (; j + 16 <= n; j += 16)
+    {
+        __m256i g0 = _mm256_cvttps_epi32(Gray8Pixels(src + j));
+        __m256i g1 = _mm256_cvttps_epi32(Gray8Pixels(src + j + 8));
+
+        // The packs work on 128-bit lanes: [g0_0123 g1_0123 | g0_4567 g1_4567] -> [g0 | g1]
+        __m256i g16 = _mm256_permute4x64_epi64(_mm256_packus_epi32(g0, g1), 0xD8);
+        __m128i g8  = _mm_packus_epi16(_mm256_castsi256_si128(g16), _mm256_extracti128_si256(g16, 1));
+        _mm_storeu_si128((__m128i*)(dst + j), g8);
+    }
+    RGBAToGray8Scalar(src + j, dst + j, n - j);
+}
+
+SAIGA_TARGET_AVX2 void RGBAToGrayFAVX2(const ucvec4* src, float* dst, int n, float scale)
+{
+    __m256 vscale = _mm256_set1_ps(scale);
+    int j         = 0;
+    for (; j + 8 <= n; j += 8)
+    {
+        _mm256_storeu_ps(dst + j, _mm256_mul_ps(Gray8Pixels(src + j), vscale));
+    }
+    RGBAToGrayFScalar(src + j, dst + j, n - j, scale);
+}
+
+SAIGA_TARGET_AVX2 void Gray8ToRGBAAVX2(const unsigned char* src, ucvec4* dst, int n, unsigned char alpha)
+{
+    __m256i va = _mm256_set1_epi8(alpha);
+    int j      = 0;
+    for (; j + 32 <= n; j += 32)
+    {
+        __m256i g = _mm256_loadu_si256((const __m256i*)(src + j));
+        // Per 128-bit lane: gg = [g0 g0 g1 g1 ...], ga = [g0 a g1 a ...] -> [g0 g0 g0 a g1 g1 g1 a ...]
+        __m256i gg_lo = _mm256_unpacklo_epi8(g, g);
+        __m256i gg_hi = _mm256_unpackhi_epi8(g, g);
+        __m256i ga_lo = _mm256_unpacklo_epi8(g, va);
+        __m256i ga_hi = _mm256_unpackhi_epi8(g, va);
+
+        // Pixels [0..3 | 16..19], [4..7 | 20..23], [8..11 | 24..27], [12..15 | 28..31]
+        __m256i p0 = _mm256_unpacklo_epi16(gg_lo, ga_lo);
+        __m256i p1 = _mm256_unpackhi_epi16(gg_lo, ga_lo);
+        __m256i p2 = _mm256_unpacklo_epi16(gg_hi, ga_hi);
+        __m256i p3 = _mm256_unpackhi_epi16(gg_hi, ga_hi);
+
+        __m256i* out = (__m256i*)(dst + j);
+        _mm256_storeu_si256(out + 0, _mm256_permute2x128_si256(p0, p1, 0x20));
+        _mm256_storeu_si256(out + 1, _mm256_permute2x128_si256(p2, p3, 0x20));
+        _mm256_storeu_si256(out + 2, _mm256_permute2x128_si256(p0, p1, 0x31));
+        _mm256_storeu_si256(out + 3, _mm256_permute2x128_si256(p2, p3, 0x31));
+    }
+    Gray8ToRGBAScalar(src + j, dst + j, n - j, alpha);
+}
+
+SAIGA_TARGET_AVX2 void ScaleDown2AVX2(const ucvec4* src0, const ucvec4* src1, ucvec4* dst, int n)
+{
+    __m256i zero = _mm256_setzero_si256();
+    int j        = 0;
+    for (; j + 4 <= n; j += 4)
+    {
+        __m256i r0 = _mm256_loadu_si256((const __m256i*)(src0 + 2 * j));
+        __m256i r1 = _mm256_loadu_si256((const __m256i*)(src1 + 2 * j));
+
+        // Vertical sums in 16 bit. Per 128-bit lane: lo = source pixels [0 1], hi = [2 3]
+        __m256i lo = _mm256_add_epi16(_mm256_unpacklo_epi8(r0, zero), _mm256_unpacklo_epi8(r1, zero));
+        __m256i hi = _mm256_add_epi16(_mm256_unpackhi_epi8(r0, zero), _mm256_unpackhi_epi8(r1, zero));
+
+        // Horizontal sums: [0 2] + [1 3]
+        __m256i sum = _mm256_add_epi16(_mm256_unpacklo_epi64(lo, hi), _mm256_unpackhi_epi64(lo, hi));
+        sum         = _mm256_srli_epi16(sum, 2);
+
+        __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(sum, sum), 0x08);
+        _mm_storeu_si128((__m128i*)(dst + j), _mm256_castsi256_si128(packed));
+    }
+    ScaleDown2Scalar(src0 + 2 * j, src1 + 2 * j, dst + j, n - j);
+}
+
+// pshufb masks which gather channel c of 16 rgb pixels from the k-th 16 byte block.
+struct RGBShuffleMasks
+{
+    alignas(16) int8_t mask[3][3][16];
+
+    RGBShuffleMasks()
+    {
+        for (int c = 0; c < 3; ++c)
+        {
+            for (int k = 0; k < 3; ++k)
+            {
+                for (int i = 0; i < 16; ++i)
+                {
+                    int byte      = 3 * i + c - 16 * k;
+                    mask[c][k][i] = (byte >= 0 && byte < 16) ? byte : -128;
+                }
+            }
+        }
+    }
+};
+const RGBShuffleMasks rgb_shuffle_masks;
+
+SAIGA_TARGET_AVX2 void AbsolutePixelErrorRGBAVX2(const ucvec3* src1, const ucvec3* src2, unsigned char* dst, int n)
+{
+    __m128i masks[3][3];
+    for (int c = 0; c < 3; ++c)
+    {
+        for (int k = 0; k < 3; ++k)
+        {
+            masks[c][k] = _mm_load_si128((const __m128i*)rgb_shuffle_masks.mask[c][k]);
+        }
+    }
+
+    int j = 0;
+    for (; j + 16 <= n; j += 16)
+    {
+        __m128i diff[3];
+        for (int k = 0; k < 3; ++k)
+        {
+            __m128i a = _mm_loadu_si128((const __m128i*)((const unsigned char*)(src1 + j) + 16 * k));
+            __m128i b = _mm_loadu_si128((const __m128i*)((const unsigned char*)(src2 + j) + 16 * k));
+            diff[k]   = _mm_or_si128(_mm_subs_epu8(a, b), _mm_subs_epu8(b, a));
+        }
+
+        __m128i result = _mm_setzero_si128();
+        for (int c = 0; c < 3; ++c)
+        {
+            __m128i channel = _mm_or_si128(_mm_shuffle_epi8(diff[0], masks[c][0]),
+                                           _mm_or_si128(_mm_shuffle_epi8(diff[1], masks[c][1]),
+                                                        _mm_shuffle_epi8(diff[2], masks[c][2])));
+            result          = _mm_max_epu8(result, channel);
+        }
+        _mm_storeu_si128((__m128i*)(dst + j), result);
+    }
+    AbsolutePixelErrorRGBScalar(src1 + j, src2 + j, dst + j, n - j);
+}
+
+SAIGA_TARGET_AVX2 void AbsolutePixelErrorAVX2(const unsigned char* src1, const unsigned char* src2,
+                                              unsigned char* dst, int n)
+{
+    int j = 0;
+    for (; j + 32 <= n; j += 32)
+    {
+        __m256i a = _mm256_loadu_si256((const __m256i*)(src1 + j));
+        __m256i b = _mm256_loadu_si256((const __m256i*)(src2 + j));
+        _mm256_storeu_si256((__m256i*)(dst + j), _mm256_or_si256(_mm256_subs_epu8(a, b), _mm256_subs_epu8(b, a)));
+    }
+    AbsolutePixelErrorScalar(src1 + j, src2 + j, dst + j, n - j);
+}
+
+SAIGA_TARGET_AVX2 long L1DifferenceAVX2(const unsigned char* src1, const unsigned char* src2, int n)
+{
+    // psadbw sums the absolute differences of 8 bytes into one 64-bit lane
+    __m256i sum = _mm256_setzero_si256();
+    int j       = 0;
+    for (; j + 32 <= n; j += 32)
+    {
+        __m256i a = _mm256_loadu_si256((const __m256i*)(src1 + j));
+        __m256i b = _mm256_loadu_si256((const __m256i*)(src2 + j));
+        sum       = _mm256_add_epi64(sum, _mm256_sad_epu8(a, b));
+    }
+    alignas(32) int64_t lanes[4];
+    _mm256_store_si256((__m256i*)lanes, sum);
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3] + L1DifferenceScalar(src1 + j, src2 + j, n - j);
+}
+#endif
+
+// ======================== Dispatch ========================
+
+struct RowKernels
+{
+    void (*depth_to_rgba)(const float*, ucvec4*, int, float, float);
+    void (*depth16_to_rgba)(const uint16_t*, ucvec4*, int, float, float);
+    void (*rgba_to_gray8)(const ucvec4*, unsigned char*, int);
+    void (*rgba_to_grayf)(const ucvec4*, float*, int, float);
+    void (*gray8_to_rgba)(const unsigned char*, ucvec4*, int, unsigned char);
+    void (*scale_down2)(const ucvec4*, const ucvec4*, ucvec4*, int);
+    void (*absolute_pixel_error_rgb)(const ucvec3*, const ucvec3*, unsigned char*, int);
+    void (*absolute_pixel_error)(const unsigned char*, const unsigned char*, unsigned char*, int);
+    long (*l1_difference)(const unsigned char*, const unsigned char*, int);
+};
+
+const RowKernels scalar_kernels = {
+    DepthToRGBAScalar<float>,
+    DepthToRGBAScalar<uint16_t>,
+    RGBAToGray8Scalar,
+    RGBAToGrayFScalar,
+    Gray8ToRGBAScalar,
+    ScaleDown2Scalar,
+    AbsolutePixelErrorRGBScalar,
+    AbsolutePixelErrorScalar,
+    L1DifferenceScalar,
+};
+
+#if defined(SAIGA_IMAGE_AVX2)
+const RowKernels avx2_kernels = {
+    DepthToRGBAAVX2,
+    DepthToRGBAAVX2,
+    RGBAToGray8AVX2,
+    RGBAToGrayFAVX2,
+    Gray8ToRGBAAVX2,
+    ScaleDown2AVX2,
+    AbsolutePixelErrorRGBAVX2,
+    AbsolutePixelErrorAVX2,
+    L1DifferenceAVX2,
+};
+#endif
+
+const RowKernels* KernelTable(ImageKernel kernel)
+{
+#if defined(SAIGA_IMAGE_AVX2)
+    if (kernel == ImageKernel::AVX2) return &avx2_kernels;
+#endif
+    return &scalar_kernels;
+}
+
+std::atomic<const RowKernels*>& ActiveKernels()
+{
+    static std::atomic<const RowKernels*> kernels(KernelTable(SupportedImageKernel(ImageKernel::Auto)));
+    return kernels;
+}
+
+const RowKernels& Kernels()
+{
+    return *ActiveKernels().load(std::memory_order_relaxed);
+}
+
+// Calls f(i) for every row i. The rows of large images are distributed over the OpenMP threads.
+template <typename F>
+void ForEachRow(ImageDimensions dims, F f)
+{
+#pragma omp parallel for if (dims.rows * dims.cols > image_parallel_pixels)
+    for (int i = 0; i < dims.rows; ++i)
+    {
+        f(i);
+    }
+}
+
+template <typename F>
+long SumRows(ImageDimensions dims, F f)
+{
+    long result = 0;
+#pragma omp parallel for reduction(+ : result) if (dims.rows * dims.cols > image_parallel_pixels)
+    for (int i = 0; i < dims.rows; ++i)
+    {
+        result += f(i);
+    }
+    return result;
+}
+
+}  // namespace
+
+ImageKernel SupportedImageKernel(ImageKernel kernel)
+{
+    auto& cpu = GetCpuFeatures();
+
+    // SAIGA_TARGET_AVX2 also enables FMA
+    bool avx2 = cpu.avx2 && cpu.fma;
+#if !defined(SAIGA_IMAGE_AVX2)
+    avx2 = false;
+#endif
+
+    if (kernel == ImageKernel::Auto || kernel == ImageKernel::AVX2)
+    {
+        kernel = avx2 ? ImageKernel::AVX2 : ImageKernel::Scalar;
+    }
+    return kernel;
+}
+
+ImageKernel SetImageKernel(ImageKernel kernel)
+{
+    kernel = SupportedImageKernel(kernel);
+    ActiveKernels().store(KernelTable(kernel), std::memory_order_relaxed);
+    return kernel;
+}
+
+
 void addAlphaChannel(ImageView<const ucvec3> src, ImageView<ucvec4> dst, unsigned char alpha)
 {
     SAIGA_ASSERT(src.width == dst.width && src.height == dst.height);
@@ -45,32 +474,15 @@ void RemoveAlphaChannel(ImageView<const ucvec4> src, ImageView<ucvec3> dst)
 void depthToRGBA(ImageView<const uint16_t> src, ImageView<ucvec4> dst, uint16_t minD, uint16_t maxD)
 {
     SAIGA_ASSERT(src.width == dst.width && src.height == dst.height);
-    for (int i = 0; i < src.height; ++i)
-    {
-        for (int j = 0; j < src.width; ++j)
-        {
-            float d = src(i, j);
-            d       = (d - minD) / (maxD - minD);
-
-            dst(i, j) = ucvec4(d * 255, d * 255, d * 255, 255);
-        }
-    }
+    auto kernel = Kernels().depth16_to_rgba;
+    ForEachRow(src.dimensions(), [&](int i) { kernel(src.rowPtr(i), dst.rowPtr(i), src.width, minD, maxD); });
 }
 
 void depthToRGBA(ImageView<const float> src, ImageView<ucvec4> dst, float minD, float maxD)
 {
     SAIGA_ASSERT(src.width == dst.width && src.height == dst.height);
-    for (int i = 0; i < src.height; ++i)
-    {
-        for (int j = 0; j < src.width; ++j)
-        {
-            float d = src(i, j);
-            d       = (d - minD) / (maxD - minD);
-            d       = clamp(d, 0.0f, 1.0f);
-
-            dst(i, j) = ucvec4(d * 255, d * 255, d * 255, 255);
-        }
-    }
+    auto kernel = Kernels().depth_to_rgba;
+    ForEachRow(src.dimensions(), [&](int i) { kernel(src.rowPtr(i), dst.rowPtr(i), src.width, minD, maxD); });
 }
 
 void depthToRGBA_HSV(ImageView<const float> src, ImageView<ucvec4> dst, float minD, float maxD)
@@ -98,53 +510,27 @@ void depthToRGBA_HSV(ImageView<const float> src, ImageView<ucvec4> dst, float mi
 
 
 
-// const vec3 rgbToGray(0.2126f, 0.7152f, 0.0722f);
-const vec3 rgbToGray(0.299f, 0.587f, 0.114f);  // opencv values
-
-struct RGBATOGRAY8Trans
-{
-    unsigned char operator()(const ucvec4& v)
-    {
-        vec3 vf(v[0], v[1], v[2]);
-        float gray = dot(rgbToGray, vf);
-        return gray;
-    }
-};
-
 void RGBAToGray8(ImageView<const ucvec4> src, ImageView<unsigned char> dst)
 {
-    src.copyToTransform(dst, RGBATOGRAY8Trans());
+    SAIGA_ASSERT(src.width == dst.width && src.height == dst.height);
+    auto kernel = Kernels().rgba_to_gray8;
+    ForEachRow(src.dimensions(), [&](int i) { kernel(src.rowPtr(i), dst.rowPtr(i), src.width); });
 }
 
-
-
-struct RGBATOGRAYFTrans
-{
-    float scale;
-    RGBATOGRAYFTrans(float scale) : scale(scale) {}
-    float operator()(const ucvec4& v)
-    {
-        vec3 vf(v[0], v[1], v[2]);
-        float gray = dot(rgbToGray, vf);
-        return gray * scale;
-    }
-};
 void RGBAToGrayF(ImageView<const ucvec4> src, ImageView<float> dst, float scale)
 {
-    src.copyToTransform(dst, RGBATOGRAYFTrans(scale));
+    SAIGA_ASSERT(src.width == dst.width && src.height == dst.height);
+    auto kernel = Kernels().rgba_to_grayf;
+    ForEachRow(src.dimensions(), [&](int i) { kernel(src.rowPtr(i), dst.rowPtr(i), src.width, scale); });
 }
 
-struct Gray8ToRGBATrans
-{
-    unsigned char alpha;
-    Gray8ToRGBATrans(unsigned char alpha) : alpha(alpha) {}
-    ucvec4 operator()(const unsigned char& v) { return ucvec4(v, v, v, alpha); }
-};
-
 void Gray8ToRGBA(ImageView<unsigned char> src, ImageView<ucvec4> dst, unsigned char alpha)
 {
-    src.copyToTransform(dst, Gray8ToRGBATrans(alpha));
+    SAIGA_ASSERT(src.width == dst.width && src.height == dst.height);
+    auto kernel = Kernels().gray8_to_rgba;
+    ForEachRow(src.dimensions(), [&](int i) { kernel(src.rowPtr(i), dst.rowPtr(i), src.width, alpha); });
 }
+
 struct Gray8ToRGBTrans
 {
     ucvec3 operator()(const unsigned char& v) { return ucvec3(v, v, v); }
@@ -220,30 +606,19 @@ bool save(const std::string& path, ImageView<float> img, float vmin, float vmax)
 
 void ScaleDown2(ImageView<const ucvec4> src, ImageView<ucvec4> dst)
 {
-    for (int i : dst.rowRange())
-    {
-        for (int j : dst.colRange())
-        {
-            int i_src = i * 2;
-            int j_src = j * 2;
-            ivec4 sum = src(i_src, j_src).cast<int>() + src(i_src + 1, j_src).cast<int>() +
-                        src(i_src, j_src + 1).cast<int>() + src(i_src + 1, j_src + 1).cast<int>();
-            sum /= 4;
-            dst(i, j) = sum.cast<unsigned char>();
-        }
-    }
+    SAIGA_ASSERT(src.height >= dst.height * 2 && src.width >= dst.width * 2);
+    auto kernel = Kernels().scale_down2;
+    ForEachRow(dst.dimensions(),
+               [&](int i) { kernel(src.rowPtr(2 * i), src.rowPtr(2 * i + 1), dst.rowPtr(i), dst.width); });
 }
+
 TemplatedImage<unsigned char> AbsolutePixelError(ImageView<const ucvec3> img1, ImageView<const ucvec3> img2)
 {
+    SAIGA_ASSERT(img1.dimensions() == img2.dimensions());
     TemplatedImage<unsigned char> result(img1.dimensions());
-    for (int i : img1.rowRange())
-    {
-        for (int j : img1.colRange())
-        {
-            int diff     = (img1(i, j).cast<int>() - img2(i, j).cast<int>()).array().abs().maxCoeff();
-            result(i, j) = diff;
-        }
-    }
+    auto kernel = Kernels().absolute_pixel_error_rgb;
+    ForEachRow(img1.dimensions(),
+               [&](int i) { kernel(img1.rowPtr(i), img2.rowPtr(i), result.rowPtr(i), img1.width); });
     return result;
 }
 
@@ -251,15 +626,11 @@ TemplatedImage<unsigned char> AbsolutePixelError(ImageView<const ucvec3> img1, I
 TemplatedImage<unsigned char> AbsolutePixelError(ImageView<const unsigned char> img1,
                                                  ImageView<const unsigned char> img2)
 {
+    SAIGA_ASSERT(img1.dimensions() == img2.dimensions());
     TemplatedImage<unsigned char> result(img1.dimensions());
-    for (int i : img1.rowRange())
-    {
-        for (int j : img1.colRange())
-        {
-            int diff     = std::abs(int(img1(i, j)) - int(img2(i, j)));
-            result(i, j) = diff;
-        }
-    }
+    auto kernel = Kernels().absolute_pixel_error;
+    ForEachRow(img1.dimensions(),
+               [&](int i) { kernel(img1.rowPtr(i), img2.rowPtr(i), result.rowPtr(i), img1.width); });
     return result;
 }
 
@@ -317,29 +688,18 @@ TemplatedImage<ucvec3> ColorizeTurbo(ImageView<float> img)
 
 long L1Difference(ImageView<const ucvec3> img1, ImageView<const ucvec3> img2)
 {
-    long result = 0;
-    for (int i : img1.rowRange())
-    {
-        for (int j : img1.colRange())
-        {
-            long diff = (img1(i, j).cast<int>() - img2(i, j).cast<int>()).array().abs().sum();
-            result += diff;
-        }
-    }
-    return result;
+    SAIGA_ASSERT(img1.dimensions() == img2.dimensions());
+    auto kernel = Kernels().l1_difference;
+    return SumRows(img1.dimensions(), [&](int i) {
+        return kernel(img1.rowPtr(i)->data(), img2.rowPtr(i)->data(), img1.width * 3);
+    });
 }
+
 long L1Difference(ImageView<const unsigned char> img1, ImageView<const unsigned char> img2)
 {
-    long result = 0;
-    for (int i : img1.rowRange())
-    {
-        for (int j : img1.colRange())
-        {
-            long diff = std::abs(img1(i, j) - img2(i, j));
-            result += diff;
-        }
-    }
-    return result;
+    SAIGA_ASSERT(img1.dimensions() == img2.dimensions());
+    auto kernel = Kernels().l1_difference;
+    return SumRows(img1.dimensions(), [&](int i) { return kernel(img1.rowPtr(i), img2.rowPtr(i), img1.width); });
 }
 
 }  // namespace ImageTransformation
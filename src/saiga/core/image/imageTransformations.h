@@ -15,10 +15,38 @@ namespace Saiga
 {
 namespace ImageTransformation
 {
+/**
+ * depthToRGBA, RGBAToGray8, RGBAToGrayF, Gray8ToRGBA, ScaleDown2, AbsolutePixelError and L1Difference are computed
+ * row by row with one of the following kernels:
+ *   - AVX2: 8 to 32 pixels per instruction
+ *   - Scalar: one pixel at a time
+ * The rows of images with more than 'image_parallel_pixels' pixels are distributed over the OpenMP threads.
+ *
+ * All kernels produce the same output, except for RGBAToGray8 and RGBAToGrayF. The gray value of the AVX2 kernel
+ * can differ in the last bit of the float, which in rare cases changes the 8-bit value by one.
+ */
+enum class ImageKernel
+{
+    Auto,
+    Scalar,
+    AVX2,
+};
+
+constexpr int image_parallel_pixels = 256 * 256;
+
+// Returns the requested kernel or the next best kernel supported by the cpu.
+SAIGA_CORE_API ImageKernel SupportedImageKernel(ImageKernel kernel);
+
+// Selects the kernel of the functions above for the whole process and returns the kernel actually used.
+// The default is ImageKernel::Auto. Must not be called while one of the functions is running.
+SAIGA_CORE_API ImageKernel SetImageKernel(ImageKernel kernel);
+
+
 SAIGA_CORE_API void addAlphaChannel(ImageView<const ucvec3> src, ImageView<ucvec4> dst, unsigned char alpha = 255);
 SAIGA_CORE_API void RemoveAlphaChannel(ImageView<const ucvec4> src, ImageView<ucvec3> dst);
 
 // depth to rgb image only for visualizaion
+// The depth is mapped linearly from [minD, maxD] to [0, 255] and clamped. Invalid depth (nan) is black.
 SAIGA_CORE_API void depthToRGBA(ImageView<const uint16_t> src, ImageView<ucvec4> dst, uint16_t minD, uint16_t maxD);
 SAIGA_CORE_API void depthToRGBA(ImageView<const float> src, ImageView<ucvec4> dst, float minD = 0, float maxD = 7);
 SAIGA_CORE_API void depthToRGBA_HSV(ImageView<const float> src, ImageView<ucvec4> dst, float minD = 0, float maxD = 7);
@@ -0,0 +1,635 @@
+/**
+ * Copyright (c) 2021 Darius Rückert
+ * Licensed under the MIT License.
+ * See LICENSE file for more information.
+ */
+
+#include "MeshSimplification.h"
+
+#include "saiga/core/util/Thread/omp.h"
+
+#include "internal/noGraphicsAPI.h"
+
+#include <algorithm>
+#include <cmath>
+#include <queue>
+
+namespace Saiga
+{
+namespace
+{
+// Symmetric 4x4 matrix of the squared distance to a set of planes. Only the upper triangle is stored.
+struct Quadric
+{
+    double a00 = 0, a01 = 0, a02 = 0, a03 = 0, a11 = 0, a12 = 0, a13 = 0, a22 = 0, a23 = 0, a33 = 0;
+
+    // The summed area of the triangles. Used to normalize the error.
+    double area = 0;
+
+    // The plane n * x + d = 0 with weight w
+    static Quadric Plane(const Vec3& n, double d, double w)
+    {
+        Quadric q;
+        q.a00 = w * n.x() * n.x();
+        q.a01 = w * n.x() * n.y();
+        q.a02 = w * n.x() * n.z();
+        q.a03 = w * n.x() * d;
+        q.a11 = w * n.y() * n.y();
+        q.a12 = w * n.y() * n.z();
+        q.a13 = w * n.y() * d;
+        q.a22 = w * n.z() * n.z();
+        q.a23 = w * n.z() * d;
+        q.a33 = w * d * d;
+        return q;
+    }
+
+    Quadric& operator+=(const Quadric& o)
+    {
+        a00 += o.a00;
+        a01 += o.a01;
+        a02 += o.a02;
+        a03 += o.a03;
+        a11 += o.a11;
+        a12 += o.a12;
+        a13 += o.a13;
+        a22 += o.a22;
+        a23 += o.a23;
+        a33 += o.a33;
+        area += o.area;
+        return *this;
+    }
+
+    double Error(const Vec3& p) const
+    {
+        double x = p.x(), y = p.y(), z = p.z();
+        double e = a00 * x * x + 2 * a01 * x * y + 2 * a02 * x * z + 2 * a03 * x + a11 * y * y + 2 * a12 * y * z +
+                   2 * a13 * y + a22 * z * z + 2 * a23 * z + a33;
+        return std::max(e, 0.0);
+    }
+
+    // The position with the smallest error. Returns false if the system is (nearly) singular, for example if all
+    // planes are parallel.
+    bool Minimize(Vec3& p) const
+    {
+        Mat3 A;
+        A << a00, a01, a02, a01, a11, a12, a02, a12, a22;
+        double scale = A.trace() / 3;
+        if (!(scale > 0)) return false;
+        if (std::abs(A.determinant()) < 1e-6 * scale * scale * scale) return false;
+        p = A.inverse() * Vec3(-a03, -a13, -a23);
+        return p.allFinite();
+    }
+};
+
+inline Vec3 FaceNormal(const vec3& a, const vec3& b, const vec3& c)
+{
+    return (b - a).cast<double>().cross((c - a).cast<double>());
+}
+
+// Sequential edge collapse on one mesh. Locked vertices are neither moved nor removed.
+class EdgeCollapse
+{
+   public:
+    EdgeCollapse(UnifiedMesh& mesh, std::vector<char> locked, const MeshSimplificationParams& params);
+
+    // Collapses edges until the mesh has at most 'target' triangles or the error bound is reached.
+    void Run(int target);
+
+    // Removes the collapsed vertices and triangles from the mesh.
+    // Returns the old index of each remaining vertex.
+    std::vector<int> Compact();
+
+   private:
+    struct Collapse
+    {
+        float cost;
+        int a, b;
+        uint32_t version_a, version_b;
+
+        // std::priority_queue is a max heap
+        bool operator<(const Collapse& other) const { return cost > other.cost; }
+    };
+
+    UnifiedMesh& mesh;
+    const MeshSimplificationParams& params;
+    std::vector<char> locked, boundary, vertex_alive, face_alive;
+    std::vector<uint32_t> version;
+    std::vector<Quadric> quadrics;
+    std::vector<std::vector<int>> vertex_faces;
+    std::priority_queue<Collapse> heap;
+    int alive_faces;
+    double cos_max_angle;
+
+    std::vector<int> neighbors_a, neighbors_b;
+
+    // The sorted neighbor vertices of v
+    void Neighbors(int v, std::vector<int>& result) const;
+
+    // Computes the position and cost of merging b into a. a and b are swapped if b must be kept.
+    bool Evaluate(int& a, int& b, Vec3& p, float& cost) const;
+
+    // Checks the topology and the normals of the triangles around the edge.
+    bool IsValid(int a, int b, const Vec3& p);
+
+    void Apply(int a, int b, const Vec3& p);
+
+    void PushEdges(int v);
+};
+
+EdgeCollapse::EdgeCollapse(UnifiedMesh& mesh, std::vector<char> _locked, const MeshSimplificationParams& params)
+    : mesh(mesh), params(params), locked(std::move(_locked))
+{
+    SAIGA_ASSERT(mesh.lines.empty(), "Line meshes are not supported");
+    int n = mesh.NumVertices();
+    int m = mesh.NumFaces();
+
+    locked.resize(n, 0);
+    boundary.resize(n, 0);
+    vertex_alive.resize(n, 1);
+    face_alive.resize(m, 1);
+    version.resize(n, 0);
+    quadrics.resize(n);
+    vertex_faces.resize(n);
+    alive_faces   = m;
+    cos_max_angle = std::cos(params.max_normal_angle);
+
+    for (int f = 0; f < m; ++f)
+    {
+        for (int k = 0; k < 3; ++k)
+        {
+            int v = mesh.triangles[f](k);
+            SAIGA_ASSERT(v >= 0 && v < n);
+            vertex_faces[v].push_back(f);
+        }
+    }
+
+    // Each vertex sums the quadrics of its triangles and of the planes through its boundary edges
+#pragma omp parallel for schedule(dynamic, 1024)
+    for (int v = 0; v < n; ++v)
+    {
+        auto& q = quadrics[v];
+        for (int f : vertex_faces[v])
+        {
+            auto t = mesh.triangles[f];
+            Vec3 normal = FaceNormal(mesh.position[t(0)], mesh.position[t(1)], mesh.position[t(2)]);
+            double len  = normal.norm();
+            if (!(len > 0)) continue;
+            normal /= len;
+            auto plane = Quadric::Plane(normal, -normal.dot(mesh.position[v].cast<double>()), len * 0.5);
+            plane.area = len * 0.5;
+            q += plane;
+
+            // The edges starting at v. An edge is on the boundary if no other triangle of v contains it.
+            for (int k = 0; k < 3; ++k)
+            {
+                if (t(k) != v) continue;
+                for (int u : {t((k + 1) % 3), t((k + 2) % 3)})
+                {
+                    int count = 0;
+                    for (int f2 : vertex_faces[v])
+                    {
+                        auto t2 = mesh.triangles[f2];
+                        count += t2(0) == u || t2(1) == u || t2(2) == u;
+                    }
+                    if (count != 1) continue;
+                    boundary[v] = true;
+
+                    Vec3 edge       = (mesh.position[u] - mesh.position[v]).cast<double>();
+                    Vec3 plane_n    = edge.cross(normal);
+                    double plane_nl = plane_n.norm();
+                    if (!(plane_nl > 0)) continue;
+                    plane_n /= plane_nl;
+                    q += Quadric::Plane(plane_n, -plane_n.dot(mesh.position[v].cast<double>()),
+                                        params.boundary_weight * edge.squaredNorm());
+                }
+            }
+        }
+    }
+
+    // The initial collapses of all edges
+    std::vector<std::pair<int, int>> edges;
+    edges.reserve(m * 3);
+    for (auto& t : mesh.triangles)
+    {
+        for (int k = 0; k < 3; ++k)
+        {
+            int a = t(k), b = t((k + 1) % 3);
+            edges.emplace_back(std::min(a, b), std::max(a, b));
+        }
+    }
+    std::sort(edges.begin(), edges.end());
+    edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+
+    std::vector<Collapse> collapses(edges.size());
+    std::vector<char> possible(edges.size());
+#pragma omp parallel for
+    for (int64_t i = 0; i < (int64_t)edges.size(); ++i)
+    {
+        auto [a, b] = edges[i];
+        Vec3 p;
+        float cost;
+        possible[i]  = Evaluate(a, b, p, cost);
+        collapses[i] = {cost, a, b, 0, 0};
+    }
+    int64_t valid = 0;
+    for (int64_t i = 0; i < (int64_t)edges.size(); ++i)
+    {
+        if (possible[i]) collapses[valid++] = collapses[i];
+    }
+    collapses.resize(valid);
+    heap = std::priority_queue<Collapse>(std::less<Collapse>(), std::move(collapses));
+}
+
+void EdgeCollapse::Neighbors(int v, std::vector<int>& result) const
+{
+    result.clear();
+    for (int f : vertex_faces[v])
+    {
+        if (!face_alive[f]) continue;
+        auto t = mesh.triangles[f];
+        for (int k = 0; k < 3; ++k)
+        {
+            if (t(k) != v) result.push_back(t(k));
+        }
+    }
+    std::sort(result.begin(), result.end());
+    result.erase(std::unique(result.begin(), result.end()), result.end());
+}
+
+bool EdgeCollapse::Evaluate(int& a, int& b, Vec3& p, float& cost) const
+{
+    if (locked[a] && locked[b]) return false;
+    if (locked[b]) std::swap(a, b);
+
+    Quadric q = quadrics[a];
+    q += quadrics[b];
+
+    Vec3 pa = mesh.position[a].cast<double>();
+    Vec3 pb = mesh.position[b].cast<double>();
+
+    double error;
+    if (locked[a])
+    {
+        p     = pa;
+        error = q.Error(pa);
+    }
+    else
+    {
+        // Use the optimal position if it is close to the edge. Otherwise the best of the end and mid points.
+        Vec3 optimal;
+        if (q.Minimize(optimal) && (optimal - 0.5 * (pa + pb)).squaredNorm() < (pa - pb).squaredNorm())
+        {
+            p     = optimal;
+            error = q.Error(p);
+        }
+        else
+        {
+            p     = pa;
+            error = q.Error(pa);
+            for (Vec3 c : {pb, Vec3(0.5 * (pa + pb))})
+            {
+                double e = q.Error(c);
+                if (e < error)
+                {
+                    error = e;
+                    p     = c;
+                }
+            }
+        }
+    }
+    if (q.area > 0) error /= q.area;
+
+    if (params.attribute_weight > 0)
+    {
+        double diff = 0;
+        if (mesh.HasColor()) diff += (mesh.color[a] - mesh.color[b]).squaredNorm();
+        if (mesh.HasNormal()) diff += (mesh.normal[a] - mesh.normal[b]).squaredNorm();
+        error += params.attribute_weight * diff * (pa - pb).squaredNorm();
+    }
+    cost = error;
+    return true;
+}
+
+bool EdgeCollapse::IsValid(int a, int b, const Vec3& p)
+{
+    Neighbors(a, neighbors_a);
+    Neighbors(b, neighbors_b);
+
+    int shared_faces = 0;
+    for (int f : vertex_faces[a])
+    {
+        if (!face_alive[f]) continue;
+        auto t = mesh.triangles[f];
+        shared_faces += t(0) == b || t(1) == b || t(2) == b;
+    }
+    if (shared_faces == 0) return false;
+
+    // Link condition: the only common neighbors are the opposite vertices of the triangles of the edge.
+    int common = 0;
+    for (int i = 0, j = 0; i < (int)neighbors_a.size() && j < (int)neighbors_b.size();)
+    {
+        if (neighbors_a[i] < neighbors_b[j])
+            ++i;
+        else if (neighbors_a[i] > neighbors_b[j])
+            ++j;
+        else
+            ++common, ++i, ++j;
+    }
+    if (common != shared_faces) return false;
+
+    // An inner edge between two boundary vertices would pinch the mesh
+    if (shared_faces == 2 && boundary[a] && boundary[b]) return false;
+
+    // The remaining triangles must not flip or rotate too much
+    for (int v : {a, b})
+    {
+        for (int f : vertex_faces[v])
+        {
+            if (!face_alive[f]) continue;
+            auto t = mesh.triangles[f];
+            if ((t.array() == a).any() && (t.array() == b).any()) continue;
+
+            Vec3 corners[3];
+            Vec3 moved[3];
+            for (int k = 0; k < 3; ++k)
+            {
+                corners[k] = mesh.position[t(k)].cast<double>();
+                moved[k]   = t(k) == v ? p : corners[k];
+            }
+            Vec3 n0 = (corners[1] - corners[0]).cross(corners[2] - corners[0]);
+            Vec3 n1 = (moved[1] - moved[0]).cross(moved[2] - moved[0]);
+            double l0 = n0.norm(), l1 = n1.norm();
+            if (!(l1 > 0)) return false;
+            if (l0 > 0 && n0.dot(n1) < cos_max_angle * l0 * l1) return false;
+        }
+    }
+    return true;
+}
+
+void EdgeCollapse::Apply(int a, int b, const Vec3& p)
+{
+    // Interpolate the attributes at the projection of p onto the edge
+    Vec3 pa   = mesh.position[a].cast<double>();
+    Vec3 edge = mesh.position[b].cast<double>() - pa;
+    float t   = edge.squaredNorm() > 0 ? std::clamp((p - pa).dot(edge) / edge.squaredNorm(), 0.0, 1.0) : 0.f;
+    if (mesh.HasNormal())
+    {
+        vec3 n = (1 - t) * mesh.normal[a] + t * mesh.normal[b];
+        if (n.squaredNorm() > 0) mesh.normal[a] = n.normalized();
+    }
+    if (mesh.HasColor()) mesh.color[a] = (1 - t) * mesh.color[a] + t * mesh.color[b];
+    if (mesh.HasTC())
+        mesh.texture_coordinates[a] = (1 - t) * mesh.texture_coordinates[a] + t * mesh.texture_coordinates[b];
+
+    mesh.position[a] = p.cast<float>();
+    quadrics[a] += quadrics[b];
+    boundary[a] = boundary[a] || boundary[b];
+    version[a]++;
+    version[b]++;
+    vertex_alive[b] = false;
+
+    for (int f : vertex_faces[b])
+    {
+        if (!face_alive[f]) continue;
+        auto& tri = mesh.triangles[f];
+        if ((tri.array() == a).any())
+        {
+            face_alive[f] = false;
+            alive_faces--;
+        }
+        else
+        {
+            for (int k = 0; k < 3; ++k)
+            {
+                if (tri(k) == b) tri(k) = a;
+            }
+            vertex_faces[a].push_back(f);
+        }
+    }
+    std::vector<int>().swap(vertex_faces[b]);
+
+    auto& faces_a = vertex_faces[a];
+    faces_a.erase(std::remove_if(faces_a.begin(), faces_a.end(), [this](int f) { return !face_alive[f]; }),
+                  faces_a.end());
+
+    PushEdges(a);
+}
+
+void EdgeCollapse::PushEdges(int v)
+{
+    Neighbors(v, neighbors_a);
+    for (int u : neighbors_a)
+    {
+        int a = v, b = u;
+        Vec3 p;
+        float cost;
+        if (Evaluate(a, b, p, cost)) heap.push({cost, a, b, version[a], version[b]});
+    }
+}
+
+void EdgeCollapse::Run(int target)
+{
+    while (alive_faces > target && !heap.empty())
+    {
+        Collapse c = heap.top();
+        heap.pop();
+        if (!vertex_alive[c.a] || !vertex_alive[c.b] || version[c.a] != c.version_a || version[c.b] != c.version_b)
+        {
+            continue;
+        }
+        if (c.cost > params.max_error) break;
+
+        int a = c.a, b = c.b;
+        Vec3 p;
+        float cost;
+        if (!Evaluate(a, b, p, cost) || !IsValid(a, b, p)) continue;
+        Apply(a, b, p);
+    }
+}
+
+std::vector<int> EdgeCollapse::Compact()
+{
+    int n = mesh.NumVertices();
+    std::vector<int> kept, new_index(n, -1);
+    for (int i = 0; i < n; ++i)
+    {
+        if (vertex_alive[i])
+        {
+            new_index[i] = kept.size();
+            kept.push_back(i);
+        }
+    }
+
+    auto gather = [&](auto& old) {
+        if (old.empty()) return;
+        std::remove_reference_t<decltype(old)> compact(kept.size());
+        for (int k = 0; k < (int)kept.size(); ++k)
+        {
+            compact[k] = old[kept[k]];
+        }
+        old = std::move(compact);
+    };
+    gather(mesh.position);
+    gather(mesh.normal);
+    gather(mesh.color);
+    gather(mesh.texture_coordinates);
+    gather(mesh.data);
+    gather(mesh.bone_info);
+
+    std::vector<ivec3> triangles;
+    triangles.reserve(alive_faces);
+    for (int f = 0; f < (int)mesh.triangles.size(); ++f)
+    {
+        if (!face_alive[f]) continue;
+        auto t = mesh.triangles[f];
+        triangles.push_back(ivec3(new_index[t(0)], new_index[t(1)], new_index[t(2)]));
+    }
+    mesh.triangles = std::move(triangles);
+    return kept;
+}
+
+// Appends the vertex attributes of src[i] to dst
+void AppendVertex(UnifiedMesh& dst, const UnifiedMesh& src, int i)
+{
+    dst.position.push_back(src.position[i]);
+    if (src.HasNormal()) dst.normal.push_back(src.normal[i]);
+    if (src.HasColor()) dst.color.push_back(src.color[i]);
+    if (src.HasTC()) dst.texture_coordinates.push_back(src.texture_coordinates[i]);
+    if (!src.data.empty()) dst.data.push_back(src.data[i]);
+    if (!src.bone_info.empty()) dst.bone_info.push_back(src.bone_info[i]);
+}
+
+UnifiedMesh SimplifyClusters(const UnifiedMesh& mesh, const MeshSimplificationParams& params)
+{
+    int n = mesh.NumVertices();
+    int m = mesh.NumFaces();
+
+    // Assign each triangle to the grid cell of its centroid
+    int k      = std::max(1, (int)std::ceil(std::cbrt(double(params.clusters))));
+    auto bb    = mesh.BoundingBox();
+    vec3 scale = vec3::Constant(k).array() / (bb.max - bb.min).array().max(1e-10f);
+
+    std::vector<int> face_cluster(m);
+#pragma omp parallel for
+    for (int f = 0; f < m; ++f)
+    {
+        auto t    = mesh.triangles[f];
+        vec3 c    = (mesh.position[t(0)] + mesh.position[t(1)] + mesh.position[t(2)]) / 3.f;
+        ivec3 ic  = ((c - bb.min).array() * scale.array()).cast<int>().max(0).min(k - 1).matrix();
+        face_cluster[f] = (ic.z() * k + ic.y()) * k + ic.x();
+    }
+
+    // The vertices used by multiple clusters are locked
+    int num_clusters = k * k * k;
+    std::vector<int> owner(n, -1);
+    std::vector<char> locked(n, 0);
+    std::vector<std::vector<int>> cluster_faces(num_clusters);
+    for (int f = 0; f < m; ++f)
+    {
+        int c = face_cluster[f];
+        cluster_faces[c].push_back(f);
+        for (int j = 0; j < 3; ++j)
+        {
+            int v = mesh.triangles[f](j);
+            if (owner[v] == -1)
+                owner[v] = c;
+            else if (owner[v] != c)
+                locked[v] = true;
+        }
+    }
+
+    std::vector<UnifiedMesh> cluster_meshes(num_clusters);
+    std::vector<std::vector<int>> cluster_vertices(num_clusters);
+#pragma omp parallel for schedule(dynamic, 1)
+    for (int c = 0; c < num_clusters; ++c)
+    {
+        auto& faces = cluster_faces[c];
+        if (faces.empty()) continue;
+
+        auto& vertices = cluster_vertices[c];
+        for (int f : faces)
+        {
+            for (int j = 0; j < 3; ++j) vertices.push_back(mesh.triangles[f](j));
+        }
+        std::sort(vertices.begin(), vertices.end());
+        vertices.erase(std::unique(vertices.begin(), vertices.end()), vertices.end());
+
+        auto& local = cluster_meshes[c];
+        std::vector<char> local_locked(vertices.size());
+        for (int i = 0; i < (int)vertices.size(); ++i)
+        {
+            AppendVertex(local, mesh, vertices[i]);
+            local_locked[i] = locked[vertices[i]];
+        }
+        for (int f : faces)
+        {
+            ivec3 t;
+            for (int j = 0; j < 3; ++j)
+            {
+                t(j) = std::lower_bound(vertices.begin(), vertices.end(), mesh.triangles[f](j)) - vertices.begin();
+            }
+            local.triangles.push_back(t);
+        }
+
+        int target = int64_t(params.target_triangles) * faces.size() / m;
+        EdgeCollapse collapse(local, std::move(local_locked), params);
+        collapse.Run(target);
+        auto kept = collapse.Compact();
+        for (auto& i : kept) i = vertices[i];
+        vertices = std::move(kept);
+    }
+
+    // Merge the clusters. The locked vertices are shared.
+    UnifiedMesh result;
+    std::vector<int> merged_index(n, -1);
+    for (int c = 0; c < num_clusters; ++c)
+    {
+        auto& local = cluster_meshes[c];
+        std::vector<int> index(local.NumVertices());
+        for (int i = 0; i < local.NumVertices(); ++i)
+        {
+            int g = cluster_vertices[c][i];
+            if (!locked[g] || merged_index[g] == -1)
+            {
+                merged_index[g] = result.NumVertices();
+                AppendVertex(result, local, i);
+            }
+            index[i] = merged_index[g];
+        }
+        for (auto t : local.triangles)
+        {
+            result.triangles.push_back(ivec3(index[t(0)], index[t(1)], index[t(2)]));
+        }
+        local = UnifiedMesh();
+    }
+
+    // Vertices without a triangle
+    for (int i = 0; i < n; ++i)
+    {
+        if (owner[i] == -1) AppendVertex(result, mesh, i);
+    }
+
+    // Simplify the cluster borders
+    EdgeCollapse collapse(result, {}, params);
+    collapse.Run(params.target_triangles);
+    collapse.Compact();
+    return result;
+}
+
+}  // namespace
+
+UnifiedMesh SimplifyMesh(const UnifiedMesh& mesh, const MeshSimplificationParams& params)
+{
+    if (params.clusters > 1 && mesh.NumFaces() > 0)
+    {
+        return SimplifyClusters(mesh, params);
+    }
+
+    UnifiedMesh result = mesh;
+    EdgeCollapse collapse(result, {}, params);
+    collapse.Run(params.target_triangles);
+    collapse.Compact();
+    return result;
+}
+
+}  // namespace Saiga
@@ -0,0 +1,54 @@
+/**
+ * Copyright (c) 2021 Darius Rückert
+ * Licensed under the MIT License.
+ * See LICENSE file for more information.
+ */
+
+#pragma once
+
+#include "saiga/core/model/UnifiedMesh.h"
+
+#include <limits>
+
+namespace Saiga
+{
+struct SAIGA_CORE_API MeshSimplificationParams
+{
+    // Stop when the mesh has at most this many triangles.
+    int target_triangles = 0;
+
+    // Stop when the cheapest collapse has a larger error. The error of a vertex is the area weighted mean squared
+    // distance to the planes of the original triangles around it (plus the attribute error below).
+    float max_error = std::numeric_limits<float>::infinity();
+
+    // Weight of the color and normal difference between the two vertices of an edge. The attribute error of an edge
+    // is attribute_weight * |a0 - a1|^2 * length^2, so edges across attribute seams are collapsed later.
+    float attribute_weight = 1;
+
+    // Weight of the planes which are perpendicular to boundary edges. Large values keep the boundary in place.
+    float boundary_weight = 100;
+
+    // A collapse is rejected if the normal of an adjacent triangle rotates by more than this angle.
+    float max_normal_angle = radians(60.f);
+
+    // Cluster mode for very large meshes. The mesh is split into about this many spatial clusters, which are
+    // simplified in parallel. The vertices on cluster borders are locked during this stage and the merged mesh is
+    // simplified once more with the sequential algorithm.
+    // 0 disables the cluster mode.
+    int clusters = 0;
+};
+
+/**
+ * Quadric error metric edge collapse (Garland and Heckbert 1997).
+ *
+ * Every vertex accumulates the plane quadrics of its incident triangles weighted by their area. The edge with the
+ * smallest error is collapsed to the position which minimizes the summed quadric of both vertices, until the target
+ * triangle count or the error bound is reached.
+ *   - Collapses which would make the mesh non-manifold or flip a triangle are rejected.
+ *   - Normals, colors and texture coordinates are interpolated along the collapsed edge. Extra data and bone
+ *     weights are taken from the remaining vertex.
+ *   - The input must be free of duplicate vertices (see UnifiedMesh::RemoveDoubles).
+ */
+SAIGA_CORE_API UnifiedMesh SimplifyMesh(const UnifiedMesh& mesh, const MeshSimplificationParams& params);
+
+}  // namespace Saiga
@@ -6,7 +6,6 @@
 
 #include "UnifiedMesh.h"
 
-#include "saiga/core/geometry/kdtree.h"
 #include "saiga/core/math/Morton.h"
 #include "saiga/core/math/random.h"
 #include "saiga/core/util/BinaryFile.h"
@@ -17,6 +16,10 @@
 
 #include "internal/noGraphicsAPI.h"
 
+#include <array>
+#include <atomic>
+#include <cmath>
+
 #include "model_loader_obj.h"
 #include "model_loader_ply.h"
 
@@ -450,51 +453,196 @@ UnifiedMesh& UnifiedMesh::SmoothVertexColors(int iterations, float self_weight)
     }
     return *this;
 }
+namespace
+{
+inline std::array<int64_t, 3> WeldCell(const vec3& p, double inv_cell_size)
+{
+    return {int64_t(std::floor(p.x() * inv_cell_size)), int64_t(std::floor(p.y() * inv_cell_size)),
+            int64_t(std::floor(p.z() * inv_cell_size))};
+}
+
+inline uint64_t WeldCellHash(int64_t x, int64_t y, int64_t z)
+{
+    uint64_t h = uint64_t(x) * 0x9E3779B97F4A7C15ull ^ uint64_t(y) * 0xC2B2AE3D27D4EB4Full ^
+                 uint64_t(z) * 0x165667B19E3779F9ull;
+    return h ^ (h >> 32);
+}
+
+// Lock-free union-find. The root with the larger index is always linked to the smaller one, so the root of each
+// set is its smallest element, independent of the order of the Union calls.
+inline int Find(std::vector<std::atomic<int>>& parent, int i)
+{
+    int p = parent[i].load(std::memory_order_relaxed);
+    while (p != i)
+    {
+        // path halving
+        int gp = parent[p].load(std::memory_order_relaxed);
+        if (gp != p) parent[i].compare_exchange_weak(p, gp, std::memory_order_relaxed);
+        i = p;
+        p = parent[i].load(std::memory_order_relaxed);
+    }
+    return i;
+}
+
+inline void Union(std::vector<std::atomic<int>>& parent, int a, int b)
+{
+    while (true)
+    {
+        a = Find(parent, a);
+        b = Find(parent, b);
+        if (a == b) return;
+        if (a > b) std::swap(a, b);
+        int expected = b;
+        if (parent[b].compare_exchange_strong(expected, a, std::memory_order_relaxed)) return;
+    }
+}
+}  // namespace
+
 UnifiedMesh& UnifiedMesh::RemoveDoubles(float distance)
 {
-    std::vector<int> to_merge(NumVertices());
+    int n = NumVertices();
+    if (n == 0 || !(distance > 0)) return *this;
+
+    // Spatial hash with a cell size of 2 * distance. All vertices closer than 'distance' to a vertex are in its own
+    // cell or in the neighbor cell closer to it on each axis (2x2x2 cells). Hash collisions only add candidates,
+    // which are rejected by the distance test.
+    double inv_cell_size = 0.5 / distance;
+    int table_size       = 1;
+    while (table_size < n) table_size *= 2;
+    uint64_t mask = table_size - 1;
+
+    std::vector<int> bucket(n);
+    std::vector<std::atomic<int>> bucket_begin(table_size + 1);
+#pragma omp parallel for
+    for (int i = 0; i < n; ++i)
+    {
+        auto c    = WeldCell(position[i], inv_cell_size);
+        bucket[i] = WeldCellHash(c[0], c[1], c[2]) & mask;
+        bucket_begin[bucket[i] + 1].fetch_add(1, std::memory_order_relaxed);
+    }
+    for (int b = 0; b < table_size; ++b)
+    {
+        bucket_begin[b + 1] += bucket_begin[b].load(std::memory_order_relaxed);
+    }
 
-    std::vector<int> to_erase;
-    std::vector<int> valid(NumVertices(), 0);
-    KDTree<3, vec3> tree(position);
-    for (int i = 0; i < position.size(); ++i)
+    // The vertex ids sorted by bucket. The order inside a bucket is arbitrary.
+    std::vector<int> sorted(n);
     {
-        auto ps     = tree.RadiusSearch(position[i], distance);
-        bool found  = false;
-        to_merge[i] = i;
-        for (auto pi : ps)
+        std::vector<std::atomic<int>> bucket_pos(table_size);
+#pragma omp parallel for
+        for (int b = 0; b < table_size; ++b)
         {
-            if (valid[pi])
-            {
-                to_erase.push_back(i);
-                to_merge[i] = pi;
-                found       = true;
-                break;
-            }
+            bucket_pos[b].store(bucket_begin[b].load(std::memory_order_relaxed), std::memory_order_relaxed);
         }
-        if (!found)
+#pragma omp parallel for
+        for (int i = 0; i < n; ++i)
         {
-            valid[i] = true;
+            sorted[bucket_pos[bucket[i]].fetch_add(1, std::memory_order_relaxed)] = i;
         }
     }
 
-    for (auto& t : triangles)
+    // Merge all pairs closer than 'distance'. Merging is transitive, so every connected group of vertices is
+    // represented by its vertex with the smallest index.
+    std::vector<std::atomic<int>> parent(n);
+#pragma omp parallel for
+    for (int i = 0; i < n; ++i)
     {
-        for (int i = 0; i < 3; ++i)
+        parent[i].store(i, std::memory_order_relaxed);
+    }
+
+    float distance2 = distance * distance;
+#pragma omp parallel for schedule(dynamic, 1024)
+    for (int i = 0; i < n; ++i)
+    {
+        vec3 p = position[i];
+        auto c = WeldCell(p, inv_cell_size);
+        std::array<int64_t, 3> neighbor;
+        for (int k = 0; k < 3; ++k)
         {
-            t(i) = to_merge[t(i)];
+            double f    = p(k) * inv_cell_size - c[k];
+            neighbor[k] = f < 0.5 ? c[k] - 1 : c[k] + 1;
+        }
+        for (int64_t z : {c[2], neighbor[2]})
+        {
+            for (int64_t y : {c[1], neighbor[1]})
+            {
+                for (int64_t x : {c[0], neighbor[0]})
+                {
+                    uint64_t b = WeldCellHash(x, y, z) & mask;
+                    int end    = bucket_begin[b + 1].load(std::memory_order_relaxed);
+                    for (int k = bucket_begin[b].load(std::memory_order_relaxed); k < end; ++k)
+                    {
+                        int j = sorted[k];
+                        if (j > i && (position[j] - p).squaredNorm() < distance2) Union(parent, i, j);
+                    }
+                }
+            }
         }
     }
 
-    for (auto& t : lines)
+    // The new index of every old vertex
+    std::vector<int> representative(n);
+#pragma omp parallel for
+    for (int i = 0; i < n; ++i)
     {
-        for (int i = 0; i < 2; ++i)
+        representative[i] = Find(parent, i);
+    }
+
+    std::vector<int> new_index(n);
+    std::vector<int> kept;
+    kept.reserve(n);
+    for (int i = 0; i < n; ++i)
+    {
+        if (representative[i] == i)
         {
-            t(i) = to_merge[t(i)];
+            new_index[i] = kept.size();
+            kept.push_back(i);
         }
     }
+    if ((int)kept.size() == n) return *this;
 
-    return EraseVertices(to_erase);
+#pragma omp parallel for
+    for (int i = 0; i < n; ++i)
+    {
+        new_index[i] = new_index[representative[i]];
+    }
+
+    // Each group keeps the attributes of its representative
+    int num_kept = kept.size();
+    auto gather  = [&](auto& old)
+    {
+        if (old.empty()) return;
+        SAIGA_ASSERT((int)old.size() == n);
+        std::remove_reference_t<decltype(old)> compact(num_kept);
+#pragma omp parallel for
+        for (int k = 0; k < num_kept; ++k)
+        {
+            compact[k] = old[kept[k]];
+        }
+        old = std::move(compact);
+    };
+    gather(position);
+    gather(normal);
+    gather(color);
+    gather(texture_coordinates);
+    gather(data);
+    gather(bone_info);
+
+#pragma omp parallel for
+    for (int i = 0; i < (int)triangles.size(); ++i)
+    {
+        auto& t = triangles[i];
+        for (int k = 0; k < 3; ++k) t(k) = new_index[t(k)];
+    }
+
+#pragma omp parallel for
+    for (int i = 0; i < (int)lines.size(); ++i)
+    {
+        auto& l = lines[i];
+        for (int k = 0; k < 2; ++k) l(k) = new_index[l(k)];
+    }
+
+    return *this;
 }
 
 UnifiedMesh& UnifiedMesh::RemoveDegenerateTriangles()
@@ -92,7 +92,9 @@ class SAIGA_CORE_API UnifiedMesh
     // Faces are currently not updated (maybe todo in the future)
     UnifiedMesh& EraseVertices(ArrayView<int> vertices);
 
-    // Merge vertices that are closer than 'distance' apart
+    // Merge vertices that are closer than 'distance' apart.
+    // Merging is transitive: each group of connected vertices is replaced by the vertex with the smallest index.
+    // Triangles and lines are remapped but degenerate triangles are not removed (see RemoveDegenerateTriangles).
     UnifiedMesh& RemoveDoubles(float distance);
 
 
@@ -39,19 +39,27 @@ UnifiedModel::UnifiedModel(const std::string& file_name)
 
     std::string type = fileEnding(file_name);
 
-    if (type == "obj" && false)
+    if (type == "obj")
     {
-#if 0
-        ObjModelLoader loader(full_file);
-        *this = loader.out_model;
-        for (auto& v : loader.outVertices)
+        ObjModelLoader loader;
+        if (!loader.loadFile(full_file))
         {
-            position.push_back(v.position.head<3>());
-            normal.push_back(v.normal.head<3>());
-            texture_coordinates.push_back(v.texture);
+            throw std::runtime_error("Could not load obj file " + file_name);
         }
+        *this = std::move(loader.out_model);
         LocateTextures(full_file);
-#endif
+    }
+    else if (type == "ply")
+    {
+        PLYLoader loader(full_file);
+
+        // PLY has no materials
+        UnifiedMaterialGroup mg;
+        mg.numFaces   = loader.mesh.NumFaces();
+        mg.materialId = 0;
+        materials.push_back(UnifiedMaterial("default"));
+        material_groups.push_back(mg);
+        this->mesh.push_back(std::move(loader.mesh));
     }
 #ifdef SAIGA_USE_ASSIMP
     else
@@ -7,6 +7,7 @@
 #pragma once
 
 
+#include "MeshSimplification.h"
 #include "UnifiedModel.h"
 
 #include "model_loader_obj.h"
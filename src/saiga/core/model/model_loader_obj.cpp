@@ -9,6 +9,8 @@
 #include "saiga/core/math/String.h"
 #include "saiga/core/time/all.h"
 #include "saiga/core/util/FileSystem.h"
+#include "saiga/core/util/MemoryMappedFile.h"
+#include "saiga/core/util/Thread/omp.h"
 #include "saiga/core/util/file.h"
 #include "saiga/core/util/fileChecker.h"
 #include "saiga/core/util/tostring.h"
@@ -16,6 +18,8 @@
 #include "internal/noGraphicsAPI.h"
 
 #include <algorithm>
+#include <charconv>
+#include <cstring>
 #include <fstream>
 #include <iostream>
 #include <sstream>
@@ -23,7 +27,6 @@
 namespace Saiga
 {
 static StringViewParser lineParser = {"\t ,\n", true};
-static StringViewParser faceParser = {"/", false};
 
 
 struct ObjLine
@@ -128,452 +131,540 @@ std::vector<UnifiedMaterial> LoadMTL(const std::string& file)
 
 
 
-// parsing index vertex
-// examples:
-// v1/vt1/vn1        12/51/1
-// v1//vn1           51//4
-inline ObjModelLoader::IndexedVertex2 parseIV(std::string_view line)
+namespace
 {
-    ObjModelLoader::IndexedVertex2 iv;
-#if 0
-    std::vector<std::string> s = split(line, '/');
-    if (s.size() > 0 && s[0].size() > 0) iv.v = std::atoi(s[0].c_str()) - 1;
-    if (s.size() > 1 && s[1].size() > 0) iv.t = std::atoi(s[1].c_str()) - 1;
-    if (s.size() > 2 && s[2].size() > 0) iv.n = std::atoi(s[2].c_str()) - 1;
-#else
-    faceParser.set(line);
-    std::string_view tmp;
-    tmp = faceParser.next();
-    if (!tmp.empty()) iv.v = to_long(tmp) - 1;
-    tmp = faceParser.next();
-    if (!tmp.empty()) iv.t = to_long(tmp) - 1;
-    tmp = faceParser.next();
-    if (!tmp.empty()) iv.n = to_long(tmp) - 1;
-#endif
-    return iv;
-}
-
+using IndexedVertex2 = ObjModelLoader::IndexedVertex2;
 
-ObjModelLoader::ObjModelLoader(const std::string& file) : file(file)
+// The parsed content of one chunk of the file.
+// Relative (negative) indices are stored relative to the beginning of the chunk and fixed after merging.
+struct ObjChunk
 {
-    loadFile(file);
-}
-
+    std::vector<vec3> vertices;
+    // Empty if the chunk has no vertex colors
+    std::vector<vec4> colors;
+    std::vector<vec3> normals;
+    std::vector<vec2> tex_coords;
+    std::vector<IndexedVertex2> corners;
+
+    // (corner, component mask) of the corners with relative indices
+    std::vector<std::pair<int, int>> relative;
+    std::vector<ObjModelLoader::MaterialRange> material_ranges;
+    std::vector<std::string> mtllibs;
+    bool error = false;
+};
 
-bool ObjModelLoader::loadFile(const std::string& _file)
+inline bool IsSeparator(char c)
 {
-    this->file = SearchPathes::model(_file);
-    if (file == "")
-    {
-        std::cerr << "Could not open file " << _file << std::endl;
-        std::cerr << SearchPathes::model << std::endl;
-        return false;
-    }
-
-    //    std::ifstream stream(file, std::ios::in);
-    //    if (!stream.is_open())
-    //    {
-    //        throw std::runtime_error("Search Pathes broken!");
-    //    }
-
-
-    std::cout << "[ObjModelLoader] Loading " << file << std::endl;
-
-    UnifiedMaterialGroup tg;
-    tg.startFace = 0;
-    tg.numFaces  = 0;
-    out_model.material_groups.push_back(tg);
-
-    std::vector<std::string> data;
-    {
-        //        SAIGA_BLOCK_TIMER();
-        data = File::loadFileStringArray(file);
-        File::removeWindowsLineEnding(data);
-    }
-    {
-        //        SAIGA_BLOCK_TIMER();
-        for (auto& line : data)
-        {
-            lineParser.set(line);
-            parseLine();
-        }
-    }
-
-    // finish last group
-    UnifiedMaterialGroup& lastGroup = out_model.material_groups[out_model.material_groups.size() - 1];
-    lastGroup.numFaces              = faces.size() - lastGroup.startFace;
-
-
-    // remove groups with 0 faces
-    out_model.material_groups.erase(std::remove_if(out_model.material_groups.begin(), out_model.material_groups.end(),
-                                                   [](const UnifiedMaterialGroup& otg) { return otg.numFaces == 0; }),
-                                    out_model.material_groups.end());
-
-    std::cout << "[ObjModelLoader] Done.  "
-              << "V " << vertices.size() << " N " << normals.size() << " T " << texCoords.size() << " F "
-              << faces.size() << " Material Groups " << out_model.material_groups.size() << std::endl;
-
-
-
-    //    std::cout<<"number of vertices "<<vertices.size()<<" number of faces "<<faces.size()<<endl;
-    createVertexIndexList();
-    //    std::cout<<"number of vertices "<<outVertices.size()<<" number of faces "<<outTriangles.size()<<endl;
-    separateVerticesByGroup();
-    //    std::cout<<"number of vertices "<<outVertices.size()<<" number of faces "<<outTriangles.size()<<endl;
-
-    calculateMissingNormals();
-
-    //    std::cout<<"objloader finished :)"<<endl;
-    return true;
+    return c == ' ' || c == '\t' || c == '\r' || c == ',';
 }
 
-void ObjModelLoader::separateVerticesByGroup()
+inline const char* SkipSeparators(const char* p, const char* end)
 {
-    // make sure faces from different triangle groups do not reference the same vertex
-    // needs to be called after createVertexIndexList()
-#if 0
-
-    std::vector<int> vertexReference(outVertices.size(), INVALID_VERTEX_ID);
-
-    for (int t = 0; t < (int)out_model.material_groups.size(); ++t)
-    {
-        UnifiedMaterialGroup& tg = out_model.material_groups[t];
-        for (int i = 0; i < tg.numFaces; ++i)
-        {
-            ivec3& face = out_model.triangles[i + tg.startFace];
-
-            for (int j = 0; j < 3; ++j)
-            {
-                int index = face[j];
-                if (vertexReference[index] == INVALID_VERTEX_ID) vertexReference[index] = t;
-                if (vertexReference[index] != t)
-                {
-                    // duplicate vertices
-                    VertexNT v   = outVertices[index];
-                    int newIndex = outVertices.size();
-                    outVertices.push_back(v);
-                    face[j] = newIndex;
-                    vertexReference.push_back(t);
-                    //                    SAIGA_ASSERT(0);
-                }
-            }
-        }
-    }
-#endif
+    while (p < end && IsSeparator(*p)) ++p;
+    return p;
 }
 
-void ObjModelLoader::calculateMissingNormals()
+inline const char* TokenEnd(const char* p, const char* end)
 {
-#if 0
-    for (auto tri : out_model.triangles)
-    {
-        auto& v1 = outVertices[tri[0]];
-        auto& v2 = outVertices[tri[1]];
-        auto& v3 = outVertices[tri[2]];
-
-        vec3 normal = normalize(cross(make_vec3(v3.position - v1.position), make_vec3(v2.position - v1.position)));
-
-        if (v1.normal == vec4(0, 0, 0, 0)) v1.normal = make_vec4(normal, 0);
-        if (v2.normal == vec4(0, 0, 0, 0)) v2.normal = make_vec4(normal, 0);
-        if (v3.normal == vec4(0, 0, 0, 0)) v3.normal = make_vec4(normal, 0);
-    }
-#endif
+    while (p < end && !IsSeparator(*p)) ++p;
+    return p;
 }
 
-#if 0
-void ObjModelLoader::computeVertexColorAndData()
+// Parses the next number of the line. Returns false if there is no valid number.
+template <typename T>
+inline bool ParseNumber(const char*& p, const char* end, T& value)
 {
-    vertexColors.resize(outVertices.size(), make_vec4(1));
-    vertexData.resize(outVertices.size(), make_vec4(0));
-
-    for (UnifiedMaterialGroup& tg : out_model.material_groups)
-    {
-        for (int i = 0; i < tg.numFaces; ++i)
-        {
-            ivec3& face = out_model.triangles[i + tg.startFace];
-            for (int f = 0; f < 3; ++f)
-            {
-                int index            = face[f];
-                vertexColors[index]  = out_model.materials[tg.materialId].color_diffuse;
-                float spec           = dot(out_model.materials[tg.materialId].color_specular, make_vec4(1)) / 4.0f;
-                vertexData[index][0] = spec;
-            }
-        }
-    }
+    p = SkipSeparators(p, end);
+    if (p < end && *p == '+') ++p;
+    auto [ptr, ec] = std::from_chars(p, end, value);
+    if (ec != std::errc()) return false;
+    p = ptr;
+    return true;
 }
-void ObjModelLoader::toTriangleMesh(TriangleMesh<VertexNC, uint32_t>& mesh)
-{
-    if (vertexColors.empty())
-    {
-        computeVertexColorAndData();
-    }
 
-    SAIGA_ASSERT(vertexColors.size() == outVertices.size());
-    mesh.faces.reserve( out_model.triangles.size());
-    for (ivec3& oj :  out_model.triangles)
+// Parses one index of a face corner (the text between two '/').
+// Positive indices are converted to 0-based indices. Negative indices are converted to an index relative to the chunk
+// begin and the bit 'component' is set in 'relative_mask'.
+inline bool ParseCornerIndex(const char*& p, const char* end, int count, int& index, int& relative_mask, int component)
+{
+    if (p == end || *p == '/') return true;
+    int value;
+    auto [ptr, ec] = std::from_chars(p, end, value);
+    if (ec != std::errc() || value == 0) return false;
+    p = ptr;
+    if (value > 0)
     {
-        mesh.addFace(oj(0), oj(1), oj(2));
+        index = value - 1;
     }
-
-    mesh.vertices.reserve(outTriangles.size());
-    for (unsigned int i = 0; i < outVertices.size(); ++i)
+    else
     {
-        auto& v = outVertices[i];
-        VertexNC vn;
-        vn.position = v.position;
-        vn.normal   = v.normal;
-        vn.color    = vertexColors[i];
-        vn.data     = vertexData[i];
-        mesh.addVertex(vn);
+        index = count + value;
+        relative_mask |= 1 << component;
     }
+    return true;
 }
 
-void ObjModelLoader::toTriangleMesh(TriangleMesh<VertexNTD, uint32_t>& mesh)
+// Parses one corner of a face. Examples:
+// v1/vt1/vn1        12/51/1
+// v1//vn1           51//4
+inline bool ParseCorner(const char* p, const char* end, const ObjChunk& chunk, IndexedVertex2& iv, int& relative_mask)
 {
-    //    SAIGA_ASSERT(texCoords.size() == outVertices.size());
-    if (vertexColors.empty())
-    {
-        computeVertexColorAndData();
-    }
-    SAIGA_ASSERT(vertexData.size() == outVertices.size());
-
-    mesh.faces.reserve(outTriangles.size());
-    for (ivec3& oj : outTriangles)
+    relative_mask = 0;
+    if (!ParseCornerIndex(p, end, chunk.vertices.size(), iv.v, relative_mask, 0)) return false;
+    if (p < end && *p == '/')
     {
-        mesh.addFace(oj(0), oj(1), oj(2));
+        ++p;
+        if (!ParseCornerIndex(p, end, chunk.tex_coords.size(), iv.t, relative_mask, 1)) return false;
     }
-
-    mesh.vertices.reserve(outTriangles.size());
-    for (unsigned int i = 0; i < outVertices.size(); ++i)
+    if (p < end && *p == '/')
     {
-        auto& v = outVertices[i];
-        VertexNTD vn;
-        vn.position = v.position;
-        vn.normal   = v.normal;
-        vn.texture  = v.texture;
-        vn.data     = vertexData[i];
-        mesh.addVertex(vn);
+        ++p;
+        if (!ParseCornerIndex(p, end, chunk.normals.size(), iv.n, relative_mask, 2)) return false;
     }
+    return p == end && iv.v != ObjModelLoader::INVALID_VERTEX_ID;
 }
-#endif
 
-void ObjModelLoader::createVertexIndexList()
+void ParseChunk(const char* p, const char* end, ObjChunk& chunk)
 {
-#if 0
-    std::vector<bool> vertices_used(vertices.size(), false);
+    while (p < end)
+    {
+        const char* line_end = (const char*)std::memchr(p, '\n', end - p);
+        if (!line_end) line_end = end;
 
-    outVertices.resize(vertices.size());
+        const char* key_begin = SkipSeparators(p, line_end);
+        const char* key_end   = TokenEnd(key_begin, line_end);
+        std::string_view key(key_begin, key_end - key_begin);
+        const char* q = key_end;
 
-    for (std::vector<IndexedVertex2>& f : faces)
-    {
-        ivec3 fa;
-        for (int i = 0; i < 3; i++)
+        bool ok = true;
+        if (key == "v")
         {
-            IndexedVertex2& currentVertex = f[i];
-            int vert                      = currentVertex.v;
-            int norm                      = currentVertex.n;
-            int tex                       = currentVertex.t;
-
-            VertexNT verte;
-            if (vert >= 0)
+            vec3 v;
+            ok = ParseNumber(q, line_end, v(0)) && ParseNumber(q, line_end, v(1)) && ParseNumber(q, line_end, v(2));
+            // Up to 4 optional numbers:
+            //   v x y z w          (the weight w is ignored)
+            //   v x y z r g b      (vertex color extension)
+            //   v x y z r g b a
+            vec4 c(1, 1, 1, 1);
+            int extra = 0;
+            while (ok && extra < 4 && ParseNumber(q, line_end, c(extra))) ++extra;
+            if (extra == 2)
             {
-                SAIGA_ASSERT(vert < (int)vertices.size());
-                verte.position = make_vec4(vertices[vert], 1);
+                ok = false;
             }
-            if (norm >= 0)
+            else if (extra >= 3)
             {
-                SAIGA_ASSERT(norm < (int)normals.size());
-                verte.normal = make_vec4(normals[norm], 0);
+                chunk.colors.resize(chunk.vertices.size(), vec4(1, 1, 1, 1));
+                chunk.colors.push_back(c);
             }
-            if (tex >= 0)
+            else if (!chunk.colors.empty())
             {
-                SAIGA_ASSERT(tex < (int)texCoords.size());
-                verte.texture = texCoords[tex];
+                chunk.colors.push_back(vec4(1, 1, 1, 1));
             }
+            chunk.vertices.push_back(v);
+        }
+        else if (key == "vt")
+        {
+            vec2 t;
+            ok = ParseNumber(q, line_end, t(0)) && ParseNumber(q, line_end, t(1));
+            chunk.tex_coords.push_back(t);
+        }
+        else if (key == "vn")
+        {
+            vec3 n;
+            ok = ParseNumber(q, line_end, n(0)) && ParseNumber(q, line_end, n(1)) && ParseNumber(q, line_end, n(2));
+            chunk.normals.push_back(n);
+        }
+        else if (key == "f")
+        {
+            // Triangulate as a fan: (0,1,2), (2,3,0), (3,4,0), ...
+            IndexedVertex2 first, last;
+            int first_mask = 0, last_mask = 0;
+            int count      = 0;
 
+            auto add_corner = [&chunk](const IndexedVertex2& iv, int relative_mask) {
+                if (relative_mask) chunk.relative.push_back({(int)chunk.corners.size(), relative_mask});
+                chunk.corners.push_back(iv);
+            };
 
-            int index = INVALID_VERTEX_ID;
-            if (vertices_used[vert])
+            while (ok)
             {
-                if (verte == outVertices[vert])
+                q = SkipSeparators(q, line_end);
+                if (q == line_end) break;
+                const char* token_end = TokenEnd(q, line_end);
+
+                IndexedVertex2 iv;
+                int mask;
+                ok = ParseCorner(q, token_end, chunk, iv, mask);
+                q  = token_end;
+
+                if (count < 3)
+                {
+                    if (count == 0)
+                    {
+                        first      = iv;
+                        first_mask = mask;
+                    }
+                    add_corner(iv, mask);
+                }
+                else
                 {
-                    index = vert;
+                    add_corner(last, last_mask);
+                    add_corner(iv, mask);
+                    add_corner(first, first_mask);
                 }
+                last      = iv;
+                last_mask = mask;
+                count++;
             }
-            else
+            ok = ok && count >= 3;
+        }
+        else if (key == "usemtl" || key == "mtllib")
+        {
+            q               = SkipSeparators(q, line_end);
+            const char* e   = line_end;
+            while (e > q && IsSeparator(e[-1])) --e;
+            std::string name(q, e - q);
+            if (key == "usemtl")
             {
-                outVertices[vert]   = verte;
-                index               = vert;
-                vertices_used[vert] = true;
+                chunk.material_ranges.push_back({int(chunk.corners.size() / 3), name});
             }
-
-            if (index == INVALID_VERTEX_ID)
+            else
             {
-                index = outVertices.size();
-                outVertices.push_back(verte);
+                chunk.mtllibs.push_back(name);
             }
-            fa[i] = index;
         }
+        // Everything else (comments, g, o, s, ...) is ignored
 
-        out_model.triangles.push_back(fa);
+        if (!ok)
+        {
+            std::cerr << "[ObjModelLoader] Invalid line: " << std::string(p, line_end) << std::endl;
+            chunk.error = true;
+            return;
+        }
+        p = line_end + 1;
     }
-#endif
 }
 
-std::vector<std::vector<ObjModelLoader::IndexedVertex2>> ObjModelLoader::triangulateFace(
-    const std::vector<IndexedVertex2>& f)
+struct CornerKey
 {
-    std::vector<std::vector<IndexedVertex2>> newFaces;
-
-    // more than 3 indices -> triangulate
-    std::vector<IndexedVertex2> face;
-    int cornerCount = 1;
-    IndexedVertex2 startVertex, lastVertex;
-    for (const IndexedVertex2& currentVertex : f)
+    int group, v, t, n;
+    bool operator==(const CornerKey& other) const
     {
-        if (cornerCount <= 3)
-        {
-            if (cornerCount == 1) startVertex = currentVertex;
-            face.push_back(currentVertex);
-            if (cornerCount == 3) newFaces.push_back(face);
-        }
-        else
-        {
-            face.resize(3);
-            face[0] = lastVertex;
-            face[1] = currentVertex;
-            face[2] = startVertex;
-            newFaces.push_back(face);
-        }
-
-        lastVertex = currentVertex;
-        cornerCount++;
+        return group == other.group && v == other.v && t == other.t && n == other.n;
     }
-    return newFaces;
-}
+};
 
-void ObjModelLoader::parseLine()
+struct CornerKeyHash
 {
-    auto header = lineParser.next();
-
-    if (header == "#")
+    size_t operator()(const CornerKey& k) const
     {
+        uint64_t h = uint64_t(uint32_t(k.v)) * 0x9E3779B97F4A7C15ull;
+        h ^= (uint64_t(uint32_t(k.t)) + 0x632BE59BD9B4E019ull + (h << 6) + (h >> 2)) * 0xC2B2AE3D27D4EB4Full;
+        h ^= (uint64_t(uint32_t(k.n)) + 0x85EBCA77C2B2AE63ull + (h << 6) + (h >> 2)) * 0x165667B19E3779F9ull;
+        h ^= uint64_t(uint32_t(k.group)) + (h << 6) + (h >> 2);
+        return h ^ (h >> 29);
     }
-    else if (header == "usemtl")
-    {
-        // finish current group and create new one
-        if (!out_model.material_groups.empty())
-        {
-            UnifiedMaterialGroup& currentGroup = out_model.material_groups[out_model.material_groups.size() - 1];
-            currentGroup.numFaces              = faces.size() - currentGroup.startFace;
-        }
-        UnifiedMaterialGroup newGroup;
-        newGroup.startFace = faces.size();
+};
 
-        //         newGroup.material  = materialLoader.getMaterial(std::string(lineParser.next()));
-        //        newGroup.materialId = materialLoader.getMaterialId(std::string(lineParser.next()));
+}  // namespace
+
+
+ObjModelLoader::ObjModelLoader(const std::string& file) : file(file)
+{
+    loadFile(file);
+}
 
-        std::string mtl_name = std::string(lineParser.next());
-        int mtl_id           = -1;
-        for (size_t i = 0; i < out_model.materials.size(); ++i)
-        {
-            if (out_model.materials[i].name == mtl_name)
-            {
-                mtl_id = i;
-                break;
-            }
-        }
-        newGroup.materialId = mtl_id;
 
-        out_model.material_groups.push_back(newGroup);
+bool ObjModelLoader::loadFile(const std::string& _file)
+{
+    this->file = SearchPathes::model(_file);
+    if (file == "")
+    {
+        std::cerr << "Could not open file " << _file << std::endl;
+        std::cerr << SearchPathes::model << std::endl;
+        return false;
     }
-    else if (header == "mtllib")
+
+    std::cout << "[ObjModelLoader] Loading " << file << std::endl;
+
+    MemoryMappedFile mapped_file(file);
+    if (!mapped_file.valid())
     {
-        FileChecker fc;
+        std::cerr << "Could not open file " << file << std::endl;
+        return false;
+    }
+    mapped_file.adviseSequential();
+
+    const char* data = mapped_file.data();
+    size_t size      = mapped_file.size();
 
-        std::string mtl_file = fc.getRelative(file, std::string(lineParser.next()));
+    // Split the file into chunks of at least 1MB, which end at a line break.
+    constexpr size_t min_chunk_size = 1024 * 1024;
+    int num_threads                 = OMP::getMaxThreads();
+    int num_chunks                  = std::max<size_t>(1, std::min<size_t>(size / min_chunk_size, num_threads * 8));
 
-        out_model.materials = LoadMTL(mtl_file);
+    std::vector<size_t> chunk_begin(num_chunks + 1, size);
+    chunk_begin[0] = 0;
+    for (int i = 1; i < num_chunks; ++i)
+    {
+        size_t pos = std::max(chunk_begin[i - 1], size * i / num_chunks);
+        auto nl    = (const char*)std::memchr(data + pos, '\n', size - pos);
+        chunk_begin[i] = nl ? nl - data + 1 : size;
     }
-    else if (header == "g")
+
+    std::vector<ObjChunk> chunks(num_chunks);
+#pragma omp parallel for schedule(dynamic, 1)
+    for (int i = 0; i < num_chunks; ++i)
     {
+        ParseChunk(data + chunk_begin[i], data + chunk_begin[i + 1], chunks[i]);
     }
-    else if (header == "o")
+
+    // Merge the chunks
+    std::vector<int> vertex_offset(num_chunks + 1, 0), normal_offset(num_chunks + 1, 0),
+        tc_offset(num_chunks + 1, 0);
+    std::vector<size_t> corner_offset(num_chunks + 1, 0);
+    bool has_color = false;
+    for (int i = 0; i < num_chunks; ++i)
     {
+        auto& c = chunks[i];
+        if (c.error) return false;
+        vertex_offset[i + 1] = vertex_offset[i] + c.vertices.size();
+        normal_offset[i + 1] = normal_offset[i] + c.normals.size();
+        tc_offset[i + 1]     = tc_offset[i] + c.tex_coords.size();
+        corner_offset[i + 1] = corner_offset[i] + c.corners.size();
+        has_color |= !c.colors.empty();
     }
-    else if (header == "s")
+
+    material_ranges.clear();
+    material_ranges.push_back({0, ""});
+    std::vector<std::string> mtllibs;
+    for (int i = 0; i < num_chunks; ++i)
     {
+        for (auto r : chunks[i].material_ranges)
+        {
+            r.start_triangle += corner_offset[i] / 3;
+            material_ranges.push_back(r);
+        }
+        mtllibs.insert(mtllibs.end(), chunks[i].mtllibs.begin(), chunks[i].mtllibs.end());
     }
-    else if (header == "v")
+
+    vertices.resize(vertex_offset.back());
+    normals.resize(normal_offset.back());
+    texCoords.resize(tc_offset.back());
+    corners.resize(corner_offset.back());
+    vertex_colors.clear();
+    if (has_color) vertex_colors.resize(vertices.size(), vec4(1, 1, 1, 1));
+
+#pragma omp parallel for schedule(dynamic, 1)
+    for (int i = 0; i < num_chunks; ++i)
     {
-        vec3 v;
-        v(0) = to_double(lineParser.next());
-        v(1) = to_double(lineParser.next());
-        v(2) = to_double(lineParser.next());
-        vertices.push_back(v);
+        auto& c = chunks[i];
+        for (auto [corner, mask] : c.relative)
+        {
+            auto& iv = c.corners[corner];
+            if (mask & 1) iv.v += vertex_offset[i];
+            if (mask & 2) iv.t += tc_offset[i];
+            if (mask & 4) iv.n += normal_offset[i];
+        }
+        std::copy(c.vertices.begin(), c.vertices.end(), vertices.begin() + vertex_offset[i]);
+        std::copy(c.colors.begin(), c.colors.end(), vertex_colors.begin() + vertex_offset[i]);
+        std::copy(c.normals.begin(), c.normals.end(), normals.begin() + normal_offset[i]);
+        std::copy(c.tex_coords.begin(), c.tex_coords.end(), texCoords.begin() + tc_offset[i]);
+        std::copy(c.corners.begin(), c.corners.end(), corners.begin() + corner_offset[i]);
+        c = ObjChunk();  // free the memory early
     }
-    else if (header == "vt")
+
+    out_model = UnifiedModel();
+    for (auto& mtllib : mtllibs)
     {
-        vec2 v;
-        v(0) = to_double(lineParser.next());
-        v(1) = to_double(lineParser.next());
-        texCoords.push_back(v);
+        FileChecker fc;
+        auto materials = LoadMTL(fc.getRelative(file, mtllib));
+        out_model.materials.insert(out_model.materials.end(), materials.begin(), materials.end());
     }
-    else if (header == "vn")
+
+    // Check the indices
+    int num_vertices = vertices.size(), num_normals = normals.size(), num_tc = texCoords.size();
+    int64_t invalid = 0;
+#pragma omp parallel for reduction(+ : invalid)
+    for (int64_t i = 0; i < (int64_t)corners.size(); ++i)
     {
-        vec3 v;
-        v(0) = to_double(lineParser.next());
-        v(1) = to_double(lineParser.next());
-        v(2) = to_double(lineParser.next());
-        normals.push_back(v);
+        auto& iv = corners[i];
+        invalid += iv.v < 0 || iv.v >= num_vertices;
+        invalid += iv.t != INVALID_VERTEX_ID && (iv.t < 0 || iv.t >= num_tc);
+        invalid += iv.n != INVALID_VERTEX_ID && (iv.n < 0 || iv.n >= num_normals);
     }
-    else if (header == "f")
+    if (invalid > 0)
     {
-        parseF();
+        std::cerr << "[ObjModelLoader] " << invalid << " invalid face indices in " << file << std::endl;
+        return false;
     }
-}
 
+    createVertexIndexList();
 
+    std::cout << "[ObjModelLoader] Done.  "
+              << "V " << vertices.size() << " N " << normals.size() << " T " << texCoords.size() << " F "
+              << corners.size() / 3 << " Material Groups " << out_model.material_groups.size() << std::endl;
+    return true;
+}
 
-void ObjModelLoader::parseF()
+void ObjModelLoader::createVertexIndexList()
 {
-    ivs.clear();
+    int num_triangles = corners.size() / 3;
 
-    std::string_view f = lineParser.next();
-    while (!f.empty())
+    // The non-empty triangle ranges [start, end) and their material
+    std::vector<std::pair<int, int>> group_range;
+    std::vector<std::string> group_material;
+    for (int i = 0; i < (int)material_ranges.size(); ++i)
     {
-        ivs.push_back(parseIV(f));
-        f = lineParser.next();
+        int start = material_ranges[i].start_triangle;
+        int end   = i + 1 < (int)material_ranges.size() ? material_ranges[i + 1].start_triangle : num_triangles;
+        if (end > start)
+        {
+            group_range.push_back({start, end});
+            group_material.push_back(material_ranges[i].material);
+        }
     }
+    int num_groups = group_range.size();
 
-    auto nf = triangulateFace(ivs);
+    int64_t n = corners.size();
+    std::vector<CornerKey> keys(n);
+    std::vector<size_t> hashes(n);
+    for (int g = 0; g < num_groups; ++g)
+    {
+#pragma omp parallel for
+        for (int64_t i = int64_t(group_range[g].first) * 3; i < int64_t(group_range[g].second) * 3; ++i)
+        {
+            auto& iv  = corners[i];
+            keys[i]   = {g, iv.v, iv.t, iv.n};
+            hashes[i] = CornerKeyHash()(keys[i]);
+        }
+    }
 
-    // relative indexing, when the index is negativ
-    for (auto& f : nf)
+    // The keys are partitioned by their hash. Each thread deduplicates one partition and stores for each corner the
+    // first corner with the same key.
+    std::vector<int> first_corner(n);
+#pragma omp parallel
     {
-        for (auto& i : f)
+        int partitions = OMP::getNumThreads();
+        int partition  = OMP::getThreadNum();
+
+        // Open addressing with linear probing. The table stores corner indices.
+        size_t capacity = 64;
+        while (capacity < size_t(2 * (n / partitions + 1))) capacity *= 2;
+        std::vector<int> table(capacity, -1);
+        size_t mask = capacity - 1;
+
+        for (int64_t i = 0; i < n; ++i)
         {
-            if (i.v < 0 && i.v != INVALID_VERTEX_ID)
+            if (hashes[i] % partitions != (size_t)partition) continue;
+            size_t slot = (hashes[i] / partitions) & mask;
+            while (table[slot] != -1 && !(keys[table[slot]] == keys[i]))
             {
-                int absIndex = vertices.size() + i.v + 1;
-                i.v          = absIndex;
+                slot = (slot + 1) & mask;
             }
-            if (i.n < 0 && i.n != INVALID_VERTEX_ID)
+            if (table[slot] == -1) table[slot] = i;
+            first_corner[i] = table[slot];
+        }
+    }
+
+    // The vertices are numbered in the order of their first occurrence.
+    // Therefore the vertices of a group are a contiguous range.
+    std::vector<int> vertex_id(n);
+    std::vector<int> vertex_corner;
+    for (int64_t i = 0; i < n; ++i)
+    {
+        if (first_corner[i] == i)
+        {
+            vertex_id[i] = vertex_corner.size();
+            vertex_corner.push_back(i);
+        }
+    }
+
+    std::vector<int> group_first_vertex(num_groups + 1, vertex_corner.size());
+    for (int g = num_groups - 1; g >= 0; --g)
+    {
+        group_first_vertex[g] = vertex_id[int64_t(group_range[g].first) * 3];
+    }
+
+    // Meshes without material get a default material
+    int default_material = -1;
+
+    out_model.mesh.resize(num_groups);
+    out_model.material_groups.resize(num_groups);
+    int start_face = 0;
+    for (int g = 0; g < num_groups; ++g)
+    {
+        auto& mesh = out_model.mesh[g];
+
+        int material_id = -1;
+        for (int m = 0; m < (int)out_model.materials.size(); ++m)
+        {
+            if (out_model.materials[m].name == group_material[g])
             {
-                int absIndex = normals.size() + i.n + 1;
-                i.n          = absIndex;
+                material_id = m;
+                break;
             }
-            if (i.t < 0 && i.t != INVALID_VERTEX_ID)
+        }
+        if (material_id == -1)
+        {
+            if (default_material == -1)
             {
-                int absIndex = texCoords.size() + i.t + 1;
-                i.t          = absIndex;
+                default_material = out_model.materials.size();
+                out_model.materials.push_back(UnifiedMaterial("default"));
             }
+            material_id = default_material;
         }
-    }
+        mesh.material_id = material_id;
 
-    faces.insert(faces.end(), nf.begin(), nf.end());
-}
+        int v_begin = group_first_vertex[g];
+        int v_end   = group_first_vertex[g + 1];
+        int t_begin = group_range[g].first;
+        int t_end   = group_range[g].second;
+
+        bool has_normal = false, has_tc = false;
+        for (int v = v_begin; v < v_end; ++v)
+        {
+            auto& iv = corners[vertex_corner[v]];
+            has_normal |= iv.n != INVALID_VERTEX_ID;
+            has_tc |= iv.t != INVALID_VERTEX_ID;
+        }
+
+        mesh.position.resize(v_end - v_begin);
+        if (has_normal) mesh.normal.resize(v_end - v_begin, vec3::Zero());
+        if (has_tc) mesh.texture_coordinates.resize(v_end - v_begin, vec2::Zero());
+        if (!vertex_colors.empty()) mesh.color.resize(v_end - v_begin);
+
+#pragma omp parallel for
+        for (int v = v_begin; v < v_end; ++v)
+        {
+            auto& iv = corners[vertex_corner[v]];
+            int i    = v - v_begin;
+
+            mesh.position[i] = vertices[iv.v];
+            if (has_normal && iv.n != INVALID_VERTEX_ID) mesh.normal[i] = normals[iv.n];
+            if (has_tc && iv.t != INVALID_VERTEX_ID) mesh.texture_coordinates[i] = texCoords[iv.t];
+            if (!vertex_colors.empty()) mesh.color[i] = vertex_colors[iv.v];
+        }
+
+        mesh.triangles.resize(t_end - t_begin);
+#pragma omp parallel for
+        for (int t = t_begin; t < t_end; ++t)
+        {
+            int64_t c = int64_t(t) * 3;
+            mesh.triangles[t - t_begin] =
+                ivec3(vertex_id[first_corner[c]] - v_begin, vertex_id[first_corner[c + 1]] - v_begin,
+                      vertex_id[first_corner[c + 2]] - v_begin);
+        }
 
+        if (!has_normal) mesh.CalculateVertexNormals();
 
+        auto& mg      = out_model.material_groups[g];
+        mg.startFace  = start_face;
+        mg.numFaces   = t_end - t_begin;
+        mg.materialId = material_id;
+        start_face += mg.numFaces;
+    }
+}
 
 }  // namespace Saiga
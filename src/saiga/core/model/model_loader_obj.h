@@ -18,6 +18,16 @@ namespace Saiga
 SAIGA_CORE_API std::vector<UnifiedMaterial> LoadMTL(const std::string& file);
 
 
+/**
+ * Loader for Wavefront OBJ files.
+ *
+ * The file is memory mapped and split into newline aligned chunks, which are parsed in parallel. Polygons are
+ * triangulated as a fan and negative (relative) indices are supported. Vertex colors ("v x y z r g b") are loaded
+ * if present.
+ *
+ * Each material group (usemtl) becomes one UnifiedMesh of out_model. The (position, texture, normal) index triples
+ * are deduplicated per group with a parallel hash, so different meshes never share a vertex.
+ */
 class SAIGA_CORE_API ObjModelLoader
 {
    public:
@@ -28,25 +38,9 @@ class SAIGA_CORE_API ObjModelLoader
     ObjModelLoader() {}
     ObjModelLoader(const std::string& file);
 
-
-
     bool loadFile(const std::string& file);
 
-    //    AlignedVector<vec4> vertexData;    // x: specular
-    //    AlignedVector<vec4> vertexColors;  // only when given by the material. Otherwise: white!
-    std::vector<VertexNT> outVertices;
-    // std::vector<ivec3> outTriangles;
-
     UnifiedModel out_model;
-    //    std::vector<UnifiedMaterialGroup> triangleGroups;
-    //    std::vector<UnifiedMaterial> materials;
-    void separateVerticesByGroup();
-    void calculateMissingNormals();
-    void computeVertexColorAndData();
-
-    //    void toTriangleMesh(TriangleMesh<VertexNC, uint32_t>& mesh);
-    //    void toTriangleMesh(TriangleMesh<VertexNTD, uint32_t>& mesh);
-
 
     static constexpr int INVALID_VERTEX_ID = -911365965;
     struct SAIGA_CORE_API IndexedVertex2
@@ -56,26 +50,25 @@ class SAIGA_CORE_API ObjModelLoader
         int t = INVALID_VERTEX_ID;
     };
 
+    // A range of triangles with the same material
+    struct MaterialRange
+    {
+        int start_triangle;
+        std::string material;
+    };
 
    private:
     std::vector<vec3> vertices;
+    std::vector<vec4> vertex_colors;
     std::vector<vec3> normals;
     std::vector<vec2> texCoords;
 
-    std::vector<std::vector<IndexedVertex2>> faces;
-
+    // The 3 corners of each triangle
+    std::vector<IndexedVertex2> corners;
+    std::vector<MaterialRange> material_ranges;
 
+    // Builds the meshes of out_model from the corners.
     void createVertexIndexList();
-
-    std::vector<std::vector<IndexedVertex2>> triangulateFace(const std::vector<IndexedVertex2>& face);
-
-
-    // ================== Parser Tmp Variables ================
-
-    std::vector<IndexedVertex2> ivs;
-    void parseLine();
-
-    void parseF();
 };
 
 }  // namespace Saiga
@@ -6,224 +6,904 @@
 
 #include "model_loader_ply.h"
 
-#include "saiga/core/util/color.h"
+#include "saiga/core/util/MemoryMappedFile.h"
+#include "saiga/core/util/Thread/omp.h"
 #include "saiga/core/util/fileChecker.h"
 
 #include "internal/noGraphicsAPI.h"
 
 #include <algorithm>
+#include <array>
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <sstream>
 
 namespace Saiga
 {
-PLYLoader::PLYLoader(const std::string& _file)
+namespace
 {
-    auto file = SearchPathes::model(_file);
-    std::ifstream stream(file, std::ios::binary);
+using Type     = PLYLoader::Type;
+using Element  = PLYLoader::Element;
+using Property = PLYLoader::Property;
 
-    if (!stream.is_open())
+int TypeSize(Type type)
+{
+    switch (type)
     {
-        std::cerr << "Could not open file " << file << std::endl;
-        throw std::runtime_error("invalid file: " + file + ", " + _file);
+        case Type::Int8:
+        case Type::UInt8:
+            return 1;
+        case Type::Int16:
+        case Type::UInt16:
+            return 2;
+        case Type::Int32:
+        case Type::UInt32:
+        case Type::Float32:
+            return 4;
+        case Type::Float64:
+            return 8;
     }
+    return 0;
+}
 
-    // open the file:
-    //         std::ifstream file(filename, std::ios::binary);
+bool ParseType(const std::string& str, Type& type)
+{
+    static const std::pair<const char*, Type> names[] = {
+        {"char", Type::Int8},     {"int8", Type::Int8},       {"uchar", Type::UInt8},    {"uint8", Type::UInt8},
+        {"short", Type::Int16},   {"int16", Type::Int16},     {"ushort", Type::UInt16},  {"uint16", Type::UInt16},
+        {"int", Type::Int32},     {"int32", Type::Int32},     {"uint", Type::UInt32},    {"uint32", Type::UInt32},
+        {"float", Type::Float32}, {"float32", Type::Float32}, {"double", Type::Float64}, {"float64", Type::Float64}};
+    for (auto& [name, t] : names)
+    {
+        if (str == name)
+        {
+            type = t;
+            return true;
+        }
+    }
+    return false;
+}
 
-    // read the data:
-    data = std::vector<char>((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+// The scale which maps an integer color channel to [0,1]
+float ColorScale(Type type)
+{
+    switch (type)
+    {
+        case Type::UInt8:
+            return 1.f / 255.f;
+        case Type::UInt16:
+            return 1.f / 65535.f;
+        default:
+            return 1.f;
+    }
+}
 
-    //         std::cout << "filesize: " << data.size() << std::endl;
+template <typename T>
+inline T LoadRaw(const char* p, bool swap)
+{
+    char tmp[sizeof(T)];
+    std::memcpy(tmp, p, sizeof(T));
+    if (swap) std::reverse(tmp, tmp + sizeof(T));
+    T value;
+    std::memcpy(&value, tmp, sizeof(T));
+    return value;
+}
 
-    parseHeader();
-    parseMeshBinary();
+// Reads one binary value of the given type and converts it to T
+template <typename T>
+inline T LoadBinary(const char* p, Type type, bool swap)
+{
+    switch (type)
+    {
+        case Type::Int8:
+            return T(LoadRaw<int8_t>(p, swap));
+        case Type::UInt8:
+            return T(LoadRaw<uint8_t>(p, swap));
+        case Type::Int16:
+            return T(LoadRaw<int16_t>(p, swap));
+        case Type::UInt16:
+            return T(LoadRaw<uint16_t>(p, swap));
+        case Type::Int32:
+            return T(LoadRaw<int32_t>(p, swap));
+        case Type::UInt32:
+            return T(LoadRaw<uint32_t>(p, swap));
+        case Type::Float32:
+            return T(LoadRaw<float>(p, swap));
+        case Type::Float64:
+            return T(LoadRaw<double>(p, swap));
+    }
+    return T(0);
 }
 
-int PLYLoader::sizeoftype(std::string t)
+// The size of one row in bytes or -1 if the element contains a list
+int FixedRowSize(const Element& element)
 {
-    if (t == "float" || t == "int")
+    int size = 0;
+    for (auto& p : element.properties)
     {
-        return 4;
+        if (p.is_list) return -1;
+        size += TypeSize(p.type);
     }
-    if (t == "uchar")
+    return size;
+}
+
+// Returns the end of a binary row or nullptr if it exceeds the file.
+const char* SkipBinaryRow(const Element& element, const char* p, const char* end, bool swap)
+{
+    for (auto& prop : element.properties)
     {
-        return 1;
+        if (prop.is_list)
+        {
+            if (end - p < TypeSize(prop.count_type)) return nullptr;
+            int64_t n = LoadBinary<int64_t>(p, prop.count_type, swap);
+            p += TypeSize(prop.count_type);
+            if (n < 0 || (end - p) / TypeSize(prop.type) < n) return nullptr;
+            p += n * TypeSize(prop.type);
+        }
+        else
+        {
+            if (end - p < TypeSize(prop.type)) return nullptr;
+            p += TypeSize(prop.type);
+        }
     }
-    SAIGA_ASSERT(0);
-    return -1;
+    return p;
 }
 
-void PLYLoader::parseHeader()
+inline bool IsSpace(char c)
 {
-    // Note: the header is always in ascii and ends with the string end_header
-    std::string str2(data.begin(), data.end());
-    auto pos = str2.find("end_header");
+    return c == ' ' || c == '\t' || c == '\r';
+}
 
-    SAIGA_ASSERT(pos != std::string::npos);
+// Parses the next number of an ascii row. Returns false if there is no valid number.
+template <typename T>
+inline bool ParseNumber(const char*& p, const char* end, T& value)
+{
+    while (p < end && IsSpace(*p)) ++p;
+    if (p < end && *p == '+') ++p;
+    auto [ptr, ec] = std::from_chars(p, end, value);
+    if (ec != std::errc()) return false;
+    p = ptr;
+    return true;
+}
 
-    dataStart = pos;
-    // go until next newline
-    while (data[dataStart] != '\n')
+// Destination of a vertex property in the mesh arrays. Properties with dst == nullptr are skipped.
+struct PropertyTarget
+{
+    float* dst  = nullptr;
+    int stride  = 0;
+    float scale = 1;
+};
+
+// Triangulates the polygon as a fan and appends the triangles to 'out'.
+inline void AddPolygon(const int* indices, int n, std::vector<ivec3>& out)
+{
+    for (int i = 2; i < n; ++i)
     {
-        dataStart++;
+        out.push_back(ivec3(indices[0], indices[i - 1], indices[i]));
     }
-    dataStart++;
+}
 
-    std::string header(str2.begin(), str2.begin() + pos);
-    header.erase(std::remove(header.begin(), header.end(), '\r'), header.end());
+const ivec3 invalid_triangle(-1, -1, -1);
 
-    std::vector<std::string> headerLines = split(header, '\n');
+}  // namespace
 
-    SAIGA_ASSERT(headerLines[0] == "ply");
 
-    int elementStatus = -1;
-    for (auto l : headerLines)
+PLYLoader::PLYLoader(const std::string& _file, int vertex_flags, bool load_faces)
+    : vertex_flags(vertex_flags), load_faces(load_faces)
+{
+    auto file = SearchPathes::model(_file);
+    if (file.empty())
     {
-        //        std::cout << l << std::endl;
-        std::vector<std::string> splitLine = split(l, ' ');
+        throw std::runtime_error("Could not find file " + _file);
+    }
 
-        if (splitLine.size() == 0) continue;
+    MemoryMappedFile mapped_file(file);
+    if (!mapped_file.valid())
+    {
+        throw std::runtime_error("Could not open file " + file);
+    }
+    mapped_file.adviseSequential();
 
-        std::string& type = splitLine[0];
-        //            std::cout << "type " << type << std::endl;
+    const char* data = mapped_file.data();
+    size_t size      = mapped_file.size();
 
+    size_t body_begin;
+    parseHeader(data, size, body_begin);
 
-        if (type == "format")
+    if (format == Format::Ascii)
+    {
+        parseAscii(data + body_begin, data + size);
+    }
+    else
+    {
+        parseBinary(data + body_begin, data + size);
+    }
+    finish();
+
+    std::cout << "Loaded Ply mesh " << file << ": V " << mesh.NumVertices() << " F " << mesh.NumFaces() << std::endl;
+}
+
+void PLYLoader::parseHeader(const char* data, size_t size, size_t& body_begin)
+{
+    // The header is ascii and ends with the line "end_header"
+    size_t pos     = 0;
+    bool first     = true;
+    bool found_end = false;
+    while (pos < size && !found_end)
+    {
+        auto nl         = (const char*)std::memchr(data + pos, '\n', size - pos);
+        size_t line_end = nl ? nl - data : size;
+        std::istringstream line(std::string(data + pos, line_end - pos));
+        pos = line_end + 1;
+
+        std::string key;
+        line >> key;
+        if (first)
         {
-            SAIGA_ASSERT(splitLine[1] == "binary_little_endian");
+            if (key != "ply") throw std::runtime_error("Not a ply file (missing magic number)");
+            first = false;
+            continue;
         }
 
-        if (type == "element")
+        if (key == "format")
         {
-            std::string& ident = splitLine[1];
-
-            if (ident == "vertex")
+            std::string f;
+            line >> f;
+            if (f == "ascii")
+                format = Format::Ascii;
+            else if (f == "binary_little_endian")
+                format = Format::BinaryLittleEndian;
+            else if (f == "binary_big_endian")
+                format = Format::BinaryBigEndian;
+            else
+                throw std::runtime_error("Unknown ply format " + f);
+        }
+        else if (key == "element")
+        {
+            Element e;
+            line >> e.name >> e.count;
+            if (!line || e.count < 0) throw std::runtime_error("Invalid ply element definition");
+            elements.push_back(e);
+        }
+        else if (key == "property")
+        {
+            if (elements.empty()) throw std::runtime_error("Ply property without element");
+            Property p;
+            std::string type;
+            line >> type;
+            if (type == "list")
             {
-                vertexCount   = to_int(splitLine[2]);
-                elementStatus = 1;
+                std::string count_type;
+                line >> count_type >> type;
+                p.is_list = true;
+                if (!ParseType(count_type, p.count_type) || p.count_type == Type::Float32 ||
+                    p.count_type == Type::Float64)
+                {
+                    throw std::runtime_error("Invalid ply list count type " + count_type);
+                }
             }
-            if (ident == "face")
+            if (!ParseType(type, p.type)) throw std::runtime_error("Unknown ply type " + type);
+            line >> p.name;
+            elements.back().properties.push_back(p);
+        }
+        else if (key == "end_header")
+        {
+            found_end = true;
+        }
+        else if (key != "comment" && key != "obj_info" && !key.empty())
+        {
+            throw std::runtime_error("Unknown ply header line " + key);
+        }
+    }
+
+    if (!found_end) throw std::runtime_error("Ply header is not terminated by end_header");
+    body_begin = std::min(pos, size);
+}
+
+namespace
+{
+// The parser state shared by the ascii and binary parser
+struct PlyLayout
+{
+    int vertex_element = -1;
+    int face_element   = -1;
+    int face_property  = -1;
+    // The last element which has to be parsed
+    int last_element = -1;
+    std::vector<PropertyTarget> targets;
+};
+
+PlyLayout CreateLayout(const std::vector<Element>& elements, int vertex_flags, bool load_faces, UnifiedMesh& mesh)
+{
+    PlyLayout layout;
+    for (int i = 0; i < (int)elements.size(); ++i)
+    {
+        auto& e = elements[i];
+        if (e.name == "vertex" && layout.vertex_element == -1)
+        {
+            layout.vertex_element = i;
+        }
+        else if (e.name == "face" && load_faces && layout.face_element == -1)
+        {
+            for (int j = 0; j < (int)e.properties.size(); ++j)
             {
-                faceCount     = to_int(splitLine[2]);
-                elementStatus = 2;
+                auto& p = e.properties[j];
+                if (p.is_list && (p.name == "vertex_indices" || p.name == "vertex_index"))
+                {
+                    if (p.type == Type::Float32 || p.type == Type::Float64)
+                        throw std::runtime_error("Ply face indices must have an integer type");
+                    layout.face_element  = i;
+                    layout.face_property = j;
+                }
             }
         }
+    }
+    if (layout.vertex_element == -1) throw std::runtime_error("Ply file has no vertex element");
+    layout.last_element = std::max(layout.vertex_element, layout.face_element);
 
-        if (type == "property")
+    auto& vertex  = elements[layout.vertex_element];
+    int64_t n     = vertex.count;
+    auto find     = [&](std::initializer_list<const char*> names) -> int {
+        for (int j = 0; j < (int)vertex.properties.size(); ++j)
         {
-            SAIGA_ASSERT(elementStatus != -1);
-
-            if (elementStatus == 1)
+            for (auto name : names)
             {
-                // vertex property
-                VertexProperty vp;
-                vp.name = splitLine[2];
-                vp.type = splitLine[1];
-                vertexProperties.push_back(vp);
+                if (!vertex.properties[j].is_list && vertex.properties[j].name == name) return j;
             }
-            if (elementStatus == 2)
-            {
-                SAIGA_ASSERT(splitLine[1] == "list");
-                SAIGA_ASSERT(splitLine[4] == "vertex_indices");
+        }
+        return -1;
+    };
+    layout.targets.resize(vertex.properties.size());
 
-                faceVertexCountType = splitLine[2];
-                faceVertexIndexType = splitLine[3];
+    // Maps the properties 'ids' to the components of 'array'
+    auto project = [&](auto& array, std::initializer_list<int> ids, bool normalize) {
+        int c = 0;
+        for (int id : ids)
+        {
+            if (id >= 0)
+            {
+                auto& t  = layout.targets[id];
+                t.dst    = array.data()->data() + c;
+                t.stride = array.data()->size();
+                t.scale  = normalize ? ColorScale(vertex.properties[id].type) : 1.f;
             }
+            c++;
         }
-    }
-
+    };
 
-    //    std::cout << std::endl;
-    //    std::cout << "V " << vertexCount << " F " << faceCount << std::endl;
-    //    std::cout << "Face: " << faceVertexCountType << " - " << faceVertexIndexType << std::endl;
-
-    offsetType.resize(6, std::pair<int, int>(0, -1));
+    int x = find({"x"}), y = find({"y"}), z = find({"z"});
+    if (x < 0 || y < 0 || z < 0) throw std::runtime_error("Ply vertex element has no position");
+    if (vertex_flags & VERTEX_POSITION)
+    {
+        mesh.position.resize(n, vec3::Zero());
+        project(mesh.position, {x, y, z}, false);
+    }
 
-    vertexSize = 0;
-    for (auto vp : vertexProperties)
+    int nx = find({"nx"}), ny = find({"ny"}), nz = find({"nz"});
+    if ((vertex_flags & VERTEX_NORMAL) && nx >= 0 && ny >= 0 && nz >= 0)
     {
-        int t = sizeoftype(vp.type);
+        mesh.normal.resize(n, vec3::Zero());
+        project(mesh.normal, {nx, ny, nz}, false);
+    }
 
+    int r = find({"red", "r"}), g = find({"green", "g"}), b = find({"blue", "b"}), a = find({"alpha", "a"});
+    if ((vertex_flags & VERTEX_COLOR) && r >= 0 && g >= 0 && b >= 0)
+    {
+        mesh.color.resize(n, vec4::Ones());
+        project(mesh.color, {r, g, b, a}, true);
+    }
 
-        if (vp.name == "x") offsetType[0] = std::make_pair(vertexSize, t);
-        if (vp.name == "y") offsetType[1] = std::make_pair(vertexSize, t);
-        if (vp.name == "z") offsetType[2] = std::make_pair(vertexSize, t);
-        if (vp.name == "red") offsetType[3] = std::make_pair(vertexSize, t);
-        if (vp.name == "green") offsetType[4] = std::make_pair(vertexSize, t);
-        if (vp.name == "blue") offsetType[5] = std::make_pair(vertexSize, t);
+    int u = find({"u", "s", "texture_u", "texture_s"}), v = find({"v", "t", "texture_v", "texture_t"});
+    if ((vertex_flags & VERTEX_TEXTURE_COORDINATES) && u >= 0 && v >= 0)
+    {
+        mesh.texture_coordinates.resize(n, vec2::Zero());
+        project(mesh.texture_coordinates, {u, v}, false);
+    }
+    return layout;
+}
 
-        //        std::cout << "Prop: " << vp.type << " " << vp.name << std::endl;
-        vertexSize += sizeoftype(vp.type);
+// Checks that the binary body contains all rows of 'element' and returns the end of it.
+const char* CheckedElementEnd(const Element& element, const char* p, const char* end, bool swap)
+{
+    int row_size = FixedRowSize(element);
+    if (row_size >= 0)
+    {
+        if (row_size > 0 && (end - p) / row_size < element.count)
+            throw std::runtime_error("Unexpected end of ply file in element " + element.name);
+        return p + element.count * row_size;
+    }
+    for (int64_t i = 0; i < element.count; ++i)
+    {
+        p = SkipBinaryRow(element, p, end, swap);
+        if (!p) throw std::runtime_error("Unexpected end of ply file in element " + element.name);
     }
+    return p;
+}
 
-    //    std::cout << "vertex size: " << vertexSize << std::endl;
+}  // namespace
 
+void PLYLoader::parseBinary(const char* data, const char* end)
+{
+    bool swap   = format == Format::BinaryBigEndian;
+    auto layout = CreateLayout(elements, vertex_flags, load_faces, mesh);
 
-    SAIGA_ASSERT(vertexCount > 0 && faceCount > 0);
-    //        std::cout << header << std::endl;
+    const char* p = data;
+    for (int e = 0; e <= layout.last_element; ++e)
+    {
+        auto& element = elements[e];
+        if (e == layout.vertex_element)
+        {
+            // Compute the property offsets. The vertex element has a fixed size in all common files, which
+            // allows to parse the rows independently.
+            int row_size = FixedRowSize(element);
+            const char* element_begin = p;
+            p                         = CheckedElementEnd(element, p, end, swap);
+
+            auto parse_row = [&](const char* row, int64_t i) {
+                for (int j = 0; j < (int)element.properties.size(); ++j)
+                {
+                    auto& prop = element.properties[j];
+                    if (prop.is_list)
+                    {
+                        int64_t n = LoadBinary<int64_t>(row, prop.count_type, swap);
+                        row += TypeSize(prop.count_type) + n * TypeSize(prop.type);
+                        continue;
+                    }
+                    auto& t = layout.targets[j];
+                    if (t.dst) t.dst[i * t.stride] = LoadBinary<float>(row, prop.type, swap) * t.scale;
+                    row += TypeSize(prop.type);
+                }
+                return row;
+            };
+
+            if (row_size >= 0)
+            {
+#pragma omp parallel for
+                for (int64_t i = 0; i < element.count; ++i)
+                {
+                    parse_row(element_begin + i * row_size, i);
+                }
+            }
+            else
+            {
+                const char* row = element_begin;
+                for (int64_t i = 0; i < element.count; ++i)
+                {
+                    row = parse_row(row, i);
+                }
+            }
+        }
+        else if (e == layout.face_element)
+        {
+            auto& list       = element.properties[layout.face_property];
+            int count_size   = TypeSize(list.count_type);
+            int index_size   = TypeSize(list.type);
+            int64_t tri_size = count_size + 3 * index_size;
+
+            // Fast path: the face element contains only the index list and all faces are triangles.
+            bool triangles_only = element.properties.size() == 1 && (end - p) / tri_size >= element.count;
+            if (triangles_only)
+            {
+                int non_triangles = 0;
+#pragma omp parallel for reduction(+ : non_triangles)
+                for (int64_t i = 0; i < element.count; ++i)
+                {
+                    non_triangles += LoadBinary<int>(p + i * tri_size, list.count_type, swap) != 3;
+                }
+                triangles_only = non_triangles == 0;
+            }
+
+            if (triangles_only)
+            {
+                mesh.triangles.resize(element.count);
+#pragma omp parallel for
+                for (int64_t i = 0; i < element.count; ++i)
+                {
+                    const char* row = p + i * tri_size + count_size;
+                    for (int k = 0; k < 3; ++k)
+                    {
+                        mesh.triangles[i](k) = LoadBinary<int>(row + k * index_size, list.type, swap);
+                    }
+                }
+                p += element.count * tri_size;
+            }
+            else
+            {
+                mesh.triangles.reserve(element.count);
+                std::vector<int> polygon;
+                for (int64_t i = 0; i < element.count; ++i)
+                {
+                    for (int j = 0; j < (int)element.properties.size(); ++j)
+                    {
+                        auto& prop = element.properties[j];
+                        int n      = 1;
+                        if (prop.is_list)
+                        {
+                            if (end - p < TypeSize(prop.count_type))
+                                throw std::runtime_error("Unexpected end of ply file in element face");
+                            n = LoadBinary<int>(p, prop.count_type, swap);
+                            p += TypeSize(prop.count_type);
+                        }
+                        if (n < 0 || (end - p) / TypeSize(prop.type) < n)
+                            throw std::runtime_error("Unexpected end of ply file in element face");
+                        if (j == layout.face_property)
+                        {
+                            polygon.resize(n);
+                            for (int k = 0; k < n; ++k)
+                            {
+                                polygon[k] = LoadBinary<int>(p + k * TypeSize(prop.type), prop.type, swap);
+                            }
+                            AddPolygon(polygon.data(), n, mesh.triangles);
+                        }
+                        p += n * TypeSize(prop.type);
+                    }
+                }
+            }
+        }
+        else
+        {
+            p = CheckedElementEnd(element, p, end, swap);
+        }
+    }
 }
 
-void PLYLoader::parseMeshBinary()
+void PLYLoader::parseAscii(const char* data, const char* end)
 {
-    for (int i = 0; i < vertexCount; ++i)
+    auto layout = CreateLayout(elements, vertex_flags, load_faces, mesh);
+    size_t size = end - data;
+
+    // Each row is stored in one line. The body is split into chunks which end at a line break. The first line of each
+    // chunk is computed with a prefix sum over the number of lines per chunk, so all chunks can be parsed in parallel.
+    constexpr size_t min_chunk_size = 1024 * 1024;
+    int num_threads                 = OMP::getMaxThreads();
+    int num_chunks = std::max<size_t>(1, std::min<size_t>(size / min_chunk_size, num_threads * 8));
+
+    std::vector<size_t> chunk_begin(num_chunks + 1, size);
+    chunk_begin[0] = 0;
+    for (int i = 1; i < num_chunks; ++i)
     {
-        char* start = data.data() + dataStart + i * vertexSize;
+        size_t pos     = std::max(chunk_begin[i - 1], size * i / num_chunks);
+        auto nl        = (const char*)std::memchr(data + pos, '\n', size - pos);
+        chunk_begin[i] = nl ? nl - data + 1 : size;
+    }
 
+    std::vector<int64_t> first_line(num_chunks + 1, 0);
+#pragma omp parallel for
+    for (int i = 0; i < num_chunks; ++i)
+    {
+        const char* begin = data + chunk_begin[i];
+        const char* c_end = data + chunk_begin[i + 1];
+        int64_t lines     = std::count(begin, c_end, '\n');
+        // the last line of the file might not end with a line break
+        if (c_end > begin && c_end[-1] != '\n') lines++;
+        first_line[i + 1] = lines;
+    }
+    for (int i = 0; i < num_chunks; ++i)
+    {
+        first_line[i + 1] += first_line[i];
+    }
 
+    // The first line of each element
+    std::vector<int64_t> element_begin(elements.size() + 1, 0);
+    for (int e = 0; e < (int)elements.size(); ++e)
+    {
+        element_begin[e + 1] = element_begin[e] + elements[e].count;
+    }
+    if (first_line[num_chunks] < element_begin[layout.last_element + 1])
+    {
+        throw std::runtime_error("Unexpected end of ply file");
+    }
 
-        float* x = reinterpret_cast<float*>(start + offsetType[0].first);
-        vec3 pos(x[0], x[1], x[2]);
+    const Element* vertex = &elements[layout.vertex_element];
+    const Element* face   = layout.face_element >= 0 ? &elements[layout.face_element] : nullptr;
+    if (face) mesh.triangles.resize(face->count, invalid_triangle);
 
+    // Triangles of polygons with more than 3 vertices are added to the end
+    std::vector<std::vector<ivec3>> extra_triangles(num_chunks);
 
-        vec3 color(1, 1, 1);
-        if (offsetType[3].second == 1)
+    auto parse_vertex = [&](const char* p, const char* line_end, int64_t row) {
+        for (int j = 0; j < (int)vertex->properties.size(); ++j)
         {
-            unsigned char* c = reinterpret_cast<unsigned char*>(start + offsetType[3].first);
-            color            = vec3(c[0], c[1], c[2]);
-            color /= 255.0f;
+            auto& prop = vertex->properties[j];
+            if (prop.is_list)
+            {
+                int n;
+                float dummy;
+                if (!ParseNumber(p, line_end, n) || n < 0) return false;
+                for (int k = 0; k < n; ++k)
+                {
+                    if (!ParseNumber(p, line_end, dummy)) return false;
+                }
+                continue;
+            }
+            float value;
+            if (!ParseNumber(p, line_end, value)) return false;
+            auto& t = layout.targets[j];
+            if (t.dst) t.dst[row * t.stride] = value * t.scale;
         }
-        else if (offsetType[3].second == 4)
+        return true;
+    };
+
+    auto parse_face = [&](const char* p, const char* line_end, int64_t row, std::vector<int>& polygon,
+                          std::vector<ivec3>& extra) {
+        for (int j = 0; j < (int)face->properties.size(); ++j)
         {
-            float* c = reinterpret_cast<float*>(start + offsetType[3].first);
-            color    = vec3(c[0], c[1], c[2]);
+            auto& prop = face->properties[j];
+            int n      = 1;
+            if (prop.is_list && (!ParseNumber(p, line_end, n) || n < 0)) return false;
+            if (j != layout.face_property)
+            {
+                float dummy;
+                for (int k = 0; k < n; ++k)
+                {
+                    if (!ParseNumber(p, line_end, dummy)) return false;
+                }
+                continue;
+            }
+            polygon.resize(n);
+            for (int k = 0; k < n; ++k)
+            {
+                if (!ParseNumber(p, line_end, polygon[k])) return false;
+            }
+            if (n >= 3)
+            {
+                mesh.triangles[row] = ivec3(polygon[0], polygon[1], polygon[2]);
+                for (int k = 3; k < n; ++k)
+                {
+                    extra.push_back(ivec3(polygon[0], polygon[k - 1], polygon[k]));
+                }
+            }
         }
+        return true;
+    };
 
+    int64_t invalid_line = -1;
+#pragma omp parallel for schedule(dynamic, 1)
+    for (int i = 0; i < num_chunks; ++i)
+    {
+        const char* p     = data + chunk_begin[i];
+        const char* c_end = data + chunk_begin[i + 1];
+        int64_t line      = first_line[i];
+        int e             = std::upper_bound(element_begin.begin(), element_begin.end(), line) - element_begin.begin() - 1;
+        std::vector<int> polygon;
 
-        VertexNC v;
-        v.position = make_vec4(pos, 1);
-        v.color    = make_vec4(color, 1);
-        mesh.addVertex(v);
-    }
+        for (; p < c_end && e <= layout.last_element; ++line)
+        {
+            const char* line_end = (const char*)std::memchr(p, '\n', c_end - p);
+            if (!line_end) line_end = c_end;
+            while (e <= layout.last_element && line >= element_begin[e + 1]) ++e;
+            if (e > layout.last_element) break;
 
-    int faceStart = dataStart + vertexCount * vertexSize;
-    char* start   = data.data() + faceStart;
+            bool ok = true;
+            if (e == layout.vertex_element)
+            {
+                ok = parse_vertex(p, line_end, line - element_begin[e]);
+            }
+            else if (e == layout.face_element)
+            {
+                ok = parse_face(p, line_end, line - element_begin[e], polygon, extra_triangles[i]);
+            }
+            if (!ok)
+            {
+#pragma omp critical
+                {
+                    if (invalid_line == -1 || line < invalid_line) invalid_line = line;
+                }
+                break;
+            }
+            p = line_end + 1;
+        }
+    }
 
-    int countSize = sizeoftype(faceVertexCountType);
+    if (invalid_line >= 0)
+    {
+        throw std::runtime_error("Invalid ply body in line " + std::to_string(invalid_line + 1) + " after the header");
+    }
 
-    for (int i = 0; i < faceCount; ++i)
+    if (face)
     {
-        int c = 0;
-        if (countSize == 1)
+        for (auto& extra : extra_triangles)
         {
-            c = *reinterpret_cast<unsigned char*>(start);
+            mesh.triangles.insert(mesh.triangles.end(), extra.begin(), extra.end());
         }
-        else if (countSize == 4)
+        // Remove faces with less than 3 vertices
+        mesh.triangles.erase(std::remove(mesh.triangles.begin(), mesh.triangles.end(), invalid_triangle),
+                             mesh.triangles.end());
+    }
+}
+
+void PLYLoader::finish()
+{
+    int64_t n = 0;
+    for (auto& e : elements)
+    {
+        if (e.name == "vertex")
         {
-            c = *reinterpret_cast<int*>(start);
+            n = e.count;
+            break;
         }
-        start += countSize;
+    }
 
-        SAIGA_ASSERT(c == 3);
+    int invalid = 0;
+#pragma omp parallel for reduction(+ : invalid)
+    for (int64_t i = 0; i < (int64_t)mesh.triangles.size(); ++i)
+    {
+        auto& t = mesh.triangles[i];
+        invalid += (t.array() < 0).any() || (t.array() >= n).any();
+    }
+    if (invalid > 0) throw std::runtime_error("Ply face index out of range");
 
-        uint32_t* face = reinterpret_cast<uint32_t*>(start);
-        mesh.addFace(face);
+    if ((vertex_flags & VERTEX_NORMAL) && (vertex_flags & VERTEX_POSITION) && !mesh.HasNormal() &&
+        !mesh.triangles.empty())
+    {
+        mesh.CalculateVertexNormals();
+    }
+}
+
+
+PLYWriter::PLYWriter(const std::string& file, int vertex_flags, bool binary)
+    : stream(file, std::ios::binary), vertex_flags(vertex_flags), binary(binary)
+{
+    if (!stream.is_open())
+    {
+        throw std::runtime_error("Could not open file " + file);
+    }
+
+    // The element counts are unknown until Close(). They are written with a fixed width, so they can be
+    // overwritten without moving the data.
+    stream << "ply\n";
+    stream << (binary ? "format binary_little_endian 1.0\n" : "format ascii 1.0\n");
+    stream << "comment generated by lib saiga\n";
+    stream << "element vertex ";
+    vertex_count_pos = stream.tellp();
+    stream << std::string(20, ' ') << "\n";
+    if (vertex_flags & VERTEX_POSITION) stream << "property float x\nproperty float y\nproperty float z\n";
+    if (vertex_flags & VERTEX_NORMAL) stream << "property float nx\nproperty float ny\nproperty float nz\n";
+    if (vertex_flags & VERTEX_COLOR)
+        stream << "property uchar red\nproperty uchar green\nproperty uchar blue\nproperty uchar alpha\n";
+    if (vertex_flags & VERTEX_TEXTURE_COORDINATES) stream << "property float u\nproperty float v\n";
+    stream << "element face ";
+    face_count_pos = stream.tellp();
+    stream << std::string(20, ' ') << "\n";
+    stream << "property list uchar int vertex_indices\n";
+    stream << "end_header\n";
+}
+
+namespace
+{
+inline void AppendBinary(std::vector<char>& buffer, const void* data, size_t size)
+{
+    buffer.insert(buffer.end(), (const char*)data, (const char*)data + size);
+}
+
+template <typename T>
+inline void AppendAscii(std::vector<char>& buffer, T value, char separator)
+{
+    char tmp[32];
+    auto result = std::to_chars(tmp, tmp + sizeof(tmp), value);
+    buffer.insert(buffer.end(), tmp, result.ptr);
+    buffer.push_back(separator);
+}
+
+inline unsigned char ColorToByte(float c)
+{
+    return (unsigned char)std::round(std::clamp(c, 0.f, 1.f) * 255.f);
+}
+}  // namespace
+
+void PLYWriter::AddVertices(const UnifiedMesh& mesh)
+{
+    SAIGA_ASSERT(stream.is_open());
+    SAIGA_ASSERT(num_faces == 0, "All vertices must be added before the faces");
+    SAIGA_ASSERT(!(vertex_flags & VERTEX_NORMAL) || mesh.normal.size() == mesh.position.size());
+    SAIGA_ASSERT(!(vertex_flags & VERTEX_COLOR) || mesh.color.size() == mesh.position.size());
+    SAIGA_ASSERT(!(vertex_flags & VERTEX_TEXTURE_COORDINATES) ||
+                 mesh.texture_coordinates.size() == mesh.position.size());
+
+    // Write blocks of vertices to keep the buffer small
+    constexpr int64_t block_size = 1 << 16;
+    int64_t n                    = mesh.position.size();
+    for (int64_t begin = 0; begin < n; begin += block_size)
+    {
+        int64_t block_end = std::min(n, begin + block_size);
+        buffer.clear();
+        for (int64_t i = begin; i < block_end; ++i)
+        {
+            std::array<float, 8> f;
+            int nf = 0;
+            if (vertex_flags & VERTEX_POSITION)
+            {
+                for (int k = 0; k < 3; ++k) f[nf++] = mesh.position[i](k);
+            }
+            if (vertex_flags & VERTEX_NORMAL)
+            {
+                for (int k = 0; k < 3; ++k) f[nf++] = mesh.normal[i](k);
+            }
+            std::array<unsigned char, 4> color;
+            if (vertex_flags & VERTEX_COLOR)
+            {
+                for (int k = 0; k < 4; ++k) color[k] = ColorToByte(mesh.color[i](k));
+            }
 
-        start += sizeof(uint32_t) * c;
-        //            std::cout << c << std::endl;
+            if (binary)
+            {
+                AppendBinary(buffer, f.data(), nf * sizeof(float));
+                if (vertex_flags & VERTEX_COLOR) AppendBinary(buffer, color.data(), 4);
+                if (vertex_flags & VERTEX_TEXTURE_COORDINATES)
+                    AppendBinary(buffer, mesh.texture_coordinates[i].data(), 2 * sizeof(float));
+            }
+            else
+            {
+                for (int k = 0; k < nf; ++k) AppendAscii(buffer, f[k], ' ');
+                if (vertex_flags & VERTEX_COLOR)
+                {
+                    for (int k = 0; k < 4; ++k) AppendAscii(buffer, int(color[k]), ' ');
+                }
+                if (vertex_flags & VERTEX_TEXTURE_COORDINATES)
+                {
+                    AppendAscii(buffer, mesh.texture_coordinates[i](0), ' ');
+                    AppendAscii(buffer, mesh.texture_coordinates[i](1), ' ');
+                }
+                buffer.back() = '\n';
+            }
+        }
+        stream.write(buffer.data(), buffer.size());
     }
+    num_vertices += n;
+}
 
-    mesh.computePerVertexNormal();
+void PLYWriter::AddFaces(ArrayView<const ivec3> triangles)
+{
+    SAIGA_ASSERT(stream.is_open());
 
-    std::cout << "Loaded Ply mesh: V " << mesh.vertices.size() << " F " << mesh.faces.size() << std::endl;
+    constexpr int64_t block_size = 1 << 16;
+    int64_t n                    = triangles.size();
+    for (int64_t begin = 0; begin < n; begin += block_size)
+    {
+        int64_t block_end = std::min(n, begin + block_size);
+        buffer.clear();
+        for (int64_t i = begin; i < block_end; ++i)
+        {
+            if (binary)
+            {
+                buffer.push_back(3);
+                AppendBinary(buffer, triangles[i].data(), 3 * sizeof(int));
+            }
+            else
+            {
+                AppendAscii(buffer, 3, ' ');
+                AppendAscii(buffer, triangles[i](0), ' ');
+                AppendAscii(buffer, triangles[i](1), ' ');
+                AppendAscii(buffer, triangles[i](2), '\n');
+            }
+        }
+        stream.write(buffer.data(), buffer.size());
+    }
+    num_faces += n;
+}
+
+void PLYWriter::Close()
+{
+    if (!stream.is_open()) return;
+    stream.seekp(vertex_count_pos);
+    stream << num_vertices;
+    stream.seekp(face_count_pos);
+    stream << num_faces;
+    stream.close();
+}
+
+void SavePLY(const std::string& file, const UnifiedMesh& mesh, bool binary)
+{
+    int flags = VERTEX_POSITION;
+    if (mesh.HasNormal()) flags |= VERTEX_NORMAL;
+    if (mesh.HasColor()) flags |= VERTEX_COLOR;
+    if (mesh.HasTC()) flags |= VERTEX_TEXTURE_COORDINATES;
+
+    PLYWriter writer(file, flags, binary);
+    writer.AddVertices(mesh);
+    writer.AddFaces(mesh.triangles);
+    writer.Close();
 }
 
 }  // namespace Saiga
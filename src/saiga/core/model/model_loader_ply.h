@@ -6,6 +6,8 @@
 
 #pragma once
 #include "saiga/core/geometry/triangle_mesh.h"
+#include "saiga/core/model/UnifiedMesh.h"
+#include "saiga/core/util/DataStructures/ArrayView.h"
 #include "saiga/core/util/color.h"
 #include "saiga/core/util/tostring.h"
 
@@ -23,41 +25,65 @@ template <typename VertexType>
 static inline void write(char* ptr, VertexType v);
 };  // namespace PLYLoaderDetail
 
+/**
+ * Reader for PLY files in ascii, binary little endian and binary big endian format.
+ *
+ * The file is memory mapped and only the vertex properties selected by 'vertex_flags' (see VertexDataFlags) are
+ * converted into the arrays of 'mesh':
+ *   VERTEX_POSITION:            x y z
+ *   VERTEX_NORMAL:              nx ny nz
+ *   VERTEX_COLOR:               red green blue [alpha]   (integer colors are normalized to [0,1])
+ *   VERTEX_TEXTURE_COORDINATES: u v | s t | texture_u texture_v
+ * Faces (vertex_indices) are triangulated as a fan. All other elements and properties are skipped.
+ *
+ * Binary elements with a fixed size per entry, binary triangle lists and ascii bodies are parsed in parallel.
+ * Invalid files throw a std::runtime_error.
+ */
 class SAIGA_CORE_API PLYLoader
 {
    public:
-    struct VertexProperty
+    enum class Format
     {
-        std::string name;
-        std::string type;
+        Ascii,
+        BinaryLittleEndian,
+        BinaryBigEndian,
     };
 
+    enum class Type
+    {
+        Int8,
+        UInt8,
+        Int16,
+        UInt16,
+        Int32,
+        UInt32,
+        Float32,
+        Float64,
+    };
 
+    struct Property
+    {
+        std::string name;
+        Type type;
+        bool is_list    = false;
+        Type count_type = Type::UInt8;
+    };
 
-    std::vector<std::pair<int, int>> offsetType;
-
-
-    int vertexSize;
-    int dataStart;
-    std::vector<char> data;
-    std::vector<VertexProperty> vertexProperties;
-
-    std::string faceVertexCountType;
-    std::string faceVertexIndexType;
-
-    TriangleMesh<VertexNC, uint32_t> mesh;
-
-    int vertexCount = -1, faceCount = -1;
-
-    PLYLoader(const std::string& file);
-
-
-    int sizeoftype(std::string t);
+    struct Element
+    {
+        std::string name;
+        int64_t count = 0;
+        std::vector<Property> properties;
+    };
 
-    void parseHeader();
+    PLYLoader(const std::string& file,
+              int vertex_flags = VERTEX_POSITION | VERTEX_NORMAL | VERTEX_COLOR | VERTEX_TEXTURE_COORDINATES,
+              bool load_faces  = true);
 
-    void parseMeshBinary();
+    UnifiedMesh mesh;
 
+    Format format = Format::Ascii;
+    std::vector<Element> elements;
 
     template <typename VertexType, typename IndexType>
     static void save(std::string file, TriangleMesh<VertexType, IndexType>& mesh)
@@ -123,8 +149,55 @@ class SAIGA_CORE_API PLYLoader
 
         stream.write(data.data(), data.size());
     }
+
+   private:
+    int vertex_flags;
+    bool load_faces;
+
+    void parseHeader(const char* data, size_t size, size_t& body_begin);
+    void parseBinary(const char* data, const char* end);
+    void parseAscii(const char* data, const char* end);
+    void finish();
+};
+
+/**
+ * Writes a PLY file chunk by chunk. This allows to write point clouds which do not fit into memory.
+ *
+ * All vertices must be added before the first face. The vertex and face count in the header are updated by Close(),
+ * which is also called by the destructor.
+ * The written vertex properties are selected by 'vertex_flags': position (float), normal (float), color (uchar RGBA)
+ * and texture coordinates (float).
+ */
+class SAIGA_CORE_API PLYWriter
+{
+   public:
+    PLYWriter(const std::string& file, int vertex_flags = VERTEX_POSITION, bool binary = true);
+    ~PLYWriter() { Close(); }
+
+    // Appends the vertices of 'mesh'. The mesh must contain all attributes selected by 'vertex_flags'.
+    void AddVertices(const UnifiedMesh& mesh);
+
+    // Appends triangles. The indices refer to all vertices written so far.
+    void AddFaces(ArrayView<const ivec3> triangles);
+
+    void Close();
+
+    int64_t NumVertices() const { return num_vertices; }
+    int64_t NumFaces() const { return num_faces; }
+
+   private:
+    std::ofstream stream;
+    int vertex_flags;
+    bool binary;
+    int64_t num_vertices = 0;
+    int64_t num_faces    = 0;
+    std::streampos vertex_count_pos, face_count_pos;
+    std::vector<char> buffer;
 };
 
+// Writes all vertex attributes of the mesh and its triangles.
+SAIGA_CORE_API void SavePLY(const std::string& file, const UnifiedMesh& mesh, bool binary = true);
+
 namespace PLYLoaderDetail
 {
 template <>
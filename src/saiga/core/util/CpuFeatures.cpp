@@ -0,0 +1,70 @@
+/**
+ * Copyright (c) 2021 Darius Rückert
+ * Licensed under the MIT License.
+ * See LICENSE file for more information.
+ */
+
+#include "CpuFeatures.h"
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#    include <immintrin.h>
+#    include <intrin.h>
+#endif
+
+namespace Saiga
+{
+static CpuFeatures DetectCpuFeatures()
+{
+    CpuFeatures f;
+#if defined(SAIGA_HAS_TARGET_ATTRIBUTE)
+    __builtin_cpu_init();
+    f.sse42           = __builtin_cpu_supports("sse4.2");
+    f.popcnt          = __builtin_cpu_supports("popcnt");
+    f.avx2            = __builtin_cpu_supports("avx2");
+    f.fma             = __builtin_cpu_supports("fma");
+    f.avx512f         = __builtin_cpu_supports("avx512f");
+    f.avx512bw        = __builtin_cpu_supports("avx512bw");
+    f.avx512vpopcntdq = __builtin_cpu_supports("avx512vpopcntdq");
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    int info[4];
+    __cpuid(info, 0);
+    int max_leaf = info[0];
+
+    __cpuid(info, 1);
+    f.sse42  = (info[2] & (1 << 20)) != 0;
+    f.popcnt = (info[2] & (1 << 23)) != 0;
+    f.fma    = (info[2] & (1 << 12)) != 0;
+
+    // The OS must save the ymm/zmm registers on a context switch
+    bool osxsave   = (info[2] & (1 << 27)) != 0;
+    uint64_t xcr0  = osxsave ? _xgetbv(0) : 0;
+    bool os_avx    = (xcr0 & 0x6) == 0x6;
+    bool os_avx512 = (xcr0 & 0xE6) == 0xE6;
+
+    if (max_leaf >= 7)
+    {
+        __cpuidex(info, 7, 0);
+        f.avx2            = os_avx && (info[1] & (1 << 5)) != 0;
+        f.avx512f         = os_avx512 && (info[1] & (1 << 16)) != 0;
+        f.avx512bw        = os_avx512 && (info[1] & (1 << 30)) != 0;
+        f.avx512vpopcntdq = os_avx512 && (info[2] & (1 << 14)) != 0;
+    }
+    f.fma = f.fma && os_avx;
+#endif
+    return f;
+}
+
+const CpuFeatures& GetCpuFeatures()
+{
+    static CpuFeatures features = DetectCpuFeatures();
+    return features;
+}
+
+std::ostream& operator<<(std::ostream& strm, const CpuFeatures& f)
+{
+    strm << "[CpuFeatures] sse4.2: " << f.sse42 << " popcnt: " << f.popcnt << " avx2: " << f.avx2 << " fma: " << f.fma
+         << " avx512f: " << f.avx512f << " avx512bw: " << f.avx512bw << " avx512vpopcntdq: " << f.avx512vpopcntdq;
+    return strm;
+}
+
+}  // namespace Saiga
@@ -0,0 +1,49 @@
+/**
+ * Copyright (c) 2021 Darius Rückert
+ * Licensed under the MIT License.
+ * See LICENSE file for more information.
+ */
+
+#pragma once
+
+#include "saiga/config.h"
+
+#include <iostream>
+
+// Functions marked with these attributes may use the given instruction set even if the translation unit is compiled
+// without it (for example without -march=native). They must only be called if GetCpuFeatures() reports support for
+// every extension of the attribute:
+//   - SAIGA_TARGET_AVX2: avx2, fma
+//   - SAIGA_TARGET_AVX512: avx2, fma, avx512f, avx512bw (Skylake-X and newer)
+//   - SAIGA_TARGET_AVX512_VPOPCNT: SAIGA_TARGET_AVX512 and avx512vpopcntdq (Ice Lake and newer)
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#    define SAIGA_HAS_TARGET_ATTRIBUTE
+#    define SAIGA_TARGET_AVX2 __attribute__((target("avx2,fma,popcnt")))
+#    define SAIGA_TARGET_AVX512 __attribute__((target("avx2,fma,popcnt,avx512f,avx512bw")))
+#    define SAIGA_TARGET_AVX512_VPOPCNT __attribute__((target("avx2,fma,popcnt,avx512f,avx512bw,avx512vpopcntdq")))
+#else
+#    define SAIGA_TARGET_AVX2
+#    define SAIGA_TARGET_AVX512
+#    define SAIGA_TARGET_AVX512_VPOPCNT
+#endif
+
+namespace Saiga
+{
+// The x86 instruction set extensions supported by the executing cpu.
+// On other architectures all flags are false.
+struct CpuFeatures
+{
+    bool sse42           = false;
+    bool popcnt          = false;
+    bool avx2            = false;
+    bool fma             = false;
+    bool avx512f         = false;
+    bool avx512bw        = false;
+    bool avx512vpopcntdq = false;
+};
+
+// Detected once on the first call.
+SAIGA_CORE_API extern const CpuFeatures& GetCpuFeatures();
+
+SAIGA_CORE_API extern std::ostream& operator<<(std::ostream& strm, const CpuFeatures& features);
+}  // namespace Saiga
@@ -0,0 +1,135 @@
+/**
+ * Copyright (c) 2021 Darius Rückert
+ * Licensed under the MIT License.
+ * See LICENSE file for more information.
+ */
+
+#pragma once
+
+#include "saiga/config.h"
+#include "saiga/core/util/assert.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+namespace Saiga
+{
+/**
+ * An array of elements stored in fixed size segments.
+ *
+ * In contrast to std::vector, growing never relocates existing elements. Pointers and references stay valid until
+ * the vector shrinks or is destroyed. grow_to_at_least() can be called by multiple threads concurrently with each
+ * other and with element access. All other modifying functions are not thread-safe.
+ *
+ * The segment table has a fixed size of MAX_SEGMENTS pointers, which limits the capacity to
+ * SEGMENT_SIZE * MAX_SEGMENTS elements.
+ *
+ * Usage:
+ *
+ *   SegmentedVector<Block> blocks(1000);
+ *
+ *   #pragma omp parallel for
+ *   for (int i = 0; i < n; ++i)
+ *   {
+ *       int id = counter.fetch_add(1);
+ *       blocks.grow_to_at_least(id + 1);
+ *       blocks[id] = ...;
+ *   }
+ */
+template <typename T, size_t SEGMENT_SIZE = 512, size_t MAX_SEGMENTS = (1 << 15)>
+class SegmentedVector
+{
+   public:
+    SegmentedVector(size_t n = 0) : segments(new std::atomic<T*>[MAX_SEGMENTS]()) { resize(n); }
+
+    SegmentedVector(const SegmentedVector& other) : SegmentedVector() { *this = other; }
+
+    SegmentedVector& operator=(const SegmentedVector& other)
+    {
+        if (this == &other) return *this;
+        resize(other.size());
+        for (size_t s = 0; s < NumSegments(); ++s)
+        {
+            std::copy(other.Segment(s), other.Segment(s) + SEGMENT_SIZE, Segment(s));
+        }
+        return *this;
+    }
+
+    ~SegmentedVector() { resize(0); }
+
+    // The number of allocated (and default constructed) elements. Always a multiple of SEGMENT_SIZE.
+    size_t size() const { return NumSegments() * SEGMENT_SIZE; }
+
+    size_t NumSegments() const { return num_segments.load(std::memory_order_acquire); }
+
+    static constexpr size_t max_size() { return SEGMENT_SIZE * MAX_SEGMENTS; }
+
+    // Allocates segments until size() >= n.
+    // Thread-safe: If multiple threads allocate the same segment, only one allocation survives.
+    void grow_to_at_least(size_t n)
+    {
+        size_t required = (n + SEGMENT_SIZE - 1) / SEGMENT_SIZE;
+        size_t current  = NumSegments();
+        if (required <= current) return;
+        SAIGA_ASSERT(required <= MAX_SEGMENTS, "SegmentedVector capacity exceeded.");
+
+        for (size_t s = current; s < required; ++s)
+        {
+            if (segments[s].load(std::memory_order_acquire)) continue;
+
+            T* segment  = new T[SEGMENT_SIZE];
+            T* expected = nullptr;
+            if (!segments[s].compare_exchange_strong(expected, segment, std::memory_order_acq_rel))
+            {
+                delete[] segment;
+            }
+        }
+
+        // All segments below 'required' exist now -> publish the new size
+        while (current < required &&
+               !num_segments.compare_exchange_weak(current, required, std::memory_order_acq_rel))
+        {
+        }
+    }
+
+    // Resizes to n rounded up to a multiple of SEGMENT_SIZE.
+    // Not thread-safe. Shrinking destroys the elements of the removed segments.
+    void resize(size_t n)
+    {
+        size_t required = (n + SEGMENT_SIZE - 1) / SEGMENT_SIZE;
+        size_t current  = NumSegments();
+        for (size_t s = required; s < current; ++s)
+        {
+            delete[] segments[s].exchange(nullptr, std::memory_order_relaxed);
+        }
+        if (required < current)
+        {
+            num_segments.store(required, std::memory_order_release);
+        }
+        grow_to_at_least(n);
+    }
+
+    T& operator[](size_t i)
+    {
+        SAIGA_DEBUG_ASSERT(i < size());
+        return Segment(i / SEGMENT_SIZE)[i % SEGMENT_SIZE];
+    }
+
+    const T& operator[](size_t i) const
+    {
+        SAIGA_DEBUG_ASSERT(i < size());
+        return Segment(i / SEGMENT_SIZE)[i % SEGMENT_SIZE];
+    }
+
+    T& front() { return (*this)[0]; }
+    const T& front() const { return (*this)[0]; }
+
+   private:
+    T* Segment(size_t s) const { return segments[s].load(std::memory_order_acquire); }
+
+    std::unique_ptr<std::atomic<T*>[]> segments;
+    std::atomic<size_t> num_segments = 0;
+};
+
+}  // namespace Saiga
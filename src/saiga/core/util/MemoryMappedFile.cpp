@@ -0,0 +1,138 @@
+/**
+ * Copyright (c) 2021 Darius Rückert
+ * Licensed under the MIT License.
+ * See LICENSE file for more information.
+ */
+
+#include "MemoryMappedFile.h"
+
+#include <utility>
+
+#ifdef _WIN32
+#    include <windows.h>
+#else
+#    include <fcntl.h>
+#    include <sys/mman.h>
+#    include <sys/stat.h>
+#    include <unistd.h>
+#endif
+
+namespace Saiga
+{
+MemoryMappedFile& MemoryMappedFile::operator=(MemoryMappedFile&& other) noexcept
+{
+    if (this != &other)
+    {
+        close();
+        std::swap(ptr, other.ptr);
+        std::swap(length, other.length);
+        std::swap(is_open, other.is_open);
+#ifdef _WIN32
+        std::swap(file_handle, other.file_handle);
+        std::swap(mapping_handle, other.mapping_handle);
+#endif
+    }
+    return *this;
+}
+
+#ifdef _WIN32
+bool MemoryMappedFile::open(const std::string& file)
+{
+    close();
+
+    HANDLE f = CreateFileA(file.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                           FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (f == INVALID_HANDLE_VALUE) return false;
+
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(f, &file_size))
+    {
+        CloseHandle(f);
+        return false;
+    }
+    file_handle = f;
+    length      = file_size.QuadPart;
+    is_open     = true;
+    if (length == 0) return true;
+
+    HANDLE m = CreateFileMappingA(f, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!m)
+    {
+        close();
+        return false;
+    }
+    mapping_handle = m;
+
+    ptr = (const char*)MapViewOfFile(m, FILE_MAP_READ, 0, 0, 0);
+    if (!ptr)
+    {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void MemoryMappedFile::close()
+{
+    if (ptr) UnmapViewOfFile(ptr);
+    if (mapping_handle) CloseHandle(mapping_handle);
+    if (file_handle) CloseHandle(file_handle);
+    ptr            = nullptr;
+    mapping_handle = nullptr;
+    file_handle    = nullptr;
+    length         = 0;
+    is_open        = false;
+}
+
+void MemoryMappedFile::adviseSequential() const {}
+
+#else
+
+bool MemoryMappedFile::open(const std::string& file)
+{
+    close();
+
+    int fd = ::open(file.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        ::close(fd);
+        return false;
+    }
+
+    length  = st.st_size;
+    is_open = true;
+    if (length > 0)
+    {
+        void* p = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED)
+        {
+            ::close(fd);
+            length  = 0;
+            is_open = false;
+            return false;
+        }
+        ptr = (const char*)p;
+    }
+    // The mapping stays valid after closing the file descriptor
+    ::close(fd);
+    return true;
+}
+
+void MemoryMappedFile::close()
+{
+    if (ptr) munmap((void*)ptr, length);
+    ptr     = nullptr;
+    length  = 0;
+    is_open = false;
+}
+
+void MemoryMappedFile::adviseSequential() const
+{
+    if (ptr) madvise((void*)ptr, length, MADV_SEQUENTIAL);
+}
+#endif
+
+}  // namespace Saiga
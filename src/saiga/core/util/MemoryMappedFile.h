@@ -0,0 +1,63 @@
+/**
+ * Copyright (c) 2021 Darius Rückert
+ * Licensed under the MIT License.
+ * See LICENSE file for more information.
+ */
+
+#pragma once
+
+#include "saiga/config.h"
+#include "saiga/core/util/DataStructures/ArrayView.h"
+
+#include <string>
+
+namespace Saiga
+{
+/**
+ * A read-only memory mapping of a complete file.
+ * The pages are loaded lazily by the OS when they are accessed, so opening even very large files is cheap.
+ *
+ * Usage:
+ *
+ *   MemoryMappedFile file(path);
+ *   if (!file.valid()) ...
+ *   const char* data = file.data();
+ */
+class SAIGA_CORE_API MemoryMappedFile
+{
+   public:
+    MemoryMappedFile() {}
+    MemoryMappedFile(const std::string& file) { open(file); }
+    ~MemoryMappedFile() { close(); }
+
+    MemoryMappedFile(const MemoryMappedFile&) = delete;
+    MemoryMappedFile& operator=(const MemoryMappedFile&) = delete;
+
+    MemoryMappedFile(MemoryMappedFile&& other) noexcept { *this = std::move(other); }
+    MemoryMappedFile& operator=(MemoryMappedFile&& other) noexcept;
+
+    // Returns false if the file could not be opened or mapped.
+    // Empty files are valid, but data() is a nullptr.
+    bool open(const std::string& file);
+    void close();
+
+    bool valid() const { return is_open; }
+    const char* data() const { return ptr; }
+    size_t size() const { return length; }
+    ArrayView<const char> view() const { return ArrayView<const char>(ptr, length); }
+
+    // Tells the OS that the file will be read sequentially (more aggressive read-ahead).
+    void adviseSequential() const;
+
+   private:
+    const char* ptr = nullptr;
+    size_t length   = 0;
+    bool is_open    = false;
+
+#ifdef _WIN32
+    void* file_handle    = nullptr;
+    void* mapping_handle = nullptr;
+#endif
+};
+
+}  // namespace Saiga
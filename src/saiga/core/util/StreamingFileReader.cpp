@@ -0,0 +1,175 @@
+/**
+ * Copyright (c) 2021 Darius Rückert
+ * Licensed under the MIT License.
+ * See LICENSE file for more information.
+ */
+
+#include "StreamingFileReader.h"
+
+#include "saiga/core/util/assert.h"
+#include "saiga/core/util/tostring.h"
+
+#include <cstdio>
+#include <iostream>
+
+#ifdef SAIGA_USE_ZLIB
+#    include <zlib.h>
+#endif
+
+#ifdef SAIGA_USE_BZIP2
+#    include <bzlib.h>
+#endif
+
+namespace Saiga
+{
+bool StreamingFileReader::open(const std::string& file)
+{
+    close();
+    end_of_file = false;
+
+    if (hasEnding(file, ".gz"))
+    {
+        type = Compression::Gzip;
+#ifdef SAIGA_USE_ZLIB
+        gzFile f = gzopen(file.c_str(), "rb");
+        if (f)
+        {
+            // Larger internal buffer for faster decompression
+            gzbuffer(f, 1 << 20);
+        }
+        handle = f;
+#else
+        std::cout << "StreamingFileReader: zlib not found. Can not read " << file << std::endl;
+#endif
+    }
+    else if (hasEnding(file, ".bz2"))
+    {
+        type = Compression::Bzip2;
+#ifdef SAIGA_USE_BZIP2
+        FILE* f = std::fopen(file.c_str(), "rb");
+        if (f)
+        {
+            int error;
+            bz_file = BZ2_bzReadOpen(&error, f, 0, 0, nullptr, 0);
+            if (error != BZ_OK)
+            {
+                BZ2_bzReadClose(&error, bz_file);
+                bz_file = nullptr;
+                std::fclose(f);
+                f = nullptr;
+            }
+        }
+        handle = f;
+#else
+        std::cout << "StreamingFileReader: bzip2 not found. Can not read " << file << std::endl;
+#endif
+    }
+    else
+    {
+        type   = Compression::None;
+        handle = std::fopen(file.c_str(), "rb");
+    }
+    return valid();
+}
+
+void StreamingFileReader::close()
+{
+    if (!handle) return;
+
+    switch (type)
+    {
+        case Compression::None:
+            std::fclose((FILE*)handle);
+            break;
+        case Compression::Gzip:
+#ifdef SAIGA_USE_ZLIB
+            gzclose((gzFile)handle);
+#endif
+            break;
+        case Compression::Bzip2:
+#ifdef SAIGA_USE_BZIP2
+        {
+            int error;
+            if (bz_file) BZ2_bzReadClose(&error, bz_file);
+            std::fclose((FILE*)handle);
+        }
+#endif
+        break;
+    }
+    handle  = nullptr;
+    bz_file = nullptr;
+}
+
+size_t StreamingFileReader::read(char* dst, size_t size)
+{
+    SAIGA_ASSERT(valid());
+    size_t total = 0;
+
+    while (total < size && !end_of_file)
+    {
+        // The decompressors read at most INT_MAX bytes per call
+        int chunk = std::min<size_t>(size - total, 1 << 30);
+        size_t n  = 0;
+        switch (type)
+        {
+            case Compression::None:
+                n           = std::fread(dst + total, 1, chunk, (FILE*)handle);
+                end_of_file = n < (size_t)chunk;
+                SAIGA_ASSERT(!std::ferror((FILE*)handle), "Read error.");
+                break;
+            case Compression::Gzip:
+#ifdef SAIGA_USE_ZLIB
+            {
+                int r = gzread((gzFile)handle, dst + total, chunk);
+                SAIGA_ASSERT(r >= 0, "Corrupt gzip file.");
+                n           = r;
+                end_of_file = n < (size_t)chunk;
+            }
+#endif
+            break;
+            case Compression::Bzip2:
+#ifdef SAIGA_USE_BZIP2
+            {
+                int error;
+                int r = BZ2_bzRead(&error, bz_file, dst + total, chunk);
+                SAIGA_ASSERT(error == BZ_OK || error == BZ_STREAM_END, "Corrupt bzip2 file.");
+                n = r;
+                if (error == BZ_STREAM_END)
+                {
+                    // Files created by parallel compressors (pbzip2, lbzip2) contain multiple streams
+                    void* unused;
+                    int num_unused;
+                    BZ2_bzReadGetUnused(&error, bz_file, &unused, &num_unused);
+                    std::vector<char> remaining((char*)unused, (char*)unused + num_unused);
+                    BZ2_bzReadClose(&error, bz_file);
+                    bz_file = nullptr;
+
+                    bool more = !remaining.empty() || std::getc((FILE*)handle) != EOF;
+                    if (more && remaining.empty()) std::fseek((FILE*)handle, -1, SEEK_CUR);
+                    if (more)
+                    {
+                        bz_file = BZ2_bzReadOpen(&error, (FILE*)handle, 0, 0, remaining.data(), remaining.size());
+                        SAIGA_ASSERT(error == BZ_OK, "Corrupt bzip2 file.");
+                    }
+                    else
+                    {
+                        end_of_file = true;
+                    }
+                }
+            }
+#endif
+            break;
+        }
+        total += n;
+    }
+    return total;
+}
+
+size_t StreamingFileReader::read(std::vector<char>& dst, size_t size)
+{
+    dst.resize(size);
+    dst.resize(read(dst.data(), size));
+    return dst.size();
+}
+
+}  // namespace Saiga
@@ -0,0 +1,69 @@
+/**
+ * Copyright (c) 2021 Darius Rückert
+ * Licensed under the MIT License.
+ * See LICENSE file for more information.
+ */
+
+#pragma once
+
+#include "saiga/config.h"
+
+#include <string>
+#include <vector>
+
+namespace Saiga
+{
+/**
+ * Sequential reader for large, possibly compressed files.
+ * Files ending with .gz are decompressed with zlib and files ending with .bz2 with libbzip2 while they are read.
+ * Only a small part of the file is kept in memory.
+ *
+ * Usage:
+ *
+ *   StreamingFileReader reader(path);
+ *   if (!reader.valid()) ...
+ *   std::vector<char> block;
+ *   while (reader.read(block, 1 << 20) > 0) ...
+ */
+class SAIGA_CORE_API StreamingFileReader
+{
+   public:
+    enum class Compression
+    {
+        None,
+        Gzip,
+        Bzip2,
+    };
+
+    StreamingFileReader() {}
+    StreamingFileReader(const std::string& file) { open(file); }
+    ~StreamingFileReader() { close(); }
+
+    StreamingFileReader(const StreamingFileReader&) = delete;
+    StreamingFileReader& operator=(const StreamingFileReader&) = delete;
+
+    // The compression is detected from the file ending.
+    // Returns false if the file could not be opened or the decompressor is not available.
+    bool open(const std::string& file);
+    void close();
+
+    bool valid() const { return handle != nullptr; }
+    bool eof() const { return end_of_file; }
+    Compression compression() const { return type; }
+
+    // Reads up to 'size' (decompressed) bytes to 'dst'.
+    // Returns the number of bytes read, which is only smaller than 'size' at the end of the file.
+    // Read errors (for example corrupt compressed data) are fatal.
+    size_t read(char* dst, size_t size);
+
+    // Replaces the content of 'dst' by the next 'size' bytes.
+    size_t read(std::vector<char>& dst, size_t size);
+
+   private:
+    void* handle     = nullptr;
+    void* bz_file    = nullptr;
+    Compression type = Compression::None;
+    bool end_of_file = false;
+};
+
+}  // namespace Saiga
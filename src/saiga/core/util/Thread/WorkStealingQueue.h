@@ -0,0 +1,145 @@
+/**
+ * Copyright (c) 2021 Darius Rückert
+ * Licensed under the MIT License.
+ * See LICENSE file for more information.
+ */
+
+#pragma once
+
+#include "saiga/config.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+namespace Saiga
+{
+/**
+ * Lock-free work stealing deque (Chase-Lev).
+ *
+ * The owner thread pushes and pops at the bottom (LIFO). All other threads steal from the top (FIFO).
+ * The buffer grows when it is full. Old buffers are kept until the queue is destroyed, because a thief might
+ * still read from them.
+ *
+ * Implementation of:
+ *   Lê, Pop, Cohen, Zappa Nardelli. "Correct and Efficient Work-Stealing for Weak Memory Models", PPoPP 2013.
+ *
+ * T must be trivially copyable, usually a pointer.
+ */
+template <typename T>
+class WorkStealingQueue
+{
+    static_assert(std::is_trivially_copyable<T>::value, "T must be trivially copyable.");
+
+   public:
+    WorkStealingQueue(int64_t initial_capacity = 256)
+    {
+        int64_t capacity = 1;
+        while (capacity < initial_capacity) capacity *= 2;
+        buffers.push_back(std::make_unique<Buffer>(capacity));
+        buffer.store(buffers.back().get(), std::memory_order_relaxed);
+    }
+
+    WorkStealingQueue(const WorkStealingQueue&) = delete;
+    WorkStealingQueue& operator=(const WorkStealingQueue&) = delete;
+
+    // Owner only
+    void push(T item)
+    {
+        int64_t b = bottom.load(std::memory_order_relaxed);
+        int64_t t = top.load(std::memory_order_acquire);
+        Buffer* a = buffer.load(std::memory_order_relaxed);
+        if (b - t > a->capacity - 1)
+        {
+            a = grow(a, t, b);
+        }
+        a->store(b, item);
+        std::atomic_thread_fence(std::memory_order_release);
+        bottom.store(b + 1, std::memory_order_relaxed);
+    }
+
+    // Owner only
+    bool pop(T& item)
+    {
+        int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+        Buffer* a = buffer.load(std::memory_order_relaxed);
+        bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = top.load(std::memory_order_relaxed);
+
+        if (t > b)
+        {
+            // Empty
+            bottom.store(b + 1, std::memory_order_relaxed);
+            return false;
+        }
+
+        item = a->load(b);
+        if (t == b)
+        {
+            // The last element: race against the thieves
+            bool won = top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+            bottom.store(b + 1, std::memory_order_relaxed);
+            return won;
+        }
+        return true;
+    }
+
+    // Any thread
+    bool steal(T& item)
+    {
+        int64_t t = top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t b = bottom.load(std::memory_order_acquire);
+
+        if (t >= b) return false;
+
+        Buffer* a = buffer.load(std::memory_order_acquire);
+        item      = a->load(t);
+        return top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+    }
+
+    // Approximate number of elements
+    int64_t size() const
+    {
+        int64_t b = bottom.load(std::memory_order_relaxed);
+        int64_t t = top.load(std::memory_order_relaxed);
+        return b > t ? b - t : 0;
+    }
+
+    bool empty() const { return size() == 0; }
+
+   private:
+    struct Buffer
+    {
+        int64_t capacity;
+        int64_t mask;
+        std::unique_ptr<std::atomic<T>[]> data;
+
+        Buffer(int64_t capacity) : capacity(capacity), mask(capacity - 1), data(new std::atomic<T>[capacity]) {}
+
+        T load(int64_t i) const { return data[i & mask].load(std::memory_order_relaxed); }
+        void store(int64_t i, T item) { data[i & mask].store(item, std::memory_order_relaxed); }
+    };
+
+    Buffer* grow(Buffer* a, int64_t t, int64_t b)
+    {
+        auto new_buffer = std::make_unique<Buffer>(a->capacity * 2);
+        for (int64_t i = t; i < b; ++i) new_buffer->store(i, a->load(i));
+        buffers.push_back(std::move(new_buffer));
+        buffer.store(buffers.back().get(), std::memory_order_release);
+        return buffers.back().get();
+    }
+
+    // top and bottom on different cache lines to avoid false sharing between the owner and the thieves
+    alignas(64) std::atomic<int64_t> top{0};
+    alignas(64) std::atomic<int64_t> bottom{0};
+    alignas(64) std::atomic<Buffer*> buffer{nullptr};
+
+    // All buffers ever allocated. Only modified by the owner.
+    std::vector<std::unique_ptr<Buffer>> buffers;
+};
+
+}  // namespace Saiga
@@ -21,10 +21,12 @@
 
 /**
  * This file was modified by Darius Rueckert for libsaiga.
+ *  - Replaced the single locked queue by a work-stealing scheduler
  */
 
 #include "threadPool.h"
 
+#include "saiga/core/util/Thread/SpinLock.h"
 #include "saiga/core/util/Thread/threadName.h"
 #include "saiga/core/util/assert.h"
 
@@ -32,29 +34,98 @@
 
 namespace Saiga
 {
-ThreadPool::ThreadPool(size_t threads, const std::string& name) : name(name), stop(false)
+namespace
+{
+// The pool and index of the worker running on this thread
+struct CurrentWorker
+{
+    const ThreadPool* pool = nullptr;
+    int id                 = -1;
+};
+thread_local CurrentWorker current_worker;
+
+// Number of spin rounds of an idle worker before it goes to sleep
+constexpr int kSpinRounds = 64;
+
+// Maximum number of free task nodes cached per thread
+constexpr int kMaxFreeNodes = 1024;
+
+inline uint64_t XorShift(uint64_t& state)
+{
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+}
+}  // namespace
+
+
+// Each thread keeps a small list of free task nodes. Nodes are returned to the list of the thread which executed them,
+// so in a steady state no allocations are required.
+struct ThreadPool::FreeNodeList
+{
+    TaskNode* head = nullptr;
+    int size       = 0;
+
+    ~FreeNodeList()
+    {
+        while (head)
+        {
+            TaskNode* next = head->next;
+            delete head;
+            head = next;
+        }
+    }
+};
+
+ThreadPool::FreeNodeList& ThreadPool::freeNodes()
+{
+    static thread_local FreeNodeList list;
+    return list;
+}
+
+ThreadPool::TaskNode* ThreadPool::allocateNode()
+{
+    auto& list = freeNodes();
+    if (list.head)
+    {
+        TaskNode* node = list.head;
+        list.head      = node->next;
+        list.size--;
+        return node;
+    }
+    return new TaskNode();
+}
+
+void ThreadPool::freeNode(TaskNode* node)
+{
+    node->task.reset();
+    node->group = nullptr;
+
+    auto& list = freeNodes();
+    if (list.size >= kMaxFreeNodes)
+    {
+        delete node;
+        return;
+    }
+    node->next = list.head;
+    list.head  = node;
+    list.size++;
+}
+
+ThreadPool::ThreadPool(size_t threads, const std::string& name) : name(name)
 {
-    workingThreads = threads;
     for (size_t i = 0; i < threads; ++i)
     {
-        workers.emplace_back([this, i, name] {
-            setThreadName(name + std::to_string(i));
-            for (;;)
-            {
-                std::function<void()> task;
-
-                {
-                    std::unique_lock<std::mutex> lock(this->queue_mutex);
-                    workingThreads--;
-                    this->condition.wait(lock, [this] { return this->stop || !this->tasks.empty(); });
-                    if (this->stop && this->tasks.empty()) return;
-                    workingThreads++;
-                    task = std::move(this->tasks.front());
-                    this->tasks.pop();
-                }
-
-                task();
-            }
+        workers.push_back(std::make_unique<Worker>());
+        workers.back()->rng_state = 0x9E3779B97F4A7C15ull * (i + 1);
+    }
+    working_threads = threads;
+    for (size_t i = 0; i < threads; ++i)
+    {
+        workers[i]->thread = std::thread([this, i] {
+            setThreadName(this->name + std::to_string(i));
+            workerLoop(i);
         });
     }
 }
@@ -67,15 +138,226 @@ ThreadPool::~ThreadPool()
 void ThreadPool::quit()
 {
     {
-        std::unique_lock<std::mutex> lock(queue_mutex);
+        std::unique_lock<std::mutex> lock(sleep_mutex);
         if (stop) return;
         stop = true;
     }
-    condition.notify_all();
-    for (std::thread& worker : workers) worker.join();
+    sleep_condition.notify_all();
+    for (auto& worker : workers) worker->thread.join();
+
+    // Tasks which were submitted while the workers were leaving
+    while (TaskNode* node = findTask()) execute(node);
     workers.clear();
 }
 
+size_t ThreadPool::queueSize()
+{
+    int64_t size = injection_size.load(std::memory_order_relaxed);
+    for (auto& worker : workers) size += worker->queue.size();
+    return size;
+}
+
+int ThreadPool::currentWorker() const
+{
+    return current_worker.pool == this ? current_worker.id : -1;
+}
+
+void ThreadPool::submit(Task&& task, TaskGroup* group)
+{
+    if (workers.empty())
+    {
+        // Single threaded behaviour
+        TaskNode node;
+        node.task  = std::move(task);
+        node.group = group;
+        try
+        {
+            node.task();
+        }
+        catch (...)
+        {
+            if (!group) throw;
+            group->setException(std::current_exception());
+        }
+        node.task.reset();
+        if (group) group->finishTask();
+        return;
+    }
+
+    TaskNode* node = allocateNode();
+    node->task     = std::move(task);
+    node->group    = group;
+
+    int id = currentWorker();
+    if (id >= 0)
+    {
+        workers[id]->queue.push(node);
+    }
+    else
+    {
+        std::unique_lock<std::mutex> lock(injection_mutex);
+        injection.push_back(node);
+        injection_size.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Wake up a sleeping worker
+    epoch.fetch_add(1, std::memory_order_seq_cst);
+    if (sleeping.load(std::memory_order_seq_cst) > 0)
+    {
+        {
+            std::unique_lock<std::mutex> lock(sleep_mutex);
+        }
+        sleep_condition.notify_one();
+    }
+}
+
+ThreadPool::TaskNode* ThreadPool::findTask()
+{
+    TaskNode* node = nullptr;
+    int id         = currentWorker();
+
+    // 1. Own deque (newest task first)
+    if (id >= 0 && workers[id]->queue.pop(node)) return node;
+
+    // 2. Tasks from outside of the pool (oldest first)
+    if (injection_size.load(std::memory_order_relaxed) > 0)
+    {
+        std::unique_lock<std::mutex> lock(injection_mutex);
+        if (!injection.empty())
+        {
+            node = injection.front();
+            injection.pop_front();
+            injection_size.fetch_sub(1, std::memory_order_relaxed);
+            return node;
+        }
+    }
+
+    // 3. Steal the oldest task of another worker, starting at a random victim
+    const int n = workers.size();
+    if (n == 0) return nullptr;
+    static thread_local uint64_t rng_state = 0x2545F4914F6CDD1Dull ^ reinterpret_cast<uintptr_t>(&rng_state);
+
+    uint64_t& state = id >= 0 ? workers[id]->rng_state : rng_state;
+    int start       = XorShift(state) % n;
+    for (int i = 0; i < n; ++i)
+    {
+        int victim = (start + i) % n;
+        if (victim == id) continue;
+        if (workers[victim]->queue.steal(node)) return node;
+    }
+    return nullptr;
+}
+
+void ThreadPool::execute(TaskNode* node)
+{
+    TaskGroup* group = node->group;
+    if (group)
+    {
+        try
+        {
+            node->task();
+        }
+        catch (...)
+        {
+            group->setException(std::current_exception());
+        }
+    }
+    else
+    {
+        node->task();
+    }
+    freeNode(node);
+    if (group) group->finishTask();
+}
+
+void ThreadPool::workerLoop(int id)
+{
+    current_worker = {this, id};
+
+    while (true)
+    {
+        uint64_t last_epoch = epoch.load(std::memory_order_seq_cst);
+
+        TaskNode* node = nullptr;
+        for (int k = 0; k < kSpinRounds && !node; ++k)
+        {
+            node = findTask();
+            if (!node) yield(k);
+        }
+
+        if (node)
+        {
+            execute(node);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleep_mutex);
+        if (stop) break;
+        sleeping.fetch_add(1, std::memory_order_seq_cst);
+        working_threads.fetch_sub(1, std::memory_order_relaxed);
+        sleep_condition.wait(lock, [&]() { return stop || epoch.load(std::memory_order_seq_cst) != last_epoch; });
+        working_threads.fetch_add(1, std::memory_order_relaxed);
+        sleeping.fetch_sub(1, std::memory_order_seq_cst);
+    }
+
+    // Finish the remaining tasks of this worker
+    while (TaskNode* node = findTask()) execute(node);
+    current_worker = {};
+}
+
+TaskGroup::~TaskGroup()
+{
+    try
+    {
+        wait();
+    }
+    catch (...)
+    {
+        // The exception was not collected by the user
+    }
+}
+
+void TaskGroup::wait()
+{
+    for (unsigned k = 0; !done(); ++k)
+    {
+        if (ThreadPool::TaskNode* node = pool.findTask())
+        {
+            pool.execute(node);
+            k = 0;
+        }
+        else
+        {
+            yield(k);
+        }
+    }
+
+    std::exception_ptr e;
+    {
+        std::unique_lock<std::mutex> lock(exception_mutex);
+        std::swap(e, exception);
+    }
+    if (e) std::rethrow_exception(e);
+}
+
+void TaskGroup::finishTask()
+{
+    in_finish.fetch_add(1, std::memory_order_seq_cst);
+    if (pending.fetch_sub(1, std::memory_order_acq_rel) == 1 && has_continuation.exchange(false))
+    {
+        // The last task of the group starts the continuation
+        Task c = std::move(continuation);
+        pool.submit(std::move(c), nullptr);
+    }
+    in_finish.fetch_sub(1, std::memory_order_release);
+}
+
+void TaskGroup::setException(std::exception_ptr e)
+{
+    std::unique_lock<std::mutex> lock(exception_mutex);
+    if (!exception) exception = e;
+}
+
 std::unique_ptr<ThreadPool> globalThreadPool;
 
 void createGlobalThreadPool(int threads)
@@ -83,7 +365,7 @@ void createGlobalThreadPool(int threads)
     if (threads < 0)
     {
 #if defined(_OPENMP)
-        threads = omp_get_thread_num();
+        threads = omp_get_max_threads();
 #else
         threads = std::thread::hardware_concurrency();
         if (threads <= 0)
@@ -21,56 +21,313 @@
 
 /**
  * This file was modified by Darius Rueckert for libsaiga.
+ *  - Replaced the single locked queue by a work-stealing scheduler
  */
 
 #pragma once
 
 #include "saiga/config.h"
+#include "saiga/core/util/Thread/WorkStealingQueue.h"
 
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <deque>
+#include <exception>
 #include <functional>
 #include <future>
 #include <memory>
 #include <mutex>
-#include <queue>
+#include <new>
 #include <stdexcept>
+#include <string>
 #include <thread>
+#include <tuple>
+#include <type_traits>
 #include <vector>
 
 #include <condition_variable>
 
 namespace Saiga
 {
+/**
+ * A move-only void() callable with small buffer optimization.
+ * Callables up to kBufferSize bytes (for example lambdas with a few captures) are stored inline without a heap
+ * allocation.
+ */
+class Task
+{
+   public:
+    static constexpr size_t kBufferSize = 64;
+
+    Task() {}
+
+    template <typename F, typename = std::enable_if_t<!std::is_same<std::decay_t<F>, Task>::value>>
+    Task(F&& f)
+    {
+        using Function = std::decay_t<F>;
+        if constexpr (sizeof(Function) <= kBufferSize && alignof(Function) <= alignof(std::max_align_t) &&
+                      std::is_nothrow_move_constructible<Function>::value)
+        {
+            new (buffer) Function(std::forward<F>(f));
+            ops = &InlineOps<Function>::ops;
+        }
+        else
+        {
+            *reinterpret_cast<Function**>(buffer) = new Function(std::forward<F>(f));
+            ops                                   = &HeapOps<Function>::ops;
+        }
+    }
+
+    Task(Task&& other) noexcept { *this = std::move(other); }
+
+    Task& operator=(Task&& other) noexcept
+    {
+        if (this != &other)
+        {
+            reset();
+            if (other.ops)
+            {
+                other.ops->move(buffer, other.buffer);
+                ops       = other.ops;
+                other.ops = nullptr;
+            }
+        }
+        return *this;
+    }
+
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+
+    ~Task() { reset(); }
+
+    void reset()
+    {
+        if (ops)
+        {
+            ops->destroy(buffer);
+            ops = nullptr;
+        }
+    }
+
+    explicit operator bool() const { return ops != nullptr; }
+
+    void operator()() { ops->invoke(buffer); }
+
+   private:
+    struct Ops
+    {
+        void (*invoke)(void*);
+        void (*move)(void* dst, void* src);
+        void (*destroy)(void*);
+    };
+
+    template <typename F>
+    struct InlineOps
+    {
+        static void invoke(void* p) { (*reinterpret_cast<F*>(p))(); }
+        static void move(void* dst, void* src)
+        {
+            new (dst) F(std::move(*reinterpret_cast<F*>(src)));
+            reinterpret_cast<F*>(src)->~F();
+        }
+        static void destroy(void* p) { reinterpret_cast<F*>(p)->~F(); }
+        static constexpr Ops ops = {invoke, move, destroy};
+    };
+
+    template <typename F>
+    struct HeapOps
+    {
+        static void invoke(void* p) { (**reinterpret_cast<F**>(p))(); }
+        static void move(void* dst, void* src) { *reinterpret_cast<F**>(dst) = *reinterpret_cast<F**>(src); }
+        static void destroy(void* p) { delete *reinterpret_cast<F**>(p); }
+        static constexpr Ops ops = {invoke, move, destroy};
+    };
+
+    alignas(std::max_align_t) unsigned char buffer[kBufferSize];
+    const Ops* ops = nullptr;
+};
+
+class TaskGroup;
+
+/**
+ * Work-stealing thread pool.
+ *
+ * Each worker has its own lock-free deque (see WorkStealingQueue). Tasks spawned from a worker are pushed to its
+ * own deque and executed in LIFO order. Idle workers steal the oldest tasks of other workers. Tasks submitted from
+ * other threads go to a shared injection queue. Idle workers spin for a short time and then sleep until new work
+ * arrives.
+ *
+ * A pool with 0 threads executes all tasks immediately in the calling thread.
+ *
+ * Usage:
+ *
+ *   ThreadPool pool(8);
+ *   auto future = pool.enqueue([](int x) { return x * 2; }, 21);
+ *
+ *   pool.parallel_for(0, n, [&](int64_t i) { data[i] *= 2; }, 1024);
+ *
+ *   TaskGroup group(pool);
+ *   group.run([&]() { a(); });
+ *   group.run([&]() { b(); });
+ *   group.then([&]() { c(); });  // runs after a and b without blocking
+ *   group.wait();                // executes other tasks while waiting
+ */
 class SAIGA_CORE_API ThreadPool
 {
    public:
     ThreadPool(size_t threads, const std::string& name = "ThreadPool");
     ~ThreadPool();
 
+    /**
+     * Executes f(args...) asynchronously and returns the future of the result.
+     */
     template <class F, class... Args>
     auto enqueue(F&& f, Args&&... args) -> std::future<typename std::invoke_result_t<F, Args...>>;
 
+    /**
+     * Fire and forget. Cheaper than enqueue, because no future is created.
+     * Exceptions thrown by the task terminate the program.
+     */
+    template <class F>
+    void spawn(F&& f)
+    {
+        submit(Task(std::forward<F>(f)), nullptr);
+    }
+
+    /**
+     * Calls f(i) for all i in [begin, end). The range is split recursively until the chunks are smaller or equal to
+     * 'grain_size'. The calling thread helps executing the chunks and returns when all are done.
+     */
+    template <class F>
+    void parallel_for(int64_t begin, int64_t end, F&& f, int64_t grain_size = 1);
+
+    /**
+     * Waits until all tasks are finished and joins the workers.
+     */
     void quit();
 
-    size_t queueSize()
+    // Approximate number of tasks waiting for execution
+    size_t queueSize();
+
+    // Approximate number of workers which are not sleeping
+    size_t getWorkingThreads() { return working_threads.load(std::memory_order_relaxed); }
+
+    size_t numThreads() const { return workers.size(); }
+
+   private:
+    friend class TaskGroup;
+
+    struct TaskNode
+    {
+        Task task;
+        TaskGroup* group = nullptr;
+        TaskNode* next   = nullptr;
+    };
+
+    struct alignas(64) Worker
+    {
+        WorkStealingQueue<TaskNode*> queue;
+        std::thread thread;
+        uint64_t rng_state = 0;
+    };
+
+    void submit(Task&& task, TaskGroup* group);
+
+    // Finds a task for the calling thread: own deque, injection queue, stealing from other workers
+    TaskNode* findTask();
+    void execute(TaskNode* node);
+    void workerLoop(int id);
+
+    // The index of the calling thread in this pool or -1 if it is not a worker of this pool
+    int currentWorker() const;
+
+    // Each thread caches a few free task nodes
+    struct FreeNodeList;
+    static FreeNodeList& freeNodes();
+    static TaskNode* allocateNode();
+    static void freeNode(TaskNode* node);
+
+    template <class F>
+    void parallel_for_split(TaskGroup& group, int64_t begin, int64_t end, const F& f, int64_t grain_size);
+
+    std::string name;
+    std::vector<std::unique_ptr<Worker>> workers;
+
+    std::mutex injection_mutex;
+    std::deque<TaskNode*> injection;
+    std::atomic<int64_t> injection_size{0};
+
+    // Sleeping: a worker only sleeps if the epoch did not change since its last unsuccessful search
+    std::mutex sleep_mutex;
+    std::condition_variable sleep_condition;
+    std::atomic<uint64_t> epoch{0};
+    std::atomic<int> sleeping{0};
+    std::atomic<size_t> working_threads{0};
+    std::atomic<bool> stop{false};
+};
+
+/**
+ * A set of tasks which can be waited on.
+ *
+ * wait() does not block the calling thread. Instead, it executes pending tasks of the pool until all tasks of the
+ * group are finished. Therefore, task groups can be nested (tasks may create groups and wait on them) without
+ * deadlocks.
+ *
+ * The first exception thrown by a task of the group is rethrown by wait().
+ */
+class SAIGA_CORE_API TaskGroup
+{
+   public:
+    TaskGroup(ThreadPool& pool) : pool(pool) {}
+    ~TaskGroup();
+
+    TaskGroup(const TaskGroup&) = delete;
+    TaskGroup& operator=(const TaskGroup&) = delete;
+
+    template <class F>
+    void run(F&& f)
     {
-        std::unique_lock<std::mutex> lock(queue_mutex);
-        return tasks.size();
+        pending.fetch_add(1, std::memory_order_relaxed);
+        pool.submit(Task(std::forward<F>(f)), this);
     }
-    size_t getWorkingThreads() { return workingThreads; }
+
+    /**
+     * Schedules f after all tasks of this group have finished (without blocking the calling thread).
+     * Must be called after the last run(). The continuation is not part of the group.
+     */
+    template <class F>
+    void then(F&& f)
+    {
+        // The extra reference makes sure that no task sees pending == 0 before the continuation is set
+        pending.fetch_add(1, std::memory_order_relaxed);
+        continuation = Task(std::forward<F>(f));
+        has_continuation.store(true, std::memory_order_release);
+        finishTask();
+    }
+
+    // Executes other tasks until all tasks of this group are finished
+    void wait();
+
+    bool done() const { return pending.load(std::memory_order_acquire) == 0 && in_finish.load() == 0; }
 
    private:
-    // number of currently working threads
-    size_t workingThreads = 0;
-    std::string name;
-    // need to keep track of threads so we can join them
-    std::vector<std::thread> workers;
-    // the task queue
-    std::queue<std::function<void()> > tasks;
-
-    // synchronization
-    std::mutex queue_mutex;
-    std::condition_variable condition;
-    bool stop;
+    friend class ThreadPool;
+
+    void finishTask();
+    void setException(std::exception_ptr e);
+
+    ThreadPool& pool;
+    std::atomic<int> pending{0};
+
+    // Number of threads in finishTask(). The group must not be destroyed before they have left.
+    std::atomic<int> in_finish{0};
+
+    Task continuation;
+    std::atomic<bool> has_continuation{false};
+
+    std::mutex exception_mutex;
+    std::exception_ptr exception;
 };
 
 template <class F, class... Args>
@@ -78,39 +335,58 @@ auto ThreadPool::enqueue(F&& f, Args&&... args) -> std::future<typename std::inv
 {
     using return_type = typename std::invoke_result_t<F, Args...>;
 
-
-    auto task = std::make_shared<std::packaged_task<return_type()> >(
-        std::bind(std::forward<F>(f), std::forward<Args>(args)...));
-    std::future<return_type> res = task->get_future();
-
+    std::packaged_task<return_type()> task(
+        [f = std::forward<F>(f), args = std::make_tuple(std::forward<Args>(args)...)]() mutable {
+            return std::apply(std::move(f), std::move(args));
+        });
+    std::future<return_type> res = task.get_future();
 
     if (workers.size() == 0)
     {
         // This is an empty thread pool
         // -> execute this task here without adding it to the queue
         // -> emulate single threaded behaviour
-        (*task)();
+        task();
         return res;
     }
 
+    // don't allow enqueueing after stopping the pool
+    if (stop) throw std::runtime_error("enqueue on stopped ThreadPool");
 
-    {
-        std::unique_lock<std::mutex> lock(queue_mutex);
+    submit(Task([task = std::move(task)]() mutable { task(); }), nullptr);
+    return res;
+}
 
-        // don't allow enqueueing after stopping the pool
-        if (stop) throw std::runtime_error("enqueue on stopped ThreadPool");
+template <class F>
+void ThreadPool::parallel_for(int64_t begin, int64_t end, F&& f, int64_t grain_size)
+{
+    if (begin >= end) return;
+    TaskGroup group(*this);
+    parallel_for_split(group, begin, end, f, std::max<int64_t>(grain_size, 1));
+    group.wait();
+}
 
-        tasks.emplace([task]() { (*task)(); });
+template <class F>
+void ThreadPool::parallel_for_split(TaskGroup& group, int64_t begin, int64_t end, const F& f, int64_t grain_size)
+{
+    // The upper halves are spawned, the lowest chunk is executed by this thread
+    while (end - begin > grain_size)
+    {
+        int64_t mid = begin + (end - begin) / 2;
+        group.run([this, &group, &f, mid, end, grain_size]() { parallel_for_split(group, mid, end, f, grain_size); });
+        end = mid;
+    }
+    for (int64_t i = begin; i < end; ++i)
+    {
+        f(i);
     }
-    condition.notify_one();
-    return res;
 }
 
 /**
  * A global thread pool that can be used from everywhere.
  * Create it at the beginning with createGlobalThreadPool.
  *
- * -1 initializes the thread count with omp_get_thread_num
+ * -1 initializes the thread count with omp_get_max_threads
  */
 extern SAIGA_CORE_API std::unique_ptr<ThreadPool> globalThreadPool;
 extern SAIGA_CORE_API void createGlobalThreadPool(int threads = -1);
@@ -8,6 +8,8 @@
 
 #include "saiga/core/util/assert.h"
 
+#include <cstring>
+
 #ifdef SAIGA_USE_ZLIB
 #    include <zlib.h>
 namespace Saiga
@@ -170,6 +172,27 @@ std::vector<unsigned char> uncompress(const void* data)
     return result;
 }
 
+bool uncompress(const void* data, size_t size, std::vector<unsigned char>& result)
+{
+    size_t header[3];
+    if (size < header_size) return false;
+    std::memcpy(header, data, header_size);
+
+    if (header[0] != magic_value || header[1] > size - header_size) return false;
+    size_t compressed_data_size   = header[1];
+    size_t decompressed_data_size = header[2];
+
+    result.resize(decompressed_data_size);
+    size_t actual_out_size = decompressed_data_size;
+    int err = uncompress3(result.data(), &actual_out_size, (const Byte*)data + header_size, &compressed_data_size);
+    if (err != Z_OK || actual_out_size != decompressed_data_size)
+    {
+        result.clear();
+        return false;
+    }
+    return true;
+}
+
 }  // namespace Saiga
 
 #endif
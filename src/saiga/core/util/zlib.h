@@ -26,6 +26,10 @@ namespace Saiga
 //
 SAIGA_CORE_API std::vector<unsigned char> compress(const void* data, std::size_t size);
 SAIGA_CORE_API std::vector<unsigned char> uncompress(const void* data);
+
+// Same as above, but for untrusted input. 'size' is the number of bytes readable at 'data'.
+// Returns false if the header or the compressed stream is invalid.
+SAIGA_CORE_API bool uncompress(const void* data, std::size_t size, std::vector<unsigned char>& result);
 }  // namespace Saiga
 
 #endif
@@ -14,6 +14,11 @@ void BAOptions::imgui()
 {
     ImGui::InputFloat("huberMono", &huberMono);
     ImGui::InputFloat("huberStereo", &huberStereo);
+
+    int currentItem             = (int)precision;
+    static const char* items[3] = {"Double", "Mixed", "Float"};
+    ImGui::Combo("Precision", &currentItem, items, 3);
+    precision = (Precision)currentItem;
 }
 
 
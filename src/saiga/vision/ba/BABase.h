@@ -22,6 +22,20 @@ struct SAIGA_VISION_API BAOptions
     int helper_threads = 1;
     int solver_threads = 1;
 
+    // Floating point precision of the recursive BA (BARec).
+    //  Double: Everything in double precision.
+    //  Mixed:  The linear system and the PCG solver in float. The parameters, the cost and the Jacobians are
+    //          evaluated in double and the Jacobians are only rounded to float when they are added to the system.
+    //  Float:  Everything in single precision.
+    // Float and Mixed halve the memory of the W blocks and the Schur complement. The final accuracy is lower.
+    enum class Precision : int
+    {
+        Double = 0,
+        Mixed  = 1,
+        Float  = 2
+    };
+    Precision precision = Precision::Double;
+
     void imgui();
 };
 
@@ -6,6 +6,7 @@
 #include "CameraBase.h"
 
 #include "saiga/core/Core.h"
+#include "saiga/core/util/Thread/threadName.h"
 namespace Saiga
 {
 void DatasetParameters::fromConfigFile(const std::string& file)
@@ -20,6 +21,9 @@ void DatasetParameters::fromConfigFile(const std::string& file)
     INI_GETADD(ini, group, maxFrames);
     INI_GETADD(ini, group, multiThreadedLoad);
     INI_GETADD(ini, group, preload);
+    INI_GETADD(ini, group, prefetch_frames);
+    INI_GETADD(ini, group, prefetch_threads);
+    INI_GETADD(ini, group, prefetch_memory_mb);
     INI_GETADD(ini, group, normalize_timestamps);
     INI_GETADD(ini, group, ground_truth_time_offset);
     if (ini.changed()) ini.SaveFile(file.c_str());
@@ -33,16 +37,29 @@ std::ostream& operator<<(std::ostream& strm, const DatasetParameters& params)
 
 DatasetCameraBase::DatasetCameraBase(const DatasetParameters& params) : params(params)
 {
-    timeStep =
-        std::chrono::duration_cast<tick_t>(std::chrono::duration<double, std::micro>(1000000.0 / params.playback_fps));
+    timeStep = tick_t(0);
+    if (params.playback_fps > 0)
+    {
+        timeStep = std::chrono::duration_cast<tick_t>(
+            std::chrono::duration<double, std::micro>(1000000.0 / params.playback_fps));
+    }
     ResetTime();
 }
 
+DatasetCameraBase::~DatasetCameraBase()
+{
+    // Stopping the threads here is too late, because the derived part is already destroyed.
+    SAIGA_ASSERT(prefetch_workers.empty(), "The derived dataset class must call StopPrefetch() in its destructor.");
+}
+
 void DatasetCameraBase::ResetTime()
 {
     timer.start();
     lastFrameTime = timer.stop();
     nextFrameTime = lastFrameTime + timeStep;
+
+    playbackBegin   = lastFrameTime;
+    playbackBeginId = this->currentId;
 }
 
 void DatasetCameraBase::Load()
@@ -69,6 +86,10 @@ void DatasetCameraBase::Load()
             loadingBar.addProgress(1);
         }
     }
+    else if (params.prefetch_frames > 0)
+    {
+        StartPrefetch();
+    }
     ResetTime();
 }
 
@@ -79,6 +100,10 @@ bool DatasetCameraBase::getImageSync(FrameData& data)
         return false;
     }
 
+    if (!prefetch_workers.empty() && timeStep > tick_t(0))
+    {
+        return getImageRealTime(data);
+    }
 
     auto t = timer.stop();
 
@@ -99,7 +124,20 @@ bool DatasetCameraBase::getImageSync(FrameData& data)
 
     auto& img = frames[this->currentId];
     SAIGA_ASSERT(this->currentId == img.id);
-    if (!params.preload)
+    if (!prefetch_workers.empty())
+    {
+        std::unique_lock l(prefetch_mutex);
+        prefetch_ready.wait(l, [this]() { return prefetch_state[this->currentId] == PrefetchState::Ready; });
+        prefetch_bytes -= prefetch_frame_bytes[this->currentId];
+        data = std::move(img);
+        this->currentId++;
+        prefetch_work.notify_all();
+        return true;
+    }
+
+    // Frames which have been prefetched before StopPrefetch() are not loaded again
+    bool prefetched = !prefetch_state.empty() && prefetch_state[this->currentId] == PrefetchState::Ready;
+    if (!params.preload && !prefetched)
     {
         LoadImageData(img);
     }
@@ -108,6 +146,138 @@ bool DatasetCameraBase::getImageSync(FrameData& data)
     return true;
 }
 
+bool DatasetCameraBase::getImageRealTime(FrameData& data)
+{
+    int last = (int)frames.size() - 1;
+    auto due = [this](int id) { return playbackBegin + (id - playbackBeginId) * timeStep; };
+
+    std::unique_lock l(prefetch_mutex);
+    while (true)
+    {
+        tick_t t = timer.stop();
+        if (t < due(this->currentId))
+        {
+            l.unlock();
+            std::this_thread::sleep_for(due(this->currentId) - t);
+            l.lock();
+            continue;
+        }
+
+        // Skip all frames before the frame which is due now. The last frame is never skipped.
+        int due_id = std::min<int>(playbackBeginId + (t - playbackBegin) / timeStep, last);
+        if (due_id > this->currentId)
+        {
+            for (int i = this->currentId; i < due_id; ++i)
+            {
+                // Frames which are still loading are released by the loading thread
+                if (prefetch_state[i] == PrefetchState::Ready)
+                {
+                    prefetch_bytes -= prefetch_frame_bytes[i];
+                    frames[i].FreeImageData();
+                }
+            }
+            this->currentId = due_id;
+            prefetch_next   = std::max(prefetch_next, due_id);
+            prefetch_work.notify_all();
+        }
+
+        auto ready = [this]() { return prefetch_state[this->currentId] == PrefetchState::Ready; };
+        if (this->currentId == last)
+        {
+            prefetch_ready.wait(l, ready);
+        }
+        else if (!prefetch_ready.wait_for(l, due(this->currentId) + timeStep - t, ready))
+        {
+            // Missed the deadline -> the next iteration skips this frame
+            continue;
+        }
+
+        auto& img = frames[this->currentId];
+        SAIGA_ASSERT(this->currentId == img.id);
+        prefetch_bytes -= prefetch_frame_bytes[this->currentId];
+        data = std::move(img);
+        this->currentId++;
+        prefetch_work.notify_all();
+        return true;
+    }
+}
+
+void DatasetCameraBase::StartPrefetch()
+{
+    StopPrefetch();
+
+    prefetch_state.assign(frames.size(), PrefetchState::Empty);
+    prefetch_frame_bytes.assign(frames.size(), 0);
+    prefetch_next       = this->currentId;
+    prefetch_bytes      = 0;
+    prefetch_last_bytes = 0;
+    prefetch_stop       = false;
+
+    for (int i = 0; i < std::max(params.prefetch_threads, 1); ++i)
+    {
+        prefetch_workers.emplace_back([this]() {
+            setThreadName("Saiga::Prefetch");
+            PrefetchLoop();
+        });
+    }
+}
+
+void DatasetCameraBase::StopPrefetch()
+{
+    {
+        std::unique_lock l(prefetch_mutex);
+        prefetch_stop = true;
+    }
+    prefetch_work.notify_all();
+    for (auto& t : prefetch_workers)
+    {
+        t.join();
+    }
+    prefetch_workers.clear();
+}
+
+void DatasetCameraBase::PrefetchLoop()
+{
+    size_t budget = params.prefetch_memory_mb * 1024 * 1024;
+
+    std::unique_lock l(prefetch_mutex);
+    while (true)
+    {
+        // The current frame is always loaded to prevent a deadlock with a tiny budget.
+        prefetch_work.wait(l, [&]() {
+            return prefetch_stop ||
+                   (prefetch_next < (int)frames.size() && prefetch_next < this->currentId + params.prefetch_frames &&
+                    (prefetch_bytes + prefetch_last_bytes <= budget || prefetch_next == this->currentId));
+        });
+        if (prefetch_stop) break;
+
+        // Reserve the size of the previous frame until the actual size is known
+        int id       = prefetch_next++;
+        size_t bytes = prefetch_last_bytes;
+        prefetch_state[id] = PrefetchState::Loading;
+        prefetch_bytes += bytes;
+
+        l.unlock();
+        auto& frame = frames[id];
+        LoadImageData(frame);
+        size_t actual = frame.image.size() + frame.image_rgb.size() + frame.depth_image.size() +
+                        frame.right_image.size() + frame.right_image_rgb.size();
+        l.lock();
+
+        prefetch_bytes           = prefetch_bytes - bytes + actual;
+        prefetch_last_bytes      = actual;
+        prefetch_frame_bytes[id] = actual;
+        prefetch_state[id]       = PrefetchState::Ready;
+        if (id < this->currentId)
+        {
+            // The frame has been skipped by getImageRealTime() while it was loading
+            prefetch_bytes -= actual;
+            frame.FreeImageData();
+        }
+        prefetch_ready.notify_all();
+    }
+}
+
 void DatasetCameraBase::saveGroundTruthTrajectory(const std::string& file)
 {
     std::ofstream strm(file);
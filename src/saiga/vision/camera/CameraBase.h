@@ -11,8 +11,10 @@
 
 #include "CameraData.h"
 
+#include <condition_variable>
 #include <fstream>
 #include <iomanip>
+#include <mutex>
 #include <thread>
 
 namespace Saiga
@@ -53,6 +55,7 @@ class SAIGA_TEMPLATE CameraBase
 struct SAIGA_VISION_API DatasetParameters
 {
     // The playback fps. Doesn't have to match the actual camera fps.
+    // With 0 the frames are returned as fast as possible.
     double playback_fps = 30;
 
     // Root directory of the dataset. The exact value depends on the dataset type.
@@ -73,6 +76,20 @@ struct SAIGA_VISION_API DatasetParameters
     // Load all images to ram at the beginning.
     bool preload = true;
 
+    // Only used if preload == false:
+    // Number of frames which are loaded by background threads ahead of the current frame. With 0 (the default) the
+    // images are loaded synchronously in getImageSync().
+    // If playback_fps > 0, the read-ahead plays the dataset in real time: A frame which is not loaded one frame period
+    // after it is due is skipped, together with all other frames that are due by then.
+    int prefetch_frames = 0;
+
+    // Number of background threads which load the prefetched frames.
+    int prefetch_threads = 2;
+
+    // Upper bound of the image memory of all prefetched frames in MB. The current frame is always loaded, even if it
+    // exceeds the budget.
+    double prefetch_memory_mb = 1024;
+
     // Subtract the timestamp of the first image from everything.
     bool normalize_timestamps = false;
 
@@ -92,6 +109,7 @@ class SAIGA_VISION_API DatasetCameraBase : public CameraBase
 {
    public:
     DatasetCameraBase(const DatasetParameters& params);
+    virtual ~DatasetCameraBase();
 
     void ResetTime();
 
@@ -124,12 +142,18 @@ class SAIGA_VISION_API DatasetCameraBase : public CameraBase
     // <timestamp> <translation x y z> <rotation x y z w>
     void saveGroundTruthTrajectory(const std::string& file);
 
-    // Completely removes the frames between from and to
+    // Completely removes the frames between from and to.
+    // Must be called before Load().
     void eraseFrames(int from, int to);
 
     void computeImuDataPerFrame();
 
+    // Stops the background loading threads and waits until they are finished.
+    // The threads call the virtual LoadImageData, therefore every derived class which overrides it must call this in
+    // its destructor. The destructor of DatasetCameraBase asserts that the threads are already stopped.
+    void StopPrefetch();
 
+    void close() override { StopPrefetch(); }
 
    protected:
     AlignedVector<FrameData> frames;
@@ -144,6 +168,36 @@ class SAIGA_VISION_API DatasetCameraBase : public CameraBase
     tick_t timeStep;
     tick_t lastFrameTime;
     tick_t nextFrameTime;
+
+    // Pacing clock of the real-time read-ahead: frame i is due at playbackBegin + (i - playbackBeginId) * timeStep.
+    tick_t playbackBegin;
+    int playbackBeginId = 0;
+
+    // ============== Read-ahead ==============
+    // The background threads load frames [currentId, currentId + prefetch_frames) in order directly into 'frames'.
+    // A thread waits if the window is full or the memory budget is exhausted. getImageSync() blocks only if the
+    // current frame is not loaded yet. With playback_fps > 0 it waits at most until one frame period after the frame
+    // is due (see getImageRealTime()).
+    enum class PrefetchState : char
+    {
+        Empty,
+        Loading,
+        Ready,
+    };
+    void StartPrefetch();
+    void PrefetchLoop();
+    bool getImageRealTime(FrameData& data);
+
+    std::vector<std::thread> prefetch_workers;
+    std::mutex prefetch_mutex;
+    std::condition_variable prefetch_work;
+    std::condition_variable prefetch_ready;
+    std::vector<PrefetchState> prefetch_state;
+    std::vector<size_t> prefetch_frame_bytes;
+    int prefetch_next          = 0;
+    size_t prefetch_bytes      = 0;
+    size_t prefetch_last_bytes = 0;
+    bool prefetch_stop         = false;
 };
 
 
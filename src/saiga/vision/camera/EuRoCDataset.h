@@ -47,6 +47,7 @@ class SAIGA_VISION_API EuRoCDataset : public DatasetCameraBase
     };
 
     EuRoCDataset(const DatasetParameters& params, Sequence sequence = UNKNOWN);
+    virtual ~EuRoCDataset() { StopPrefetch(); }
 
     StereoIntrinsics intrinsics;
 
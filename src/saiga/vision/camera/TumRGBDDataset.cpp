@@ -86,7 +86,10 @@ TumRGBDDataset::TumRGBDDataset(const DatasetParameters& _params, int freiburg)
     Load();
 }
 
-TumRGBDDataset::~TumRGBDDataset() {}
+TumRGBDDataset::~TumRGBDDataset()
+{
+    StopPrefetch();
+}
 
 
 SE3 TumRGBDDataset::getGroundTruth(int frame)
@@ -38,6 +38,7 @@ class SAIGA_VISION_API ZJUDataset : public DatasetCameraBase
     };
 
     ZJUDataset(const DatasetParameters& params);
+    virtual ~ZJUDataset() { StopPrefetch(); }
 
 
     MonocularIntrinsics intrinsics;
@@ -0,0 +1,296 @@
+/**
+ * Copyright (c) 2021 Darius Rückert
+ * Licensed under the MIT License.
+ * See LICENSE file for more information.
+ *
+ * The segment test and the corner score are based on the FAST implementation of OpenCV (fast.cpp, fast_score.cpp).
+ */
+
+#include "FastDetector.h"
+
+#include "saiga/core/util/assert.h"
+
+#include <cstring>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#    include <immintrin.h>
+#endif
+
+namespace Saiga
+{
+namespace
+{
+// The 16 pixel bresenham circle with radius 3 given as (x,y) offsets.
+constexpr int circle_offsets[16][2] = {{0, 3},  {1, 3},   {2, 2},   {3, 1},   {3, 0},  {3, -1}, {2, -2}, {1, -3},
+                                       {0, -3}, {-1, -3}, {-2, -2}, {-3, -1}, {-3, 0}, {-3, 1}, {-2, 2}, {-1, 3}};
+
+// Computes the pointer offsets of the circle. The first 9 entries are repeated at the end so that a contiguous arc
+// can be tested without wrapping around.
+void MakeOffsets(int pixel[25], int row_stride)
+{
+    for (int k = 0; k < 16; ++k)
+    {
+        pixel[k] = circle_offsets[k][0] + circle_offsets[k][1] * row_stride;
+    }
+    for (int k = 16; k < 25; ++k)
+    {
+        pixel[k] = pixel[k - 16];
+    }
+}
+
+// Scalar segment test for a single pixel.
+inline bool IsCorner(const unsigned char* ptr, const int* pixel, int threshold)
+{
+    const int v      = ptr[0];
+    const int v_high = v + threshold;
+    const int v_low  = v - threshold;
+
+    // Fast rejection test with the 4 pixels on the main axes. A contiguous arc of 9 pixels always contains at least 2
+    // adjacent main axis pixels.
+    auto bright = [&](int k) { return ptr[pixel[k]] > v_high; };
+    auto dark   = [&](int k) { return ptr[pixel[k]] < v_low; };
+    if (!((bright(0) && bright(4)) || (bright(4) && bright(8)) || (bright(8) && bright(12)) ||
+          (bright(12) && bright(0)) || (dark(0) && dark(4)) || (dark(4) && dark(8)) || (dark(8) && dark(12)) ||
+          (dark(12) && dark(0))))
+    {
+        return false;
+    }
+
+    int count_bright = 0;
+    int count_dark   = 0;
+    for (int k = 0; k < 25; ++k)
+    {
+        int x        = ptr[pixel[k]];
+        count_bright = (x > v_high) ? count_bright + 1 : 0;
+        count_dark   = (x < v_low) ? count_dark + 1 : 0;
+        if (count_bright > 8 || count_dark > 8) return true;
+    }
+    return false;
+}
+
+#if defined(__AVX2__)
+struct SimdU8
+{
+    using Vec                   = __m256i;
+    static constexpr int kWidth = 32;
+
+    static Vec load(const unsigned char* ptr) { return _mm256_loadu_si256((const __m256i*)ptr); }
+    static Vec set1(int v) { return _mm256_set1_epi8((char)v); }
+    static Vec zero() { return _mm256_setzero_si256(); }
+    static Vec bit_and(Vec a, Vec b) { return _mm256_and_si256(a, b); }
+    static Vec bit_or(Vec a, Vec b) { return _mm256_or_si256(a, b); }
+    static Vec bit_xor(Vec a, Vec b) { return _mm256_xor_si256(a, b); }
+    static Vec sub(Vec a, Vec b) { return _mm256_sub_epi8(a, b); }
+    static Vec adds_u(Vec a, Vec b) { return _mm256_adds_epu8(a, b); }
+    static Vec subs_u(Vec a, Vec b) { return _mm256_subs_epu8(a, b); }
+    static Vec max_u(Vec a, Vec b) { return _mm256_max_epu8(a, b); }
+    static Vec cmpgt(Vec a, Vec b) { return _mm256_cmpgt_epi8(a, b); }
+    static uint32_t movemask(Vec a) { return (uint32_t)_mm256_movemask_epi8(a); }
+};
+#    define SAIGA_FAST_SIMD
+#elif defined(__SSE2__)
+struct SimdU8
+{
+    using Vec                   = __m128i;
+    static constexpr int kWidth = 16;
+
+    static Vec load(const unsigned char* ptr) { return _mm_loadu_si128((const __m128i*)ptr); }
+    static Vec set1(int v) { return _mm_set1_epi8((char)v); }
+    static Vec zero() { return _mm_setzero_si128(); }
+    static Vec bit_and(Vec a, Vec b) { return _mm_and_si128(a, b); }
+    static Vec bit_or(Vec a, Vec b) { return _mm_or_si128(a, b); }
+    static Vec bit_xor(Vec a, Vec b) { return _mm_xor_si128(a, b); }
+    static Vec sub(Vec a, Vec b) { return _mm_sub_epi8(a, b); }
+    static Vec adds_u(Vec a, Vec b) { return _mm_adds_epu8(a, b); }
+    static Vec subs_u(Vec a, Vec b) { return _mm_subs_epu8(a, b); }
+    static Vec max_u(Vec a, Vec b) { return _mm_max_epu8(a, b); }
+    static Vec cmpgt(Vec a, Vec b) { return _mm_cmpgt_epi8(a, b); }
+    static uint32_t movemask(Vec a) { return (uint32_t)_mm_movemask_epi8(a); }
+};
+#    define SAIGA_FAST_SIMD
+#endif
+
+#ifdef SAIGA_FAST_SIMD
+// Segment test for SimdU8::kWidth consecutive pixels starting at ptr.
+// Bit i of the result is set if ptr[i] is a corner.
+//
+// The unsigned pixel values are shifted into the signed range by xor-ing the sign bit, because there is no unsigned
+// byte comparison. The length of the bright/dark arc ending at pixel k of the circle is counted with one byte counter
+// per lane.
+inline uint32_t CornerMask(const unsigned char* ptr, const int* pixel, typename SimdU8::Vec t)
+{
+    using S           = SimdU8;
+    const S::Vec sign = S::set1(0x80);
+
+    S::Vec v      = S::load(ptr);
+    S::Vec v_high = S::bit_xor(S::adds_u(v, t), sign);
+    S::Vec v_low  = S::bit_xor(S::subs_u(v, t), sign);
+
+    {
+        S::Vec x0 = S::bit_xor(S::load(ptr + pixel[0]), sign);
+        S::Vec x1 = S::bit_xor(S::load(ptr + pixel[4]), sign);
+        S::Vec x2 = S::bit_xor(S::load(ptr + pixel[8]), sign);
+        S::Vec x3 = S::bit_xor(S::load(ptr + pixel[12]), sign);
+
+        S::Vec b0 = S::cmpgt(x0, v_high), b1 = S::cmpgt(x1, v_high);
+        S::Vec b2 = S::cmpgt(x2, v_high), b3 = S::cmpgt(x3, v_high);
+        S::Vec d0 = S::cmpgt(v_low, x0), d1 = S::cmpgt(v_low, x1);
+        S::Vec d2 = S::cmpgt(v_low, x2), d3 = S::cmpgt(v_low, x3);
+
+        S::Vec m = S::bit_or(S::bit_or(S::bit_and(b0, b1), S::bit_and(b1, b2)),
+                             S::bit_or(S::bit_and(b2, b3), S::bit_and(b3, b0)));
+        m        = S::bit_or(m, S::bit_or(S::bit_or(S::bit_and(d0, d1), S::bit_and(d1, d2)),
+                                          S::bit_or(S::bit_and(d2, d3), S::bit_and(d3, d0))));
+        if (S::movemask(m) == 0) return 0;
+    }
+
+    S::Vec count_bright = S::zero(), count_dark = S::zero();
+    S::Vec max_bright = S::zero(), max_dark = S::zero();
+    for (int k = 0; k < 25; ++k)
+    {
+        S::Vec x = S::bit_xor(S::load(ptr + pixel[k]), sign);
+
+        S::Vec m_bright = S::cmpgt(x, v_high);
+        S::Vec m_dark   = S::cmpgt(v_low, x);
+
+        // mask is -1 if true -> counter + 1, otherwise reset to 0
+        count_bright = S::bit_and(S::sub(count_bright, m_bright), m_bright);
+        count_dark   = S::bit_and(S::sub(count_dark, m_dark), m_dark);
+
+        max_bright = S::max_u(max_bright, count_bright);
+        max_dark   = S::max_u(max_dark, count_dark);
+    }
+
+    S::Vec max_count = S::max_u(max_bright, max_dark);
+    return S::movemask(S::cmpgt(max_count, S::set1(8)));
+}
+#endif
+
+}  // namespace
+
+
+int FastDetector::CornerScore(const unsigned char* ptr, const int* pixel, int threshold)
+{
+    const int K = 8, N = K * 3 + 1;
+    int v = ptr[0];
+    short d[N];
+    for (int k = 0; k < N; k++) d[k] = (short)(v - ptr[pixel[k]]);
+
+    // Dark arcs: the minimum difference along the arc
+    int a0 = threshold;
+    for (int k = 0; k < 16; k += 2)
+    {
+        int a = std::min((int)d[k + 1], (int)d[k + 2]);
+        a     = std::min(a, (int)d[k + 3]);
+        if (a <= a0) continue;
+        a  = std::min(a, (int)d[k + 4]);
+        a  = std::min(a, (int)d[k + 5]);
+        a  = std::min(a, (int)d[k + 6]);
+        a  = std::min(a, (int)d[k + 7]);
+        a  = std::min(a, (int)d[k + 8]);
+        a0 = std::max(a0, std::min(a, (int)d[k]));
+        a0 = std::max(a0, std::min(a, (int)d[k + 9]));
+    }
+
+    // Bright arcs
+    int b0 = -a0;
+    for (int k = 0; k < 16; k += 2)
+    {
+        int b = std::max((int)d[k + 1], (int)d[k + 2]);
+        b     = std::max(b, (int)d[k + 3]);
+        b     = std::max(b, (int)d[k + 4]);
+        b     = std::max(b, (int)d[k + 5]);
+        if (b >= b0) continue;
+        b  = std::max(b, (int)d[k + 6]);
+        b  = std::max(b, (int)d[k + 7]);
+        b  = std::max(b, (int)d[k + 8]);
+        b0 = std::min(b0, std::max(b, (int)d[k]));
+        b0 = std::min(b0, std::max(b, (int)d[k + 9]));
+    }
+
+    return -b0 - 1;
+}
+
+int FastDetector::Detect(ImageView<const unsigned char> image, int threshold, bool nonmax_suppression,
+                         std::vector<KeyPoint<float>>& keypoints)
+{
+    const int rows = image.rows;
+    const int cols = image.cols;
+    if (rows < 7 || cols < 7) return 0;
+
+    threshold = std::min(std::max(threshold, 0), 255);
+
+    int pixel[25];
+    MakeOffsets(pixel, (int)image.pitchBytes);
+
+    score_buffer.resize(cols * 3);
+    corner_buffer.resize(cols * 3);
+    std::fill(score_buffer.begin(), score_buffer.end(), 0);
+    int num_corners[3] = {0, 0, 0};
+
+    auto score_row  = [&](int row) { return score_buffer.data() + (row % 3) * cols; };
+    auto corner_row = [&](int row) { return corner_buffer.data() + (row % 3) * cols; };
+
+#ifdef SAIGA_FAST_SIMD
+    const typename SimdU8::Vec t = SimdU8::set1(threshold);
+#endif
+
+    int start_size = keypoints.size();
+
+    // Row i is tested and row i-1 is suppressed, because that requires the scores of the row below.
+    for (int i = 3; i < rows - 2; ++i)
+    {
+        const unsigned char* ptr = image.rowPtr(i);
+        unsigned char* curr      = score_row(i);
+        int* cornerpos           = corner_row(i);
+        int ncorners             = 0;
+
+        memset(curr, 0, cols);
+
+        if (i < rows - 3)
+        {
+            auto add_corner = [&](int j) {
+                cornerpos[ncorners++] = j;
+                curr[j]               = (unsigned char)CornerScore(ptr + j, pixel, threshold);
+            };
+
+            int j = 3;
+#ifdef SAIGA_FAST_SIMD
+            for (; j <= cols - 3 - SimdU8::kWidth; j += SimdU8::kWidth)
+            {
+                uint32_t mask = CornerMask(ptr + j, pixel, t);
+                for (int k = 0; mask != 0; ++k, mask >>= 1)
+                {
+                    if (mask & 1) add_corner(j + k);
+                }
+            }
+#endif
+            for (; j < cols - 3; ++j)
+            {
+                if (IsCorner(ptr + j, pixel, threshold)) add_corner(j);
+            }
+        }
+        num_corners[i % 3] = ncorners;
+
+        if (i == 3) continue;
+
+        const unsigned char* prev  = score_row(i - 1);
+        const unsigned char* pprev = score_row(i - 2);
+        const int* prev_corners    = corner_row(i - 1);
+        for (int k = 0; k < num_corners[(i - 1) % 3]; ++k)
+        {
+            int j     = prev_corners[k];
+            int score = prev[j];
+            if (!nonmax_suppression ||
+                (score > prev[j + 1] && score > prev[j - 1] && score > pprev[j - 1] && score > pprev[j] &&
+                 score > pprev[j + 1] && score > curr[j - 1] && score > curr[j] && score > curr[j + 1]))
+            {
+                keypoints.emplace_back(float(j), float(i - 1), 7.f, -1.f, float(score));
+            }
+        }
+    }
+
+    return keypoints.size() - start_size;
+}
+
+}  // namespace Saiga
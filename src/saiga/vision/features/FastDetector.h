@@ -0,0 +1,47 @@
+/**
+ * Copyright (c) 2021 Darius Rückert
+ * Licensed under the MIT License.
+ * See LICENSE file for more information.
+ */
+
+#pragma once
+
+#include "saiga/core/image/imageView.h"
+#include "saiga/vision/features/Features.h"
+
+#include <vector>
+
+namespace Saiga
+{
+// FAST-9 corner detector (9 contiguous pixels on a 16 pixel bresenham circle) with optional 3x3 non-maximum
+// suppression.
+//
+// The results are identical to cv::FAST(image, keypoints, threshold, nonmax, TYPE_9_16), but this implementation works
+// directly on Saiga image views and processes 32 (AVX2) or 16 (SSE2) pixels per instruction. All temporary buffers are
+// stored in the object and reused by the next call. Therefore, the detector does not allocate memory after the first
+// call on an image of the same size.
+//
+// This class is not thread safe. Use one object per thread!
+class SAIGA_VISION_API FastDetector
+{
+   public:
+    FastDetector() = default;
+
+    // Appends all corners with a contrast above 'threshold' to 'keypoints'.
+    // Only pixels with a distance of at least 3 to the image border are tested.
+    // The point of each keypoint is given in the coordinate frame of 'image' and the response is the corner score.
+    // Returns the number of appended keypoints.
+    int Detect(ImageView<const unsigned char> image, int threshold, bool nonmax_suppression,
+               std::vector<KeyPoint<float>>& keypoints);
+
+    // The score of a corner is the largest threshold for which this pixel is still detected as a corner.
+    // A pixel is a corner for threshold t <=> CornerScore(...) >= t.
+    static int CornerScore(const unsigned char* ptr, const int* pixel, int threshold);
+
+   private:
+    // 3 rows of corner scores and corner positions (ring buffer)
+    std::vector<unsigned char> score_buffer;
+    std::vector<int> corner_buffer;
+};
+
+}  // namespace Saiga
@@ -127,10 +127,8 @@ inline int distance(const DescriptorORB& a, const DescriptorORB& b)
     for (int i = 0; i < (int)a.size(); i++)
     {
         auto v = a[i] ^ b[i];
-        // TODO: if this is really a bottleneck we can also use AVX-2
-        // to gain around 25% more performance
-        // according to this source:
-        // https://github.com/kimwalisch/libpopcnt
+        // For one-to-many and many-to-many matching use the HammingMatcher (HammingMatcher.h), which computes the
+        // distances with AVX2 or AVX-512.
         dist += popcnt(v);
     }
 
@@ -0,0 +1,327 @@
+/**
+ * Copyright (c) 2021 Darius Rückert
+ * Licensed under the MIT License.
+ * See LICENSE file for more information.
+ */
+
+#include "HammingMatcher.h"
+
+#include "saiga/core/util/CpuFeatures.h"
+#include "saiga/core/util/Thread/omp.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+
+#if defined(SAIGA_HAS_TARGET_ATTRIBUTE) || defined(__AVX2__)
+#    include <immintrin.h>
+#    define SAIGA_HAMMING_AVX2
+#endif
+
+#if defined(SAIGA_HAS_TARGET_ATTRIBUTE) || defined(__AVX512VPOPCNTDQ__)
+#    define SAIGA_HAMMING_AVX512
+#endif
+
+namespace Saiga
+{
+void HammingDescriptorSet::Set(ArrayView<const DescriptorORB> descriptors)
+{
+    n      = descriptors.size();
+    stride = iAlignUp(n, 8);
+    data.resize(4 * stride);
+
+    for (int k = 0; k < 4; ++k)
+    {
+        uint64_t* words = data.data() + k * stride;
+        for (int i = 0; i < n; ++i)
+        {
+            words[i] = descriptors[i][k];
+        }
+        std::fill(words + n, words + stride, 0);
+    }
+}
+
+namespace
+{
+inline void DistancesScalar(const DescriptorORB& query, const uint64_t* words, int stride, int begin, int end,
+                            int* distances)
+{
+    const uint64_t* w0 = words;
+    const uint64_t* w1 = words + stride;
+    const uint64_t* w2 = words + 2 * stride;
+    const uint64_t* w3 = words + 3 * stride;
+    for (int j = begin; j < end; ++j)
+    {
+        distances[j] = popcnt(w0[j] ^ query[0]) + popcnt(w1[j] ^ query[1]) + popcnt(w2[j] ^ query[2]) +
+                       popcnt(w3[j] ^ query[3]);
+    }
+}
+
+void DistanceKernelScalar(const DescriptorORB& query, const uint64_t* words, int stride, int n, int* distances)
+{
+    DistancesScalar(query, words, stride, 0, n, distances);
+}
+
+#if defined(SAIGA_HAMMING_AVX2)
+// Popcount of each byte with a 4-bit lookup table.
+// See: Mula et al. "Faster Population Counts Using AVX2 Instructions".
+SAIGA_TARGET_AVX2 inline __m256i PopcountBytes(__m256i v)
+{
+    const __m256i lookup   = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4, 0, 1, 1, 2, 1, 2, 2, 3,
+                                            1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i low_mask = _mm256_set1_epi8(0x0f);
+    __m256i lo             = _mm256_and_si256(v, low_mask);
+    __m256i hi             = _mm256_and_si256(_mm256_srli_epi16(v, 4), low_mask);
+    return _mm256_add_epi8(_mm256_shuffle_epi8(lookup, lo), _mm256_shuffle_epi8(lookup, hi));
+}
+
+// The distances of 4 consecutive train descriptors in the low 32 bits of each 64-bit lane.
+SAIGA_TARGET_AVX2 inline __m256i Distances4(const __m256i q[4], const uint64_t* const w[4], int j)
+{
+    // The maximum count per byte is 4*8=32, so the byte accumulator can not overflow.
+    __m256i acc = _mm256_setzero_si256();
+    for (int k = 0; k < 4; ++k)
+    {
+        __m256i v = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(w[k] + j)), q[k]);
+        acc       = _mm256_add_epi8(acc, PopcountBytes(v));
+    }
+    return _mm256_sad_epu8(acc, _mm256_setzero_si256());
+}
+
+SAIGA_TARGET_AVX2 void DistanceKernelAVX2(const DescriptorORB& query, const uint64_t* words, int stride, int n,
+                                          int* distances)
+{
+    const uint64_t* const w[4] = {words, words + stride, words + 2 * stride, words + 3 * stride};
+    __m256i q[4];
+    for (int k = 0; k < 4; ++k) q[k] = _mm256_set1_epi64x(query[k]);
+
+    // Combines two results of Distances4 into 8 consecutive integers
+    const __m256i order = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+
+    const int n_simd = n / 8 * 8;
+    for (int j = 0; j < n_simd; j += 8)
+    {
+        __m256i d0 = Distances4(q, w, j);
+        __m256i d1 = Distances4(q, w, j + 4);
+        __m256i d  = _mm256_permutevar8x32_epi32(_mm256_or_si256(d0, _mm256_slli_epi64(d1, 32)), order);
+        _mm256_storeu_si256((__m256i*)(distances + j), d);
+    }
+    DistancesScalar(query, words, stride, n_simd, n, distances);
+}
+#endif
+
+#if defined(SAIGA_HAMMING_AVX512)
+SAIGA_TARGET_AVX512_VPOPCNT void DistanceKernelAVX512(const DescriptorORB& query, const uint64_t* words, int stride,
+                                                      int n, int* distances)
+{
+    const uint64_t* const w[4] = {words, words + stride, words + 2 * stride, words + 3 * stride};
+    __m512i q[4];
+    for (int k = 0; k < 4; ++k) q[k] = _mm512_set1_epi64(query[k]);
+
+    const int n_simd = n / 8 * 8;
+    for (int j = 0; j < n_simd; j += 8)
+    {
+        __m512i acc = _mm512_setzero_si512();
+        for (int k = 0; k < 4; ++k)
+        {
+            __m512i v = _mm512_xor_si512(_mm512_loadu_si512((const void*)(w[k] + j)), q[k]);
+            acc       = _mm512_add_epi64(acc, _mm512_popcnt_epi64(v));
+        }
+        _mm256_storeu_si256((__m256i*)(distances + j), _mm512_cvtepi64_epi32(acc));
+    }
+    DistancesScalar(query, words, stride, n_simd, n, distances);
+}
+#endif
+
+// Inserts (distance, index) into the sorted list of the k best matches.
+inline void InsertSorted(HammingMatch* best, int k, int query, int train, int distance)
+{
+    if (distance >= best[k - 1].distance) return;
+    int i = k - 1;
+    for (; i > 0 && best[i - 1].distance > distance; --i)
+    {
+        best[i] = best[i - 1];
+    }
+    best[i] = {query, train, distance};
+}
+
+// Inserts all distances of one row into the sorted list of the k best matches.
+// Most blocks of 8 distances contain no candidate, which is checked with a branch free minimum first.
+inline void SelectBest(const int* row, int m, HammingMatch* best, int k, int query)
+{
+    int j = 0;
+    for (; j + 8 <= m; j += 8)
+    {
+        int block_min = row[j];
+        for (int l = 1; l < 8; ++l) block_min = std::min(block_min, row[j + l]);
+        if (block_min >= best[k - 1].distance) continue;
+        for (int l = 0; l < 8; ++l) InsertSorted(best, k, query, j + l, row[j + l]);
+    }
+    for (; j < m; ++j) InsertSorted(best, k, query, j, row[j]);
+}
+
+
+using Kernel = HammingMatcher::Kernel;
+
+// Returns the requested kernel or the next best kernel supported by the cpu.
+Kernel SupportedKernel(Kernel kernel)
+{
+    auto& cpu = GetCpuFeatures();
+
+    // All extensions enabled by SAIGA_TARGET_AVX512_VPOPCNT and SAIGA_TARGET_AVX2
+    bool avx512 = cpu.avx512f && cpu.avx512bw && cpu.avx512vpopcntdq;
+    bool avx2   = cpu.avx2 && cpu.fma;
+#if !defined(SAIGA_HAMMING_AVX512)
+    avx512 = false;
+#endif
+#if !defined(SAIGA_HAMMING_AVX2)
+    avx2 = false;
+#endif
+
+    if (kernel == Kernel::Auto || kernel == Kernel::AVX512)
+    {
+        kernel = avx512 ? Kernel::AVX512 : Kernel::AVX2;
+    }
+    if (kernel == Kernel::AVX2 && !avx2)
+    {
+        kernel = Kernel::Scalar;
+    }
+    return kernel;
+}
+
+HammingMatcher::DistanceKernel KernelFunction(Kernel kernel)
+{
+    switch (kernel)
+    {
+#if defined(SAIGA_HAMMING_AVX512)
+        case Kernel::AVX512:
+            return DistanceKernelAVX512;
+#endif
+#if defined(SAIGA_HAMMING_AVX2)
+        case Kernel::AVX2:
+            return DistanceKernelAVX2;
+#endif
+        default:
+            return DistanceKernelScalar;
+    }
+}
+
+}  // namespace
+
+void HammingDistances(const DescriptorORB& query, const uint64_t* words, int stride, int n, int* distances)
+{
+    static const HammingMatcher::DistanceKernel kernel = KernelFunction(SupportedKernel(Kernel::Auto));
+    kernel(query, words, stride, n, distances);
+}
+
+HammingMatcher::HammingMatcher(Kernel _kernel, int threads) : threads(threads)
+{
+    kernel          = SupportedKernel(_kernel);
+    distance_kernel = KernelFunction(kernel);
+}
+
+void HammingMatcher::Distances(const DescriptorORB& query, const HammingDescriptorSet& train, int* distances) const
+{
+    distance_kernel(query, train.Words(0), train.Stride(), train.size(), distances);
+}
+
+void HammingMatcher::Distances(ArrayView<const DescriptorORB> query, const HammingDescriptorSet& train,
+                               std::vector<int>& distances) const
+{
+    const int n = query.size();
+    const int m = train.size();
+    distances.resize(size_t(n) * m);
+
+#pragma omp parallel for num_threads(threads) schedule(static)
+    for (int i = 0; i < n; ++i)
+    {
+        Distances(query[i], train, distances.data() + size_t(i) * m);
+    }
+}
+
+void HammingMatcher::MatchKnn(ArrayView<const DescriptorORB> query, const HammingDescriptorSet& train, int k,
+                              std::vector<HammingMatch>& knn) const
+{
+    SAIGA_ASSERT(k > 0);
+    const int n = query.size();
+    const int m = train.size();
+    knn.resize(size_t(n) * k);
+
+#pragma omp parallel num_threads(threads)
+    {
+        std::vector<int> row(m);
+#pragma omp for schedule(static)
+        for (int i = 0; i < n; ++i)
+        {
+            Distances(query[i], train, row.data());
+
+            HammingMatch* best = knn.data() + size_t(i) * k;
+            std::fill(best, best + k, HammingMatch{i, -1, INT_MAX});
+            SelectBest(row.data(), m, best, k, i);
+        }
+    }
+}
+
+int HammingMatcher::Match(ArrayView<const DescriptorORB> query, const HammingDescriptorSet& train,
+                          const HammingMatchOptions& options, std::vector<HammingMatch>& matches) const
+{
+    const int n = query.size();
+    const int m = train.size();
+
+    std::vector<HammingMatch> best(size_t(n) * 2);
+
+    // The best query of each train descriptor for the mutual check.
+    // (distance, query) is packed into one 64-bit key so that ties are resolved by the smaller query index.
+    std::vector<uint64_t> train_best;
+    if (options.mutual_check) train_best.resize(m, UINT64_MAX);
+
+#pragma omp parallel num_threads(threads)
+    {
+        std::vector<int> row(m);
+        std::vector<uint64_t> local_train_best(train_best.size(), UINT64_MAX);
+
+#pragma omp for schedule(static)
+        for (int i = 0; i < n; ++i)
+        {
+            Distances(query[i], train, row.data());
+
+            HammingMatch* b = best.data() + size_t(i) * 2;
+            b[0] = b[1] = {i, -1, INT_MAX};
+            SelectBest(row.data(), m, b, 2, i);
+
+            if (options.mutual_check)
+            {
+                for (int j = 0; j < m; ++j)
+                {
+                    uint64_t key        = (uint64_t(row[j]) << 32) | uint64_t(i);
+                    local_train_best[j] = std::min(local_train_best[j], key);
+                }
+            }
+        }
+
+        if (options.mutual_check)
+        {
+#pragma omp critical
+            {
+                for (int j = 0; j < m; ++j)
+                {
+                    train_best[j] = std::min(train_best[j], local_train_best[j]);
+                }
+            }
+        }
+    }
+
+    matches.clear();
+    for (int i = 0; i < n; ++i)
+    {
+        auto& b0 = best[size_t(i) * 2];
+        auto& b1 = best[size_t(i) * 2 + 1];
+        if (b0.train < 0 || b0.distance > options.max_distance) continue;
+        if (options.ratio < 1 && b1.train >= 0 && float(b0.distance) > float(b1.distance) * options.ratio) continue;
+        if (options.mutual_check && int(train_best[b0.train] & 0xFFFFFFFF) != i) continue;
+        matches.push_back(b0);
+    }
+    return matches.size();
+}
+
+}  // namespace Saiga
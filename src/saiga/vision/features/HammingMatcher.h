@@ -0,0 +1,126 @@
+/**
+ * Copyright (c) 2021 Darius Rückert
+ * Licensed under the MIT License.
+ * See LICENSE file for more information.
+ */
+
+#pragma once
+
+#include "saiga/core/util/Align.h"
+#include "saiga/core/util/DataStructures/ArrayView.h"
+#include "saiga/vision/features/Features.h"
+
+#include <vector>
+
+namespace Saiga
+{
+// A set of ORB descriptors in SoA layout. Word k of descriptor i is stored at Words(k)[i].
+// Each of the 4 word arrays is 64 byte aligned and padded with zeros to a multiple of 8 descriptors, so that the
+// distance kernels can load 4 (AVX2) or 8 (AVX-512) descriptors with a single instruction.
+class SAIGA_VISION_API HammingDescriptorSet
+{
+   public:
+    HammingDescriptorSet() {}
+    HammingDescriptorSet(ArrayView<const DescriptorORB> descriptors) { Set(descriptors); }
+
+    void Set(ArrayView<const DescriptorORB> descriptors);
+
+    int size() const { return n; }
+    int Stride() const { return stride; }
+    const uint64_t* Words(int k) const { return data.data() + k * stride; }
+
+    DescriptorORB Get(int i) const
+    {
+        return {Words(0)[i], Words(1)[i], Words(2)[i], Words(3)[i]};
+    }
+
+   private:
+    int n      = 0;
+    int stride = 0;
+    AlignedVector<uint64_t, 64> data;
+};
+
+// Distances of 'query' to n descriptors in SoA layout. Word k of descriptor j is words[k * stride + j].
+// Uses the best kernel supported by the cpu. Aligning 'words' to 64 bytes is recommended.
+SAIGA_VISION_API void HammingDistances(const DescriptorORB& query, const uint64_t* words, int stride, int n,
+                                       int* distances);
+
+struct HammingMatch
+{
+    int query;
+    int train;
+    int distance;
+
+    bool operator==(const HammingMatch& other) const
+    {
+        return query == other.query && train == other.train && distance == other.distance;
+    }
+};
+
+struct HammingMatchOptions
+{
+    // Matches with a larger distance are rejected.
+    int max_distance = 256;
+
+    // Lowe's ratio test: best < ratio * second_best. A value >= 1 disables the test.
+    float ratio = 1;
+
+    // The query must also be the best match of the train descriptor.
+    bool mutual_check = false;
+};
+
+/**
+ * Brute force matcher for ORB descriptors.
+ *
+ * The distances of one query to all train descriptors are computed by a runtime dispatched kernel:
+ *   - AVX-512 VPOPCNTDQ: 8 descriptors per instruction with the native 64-bit popcount
+ *   - AVX2: 4 descriptors per instruction with the nibble lookup popcount (pshufb)
+ *   - Scalar: popcnt per 64-bit word
+ * The query descriptors are distributed to 'threads' OpenMP threads.
+ *
+ * For a given query, the results of all kernels are identical. Ties are resolved by the smaller train index.
+ */
+class SAIGA_VISION_API HammingMatcher
+{
+   public:
+    enum class Kernel
+    {
+        Auto,
+        Scalar,
+        AVX2,
+        AVX512,
+    };
+
+    // If the requested kernel is not supported by the cpu, the next best supported kernel is used.
+    HammingMatcher(Kernel kernel = Kernel::Auto, int threads = 1);
+
+    Kernel UsedKernel() const { return kernel; }
+
+    // distances[j] = distance(query, train.Get(j)). The output must have train.size() elements.
+    void Distances(const DescriptorORB& query, const HammingDescriptorSet& train, int* distances) const;
+
+    // The row-major n x m distance matrix with n=query.size() and m=train.size().
+    void Distances(ArrayView<const DescriptorORB> query, const HammingDescriptorSet& train,
+                   std::vector<int>& distances) const;
+
+    // The k nearest train descriptors of each query sorted by distance.
+    // knn[i * k + j] is the j-th best match of query i. If train has less than k elements the remaining matches
+    // have the train index -1.
+    void MatchKnn(ArrayView<const DescriptorORB> query, const HammingDescriptorSet& train, int k,
+                  std::vector<HammingMatch>& knn) const;
+
+    // The best match of each query that passes the threshold, ratio and mutual check.
+    // Returns the number of matches.
+    int Match(ArrayView<const DescriptorORB> query, const HammingDescriptorSet& train,
+              const HammingMatchOptions& options, std::vector<HammingMatch>& matches) const;
+
+    using DistanceKernel = void (*)(const DescriptorORB& query, const uint64_t* words, int stride, int n,
+                                    int* distances);
+
+   private:
+    Kernel kernel;
+    int threads;
+    DistanceKernel distance_kernel;
+};
+
+}  // namespace Saiga
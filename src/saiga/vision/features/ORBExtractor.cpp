@@ -60,187 +60,407 @@
 
 #include "ORBExtractor.h"
 
-
-#ifdef SAIGA_USE_OPENCV
-
-#    include "saiga/core/time/all.h"
-#    include "saiga/core/util/Thread/omp.h"
-#    include "saiga/vision/opencv/opencv.h"
-
-#    include <opencv2/core/core.hpp>
-#    include <opencv2/features2d/features2d.hpp>
-#    include <opencv2/highgui/highgui.hpp>
-#    include <opencv2/imgproc/imgproc.hpp>
+#include "saiga/core/time/all.h"
+#include "saiga/core/util/Thread/omp.h"
 
 
 namespace Saiga
 {
 const int PATCH_SIZE     = 31;
 const int EDGE_THRESHOLD = 19;
+const int BLUR_TILE_SIZE = 32;
 
 
-ORBExtractor::ORBExtractor(int _nfeatures, float _scaleFactor, int _nlevels, int _iniThFAST, int _minThFAST,
-                           int threads)
-    : num_levels(_nlevels), th_fast(_iniThFAST), th_fast_min(_minThFAST), num_threads(threads)
+// Fills the border of 'img' by mirroring the inner image without duplicating the edge pixels.
+// Same as cv::copyMakeBorder with cv::BORDER_REFLECT_101.
+static void MakeBorderReflect101(ImageView<unsigned char> img, int border)
 {
-    pyramid = Saiga::ScalePyramid(_nlevels, _scaleFactor, _nfeatures);
-    levels.resize(num_levels);
-}
+    const int inner_rows = img.rows - 2 * border;
+    const int inner_cols = img.cols - 2 * border;
+    SAIGA_ASSERT(inner_rows > border && inner_cols > border);
 
-void ORBExtractor::DetectKeypoints()
-{
-    const float W = 30;
-#    pragma omp parallel for num_threads(num_threads) schedule(dynamic)
-    for (int level = 0; level < num_levels; ++level)
+    for (int y = border; y < border + inner_rows; ++y)
+    {
+        unsigned char* row = img.rowPtr(y);
+        for (int i = 1; i <= border; ++i)
+        {
+            row[border - i]                  = row[border + i];
+            row[border + inner_cols - 1 + i] = row[border + inner_cols - 1 - i];
+        }
+    }
+
+    for (int i = 1; i <= border; ++i)
     {
-        auto& level_data = levels[level];
-        level_data.keypoints_tmp.clear();
+        memcpy(img.rowPtr(border - i), img.rowPtr(border + i), img.cols);
+        memcpy(img.rowPtr(border + inner_rows - 1 + i), img.rowPtr(border + inner_rows - 1 - i), img.cols);
+    }
+}
 
-        auto image = Saiga::ImageViewToMat(level_data.image);
+// Bilinear downsampling with pixel centers at (x+0.5,y+0.5).
+// Same sampling positions as cv::resize with cv::INTER_LINEAR.
+static void ResizeLinear(ImageView<const unsigned char> src, ImageView<unsigned char> dst)
+{
+    const float scale_x = float(src.cols) / dst.cols;
+    const float scale_y = float(src.rows) / dst.rows;
 
-        const int minBorderX = EDGE_THRESHOLD - 3;
-        const int minBorderY = minBorderX;
-        const int maxBorderX = level_data.image.cols - EDGE_THRESHOLD + 3;
-        const int maxBorderY = level_data.image.rows - EDGE_THRESHOLD + 3;
+    for (int y = 0; y < dst.rows; ++y)
+    {
+        float fy = std::max((y + 0.5f) * scale_y - 0.5f, 0.f);
+        int y0   = std::min(int(fy), src.rows - 1);
+        int y1   = std::min(y0 + 1, src.rows - 1);
+        float wy = fy - y0;
 
+        const unsigned char* row0 = src.rowPtr(y0);
+        const unsigned char* row1 = src.rowPtr(y1);
+        unsigned char* out        = dst.rowPtr(y);
 
-        const float width  = (maxBorderX - minBorderX);
-        const float height = (maxBorderY - minBorderY);
+        for (int x = 0; x < dst.cols; ++x)
+        {
+            float fx = std::max((x + 0.5f) * scale_x - 0.5f, 0.f);
+            int x0   = std::min(int(fx), src.cols - 1);
+            int x1   = std::min(x0 + 1, src.cols - 1);
+            float wx = fx - x0;
+
+            float top    = row0[x0] + wx * (row0[x1] - row0[x0]);
+            float bottom = row1[x0] + wx * (row1[x1] - row1[x0]);
+            out[x]       = (unsigned char)(top + wy * (bottom - top) + 0.5f);
+        }
+    }
+}
 
-        const int nCols = width / W;
-        const int nRows = height / W;
-        const int wCell = ceil(width / nCols);
-        const int hCell = ceil(height / nRows);
+// Separable 7x7 gaussian blur with sigma=2 using 8-bit fixed point weights.
+// The 3 pixels around 'src' must be readable. For the pyramid levels this is the reflected border, which makes this
+// function equivalent to cv::GaussianBlur(src, dst, cv::Size(7, 7), 2, 2, cv::BORDER_REFLECT_101).
+static void GaussianBlur7x7(ImageView<const unsigned char> src, ImageView<unsigned char> dst,
+                            ImageView<unsigned short> tmp)
+{
+    const int radius = 3;
+    SAIGA_ASSERT(tmp.rows == src.rows + 2 * radius && tmp.cols == src.cols);
 
-        for (int i = 0; i < nRows; i++)
+    static const std::array<int, 2 * radius + 1> kernel = []() {
+        std::array<double, 2 * radius + 1> kernel_f;
+        double sum = 0;
+        for (int i = -radius; i <= radius; ++i)
+        {
+            kernel_f[i + radius] = std::exp(-(i * i) / (2.0 * 2.0 * 2.0));
+            sum += kernel_f[i + radius];
+        }
+        std::array<int, 2 * radius + 1> kernel_i;
+        int sum_i = 0;
+        for (int i = 0; i < 2 * radius + 1; ++i)
         {
-            const float iniY = minBorderY + i * hCell;
-            float maxY       = iniY + hCell + 6;
+            kernel_i[i] = iRound(kernel_f[i] / sum * 256);
+            sum_i += kernel_i[i];
+        }
+        // Make sure the weights add up to exactly 1
+        kernel_i[radius] += 256 - sum_i;
+        return kernel_i;
+    }();
 
-            if (iniY >= maxBorderY - 3) continue;
-            if (maxY > maxBorderY) maxY = maxBorderY;
+    for (int y = 0; y < tmp.rows; ++y)
+    {
+        const unsigned char* in = src.rowPtr(y - radius);
+        unsigned short* out     = tmp.rowPtr(y);
+        for (int x = 0; x < src.cols; ++x)
+        {
+            int sum = 0;
+            for (int k = -radius; k <= radius; ++k)
+            {
+                sum += kernel[k + radius] * in[x + k];
+            }
+            out[x] = (unsigned short)sum;
+        }
+    }
 
-            for (int j = 0; j < nCols; j++)
+    for (int y = 0; y < dst.rows; ++y)
+    {
+        unsigned char* out = dst.rowPtr(y);
+        for (int x = 0; x < dst.cols; ++x)
+        {
+            unsigned int sum = 0;
+            for (int k = -radius; k <= radius; ++k)
             {
-                const float iniX = minBorderX + j * wCell;
-                float maxX       = iniX + wCell + 6;
-                if (iniX >= maxBorderX - 6) continue;
-                if (maxX > maxBorderX) maxX = maxBorderX;
+                sum += kernel[k + radius] * tmp(y + radius + k, x);
+            }
+            out[x] = (unsigned char)((sum + (1 << 15)) >> 16);
+        }
+    }
+}
 
 
-                std::vector<cv::KeyPoint> cv_KeysCell;
+ORBExtractor::ORBExtractor(int _nfeatures, float _scaleFactor, int _nlevels, int _iniThFAST, int _minThFAST,
+                           int threads)
+    : num_levels(_nlevels), th_fast(_iniThFAST), th_fast_min(_minThFAST), num_threads(threads)
+{
+    pyramid = Saiga::ScalePyramid(_nlevels, _scaleFactor, _nfeatures);
+}
 
-                FAST(image.rowRange(iniY, maxY).colRange(iniX, maxX), cv_KeysCell, th_fast, true);
-                int dis_before = cv_KeysCell.size();
+void ORBExtractor::DetectBand(int image, int level, int band)
+{
+    auto& level_data = images[image].levels[level];
+    auto& band_data  = level_data.bands[band];
+
+    const int minBorderX = EDGE_THRESHOLD - 3;
+    const int minBorderY = minBorderX;
+    const int maxBorderX = level_data.image.cols - EDGE_THRESHOLD + 3;
+    const int maxBorderY = level_data.image.rows - EDGE_THRESHOLD + 3;
+
+    auto fast_image =
+        level_data.image.subImageView(minBorderY, minBorderX, maxBorderY - minBorderY, maxBorderX - minBorderX);
+
+    // Rows of 'fast_image' which contain the keypoints of this band (see DetectKeypoints).
+    const bool last_band = band == (int)level_data.bands.size() - 1;
+    const int y_begin    = std::min(band_data.cell_row_begin * level_data.cell_height + 3, fast_image.rows - 3);
+    const int y_end      = last_band ? fast_image.rows - 3
+                                : std::min(band_data.cell_row_end * level_data.cell_height + 3, fast_image.rows - 3);
+
+    // The detector skips 3 pixels at the top and bottom. We add one additional row at each side so that the
+    // non-maximum suppression at the band boundaries sees the same scores as a detection on the complete level.
+    const int sub_begin = std::max(y_begin - 4, 0);
+    const int sub_end   = std::min(y_end + 4, fast_image.rows);
+
+    auto& keypoints = band_data.keypoints;
+    keypoints.clear();
+    band_data.fast.Detect(fast_image.subImageView(sub_begin, 0, sub_end - sub_begin, fast_image.cols), th_fast_min,
+                          true, keypoints);
+
+    int n = 0;
+    for (auto& kp : keypoints)
+    {
+        kp.point.y() += sub_begin;
+        if (kp.point.y() >= y_begin && kp.point.y() < y_end)
+        {
+            keypoints[n++] = kp;
+        }
+    }
+    keypoints.resize(n);
+}
 
-                if (cv_KeysCell.empty())
-                {
-                    FAST(image.rowRange(iniY, maxY).colRange(iniX, maxX), cv_KeysCell, th_fast_min, true);
-                    dis_before = cv_KeysCell.size();
-                }
+void ORBExtractor::DetectKeypoints(int image, int level)
+{
+    auto& level_data = images[image].levels[level];
+    auto& keypoints  = level_data.keypoints_tmp;
+    keypoints.clear();
+
+    const int minBorderX = EDGE_THRESHOLD - 3;
+    const int minBorderY = minBorderX;
+    const int maxBorderX = level_data.image.cols - EDGE_THRESHOLD + 3;
+    const int maxBorderY = level_data.image.rows - EDGE_THRESHOLD + 3;
+
+    const int nCols = level_data.cell_cols;
+    const int nRows = level_data.cell_rows;
+    const int wCell = level_data.cell_width;
+    const int hCell = level_data.cell_height;
+
+    // The image is divided into cells of size WxW. In each cell we want the keypoints of the high threshold, or if
+    // there are none, the keypoints of the low threshold. A pixel is a corner for the high threshold iff its score
+    // is >= th_fast. Therefore, we run the detector only once with the low threshold and select the keypoints of
+    // each cell afterwards. The cells overlap by 6 pixels, but FAST skips 3 pixels at each side so the keypoints
+    // in cell (i,j) are in the range [j*wCell+3, (j+1)*wCell+3).
+    // The detection itself was done by the bands (see DetectBand) in row major order.
+    for (auto& band : level_data.bands)
+    {
+        keypoints.insert(keypoints.end(), band.keypoints.begin(), band.keypoints.end());
+    }
 
-                for (auto& cvkp : cv_KeysCell)
-                {
-                    KeypointType kp;
-                    kp.point    = Saiga::vec2(cvkp.pt.x, cvkp.pt.y);
-                    kp.size     = cvkp.size;
-                    kp.angle    = cvkp.angle;
-                    kp.response = cvkp.response;
-                    kp.octave   = cvkp.octave;
+    auto cell_index = [&](const KeypointType& kp) {
+        int cx = std::min((int(kp.point.x()) - 3) / wCell, nCols - 1);
+        int cy = std::min((int(kp.point.y()) - 3) / hCell, nRows - 1);
+        return cy * nCols + cx;
+    };
 
+    auto& cell_high_count = level_data.cell_high_count;
+    cell_high_count.assign(nRows * nCols, 0);
+    for (auto& kp : keypoints)
+    {
+        if (kp.response >= th_fast) cell_high_count[cell_index(kp)]++;
+    }
 
-                    kp.point.x() += j * wCell;
-                    kp.point.y() += i * hCell;
-                    level_data.keypoints_tmp.push_back(kp);
-                }
-            }
+    int n = 0;
+    for (auto& kp : keypoints)
+    {
+        if (kp.response >= th_fast || cell_high_count[cell_index(kp)] == 0)
+        {
+            keypoints[n++] = kp;
         }
+    }
+    keypoints.resize(n);
 
-        level_data.keypoints_tmp =
-            level_data.distributor.Distribute(level_data.keypoints_tmp, Saiga::vec2(minBorderX, minBorderY),
-                                              Saiga::vec2(maxBorderX, maxBorderY), pyramid.Features(level));
+    level_data.keypoints_tmp =
+        level_data.distributor.Distribute(level_data.keypoints_tmp, Saiga::vec2(minBorderX, minBorderY),
+                                          Saiga::vec2(maxBorderX, maxBorderY), pyramid.Features(level));
 
-        const int scaledPatchSize = PATCH_SIZE * pyramid.Scale(level);
+    const int scaledPatchSize = PATCH_SIZE * pyramid.Scale(level);
 
-        for (auto& kp : level_data.keypoints_tmp)
+    for (auto& kp : level_data.keypoints_tmp)
+    {
+        kp.point.x() += minBorderX;
+        kp.point.y() += minBorderY;
+        kp.octave = level;
+        kp.size   = scaledPatchSize;
+        kp.angle  = orb.ComputeAngle(level_data.image, kp.point);
+    }
+}
+
+void ORBExtractor::ComputeDescriptors(int image, int level, std::vector<KeypointType>& output_keypoints,
+                                      std::vector<Saiga::DescriptorORB>& output_descriptors)
+{
+    auto& level_data = images[image].levels[level];
+    auto& keypoints  = level_data.keypoints_tmp;
+    if (keypoints.empty()) return;
+
+    // Blur only the tiles which are touched by the patch of a keypoint. All samples of the descriptor are inside a
+    // radius of EDGE_THRESHOLD around the keypoint.
+    auto& tile_used = level_data.tile_used;
+    tile_used.assign(level_data.tile_rows * level_data.tile_cols, 0);
+    for (auto& kp : keypoints)
+    {
+        int x  = iRound(kp.point.x());
+        int y  = iRound(kp.point.y());
+        int x0 = std::max(x - EDGE_THRESHOLD, 0) / BLUR_TILE_SIZE;
+        int x1 = std::min(x + EDGE_THRESHOLD, level_data.image.cols - 1) / BLUR_TILE_SIZE;
+        int y0 = std::max(y - EDGE_THRESHOLD, 0) / BLUR_TILE_SIZE;
+        int y1 = std::min(y + EDGE_THRESHOLD, level_data.image.rows - 1) / BLUR_TILE_SIZE;
+        for (int ty = y0; ty <= y1; ++ty)
         {
-            kp.point.x() += minBorderX;
-            kp.point.y() += minBorderY;
-            kp.octave = level;
-            kp.size   = scaledPatchSize;
-            kp.angle  = orb.ComputeAngle(level_data.image, kp.point);
+            for (int tx = x0; tx <= x1; ++tx)
+            {
+                tile_used[ty * level_data.tile_cols + tx] = 1;
+            }
         }
     }
-}
 
+    for (int ty = 0; ty < level_data.tile_rows; ++ty)
+    {
+        for (int tx = 0; tx < level_data.tile_cols; ++tx)
+        {
+            if (!tile_used[ty * level_data.tile_cols + tx]) continue;
+            int y    = ty * BLUR_TILE_SIZE;
+            int x    = tx * BLUR_TILE_SIZE;
+            int rows = std::min(BLUR_TILE_SIZE, level_data.image.rows - y);
+            int cols = std::min(BLUR_TILE_SIZE, level_data.image.cols - x);
+            GaussianBlur7x7(level_data.image.subImageView(y, x, rows, cols),
+                            level_data.image_gauss.getImageView().subImageView(y, x, rows, cols),
+                            level_data.gauss_tmp.getImageView().subImageView(0, 0, rows + 6, cols));
+        }
+    }
+
+    int offset = level_data.offset;
+    orb.ComputeDescriptors(level_data.image_gauss.getImageView(), keypoints,
+                           ArrayView<Saiga::DescriptorORB>(output_descriptors.data() + offset, keypoints.size()));
+
+    // Scale keypoint coordinates
+    if (level != 0)
+    {
+        float scale = pyramid.Scale(level);
+        for (auto& kp : keypoints) kp.point *= scale;
+    }
+    // And add the keypoints to the output
+    for (size_t i = 0; i < keypoints.size(); ++i)
+    {
+        output_keypoints[offset + i] = keypoints[i];
+    }
+}
 
 
 void ORBExtractor::Detect(Saiga::ImageView<unsigned char> inputImage, std::vector<KeypointType>& _keypoints,
                           std::vector<Saiga::DescriptorORB>& outputDescriptors)
 {
-    cv::setNumThreads(1);
     if (inputImage.empty()) return;
+    ComputeBatch(ArrayView<ImageView<unsigned char>>(inputImage), &_keypoints, &outputDescriptors);
+}
 
+void ORBExtractor::DetectBatch(ArrayView<Saiga::ImageView<unsigned char>> input_images,
+                               std::vector<std::vector<KeypointType>>& keypoints,
+                               std::vector<std::vector<Saiga::DescriptorORB>>& descriptors)
+{
+    keypoints.resize(input_images.size());
+    descriptors.resize(input_images.size());
+    ComputeBatch(input_images, keypoints.data(), descriptors.data());
+}
 
-    outputDescriptors.clear();
-    ComputePyramid(inputImage);
-    DetectKeypoints();
-
+void ORBExtractor::ComputeBatch(ArrayView<Saiga::ImageView<unsigned char>> input_images,
+                                std::vector<KeypointType>* keypoints, std::vector<Saiga::DescriptorORB>* descriptors)
+{
+    const int num_images = input_images.size();
+    // Never shrink, so that the buffers of all images are kept for the next call
+    if ((int)images.size() < num_images) images.resize(num_images);
 
-    int nkeypoints = 0;
-    for (int level = 0; level < num_levels; ++level)
+    // The levels of one pyramid depend on each other, therefore we only parallelize over the images here.
+#pragma omp parallel for num_threads(num_threads) schedule(dynamic)
+    for (int i = 0; i < num_images; ++i)
     {
-        levels[level].offset = nkeypoints;
-        int n                = (int)levels[level].keypoints_tmp.size();
-        nkeypoints += n;
+        if (!input_images[i].empty()) ComputePyramid(i, input_images[i]);
     }
 
-    outputDescriptors.resize(nkeypoints);
-    _keypoints.resize(nkeypoints);
-
-#    pragma omp parallel for num_threads(num_threads) schedule(dynamic)
-    for (int level = 0; level < num_levels; ++level)
+    band_work.clear();
+    level_work.clear();
+    for (int i = 0; i < num_images; ++i)
     {
-        auto& level_data    = levels[level];
-        auto& keypoints     = level_data.keypoints_tmp;
-        int nkeypointsLevel = (int)keypoints.size();
-
-        if (nkeypointsLevel == 0) continue;
+        if (input_images[i].empty()) continue;
+        for (int level = 0; level < num_levels; ++level)
+        {
+            level_work.push_back({i, level, 0});
+            for (int band = 0; band < (int)images[i].levels[level].bands.size(); ++band)
+            {
+                band_work.push_back({i, level, band});
+            }
+        }
+    }
 
-        auto image       = Saiga::ImageViewToMat(level_data.image);
-        auto image_gauss = Saiga::ImageViewToMat(level_data.image_gauss.getImageView());
+    // The bands have roughly the same size, independent of the level. Therefore, the dynamic schedule of the flat
+    // work list distributes the work evenly, even for small batches.
+#pragma omp parallel for num_threads(num_threads) schedule(dynamic)
+    for (int w = 0; w < (int)band_work.size(); ++w)
+    {
+        DetectBand(band_work[w].image, band_work[w].level, band_work[w].band);
+    }
 
-        cv::GaussianBlur(image, image_gauss, cv::Size(7, 7), 2, 2, cv::BORDER_REFLECT_101);
+#pragma omp parallel for num_threads(num_threads) schedule(dynamic)
+    for (int w = 0; w < (int)level_work.size(); ++w)
+    {
+        DetectKeypoints(level_work[w].image, level_work[w].level);
+    }
 
-        int offset = level_data.offset;
-        for (size_t i = 0; i < keypoints.size(); i++)
+    for (int i = 0; i < num_images; ++i)
+    {
+        int nkeypoints = 0;
+        if (!input_images[i].empty())
         {
-            outputDescriptors[offset + i] =
-                orb.ComputeDescriptor(level_data.image_gauss.getImageView(), keypoints[i].point, keypoints[i].angle);
+            for (auto& level_data : images[i].levels)
+            {
+                level_data.offset = nkeypoints;
+                nkeypoints += (int)level_data.keypoints_tmp.size();
+            }
         }
+        keypoints[i].resize(nkeypoints);
+        descriptors[i].resize(nkeypoints);
+    }
 
-        // Scale keypoint coordinates
-        if (level != 0)
-        {
-            float scale = pyramid.Scale(level);
-            for (auto& kp : keypoints) kp.point *= scale;
-        }
-        // And add the keypoints to the output
-        for (int i = 0; i < nkeypointsLevel; ++i)
-        {
-            _keypoints[offset + i] = keypoints[i];
-        }
+#pragma omp parallel for num_threads(num_threads) schedule(dynamic)
+    for (int w = 0; w < (int)level_work.size(); ++w)
+    {
+        int i = level_work[w].image;
+        ComputeDescriptors(i, level_work[w].level, keypoints[i], descriptors[i]);
     }
 }
 
-void ORBExtractor::AllocatePyramid(int rows, int cols)
+void ORBExtractor::AllocatePyramid(int image, int rows, int cols)
 {
-    SAIGA_ASSERT(!levels.empty());
-    if (levels.front().image.valid()) return;
+    auto& image_data = images[image];
+    if (image_data.rows == rows && image_data.cols == cols) return;
+
+    image_data.rows = rows;
+    image_data.cols = cols;
+    image_data.levels.resize(num_levels);
+
+    // Number of cell rows which are processed together. With W=30 a band covers ~120 image rows.
+    const int cell_rows_per_band = 4;
+    const float W                = 30;
 
     for (int level = 0; level < num_levels; ++level)
     {
-        auto& level_data = levels[level];
+        auto& level_data = image_data.levels[level];
 
         float scale    = pyramid.InverseScale(level);
         int level_rows = Saiga::iRound(rows * scale);
@@ -255,37 +475,51 @@ void ORBExtractor::AllocatePyramid(int rows, int cols)
         level_data.image_gauss.create(level_rows, level_cols);
 
         level_data.keypoints_tmp.reserve(pyramid.total_num_features * 10);
+
+        // The cell grid of the FAST detection
+        const float width      = level_cols + 6 - 2 * EDGE_THRESHOLD;
+        const float height     = level_rows + 6 - 2 * EDGE_THRESHOLD;
+        level_data.cell_cols   = width / W;
+        level_data.cell_rows   = height / W;
+        level_data.cell_width  = ceil(width / level_data.cell_cols);
+        level_data.cell_height = ceil(height / level_data.cell_rows);
+
+        int num_bands = std::max(1, level_data.cell_rows / cell_rows_per_band);
+        level_data.bands.resize(num_bands);
+        for (int band = 0; band < num_bands; ++band)
+        {
+            auto& band_data          = level_data.bands[band];
+            band_data.cell_row_begin = level_data.cell_rows * band / num_bands;
+            band_data.cell_row_end   = level_data.cell_rows * (band + 1) / num_bands;
+        }
+
+        level_data.tile_rows = iDivUp(level_rows, BLUR_TILE_SIZE);
+        level_data.tile_cols = iDivUp(level_cols, BLUR_TILE_SIZE);
+        level_data.gauss_tmp.create(BLUR_TILE_SIZE + 6, BLUR_TILE_SIZE);
     }
 }
 
-void ORBExtractor::ComputePyramid(Saiga::ImageView<unsigned char> image)
+void ORBExtractor::ComputePyramid(int image, Saiga::ImageView<unsigned char> input)
 {
-    AllocatePyramid(image.rows, image.cols);
+    AllocatePyramid(image, input.rows, input.cols);
 
-    cv::Mat cv_image = Saiga::ImageViewToMat(image);
-    assert(cv_image.type() == CV_8UC1);
-
-    SAIGA_ASSERT(!levels.empty());
-    cv::copyMakeBorder(cv_image, Saiga::ImageViewToMat(levels.front().image_with_border.getImageView()), EDGE_THRESHOLD,
-                       EDGE_THRESHOLD, EDGE_THRESHOLD, EDGE_THRESHOLD, cv::BORDER_REFLECT_101);
+    auto& levels      = images[image].levels;
+    auto& first_level = levels.front();
+    SAIGA_ASSERT(first_level.image.rows == input.rows && first_level.image.cols == input.cols);
+    for (int y = 0; y < input.rows; ++y)
+    {
+        memcpy(first_level.image.rowPtr(y), input.rowPtr(y), input.cols);
+    }
+    MakeBorderReflect101(first_level.image_with_border.getImageView(), EDGE_THRESHOLD);
 
     for (int level = 1; level < num_levels; ++level)
     {
         auto& level_data      = levels[level];
         auto& level_data_prev = levels[level - 1];
 
-        auto image      = Saiga::ImageViewToMat(level_data.image);
-        auto image_prev = Saiga::ImageViewToMat(level_data_prev.image);
-        auto temp       = Saiga::ImageViewToMat(levels.front().image_with_border.getImageView());
-
-
-        cv::resize(image_prev, image, cv::Size(image.cols, image.rows), 0, 0, cv::INTER_LINEAR);
-
-        cv::copyMakeBorder(image, temp, EDGE_THRESHOLD, EDGE_THRESHOLD, EDGE_THRESHOLD, EDGE_THRESHOLD,
-                           cv::BORDER_REFLECT_101 + cv::BORDER_ISOLATED);
+        ResizeLinear(level_data_prev.image, level_data.image);
+        MakeBorderReflect101(level_data.image_with_border.getImageView(), EDGE_THRESHOLD);
     }
 }
 
 }  // namespace Saiga
-
-#endif
@@ -30,6 +30,8 @@
 #include "saiga/config.h"
 #include "saiga/core/image/imageView.h"
 #include "saiga/core/image/templatedImage.h"
+#include "saiga/core/util/DataStructures/ArrayView.h"
+#include "saiga/vision/features/FastDetector.h"
 #include "saiga/vision/features/FeatureDistribution.h"
 #include "saiga/vision/features/Features.h"
 #include "saiga/vision/features/OrbDescriptors.h"
@@ -37,8 +39,6 @@
 
 #include <vector>
 
-#ifdef SAIGA_USE_OPENCV
-
 namespace Saiga
 {
 class SAIGA_VISION_API ORBExtractor
@@ -52,20 +52,37 @@ class SAIGA_VISION_API ORBExtractor
     void Detect(Saiga::ImageView<unsigned char> inputImage, std::vector<KeypointType>& keypoints,
                 std::vector<Saiga::DescriptorORB>& outputDescriptors);
 
+    // Detects the keypoints and descriptors of multiple images (for example all frames of a stereo or multi-camera
+    // rig) in one call. The work is split into (image, level, cell row band) items, so even small batches and
+    // pyramids with very different level sizes keep all threads busy.
+    // The images can have different sizes. The pyramid buffers of each image are reused in the next call.
+    // keypoints[i] and descriptors[i] are the result of images[i].
+    void DetectBatch(ArrayView<Saiga::ImageView<unsigned char>> images,
+                     std::vector<std::vector<KeypointType>>& keypoints,
+                     std::vector<std::vector<Saiga::DescriptorORB>>& descriptors);
+
     // Can be called after 'Detect' to return the scaled image on the given level.
     // The imageview is invalidated after calling detect again.
-    ImageView<unsigned char> GetImage(int level){
-        return levels[level].image;
-    }
+    ImageView<unsigned char> GetImage(int level, int image = 0) { return images[image].levels[level].image; }
 
     ScalePyramid getPyramid(){
         return pyramid;
     }
 
    protected:
-    void AllocatePyramid(int rows, int cols);
-    void ComputePyramid(Saiga::ImageView<unsigned char> image);
-    void DetectKeypoints();
+    // keypoints and descriptors point to arrays with one element per image.
+    void ComputeBatch(ArrayView<Saiga::ImageView<unsigned char>> images, std::vector<KeypointType>* keypoints,
+                      std::vector<Saiga::DescriptorORB>* descriptors);
+
+    void AllocatePyramid(int image, int rows, int cols);
+    void ComputePyramid(int image, Saiga::ImageView<unsigned char> input);
+
+    // Runs FAST on one band of cell rows.
+    void DetectBand(int image, int level, int band);
+    // Selects the keypoints of each cell, distributes them and computes the angles.
+    void DetectKeypoints(int image, int level);
+    void ComputeDescriptors(int image, int level, std::vector<KeypointType>& keypoints,
+                            std::vector<Saiga::DescriptorORB>& descriptors);
 
     int num_levels;
     int th_fast;
@@ -75,6 +92,16 @@ class SAIGA_VISION_API ORBExtractor
     Saiga::ORB orb;
     Saiga::ScalePyramid pyramid;
 
+    // A horizontal stripe of cells of one pyramid level.
+    // Each band has its own detector and buffers so that all bands can be processed in parallel.
+    struct Band
+    {
+        // First and last (exclusive) cell row of this band
+        int cell_row_begin, cell_row_end;
+
+        Saiga::FastDetector fast;
+        std::vector<KeypointType> keypoints;
+    };
 
     struct Level
     {
@@ -85,10 +112,33 @@ class SAIGA_VISION_API ORBExtractor
         Saiga::ImageView<unsigned char> image;
         std::vector<KeypointType> keypoints_tmp;
         Saiga::QuadtreeFeatureDistributor distributor;
+
+        // Cell grid of the FAST detection
+        int cell_rows, cell_cols;
+        int cell_width, cell_height;
+        // Number of keypoints above the high FAST threshold per cell
+        std::vector<int> cell_high_count;
+        std::vector<Band> bands;
+
+        // Only the tiles of image_gauss which are covered by a descriptor patch are blurred.
+        int tile_rows, tile_cols;
+        std::vector<char> tile_used;
+        // Result of the horizontal gauss pass of one tile (including 3 rows of border at the top and bottom)
+        Saiga::TemplatedImage<unsigned short> gauss_tmp;
+    };
+
+    struct Image
+    {
+        int rows = 0, cols = 0;
+        std::vector<Level> levels;
     };
-    std::vector<Level> levels;
+    std::vector<Image> images;
+
+    struct WorkItem
+    {
+        int image, level, band;
+    };
+    std::vector<WorkItem> band_work, level_work;
 };
 
 }  // namespace Saiga
-
-#endif
@@ -7,6 +7,10 @@
 #include "OrbPattern.h"
 
 #include <vector>
+
+#if defined(__AVX2__)
+#    include <immintrin.h>
+#endif
 using namespace std;
 
 namespace Saiga
@@ -21,6 +25,26 @@ ORB::ORB()
     u_max = ORBPattern::AngleUmax();
     descriptor_pattern =
         std::vector<ivec2>(ORBPattern::DescriptorPattern().begin(), ORBPattern::DescriptorPattern().end());
+
+    // Rotate the pattern for each angle bin the same way as ComputeDescriptor. The maximum radius of the pattern is
+    // 18.4 so all offsets fit into a signed char. ComputeDescriptor rounds the (positive) absolute position, therefore
+    // the offsets are rounded half up instead of away from zero.
+    rotated_pattern.resize(kNumAngleBins * 1024);
+    for (int bin = 0; bin < kNumAngleBins; ++bin)
+    {
+        float angle         = Saiga::radians(bin * (360.f / kNumAngleBins));
+        float a             = (float)cos(angle), b = (float)sin(angle);
+        signed char* target = rotated_pattern.data() + bin * 1024;
+        for (int i = 0; i < 256; ++i)
+        {
+            for (int k = 0; k < 2; ++k)
+            {
+                auto p                     = descriptor_pattern[2 * i + k];
+                target[k * 512 + i]       = (signed char)std::floor(p.x() * a - p.y() * b + 0.5f);
+                target[k * 512 + 256 + i] = (signed char)std::floor(p.x() * b + p.y() * a + 0.5f);
+            }
+        }
+    }
 }
 
 float ORB::ComputeAngle(Saiga::ImageView<unsigned char> image, const Saiga::vec2& pt)
@@ -123,4 +147,61 @@ DescriptorORB ORB::ComputeDescriptor(Saiga::ImageView<unsigned char> image, cons
     }
     return result;
 }
+
+void ORB::ComputeDescriptors(Saiga::ImageView<const unsigned char> image, ArrayView<const KeyPoint<float>> keypoints,
+                             ArrayView<DescriptorORB> descriptors) const
+{
+    SAIGA_ASSERT(keypoints.size() == descriptors.size());
+    const int step = (int)image.pitchBytes;
+
+    for (size_t k = 0; k < keypoints.size(); ++k)
+    {
+        auto& kp = keypoints[k];
+        int x    = iRound(kp.point.x());
+        int y    = iRound(kp.point.y());
+        SAIGA_DEBUG_ASSERT(x >= 18 && y >= 18 && x < image.cols - 18 && y < image.rows - 19);
+
+        int bin = iRound(kp.angle * (kNumAngleBins / 360.f));
+        bin     = ((bin % kNumAngleBins) + kNumAngleBins) % kNumAngleBins;
+
+        const unsigned char* center = image.rowPtr(y) + x;
+        const signed char* xa       = rotated_pattern.data() + bin * 1024;
+        const signed char* ya       = xa + 256;
+        const signed char* xb       = xa + 512;
+        const signed char* yb       = xa + 768;
+
+        auto desc = (unsigned char*)&descriptors[k];
+
+#if defined(__AVX2__)
+        const __m256i step_v = _mm256_set1_epi32(step);
+        const __m256i mask   = _mm256_set1_epi32(0xFF);
+        auto offsets         = [&](const signed char* px, const signed char* py, int i) {
+            __m256i vx = _mm256_cvtepi8_epi32(_mm_loadl_epi64((const __m128i*)(px + i)));
+            __m256i vy = _mm256_cvtepi8_epi32(_mm_loadl_epi64((const __m128i*)(py + i)));
+            return _mm256_add_epi32(_mm256_mullo_epi32(vy, step_v), vx);
+        };
+        // 8 comparisons (= one byte of the descriptor) per iteration. The gather loads 4 bytes at each position and
+        // the mask extracts the first one.
+        for (int i = 0; i < 256; i += 8)
+        {
+            __m256i t0 = _mm256_and_si256(_mm256_i32gather_epi32((const int*)center, offsets(xa, ya, i), 1), mask);
+            __m256i t1 = _mm256_and_si256(_mm256_i32gather_epi32((const int*)center, offsets(xb, yb, i), 1), mask);
+            desc[i / 8] = (unsigned char)_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(t1, t0)));
+        }
+#else
+        for (int i = 0; i < 32; ++i)
+        {
+            int val = 0;
+            for (int j = 0; j < 8; ++j)
+            {
+                int s  = i * 8 + j;
+                int t0 = center[ya[s] * step + xa[s]];
+                int t1 = center[yb[s] * step + xb[s]];
+                val |= (t0 < t1) << j;
+            }
+            desc[i] = (unsigned char)val;
+        }
+#endif
+    }
+}
 }  // namespace Saiga
@@ -9,6 +9,35 @@
 
 namespace Saiga::Imu
 {
+void DecoupledImuScene::PreintAll()
+{
+#pragma omp parallel for schedule(dynamic, 4)
+    for (int i = 0; i < (int)edges.size(); ++i)
+    {
+        auto& e = edges[i];
+        *e.preint = Imu::Preintegration(states[e.from].velocity_and_bias);
+        e.preint->IntegrateMidPoint(*e.data, true);
+    }
+}
+
+void DecoupledImuScene::Preint(ArrayView<const int> edge_ids, bool use_global_bias)
+{
+#pragma omp parallel for schedule(dynamic, 4)
+    for (int i = 0; i < (int)edge_ids.size(); ++i)
+    {
+        auto& e = edges[edge_ids[i]];
+        if (use_global_bias)
+        {
+            *e.preint = Imu::Preintegration(global_bias_gyro, global_bias_acc);
+        }
+        else
+        {
+            *e.preint = Imu::Preintegration(states[e.from].velocity_and_bias);
+        }
+        e.preint->IntegrateMidPoint(*e.data, true);
+    }
+}
+
 void DecoupledImuScene::MakeRandom(int N, int K, double dt)
 {
     auto data = GenerateRandomSequence(N, K, dt);
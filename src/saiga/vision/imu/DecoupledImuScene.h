@@ -91,16 +91,12 @@ class SAIGA_VISION_API DecoupledImuScene
     Vec3 WeightPVR() { return Vec3(weight_P, weight_V, weight_R); }
 
 
-    void PreintAll()
-    {
-        for (auto& e : edges)
-        {
-            auto& s1 = states[e.from];
+    // Preintegrates all edges in parallel with the bias of their 'from' state as linearization point.
+    void PreintAll();
 
-            *e.preint = Imu::Preintegration(s1.velocity_and_bias);
-            e.preint->IntegrateMidPoint(*e.data, true);
-        }
-    }
+    // Preintegrates the given edges in parallel. The linearization point is the bias of the 'from' state or the
+    // global bias.
+    void Preint(ArrayView<const int> edge_ids, bool use_global_bias = false);
 
     void SanityCheck()
     {
@@ -352,36 +352,42 @@ void DecoupledImuSolver::addLambda(double lambda)
 void DecoupledImuSolver::RecomputePreint(bool always)
 {
     //    SAIGA_BLOCK_TIMER();
-    int rec     = 0;
     auto& scene = *_scene;
-    for (int i = 0; i < scene.edges.size(); ++i)
-    {
-        auto& e = scene.edges[i];
-        auto& s = scene.states[e.from];
 
-        if (always || s.delta_bias.acc_bias.squaredNorm() > params.bias_recompute_delta_squared ||
+    // States with a large bias change get a new linearization point. All edges starting at these states are
+    // re-integrated (in parallel). The other edges keep their preintegration and use the first order bias correction
+    // in ImuError.
+    recompute_state.assign(scene.states.size(), always);
+    for (int i = 0; i < scene.states.size(); ++i)
+    {
+        auto& s = scene.states[i];
+        if (s.delta_bias.acc_bias.squaredNorm() > params.bias_recompute_delta_squared ||
             s.delta_bias.gyro_bias.squaredNorm() > params.bias_recompute_delta_squared)
         {
-            s.velocity_and_bias.acc_bias += s.delta_bias.acc_bias;
-            s.velocity_and_bias.gyro_bias += s.delta_bias.gyro_bias;
-            s.delta_bias = VelocityAndBias();
-
-            *e.preint = Imu::Preintegration(s.velocity_and_bias);
-            e.preint->IntegrateMidPoint(*e.data, true);
-            rec++;
+            recompute_state[i] = true;
         }
     }
-
-
     for (auto is : states_without_preint)
     {
-        auto& s = scene.states[is];
+        recompute_state[is] = true;
+    }
 
+    for (int i = 0; i < scene.states.size(); ++i)
+    {
+        if (!recompute_state[i]) continue;
+        auto& s = scene.states[i];
         s.velocity_and_bias.acc_bias += s.delta_bias.acc_bias;
         s.velocity_and_bias.gyro_bias += s.delta_bias.gyro_bias;
         s.delta_bias = VelocityAndBias();
     }
-    //    std::cout << "Recomputed " << rec << " / " << scene.edges.size() << std::endl;
+
+    recompute_edges.clear();
+    for (int i = 0; i < scene.edges.size(); ++i)
+    {
+        if (recompute_state[scene.edges[i].from]) recompute_edges.push_back(i);
+    }
+    scene.Preint(recompute_edges);
+    //    std::cout << "Recomputed " << recompute_edges.size() << " / " << scene.edges.size() << std::endl;
 }
 
 
@@ -30,6 +30,8 @@ class SAIGA_VISION_API DecoupledImuSolver : public LMOptimizer
 
 
     std::vector<int> states_without_preint;
+    std::vector<char> recompute_state;
+    std::vector<int> recompute_edges;
     int N;
     int num_params;
     int non_zeros;
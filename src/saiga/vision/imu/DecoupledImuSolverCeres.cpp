@@ -15,6 +15,8 @@
 #    include "ceres/autodiff_cost_function.h"
 #    include "ceres/evaluation_callback.h"
 #    include "ceres/local_parameterization.h"
+
+#    include <numeric>
 namespace Saiga::Imu
 {
 struct ImuErrorAD
@@ -128,7 +130,10 @@ struct ImuError : public ceres::SizedCostFunction<9, 4, 1, 3, 3, 3, 3>
 
 
 
+        // First order correction for the difference to the linearization bias (see PreintCallBack)
         VelocityAndBias delta;
+        delta.acc_bias  = bias_acc - edge.preint->GetBiasAcc();
+        delta.gyro_bias = bias_gyro - edge.preint->GetBiasGyro();
 
 
         if (jacobians == nullptr)
@@ -235,28 +240,36 @@ struct BiasChange
 
 struct PreintCallBack : public ceres::EvaluationCallback
 {
+    // Only the edges with a large bias change are re-integrated. The residual of the other edges uses the first order
+    // bias correction.
     virtual void PrepareForEvaluation(bool evaluate_jacobians, bool new_evaluation_point) override
     {
         // std::cout << "callback " << evaluate_jacobians << " " << new_evaluation_point << std::endl;
         if (new_evaluation_point)
         {
             //            SAIGA_BLOCK_TIMER();
-            for (auto& e : scene->edges)
+            recompute_edges.clear();
+            for (int i = 0; i < (int)scene->edges.size(); ++i)
             {
-                if (global_bias)
-                {
-                    *e.preint = Imu::Preintegration(scene->global_bias_gyro, scene->global_bias_acc);
-                }
-                else
+                auto& e = scene->edges[i];
+
+                auto& vb       = scene->states[e.from].velocity_and_bias;
+                Vec3 bias_acc  = global_bias ? scene->global_bias_acc : vb.acc_bias;
+                Vec3 bias_gyro = global_bias ? scene->global_bias_gyro : vb.gyro_bias;
+
+                if ((bias_acc - e.preint->GetBiasAcc()).squaredNorm() > bias_recompute_delta_squared ||
+                    (bias_gyro - e.preint->GetBiasGyro()).squaredNorm() > bias_recompute_delta_squared)
                 {
-                    *e.preint = Imu::Preintegration(scene->states[e.from].velocity_and_bias);
+                    recompute_edges.push_back(i);
                 }
-                e.preint->IntegrateMidPoint(*e.data, true);
             }
+            scene->Preint(recompute_edges, global_bias);
         }
     }
     DecoupledImuScene* scene;
     bool global_bias;
+    double bias_recompute_delta_squared;
+    std::vector<int> recompute_edges;
 };
 
 
@@ -272,6 +285,8 @@ void DecoupledImuScene::SolveCeres(const SolverOptions& params, bool ad)
     cb.scene       = this;
     cb.global_bias = params.use_global_bias;
 
+    cb.bias_recompute_delta_squared = params.bias_recompute_delta_squared;
+
 
     ceres::Problem problem(problemOptions);
     OptimizationOptions optimizationOptions;
@@ -412,6 +427,13 @@ void DecoupledImuScene::SolveCeres(const SolverOptions& params, bool ad)
 
     OptimizationResults result = ceres_solve(ceres_options, problem);
 
+    if (!ad && params.final_recompute)
+    {
+        // The edges below the recompute threshold are still linearized at an older bias
+        std::vector<int> all_edges(edges.size());
+        std::iota(all_edges.begin(), all_edges.end(), 0);
+        Preint(all_edges, params.use_global_bias);
+    }
 
 
     //    std::cout << g_r << std::endl;
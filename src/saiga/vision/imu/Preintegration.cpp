@@ -28,25 +28,30 @@ void Preintegration::Add(const Vec3& omega_with_bias, const Vec3& acc_with_bias,
     Vec3 acc   = acc_with_bias - bias_accel_lin;
     double dt2 = dt * dt;
 
-    SO3 dR = Sophus::SO3d::exp(omega * dt);
-    Mat3 Jr;
-    Sophus::rightJacobianSO3(omega * dt, Jr);
+    Vec3 phi = omega * dt;
+    SO3 dR   = Sophus::SO3d::exp(phi);
+
+    // The rotation matrix and the rotated acceleration are used by all updates below.
+    Mat3 R     = delta_R.matrix();
+    Vec3 R_acc = R * acc;
 
 
 #if 0
     // noise covariance propagation of delta measurements
     // err_k+1 = A*err_k + B*err_gyro + C*err_acc
+    Mat3 Jr;
+    Sophus::rightJacobianSO3(phi, Jr);
     Mat3 I3x3               = Mat3::Identity();
     Matrix<double, 9, 9> A  = Matrix<double, 9, 9>::Identity();
     A.block<3, 3>(6, 6)     = dR.inverse().matrix();
-    A.block<3, 3>(3, 6)     = -delta_R.matrix() * skew(acc) * dt;
-    A.block<3, 3>(0, 6)     = -0.5 * delta_R.matrix() * skew(acc) * dt2;
+    A.block<3, 3>(3, 6)     = -R * skew(acc) * dt;
+    A.block<3, 3>(0, 6)     = -0.5 * R * skew(acc) * dt2;
     A.block<3, 3>(0, 3)     = I3x3 * dt;
     Matrix<double, 9, 3> Bg = Matrix<double, 9, 3>::Zero();
     Bg.block<3, 3>(6, 0)    = Jr * dt;
     Matrix<double, 9, 3> Ca = Matrix<double, 9, 3>::Zero();
-    Ca.block<3, 3>(3, 0)    = delta_R.matrix() * dt;
-    Ca.block<3, 3>(0, 0)    = 0.5 * delta_R.matrix() * dt2;
+    Ca.block<3, 3>(3, 0)    = R * dt;
+    Ca.block<3, 3>(0, 0)    = 0.5 * R * dt2;
 
 
     cov_P_V_Phi = A * cov_P_V_Phi * A.transpose() + Bg * cov_gyro * Bg.transpose() + Ca * cov_acc * Ca.transpose();
@@ -54,20 +59,25 @@ void Preintegration::Add(const Vec3& omega_with_bias, const Vec3& acc_with_bias,
 
     if (derive)
     {
+        Mat3 Jr;
+        Sophus::rightJacobianSO3(phi, Jr);
+        Mat3 R_skew_J = R * (skew(acc) * J_R_Biasg);
+
         // jacobian of delta measurements w.r.t bias of gyro/acc
         // update P first, then V, then R
-        J_P_Biasa += J_V_Biasa * dt - 0.5 * delta_R.matrix() * dt2;
-        J_P_Biasg += J_V_Biasg * dt - 0.5 * delta_R.matrix() * skew(acc) * J_R_Biasg * dt2;
-        J_V_Biasa += -delta_R.matrix() * dt;
-        J_V_Biasg += -delta_R.matrix() * skew(acc) * J_R_Biasg * dt;
+        J_P_Biasa += J_V_Biasa * dt - (0.5 * dt2) * R;
+        J_P_Biasg += J_V_Biasg * dt - (0.5 * dt2) * R_skew_J;
+        J_V_Biasa -= R * dt;
+        J_V_Biasg -= R_skew_J * dt;
 
-        J_R_Biasg = dR.inverse().matrix() * J_R_Biasg - Jr * dt;
+        // dR is a rotation -> inverse == transpose
+        J_R_Biasg = dR.matrix().transpose() * J_R_Biasg - Jr * dt;
     }
 
 
     delta_t += dt;
-    delta_x += delta_v * dt + 0.5 * dt2 * (delta_R * acc);  // P_k+1 = P_k + V_k*dt + R_k*a_k*dt*dt/2
-    delta_v += dt * (delta_R * acc);
+    delta_x += delta_v * dt + (0.5 * dt2) * R_acc;  // P_k+1 = P_k + V_k*dt + R_k*a_k*dt*dt/2
+    delta_v += dt * R_acc;
     delta_R = (delta_R * dR);
 }
 
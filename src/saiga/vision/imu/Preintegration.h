@@ -87,8 +87,10 @@ struct SAIGA_VISION_API Preintegration
     double cov_acc  = 0;
 #endif
 
-    Vec3 GetBiasAcc() { return bias_accel_lin; }
-    Vec3 GetBiasGyro() { return bias_gyro_lin; }
+    // The bias used as linearization point. Small bias changes relative to this point are handled by the first order
+    // correction in ImuError.
+    Vec3 GetBiasAcc() const { return bias_accel_lin; }
+    Vec3 GetBiasGyro() const { return bias_gyro_lin; }
 
    private:
     // Linear bias, which is subtracted from the meassurements.
@@ -133,7 +133,7 @@ inline std::pair<Vector<T, 2>, T> BundleAdjustment(const IntrinsicsPinhole<T>& c
                                                    Matrix<T, 2, 3>* jacobian_point = nullptr)
 {
     Vector<T, 3> p      = pose * point;
-    Vector<T, 2> p_by_z = Vec2(p(0) / p(2), p(1) / p(2));
+    Vector<T, 2> p_by_z = Vector<T, 2>(p(0) / p(2), p(1) / p(2));
 
     Vector<T, 2> residual;
     residual(0) = camera.fx * p_by_z(0) + camera.s * p_by_z(1) + camera.cx - observation(0);
@@ -216,22 +216,23 @@ inline std::pair<Vector<T, 2>, T> BundleAdjustment(const IntrinsicsPinhole<T>& c
 
 // Returns: <Residual, Depth>
 template <typename T = double>
-inline std::pair<Vec3, double> BundleAdjustmentStereo(const StereoCamera4& camera, const Vec2& observation,
-                                                      double observed_stereo_point, const SE3& pose, const Vec3& point,
-                                                      double weight, double weight_depth,
-                                                      Matrix<double, 3, 6>* jacobian_pose  = nullptr,
-                                                      Matrix<double, 3, 3>* jacobian_point = nullptr)
+inline std::pair<Vector<T, 3>, T> BundleAdjustmentStereo(const StereoCamera4Base<T>& camera,
+                                                         const Vector<T, 2>& observation, T observed_stereo_point,
+                                                         const Sophus::SE3<T>& pose, const Vector<T, 3>& point, T weight,
+                                                         T weight_depth, Matrix<T, 3, 6>* jacobian_pose = nullptr,
+                                                         Matrix<T, 3, 3>* jacobian_point = nullptr)
 {
-    Vec3 p      = pose * point;
-    Vec2 p_by_z = Vec2(p(0) / p(2), p(1) / p(2));
+    Vector<T, 3> p      = pose * point;
+    Vector<T, 2> p_by_z = Vector<T, 2>(p(0) / p(2), p(1) / p(2));
 
-    Vec2 projected_point(camera.fx * p_by_z(0) + camera.s * p_by_z(1) + camera.cx, camera.fy * p_by_z(1) + camera.cy);
+    Vector<T, 2> projected_point(camera.fx * p_by_z(0) + camera.s * p_by_z(1) + camera.cx,
+                                 camera.fy * p_by_z(1) + camera.cy);
 
-    Vec3 residual;
-    residual.head<2>() = projected_point - observation;
+    Vector<T, 3> residual;
+    residual.template head<2>() = projected_point - observation;
 
 
-    double stereo_point = projected_point(0) - camera.bf / p(2);
+    T stereo_point = projected_point(0) - camera.bf / p(2);
     residual(2)         = observed_stereo_point - stereo_point;
 
 
@@ -8,6 +8,7 @@
 #include "saiga/core/geometry/all.h"
 #include "saiga/core/image/all.h"
 #include "saiga/core/util/BinaryFile.h"
+#include "saiga/core/util/DataStructures/SegmentedVector.h"
 #include "saiga/core/util/ProgressBar.h"
 #include "saiga/core/util/Thread/SpinLock.h"
 #include "saiga/core/util/Thread/omp.h"
@@ -15,10 +16,47 @@
 
 namespace Saiga
 {
+// A block id which can be read and modified atomically.
+// In contrast to std::atomic_int it is copyable, so it can be stored in std::vector and in copyable structs. The
+// copy itself is not atomic.
+struct AtomicBlockId
+{
+    AtomicBlockId(int id = -1) : id(id) {}
+    AtomicBlockId(const AtomicBlockId& other) : id(other.load(std::memory_order_relaxed)) {}
+
+    AtomicBlockId& operator=(const AtomicBlockId& other)
+    {
+        store(other.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        return *this;
+    }
+
+    AtomicBlockId& operator=(int other)
+    {
+        store(other);
+        return *this;
+    }
+
+    operator int() const { return load(); }
+
+    int load(std::memory_order order = std::memory_order_acquire) const { return id.load(order); }
+    void store(int other, std::memory_order order = std::memory_order_release) { id.store(other, order); }
+
+    // On failure 'expected' is updated to the current value
+    bool compare_exchange_weak(int& expected, int desired)
+    {
+        return id.compare_exchange_weak(expected, desired, std::memory_order_acq_rel, std::memory_order_acquire);
+    }
+
+   private:
+    std::atomic_int id;
+};
+static_assert(sizeof(AtomicBlockId) == sizeof(int), "AtomicBlockId is serialized as int.");
+
 template <typename VoxelType, int _VOXEL_BLOCK_SIZE>
 struct SAIGA_TEMPLATE BlockSparseGrid
 {
     static constexpr int VOXEL_BLOCK_SIZE = _VOXEL_BLOCK_SIZE;
+    static constexpr int UNLINKED_BLOCK   = -2;
     using VoxelBlockIndex                 = ivec3;
     using VoxelIndex                      = ivec3;
     using Voxel                           = VoxelType;
@@ -29,12 +67,13 @@ struct SAIGA_TEMPLATE BlockSparseGrid
     //
     // Due to the sparse storage, each voxel block has to known it's own index.
     // The next_index points to the next voxel block in the same hash bucket.
+    // Blocks which are not part of any bucket (see InsertBlockConcurrent) have next_index == UNLINKED_BLOCK.
     struct VoxelBlock
     {
         //        Voxel data[VOXEL_BLOCK_SIZE][VOXEL_BLOCK_SIZE][VOXEL_BLOCK_SIZE];
         std::array<std::array<std::array<Voxel, 8>, 8>, 8> data;
-        VoxelBlockIndex index = VoxelBlockIndex(-973454, -973454, -973454);
-        int next_index        = -1;
+        VoxelBlockIndex index    = VoxelBlockIndex(-973454, -973454, -973454);
+        AtomicBlockId next_index = -1;
 
         // the weight of all voxels is 0
         bool Empty()
@@ -59,9 +98,7 @@ struct SAIGA_TEMPLATE BlockSparseGrid
           voxel_size_inv(1.0 / voxel_size),
           hash_size(hash_size),
           blocks(reserve_blocks),
-          first_hashed_block(hash_size, -1),
-          hash_locks(hash_size)
-
+          first_hashed_block(hash_size, -1)
     {
         block_size_inv = 1.0 / (voxel_size * VOXEL_BLOCK_SIZE);
     }
@@ -73,7 +110,6 @@ struct SAIGA_TEMPLATE BlockSparseGrid
         hash_size          = other.hash_size;
         blocks             = other.blocks;
         first_hashed_block = other.first_hashed_block;
-        hash_locks         = std::vector<SpinLock>(hash_size);
         current_blocks     = other.current_blocks.load();
     }
 
@@ -103,11 +139,7 @@ struct SAIGA_TEMPLATE BlockSparseGrid
 
         // Create block and insert as the first element.
         int new_index = current_blocks.fetch_add(1);
-
-        if (new_index >= (int)blocks.size())
-        {
-            blocks.resize(blocks.size() * 2);
-        }
+        blocks.grow_to_at_least(new_index + 1);
 
         int hash                 = H(i);
         auto* new_block          = &blocks[new_index];
@@ -157,7 +189,7 @@ struct SAIGA_TEMPLATE BlockSparseGrid
 
     bool EraseBlockWithHole(const VoxelBlockIndex& i, int hash)
     {
-        int* block_id_ptr = &first_hashed_block[hash];
+        AtomicBlockId* block_id_ptr = &first_hashed_block[hash];
 
         bool found = false;
 
@@ -179,34 +211,86 @@ struct SAIGA_TEMPLATE BlockSparseGrid
         return true;
     }
 
-    VoxelBlock* InsertBlockLock(const VoxelBlockIndex& i)
+    // Thread-safe and lock-free version of InsertBlock.
+    // Can be called in parallel to other InsertBlockConcurrent and GetBlock calls. The block storage grows on
+    // demand without moving existing blocks, so the returned pointers stay valid.
+    //
+    // The new block is allocated before it is linked into the hash bucket. If two threads insert the same block at
+    // the same time, the block of the losing thread is not linked and marked as UNLINKED_BLOCK. Call
+    // FinishConcurrentInsertion() after the parallel section to remove these blocks.
+    VoxelBlock* InsertBlockConcurrent(const VoxelBlockIndex& i)
     {
-        int h = H(i);
+        auto& head = first_hashed_block[H(i)];
 
-        std::unique_lock lock(hash_locks[h]);
-
-        auto block = GetBlock(i, h);
+        int first     = head.load();
+        int new_index = -1;
+        // The blocks of this bucket starting at 'searched_until' have already been compared to i.
+        int searched_until = -1;
 
-        if (block)
+        while (true)
         {
-            // block already exists
-            return block;
+            // Blocks are only added to the front of the list. Therefore, only the blocks inserted since the last
+            // iteration have to be checked.
+            for (int id = first; id != searched_until; id = blocks[id].next_index.load())
+            {
+                if (blocks[id].index == i)
+                {
+                    if (new_index >= 0)
+                    {
+                        // Another thread was faster
+                        blocks[new_index]            = VoxelBlock();
+                        blocks[new_index].next_index = UNLINKED_BLOCK;
+                        unlinked_blocks.fetch_add(1, std::memory_order_relaxed);
+                    }
+                    return &blocks[id];
+                }
+            }
+            searched_until = first;
+
+            if (new_index < 0)
+            {
+                new_index = current_blocks.fetch_add(1, std::memory_order_relaxed);
+                blocks.grow_to_at_least(new_index + 1);
+                blocks[new_index].index = i;
+            }
+
+            blocks[new_index].next_index.store(first, std::memory_order_relaxed);
+            if (head.compare_exchange_weak(first, new_index))
+            {
+                return &blocks[new_index];
+            }
         }
+    }
 
-        // Create block and insert as the first element.
-        int new_index = current_blocks.fetch_add(1);
+    // Removes the blocks which were not linked by InsertBlockConcurrent.
+    // The last blocks are moved into the holes, so block ids might change. Not thread-safe.
+    void FinishConcurrentInsertion()
+    {
+        if (unlinked_blocks == 0) return;
 
-        if (new_index >= (int)blocks.size())
+        for (int i = 0; i < current_blocks;)
         {
-            SAIGA_EXIT_ERROR("Resizing not allowed during parallel insertion!");
-        }
+            if (blocks[i].next_index != UNLINKED_BLOCK)
+            {
+                ++i;
+                continue;
+            }
 
-        int hash                 = H(i);
-        auto* new_block          = &blocks[new_index];
-        new_block->index         = i;
-        new_block->next_index    = first_hashed_block[hash];
-        first_hashed_block[hash] = new_index;
-        return new_block;
+            int last = current_blocks - 1;
+            if (last != i && blocks[last].next_index != UNLINKED_BLOCK)
+            {
+                auto last_index = blocks[last].index;
+                int last_h      = H(last_index);
+                EraseBlockWithHole(last_index, last_h);
+
+                blocks[i]                  = blocks[last];
+                blocks[i].next_index       = first_hashed_block[last_h];
+                first_hashed_block[last_h] = i;
+            }
+            blocks[last] = VoxelBlock();
+            current_blocks--;
+        }
+        unlinked_blocks = 0;
     }
 
     void AllocateAroundPoint(const vec3& position, int r = 1)
@@ -225,6 +309,86 @@ struct SAIGA_TEMPLATE BlockSparseGrid
         }
     }
 
+    // Calls f(block_index) for all blocks intersected by the line segment [start, end] (3D DDA).
+    // The blocks are visited in order from start to end.
+    template <typename F>
+    void TraverseBlocks(const vec3& start, const vec3& end, F&& f)
+    {
+        vec3 rayDir = (end - start).normalized();
+
+        auto idCurrentVoxel = GetBlockIndex(start);
+        auto idEnd          = GetBlockIndex(end);
+
+        vec3 step        = rayDir.array().sign();
+        vec3 boundaryPos = GlobalBlockOffset(
+                               idCurrentVoxel + step.cast<int>().array().max(ivec3::Zero().array()).matrix()) -
+                           make_vec3(0.5f * voxel_size);
+        vec3 tMax   = (boundaryPos - start).array() / rayDir.array();
+        vec3 tDelta = (step * VOXEL_BLOCK_SIZE * voxel_size).array() / rayDir.array();
+
+
+        ivec3 idBound = idEnd + step.cast<int>();
+
+
+        auto inf = std::numeric_limits<float>::infinity();
+        if (rayDir.x() == 0.0f)
+        {
+            tMax.x()   = inf;
+            tDelta.x() = inf;
+        }
+        if (rayDir.y() == 0.0f)
+        {
+            tMax.y()   = inf;
+            tDelta.y() = inf;
+        }
+        if (rayDir.z() == 0.0f)
+        {
+            tMax.z()   = inf;
+            tDelta.z() = inf;
+        }
+
+
+        if (boundaryPos.x() - start.x() == 0.0f)
+        {
+            tMax.x()   = inf;
+            tDelta.x() = inf;
+        }
+        if (boundaryPos.y() - start.y() == 0.0f)
+        {
+            tMax.y()   = inf;
+            tDelta.y() = inf;
+        }
+        if (boundaryPos.z() - start.z() == 0.0f)
+        {
+            tMax.z()   = inf;
+            tDelta.z() = inf;
+        }
+
+        while (true)
+        {
+            f(idCurrentVoxel);
+            // Traverse voxel grid
+            if (tMax.x() < tMax.y() && tMax.x() < tMax.z())
+            {
+                idCurrentVoxel.x() += step.x();
+                if (idCurrentVoxel.x() == idBound.x()) break;
+                tMax.x() += tDelta.x();
+            }
+            else if (tMax.z() < tMax.y())
+            {
+                idCurrentVoxel.z() += step.z();
+                if (idCurrentVoxel.z() == idBound.z()) break;
+                tMax.z() += tDelta.z();
+            }
+            else
+            {
+                idCurrentVoxel.y() += step.y();
+                if (idCurrentVoxel.y() == idBound.y()) break;
+                tMax.y() += tDelta.y();
+            }
+        }
+    }
+
     // Returns the 8 voxel ids + weights for a trilinear access
     std::array<std::pair<VoxelIndex, float>, 8> TrilinearAccess(const vec3& position)
     {
@@ -351,7 +515,11 @@ struct SAIGA_TEMPLATE BlockSparseGrid
     }
 
 
-    void Compact() { blocks.resize(current_blocks); }
+    void Compact()
+    {
+        FinishConcurrentInsertion();
+        blocks.resize(current_blocks);
+    }
 
     int Size() { return current_blocks; }
 
@@ -364,17 +532,21 @@ struct SAIGA_TEMPLATE BlockSparseGrid
 
     unsigned int hash_size;
     std::atomic_int current_blocks = 0;
-    std::vector<VoxelBlock> blocks;
-    std::vector<int> first_hashed_block;
-    std::vector<SpinLock> hash_locks;
+
+    // Number of blocks marked as UNLINKED_BLOCK by InsertBlockConcurrent.
+    std::atomic_int unlinked_blocks = 0;
+
+    SegmentedVector<VoxelBlock> blocks;
+    std::vector<AtomicBlockId> first_hashed_block;
 
 
     void Clear()
     {
-        current_blocks = 0;
-        for (auto& b : blocks)
+        current_blocks  = 0;
+        unlinked_blocks = 0;
+        for (size_t i = 0; i < blocks.size(); ++i)
         {
-            b = VoxelBlock();
+            blocks[i] = VoxelBlock();
         }
         for (auto& i : first_hashed_block)
         {
@@ -91,33 +91,32 @@ int EightPointRansac::solve(ArrayView<const Vec2> _points1, ArrayView<const Vec2
         points1 = _points1;
         points2 = _points2;
         N       = points1.size();
+        point_set.Set(points1, points2);
     }
 
 
 
-    int idx;
-    idx = compute(points1.size());
+    int num_inliers = compute(points1.size());
 
 
 
 #pragma omp single
     {
-        //            std::cout << "best idx " << idx << std::endl;
-        bestE = models[idx];
+        bestE = bestModel;
 
 
         bestInlierMatches.clear();
-        bestInlierMatches.reserve(numInliers[idx]);
+        bestInlierMatches.reserve(num_inliers);
         for (int i = 0; i < N; ++i)
         {
-            if (inliers[idx][i]) bestInlierMatches.push_back(i);
+            if (bestInlierMask[i]) bestInlierMatches.push_back(i);
         }
 
-        inlierMask = inliers[idx];
+        inlierMask = bestInlierMask;
     }
 
 
-    return numInliers[idx];
+    return num_inliers;
 }
 
 bool EightPointRansac::computeModel(const RansacBase::Subset& set, EightPointRansac::Model& model)
@@ -139,6 +138,11 @@ double EightPointRansac::computeResidual(const EightPointRansac::Model& model, i
     return EpipolarDistanceSquared(points1[i], points2[i], model);
 }
 
+int EightPointRansac::computeInliers(const EightPointRansac::Model& model, int begin, int end, char* mask)
+{
+    return EpipolarInliers(model, point_set, begin, end, params.residualThreshold, mask, kernel);
+}
+
 
 
 }  // namespace Saiga
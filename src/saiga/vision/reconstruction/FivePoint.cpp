@@ -495,33 +495,32 @@ int FivePointRansac::solve(ArrayView<const Vec2> _points1, ArrayView<const Vec2>
         points1 = _points1;
         points2 = _points2;
         N       = points1.size();
+        point_set.Set(points1, points2);
     }
 
 
 
-    int idx;
-    idx = compute(points1.size());
+    int num_inliers = compute(points1.size());
 
 
 
 #pragma omp single
     {
-        //            std::cout << "best idx " << idx << std::endl;
-        bestE = models[idx].first;
-        bestT = models[idx].second;
+        bestE = bestModel.first;
+        bestT = bestModel.second;
 
         bestInlierMatches.clear();
-        bestInlierMatches.reserve(numInliers[idx]);
+        bestInlierMatches.reserve(num_inliers);
         for (int i = 0; i < N; ++i)
         {
-            if (inliers[idx][i]) bestInlierMatches.push_back(i);
+            if (bestInlierMask[i]) bestInlierMatches.push_back(i);
         }
 
-        inlierMask = inliers[idx];
+        inlierMask = bestInlierMask;
     }
 
 
-    return numInliers[idx];
+    return num_inliers;
 }
 
 bool FivePointRansac::computeModel(const RansacBase::Subset& set, FivePointRansac::Model& model)
@@ -559,4 +558,9 @@ double FivePointRansac::computeResidual(const FivePointRansac::Model& model, int
     return EpipolarDistanceSquared(points1[i], points2[i], model.first);
 }
 
+int FivePointRansac::computeInliers(const FivePointRansac::Model& model, int begin, int end, char* mask)
+{
+    return EpipolarInliers(model.first, point_set, begin, end, params.residualThreshold, mask, kernel);
+}
+
 }  // namespace Saiga
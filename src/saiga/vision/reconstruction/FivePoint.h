@@ -73,8 +73,11 @@ class SAIGA_VISION_API FivePointRansac : public RansacBase<FivePointRansac, std:
 
     double computeResidual(const Model& model, int i);
 
+    int computeInliers(const Model& model, int begin, int end, char* mask);
+
     ArrayView<const Vec2> points1;
     ArrayView<const Vec2> points2;
+    RansacPointSet point_set;
 };
 
 
@@ -67,21 +67,14 @@ int HomographyRansac::solve(ArrayView<const Vec2> _points1, ArrayView<const Vec2
 {
     points1 = _points1;
     points2 = _points2;
-
-    int idx = 0;
+    point_set.Set(points1, points2);
 
 #pragma omp parallel num_threads(params.threads)
     {
-        int l_idx = compute(points1.size());
-
-        if (OMP::getThreadNum() == 0)
-        {
-            // fix write/write face condition
-            idx = l_idx;
-        }
+        compute(points1.size());
     }
-    bestH = models[idx];
-    return numInliers[idx];
+    bestH = bestModel;
+    return bestNumInliers;
 }
 
 bool HomographyRansac::computeModel(const RansacBase::Subset& set, HomographyRansac::Model& model)
@@ -102,6 +95,11 @@ double HomographyRansac::computeResidual(const HomographyRansac::Model& model, i
     return homographyResidual(points1[i], points2[i], model);
 }
 
+int HomographyRansac::computeInliers(const HomographyRansac::Model& model, int begin, int end, char* mask)
+{
+    return HomographyInliers(model, point_set, begin, end, params.residualThreshold, mask, kernel);
+}
+
 
 
 }  // namespace Saiga
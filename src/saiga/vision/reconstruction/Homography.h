@@ -50,8 +50,11 @@ class SAIGA_VISION_API HomographyRansac : public RansacBase<HomographyRansac, Ma
 
     double computeResidual(const Model& model, int i);
 
+    int computeInliers(const Model& model, int begin, int end, char* mask);
+
     ArrayView<const Vec2> points1;
     ArrayView<const Vec2> points2;
+    RansacPointSet point_set;
 };
 
 
@@ -0,0 +1,374 @@
+/**
+ * Copyright (c) 2021 Darius Rückert
+ * Licensed under the MIT License.
+ * See LICENSE file for more information.
+ */
+
+#include "IncrementalFusion.h"
+
+#include "saiga/core/util/Thread/omp.h"
+
+#include <climits>
+
+namespace Saiga
+{
+IncrementalFusion::IncrementalFusion(const IntrinsicsPinholed& K, const Distortion& dis, int w, int h,
+                                     const FusionParams& params)
+    : params(params), K(K), dis(dis), w(w), h(h)
+{
+    SAIGA_ASSERT(!params.ground_truth_fuse && !params.point_based, "Not supported by IncrementalFusion.");
+
+    tsdf           = std::make_shared<SparseTSDF>(params.voxelSize, params.block_count, params.hash_size);
+    has_distortion = !dis.Coeffs().isZero();
+
+    unproject_undistort_map.create(h, w);
+#pragma omp parallel for
+    for (int i = 0; i < h; ++i)
+    {
+        for (int j = 0; j < w; ++j)
+        {
+            Vec2 p = K.unproject2(Vec2(j, i));
+            p      = undistortPointGN(p, p, dis);
+
+            unproject_undistort_map(i, j) = p.cast<float>();
+        }
+    }
+
+    if (params.use_confidence)
+    {
+        unprojected_position.create(h, w);
+        unprojected_position.makeZero();
+        confidence.create(h, w);
+    }
+
+    thread_block_indices.resize(OMP::getMaxThreads());
+    thread_block_ids.resize(OMP::getMaxThreads());
+}
+
+void IncrementalFusion::Integrate(ImageView<const float> depth_map, const SE3& V)
+{
+    SAIGA_ASSERT(depth_map.w == w && depth_map.h == h);
+    frame++;
+    last_frame = {};
+
+    int blocks_before = tsdf->current_blocks;
+    AllocateBlocks(depth_map, V);
+    last_frame.allocated_blocks = tsdf->current_blocks - blocks_before;
+
+    if (params.use_confidence)
+    {
+        vec3 eye = V.inverse().translation().cast<float>();
+        ComputeFusionConfidence(depth_map, unprojected_position, eye, confidence);
+    }
+
+    int n = tsdf->current_blocks;
+    block_frame.resize(n, 0);
+    is_dirty.resize(n, 0);
+
+    CollectBlocks(V);
+    last_frame.integrated_blocks = frame_blocks.size();
+
+    frame_block_changed.assign(frame_blocks.size(), 0);
+#pragma omp parallel for schedule(dynamic, 16)
+    for (int i = 0; i < (int)frame_blocks.size(); ++i)
+    {
+        frame_block_changed[i] = IntegrateBlock(tsdf->blocks[frame_blocks[i]], depth_map, V);
+    }
+
+    MarkDirty();
+}
+
+void IncrementalFusion::AllocateBlocks(ImageView<const float> depth_map, const SE3& V)
+{
+    auto invV = V.inverse().cast<float>();
+
+#pragma omp parallel
+    {
+        auto& local = thread_block_indices[OMP::getThreadNum()];
+        local.clear();
+
+        // Neighbouring pixels usually hit the same blocks.
+        // A small direct mapped cache of the last inserted blocks skips most of the hash map lookups.
+        std::array<ivec3, 256> recent;
+        recent.fill(ivec3(INT_MAX, INT_MAX, INT_MAX));
+
+        auto insert = [&](const ivec3& block_id) {
+            unsigned int hash = block_id.x() * 73856093u ^ block_id.y() * 19349663u ^ block_id.z() * 83492791u;
+            auto& slot        = recent[hash % recent.size()];
+            if (slot == block_id) return;
+            slot = block_id;
+
+            tsdf->InsertBlockConcurrent(block_id);
+            local.push_back(block_id);
+        };
+
+#pragma omp for schedule(dynamic, 4)
+        for (int i = 0; i < h; ++i)
+        {
+            for (int j = 0; j < w; ++j)
+            {
+                if (params.use_confidence) unprojected_position(i, j) = vec3::Zero();
+
+                auto depth = depth_map(i, j);
+                if (depth <= 0 || depth > params.maxIntegrationDistance) continue;
+
+                float truncation_distance = params.truncationDistance + params.truncationDistanceScale * depth;
+                truncation_distance = std::max(params.min_truncation_factor * params.voxelSize, truncation_distance);
+
+                float min_depth = clamp(depth - truncation_distance, 0, params.maxIntegrationDistance);
+                float max_depth = clamp(depth + truncation_distance, 0, params.maxIntegrationDistance);
+
+                vec2 p = unproject_undistort_map(i, j);
+                if (params.use_confidence) unprojected_position(i, j) = invV * (vec3(p(0), p(1), 1) * depth);
+
+                if (min_depth >= max_depth) continue;
+
+                vec3 ray_min = invV * (vec3(p(0), p(1), 1) * min_depth);
+                vec3 ray_max = invV * (vec3(p(0), p(1), 1) * max_depth);
+                tsdf->TraverseBlocks(ray_min, ray_max, insert);
+            }
+        }
+    }
+
+    // Only blocks created in this frame are moved here
+    tsdf->FinishConcurrentInsertion();
+}
+
+void IncrementalFusion::CollectBlocks(const SE3& V)
+{
+    auto K2 = K;
+    if (params.increase_visibility_frustum)
+    {
+        K2.fx *= 0.95;
+        K2.fy *= 0.95;
+    }
+
+    int n = tsdf->current_blocks;
+
+#pragma omp parallel
+    {
+        auto& ids = thread_block_ids[OMP::getThreadNum()];
+        ids.clear();
+
+        // 1. The blocks in the truncation band of the new depth map
+#pragma omp for schedule(dynamic)
+        for (int t = 0; t < (int)thread_block_indices.size(); ++t)
+        {
+            for (auto& index : thread_block_indices[t])
+            {
+                ids.push_back(tsdf->GetBlockId(index));
+            }
+        }
+
+        // 2. The existing blocks inside the view frustum (same test as FusionScene::Visibility)
+#pragma omp for schedule(static)
+        for (int b = 0; b < n; ++b)
+        {
+            Vec3 c            = tsdf->BlockCenter(tsdf->blocks[b].index).cast<double>();
+            Vec3 pos          = V * c;
+            double voxelDepth = pos.z();
+            if (voxelDepth < 0 || voxelDepth > params.maxIntegrationDistance + 0.4) continue;
+
+            Vec2 np = pos.head<2>() / pos.z();
+            np      = distortNormalizedPoint(np, dis);
+            Vec2 ip = K2.normalizedToImage(np).array().round();
+            if (!unproject_undistort_map.inImage(ip(1), ip(0))) continue;
+
+            ids.push_back(b);
+        }
+    }
+
+    frame_blocks.clear();
+    for (auto& ids : thread_block_ids)
+    {
+        for (auto id : ids)
+        {
+            SAIGA_ASSERT(id >= 0 && id < n);
+            if (block_frame[id] == frame) continue;
+            block_frame[id] = frame;
+            frame_blocks.push_back(id);
+        }
+    }
+}
+
+bool IncrementalFusion::IntegrateBlock(SparseTSDF::VoxelBlock& block, ImageView<const float> depth_map, const SE3& V)
+{
+    constexpr int N = SparseTSDF::VOXEL_BLOCK_SIZE;
+    static_assert(N == 8, "One row of voxels is processed as an 8-wide vector.");
+    using Array8f = Eigen::Array<float, N, 1>;
+    using Voxels8 = Eigen::Map<Array8f, Eigen::Unaligned, Eigen::InnerStride<2>>;
+
+    // Camera space position of voxel (x, y, z): origin + x * dx + y * dy + z * dz
+    Mat3 R      = V.so3().matrix();
+    vec3 origin = (V * tsdf->GlobalBlockOffset(block.index).cast<double>()).cast<float>();
+    vec3 dx     = (R.col(0) * tsdf->voxel_size).cast<float>();
+    vec3 dy     = (R.col(1) * tsdf->voxel_size).cast<float>();
+    vec3 dz     = (R.col(2) * tsdf->voxel_size).cast<float>();
+
+    const Array8f lane = Array8f::LinSpaced(N, 0, N - 1);
+    const float fx = K.fx, fy = K.fy, cx = K.cx + params.ip_offset.x(), cy = K.cy + params.ip_offset.y(), s = K.s;
+    const float min_truncation = params.min_truncation_factor * params.voxelSize;
+
+    bool changed = false;
+    Array8f image_depth, image_confidence, ix, iy;
+
+    for (int z = 0; z < N; ++z)
+    {
+        for (int y = 0; y < N; ++y)
+        {
+            vec3 row   = origin + dy * y + dz * z;
+            Array8f px = row.x() + lane * dx.x();
+            Array8f py = row.y() + lane * dx.y();
+            Array8f pz = row.z() + lane * dx.z();
+
+            Array8f inv_z = pz.inverse();
+            Array8f nx    = px * inv_z;
+            Array8f ny    = py * inv_z;
+
+            if (!has_distortion)
+            {
+                ix = fx * nx + s * ny + cx;
+                iy = fy * ny + cy;
+            }
+            else
+            {
+                for (int l = 0; l < N; ++l)
+                {
+                    Vec2 ip = K.normalizedToImage(distortNormalizedPoint(Vec2(nx(l), ny(l)), dis)) + params.ip_offset;
+                    ix(l)   = ip(0);
+                    iy(l)   = ip(1);
+                }
+            }
+
+            // Gather the depth values (same rules as FusionScene::Integrate)
+            bool any = false;
+            for (int l = 0; l < N; ++l)
+            {
+                image_depth(l)      = 0;
+                image_confidence(l) = 0;
+                if (pz(l) <= 0) continue;
+
+                int ipx = std::round(ix(l));
+                int ipy = std::round(iy(l));
+                if (depth_map.distanceFromEdge(ipy, ipx) <= 2) continue;
+
+                float d;
+                if (params.bilinear_intperpolation)
+                {
+                    int x0  = std::floor(ix(l));
+                    int y0  = std::floor(iy(l));
+                    auto a1 = depth_map(y0, x0);
+                    auto a4 = depth_map(y0, x0 + 1);
+                    auto a2 = depth_map(y0 + 1, x0);
+                    auto a3 = depth_map(y0 + 1, x0 + 1);
+                    if (a1 <= 0 || a2 <= 0 || a3 <= 0 || a4 <= 0) continue;
+                    d = depth_map.inter(iy(l), ix(l));
+                }
+                else
+                {
+                    d = depth_map(ipy, ipx);
+                }
+                if (d <= 0 || d > params.maxIntegrationDistance) continue;
+
+                float c = params.use_confidence ? confidence(ipy, ipx) : 1;
+                if (c <= 0) continue;
+
+                image_depth(l)      = d;
+                image_confidence(l) = c;
+                any                 = true;
+            }
+            if (!any) continue;
+
+            Array8f truncation =
+                (params.truncationDistance + params.truncationDistanceScale * image_depth).max(min_truncation);
+            Array8f new_tsdf = image_depth - pz;
+            auto mask        = (image_depth > 0.f) && (new_tsdf >= -truncation);
+            if (!mask.any()) continue;
+
+            new_tsdf           = new_tsdf.max(-params.sd_clamp).min(params.sd_clamp);
+            Array8f new_weight = params.newWeight * image_confidence;
+
+            Voxels8 distance(&block.data[z][y][0].distance);
+            Voxels8 weight(&block.data[z][y][0].weight);
+            Array8f current_tsdf   = distance;
+            Array8f current_weight = weight;
+
+            Array8f sum_weight   = current_weight + new_weight;
+            Array8f updated_tsdf = (current_weight * current_tsdf + new_weight * new_tsdf) / sum_weight;
+            updated_tsdf         = (current_weight == 0.f).select(new_tsdf, updated_tsdf);
+            Array8f updated_weight =
+                (current_weight == 0.f).select(new_weight, sum_weight.min(params.maxWeight));
+
+            distance = mask.select(updated_tsdf, current_tsdf);
+            weight   = mask.select(updated_weight, current_weight);
+            changed  = true;
+        }
+    }
+    return changed;
+}
+
+void IncrementalFusion::MarkDirty()
+{
+    // The triangles of a block depend on its own voxels and on the voxels of the 7 neighbours in positive direction
+    // (see SparseTSDF::ExtractSurfaceBlock). Therefore, a changed block invalidates itself and the 7 neighbours in
+    // negative direction.
+#pragma omp parallel
+    {
+        auto& ids = thread_block_ids[OMP::getThreadNum()];
+        ids.clear();
+
+#pragma omp for schedule(static)
+        for (int i = 0; i < (int)frame_blocks.size(); ++i)
+        {
+            if (!frame_block_changed[i]) continue;
+
+            int id     = frame_blocks[i];
+            auto index = tsdf->blocks[id].index;
+            ids.push_back(id);
+            for (int n = 1; n < 8; ++n)
+            {
+                int neighbour = tsdf->GetBlockId(index - ivec3(n & 1, (n >> 1) & 1, (n >> 2) & 1));
+                if (neighbour >= 0) ids.push_back(neighbour);
+            }
+        }
+    }
+
+    last_frame.changed_blocks = 0;
+    for (auto c : frame_block_changed) last_frame.changed_blocks += c;
+
+    for (auto& ids : thread_block_ids)
+    {
+        for (auto id : ids)
+        {
+            if (is_dirty[id]) continue;
+            is_dirty[id] = true;
+            dirty_blocks.push_back(id);
+        }
+    }
+}
+
+int IncrementalFusion::UpdateMesh()
+{
+    block_triangles.resize(tsdf->current_blocks);
+
+#pragma omp parallel for schedule(dynamic, 8)
+    for (int i = 0; i < (int)dirty_blocks.size(); ++i)
+    {
+        int id         = dirty_blocks[i];
+        auto& triangles = block_triangles[id];
+        triangles.clear();
+        tsdf->ExtractSurfaceBlock(tsdf->blocks[id], params.extract_iso, params.extract_outlier_factor, 0, triangles);
+        is_dirty[id] = false;
+    }
+
+    int updated = dirty_blocks.size();
+    dirty_blocks.clear();
+    return updated;
+}
+
+UnifiedMesh IncrementalFusion::Mesh()
+{
+    return tsdf->CreateMesh(block_triangles, params.post_process_mesh);
+}
+
+}  // namespace Saiga
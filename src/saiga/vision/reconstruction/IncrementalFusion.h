@@ -0,0 +1,116 @@
+/**
+ * Copyright (c) 2021 Darius Rückert
+ * Licensed under the MIT License.
+ * See LICENSE file for more information.
+ */
+
+#pragma once
+
+#include "VoxelFusion.h"
+
+namespace Saiga
+{
+/**
+ * Online TSDF fusion of a depth map stream on the CPU.
+ *
+ * In contrast to FusionScene::FuseIncrement, each call of Integrate() only touches the data of the new depth map:
+ *   1. Allocation: The blocks along the rays of all valid depth values (inside the truncation band) are inserted in
+ *      parallel with the lock-free SparseTSDF::InsertBlockConcurrent.
+ *   2. Culling: Only these blocks and the existing blocks inside the view frustum are integrated.
+ *   3. Integration: The voxels of a block are updated in rows of 8 with vectorized Eigen array operations.
+ *   4. Blocks with at least one updated voxel are added to the dirty set.
+ *
+ * UpdateMesh() re-extracts the triangles of the dirty blocks and of their neighbours. All other blocks keep the
+ * triangles of the previous call.
+ *
+ * The voxel update is the weighted average of FusionScene::Integrate. The ground truth and point based modes of
+ * FusionParams are not supported.
+ *
+ * Usage:
+ *
+ *   IncrementalFusion fusion(K, dis, w, h, params);
+ *   for (auto& frame : stream)
+ *   {
+ *       fusion.Integrate(frame.depth, frame.V);
+ *       fusion.UpdateMesh();
+ *   }
+ *   UnifiedMesh mesh = fusion.Mesh();
+ */
+class SAIGA_VISION_API IncrementalFusion
+{
+   public:
+    using Triangle = SparseTSDF::Triangle;
+
+    struct FrameStatistics
+    {
+        // Number of blocks created by the last frame
+        int allocated_blocks = 0;
+        // Number of blocks inside the truncation band or the view frustum
+        int integrated_blocks = 0;
+        // Number of blocks with at least one updated voxel
+        int changed_blocks = 0;
+    };
+
+    IncrementalFusion(const IntrinsicsPinholed& K, const Distortion& dis, int w, int h, const FusionParams& params);
+
+    // Fuses one depth map of size w x h. V transforms from world to camera space (see FusionImage::V).
+    void Integrate(ImageView<const float> depth_map, const SE3& V);
+
+    // Re-extracts the triangles of all blocks affected by the changes since the last call.
+    // Returns the number of updated blocks.
+    int UpdateMesh();
+
+    // The mesh of all triangles extracted by UpdateMesh().
+    UnifiedMesh Mesh();
+
+    // The triangles of each block (indexed by block id) at the last UpdateMesh().
+    const std::vector<std::vector<Triangle>>& TrianglesPerBlock() const { return block_triangles; }
+
+    int NumDirtyBlocks() const { return dirty_blocks.size(); }
+    const FrameStatistics& LastFrame() const { return last_frame; }
+
+    std::shared_ptr<SparseTSDF> tsdf;
+    FusionParams params;
+
+   private:
+    void AllocateBlocks(ImageView<const float> depth_map, const SE3& V);
+    void CollectBlocks(const SE3& V);
+
+    // Returns true if at least one voxel was updated
+    bool IntegrateBlock(SparseTSDF::VoxelBlock& block, ImageView<const float> depth_map, const SE3& V);
+
+    void MarkDirty();
+
+    IntrinsicsPinholed K;
+    Distortion dis;
+    bool has_distortion;
+    int w, h;
+
+    TemplatedImage<vec2> unproject_undistort_map;
+    TemplatedImage<vec3> unprojected_position;
+    TemplatedImage<float> confidence;
+
+    // Per thread lists of block indices or ids
+    std::vector<std::vector<ivec3>> thread_block_indices;
+    std::vector<std::vector<int>> thread_block_ids;
+
+    // The blocks integrated in the current frame and whether they have changed
+    std::vector<int> frame_blocks;
+    std::vector<char> frame_block_changed;
+
+    // The last frame in which a block was added to frame_blocks (indexed by block id)
+    std::vector<int> block_frame;
+    int frame = 0;
+
+    // Blocks which need a new triangulation
+    std::vector<int> dirty_blocks;
+    std::vector<char> is_dirty;
+
+    // Triangles of each block indexed by block id.
+    // FinishConcurrentInsertion only moves blocks created in the same frame, so the ids of meshed blocks are stable.
+    std::vector<std::vector<Triangle>> block_triangles;
+
+    FrameStatistics last_frame;
+};
+
+}  // namespace Saiga
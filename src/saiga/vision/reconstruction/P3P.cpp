@@ -197,26 +197,26 @@ int P3PRansac::solve(ArrayView<const Vec3> _worldPoints, ArrayView<const Vec2> _
         worldPoints           = _worldPoints;
         normalizedImagePoints = _normalizedImagePoints;
         N                     = _worldPoints.size();
+        point_set.Set(worldPoints, normalizedImagePoints);
     }
 
 
-    int idx;
-    idx = compute(_worldPoints.size());
+    int num_inliers = compute(_worldPoints.size());
 
 #pragma omp single
     {
-        bestT      = models[idx];
-        inlierMask = inliers[idx];
+        bestT      = bestModel;
+        inlierMask = bestInlierMask;
 
         bestInlierMatches.clear();
-        bestInlierMatches.reserve(numInliers[idx]);
+        bestInlierMatches.reserve(num_inliers);
         for (int i = 0; i < N; ++i)
         {
-            if (inliers[idx][i]) bestInlierMatches.push_back(i);
+            if (bestInlierMask[i]) bestInlierMatches.push_back(i);
         }
     }
 
-    return numInliers[idx];
+    return num_inliers;
 }
 
 bool P3PRansac::computeModel(const RansacBase::Subset& set, P3PRansac::Model& model)
@@ -248,6 +248,11 @@ double P3PRansac::computeResidual(const P3PRansac::Model& model, int i)
     return (ip - normalizedImagePoints[i]).squaredNorm();
 }
 
+int P3PRansac::computeInliers(const P3PRansac::Model& model, int begin, int end, char* mask)
+{
+    return ReprojectionInliers(model, point_set, begin, end, params.residualThreshold, mask, kernel);
+}
+
 
 #if 0
 SE3 refinePose(const SE3& pose, const Vec3* worldPoints, const Vec2* normalizedImagePoints, int N, int iterations)
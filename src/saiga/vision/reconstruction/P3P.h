@@ -79,9 +79,12 @@ class SAIGA_VISION_API P3PRansac : public RansacBase<P3PRansac, SE3, 4>
 
     double computeResidual(const Model& model, int i);
 
+    int computeInliers(const Model& model, int begin, int end, char* mask);
+
    private:
     ArrayView<const Vec3> worldPoints;
     ArrayView<const Vec2> normalizedImagePoints;
+    RansacPointSet point_set;
 };
 
 
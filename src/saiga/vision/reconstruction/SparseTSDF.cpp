@@ -10,6 +10,23 @@
 #include "saiga/core/util/zlib.h"
 namespace Saiga
 {
+// The blocks are stored in the same format as a std::vector (size + elements).
+template <typename Stream>
+static void WriteBlocks(Stream& strm, const SegmentedVector<SparseTSDF::VoxelBlock>& blocks)
+{
+    strm << (size_t)blocks.size();
+    for (size_t i = 0; i < blocks.size(); ++i) strm << blocks[i];
+}
+
+template <typename Stream>
+static void ReadBlocks(Stream& strm, SegmentedVector<SparseTSDF::VoxelBlock>& blocks)
+{
+    size_t size;
+    strm >> size;
+    blocks.resize(size);
+    for (size_t i = 0; i < size; ++i) strm >> blocks[i];
+}
+
 void SparseTSDF::EraseEmptyBlocks()
 {
     for (int i = 0; i < current_blocks; ++i)
@@ -24,112 +41,113 @@ void SparseTSDF::EraseEmptyBlocks()
     }
 }
 
-std::vector<std::vector<SparseTSDF::Triangle>> SparseTSDF::ExtractSurface(double iso, float outlier_factor,
-                                                                          float min_weight, int threads, bool verbose)
+void SparseTSDF::ExtractSurfaceBlock(const VoxelBlock& block, double iso, float outlier_factor, float min_weight,
+                                     std::vector<Triangle>& triangles)
 {
-    std::stringstream sstrm;
-    ProgressBar loading_bar(verbose ? std::cout : sstrm, "Ex. Surface", current_blocks);
+    // Compute positions and values of (n+1) x (n+1) x (n+1) block.
+    // The (+1) data point is taken from neighbouring blocks to close the holes.
+    std::pair<vec3, float> local_data[VOXEL_BLOCK_SIZE + 1][VOXEL_BLOCK_SIZE + 1][VOXEL_BLOCK_SIZE + 1];
 
-    //        std::vector<std::vector<std::array<vec3, 3>>> triangle_soup_thread(threads);
-
-    // Each block generates a list of triangles
-    std::vector<std::vector<Triangle>> triangle_soup_per_block(current_blocks);
-
-#pragma omp parallel for num_threads(threads)
-    for (int b = 0; b < current_blocks; ++b)
+    // Fill from own block
+    for (int i = 0; i < VOXEL_BLOCK_SIZE + 1; ++i)
     {
-        auto& triangle_soup = triangle_soup_per_block[b];
-        auto& block         = blocks[b];
-        // Compute positions and values of (n+1) x (n+1) x (n+1) block.
-        // The (+1) data point is taken from neighbouring blocks to close the holes.
-        std::pair<vec3, float> local_data[VOXEL_BLOCK_SIZE + 1][VOXEL_BLOCK_SIZE + 1][VOXEL_BLOCK_SIZE + 1];
-
-        // Fill from own block
-        for (int i = 0; i < VOXEL_BLOCK_SIZE + 1; ++i)
+        for (int j = 0; j < VOXEL_BLOCK_SIZE + 1; ++j)
         {
-            for (int j = 0; j < VOXEL_BLOCK_SIZE + 1; ++j)
+            for (int k = 0; k < VOXEL_BLOCK_SIZE + 1; ++k)
             {
-                for (int k = 0; k < VOXEL_BLOCK_SIZE + 1; ++k)
-                {
-                    int li = i % VOXEL_BLOCK_SIZE;
-                    int lj = j % VOXEL_BLOCK_SIZE;
-                    int lk = k % VOXEL_BLOCK_SIZE;
+                int li = i % VOXEL_BLOCK_SIZE;
+                int lj = j % VOXEL_BLOCK_SIZE;
+                int lk = k % VOXEL_BLOCK_SIZE;
 
-                    int bi = i / VOXEL_BLOCK_SIZE;
-                    int bj = j / VOXEL_BLOCK_SIZE;
-                    int bk = k / VOXEL_BLOCK_SIZE;
+                int bi = i / VOXEL_BLOCK_SIZE;
+                int bj = j / VOXEL_BLOCK_SIZE;
+                int bk = k / VOXEL_BLOCK_SIZE;
 
-                    VoxelBlockIndex read_block_id = block.index + ivec3(bk, bj, bi);
+                VoxelBlockIndex read_block_id = block.index + ivec3(bk, bj, bi);
 
-                    auto* read_block = GetBlock(read_block_id);
+                auto* read_block = GetBlock(read_block_id);
 
 
-                    vec3 p = GlobalPosition(block.index, i, j, k);
+                vec3 p = GlobalPosition(block.index, i, j, k);
 
-                    if (read_block)
-                    {
-                        float dis           = read_block->data[li][lj][lk].distance;
-                        float wei           = read_block->data[li][lj][lk].weight;
-                        local_data[i][j][k] = {p, wei > min_weight ? dis : std::numeric_limits<float>::infinity()};
-                        //                        local_data[i][j][k] = {p, dis};
-                    }
-                    else
-                    {
-                        local_data[i][j][k] = {p, std::numeric_limits<float>::infinity()};
-                    }
+                if (read_block)
+                {
+                    float dis           = read_block->data[li][lj][lk].distance;
+                    float wei           = read_block->data[li][lj][lk].weight;
+                    local_data[i][j][k] = {p, wei > min_weight ? dis : std::numeric_limits<float>::infinity()};
+                    //                        local_data[i][j][k] = {p, dis};
+                }
+                else
+                {
+                    local_data[i][j][k] = {p, std::numeric_limits<float>::infinity()};
                 }
             }
         }
+    }
 
 
-        // create triangles
-        for (int i = 0; i < VOXEL_BLOCK_SIZE; ++i)
+    // create triangles
+    for (int i = 0; i < VOXEL_BLOCK_SIZE; ++i)
+    {
+        for (int j = 0; j < VOXEL_BLOCK_SIZE; ++j)
         {
-            for (int j = 0; j < VOXEL_BLOCK_SIZE; ++j)
+            for (int k = 0; k < VOXEL_BLOCK_SIZE; ++k)
             {
-                for (int k = 0; k < VOXEL_BLOCK_SIZE; ++k)
-                {
-                    std::array<std::pair<vec3, float>, 8> cell;
+                std::array<std::pair<vec3, float>, 8> cell;
 
-                    cell[0] = local_data[i][j][k];
-                    cell[1] = local_data[i][j][k + 1];
-                    cell[2] = local_data[i + 1][j][k + 1];
-                    cell[3] = local_data[i + 1][j][k];
-                    cell[4] = local_data[i][j + 1][k];
-                    cell[5] = local_data[i][j + 1][k + 1];
-                    cell[6] = local_data[i + 1][j + 1][k + 1];
-                    cell[7] = local_data[i + 1][j + 1][k];
+                cell[0] = local_data[i][j][k];
+                cell[1] = local_data[i][j][k + 1];
+                cell[2] = local_data[i + 1][j][k + 1];
+                cell[3] = local_data[i + 1][j][k];
+                cell[4] = local_data[i][j + 1][k];
+                cell[5] = local_data[i][j + 1][k + 1];
+                cell[6] = local_data[i + 1][j + 1][k + 1];
+                cell[7] = local_data[i + 1][j + 1][k];
 
-                    bool finite   = true;
-                    float abs_max = 0;
+                bool finite   = true;
+                float abs_max = 0;
 
-                    for (auto i = 0; i < 8; ++i)
-                    {
-                        finite &= std::isfinite(cell[i].second);
-                        abs_max = std::max(abs_max, std::abs(cell[i].second));
-                    }
+                for (auto i = 0; i < 8; ++i)
+                {
+                    finite &= std::isfinite(cell[i].second);
+                    abs_max = std::max(abs_max, std::abs(cell[i].second));
+                }
 
-                    if (abs_max > outlier_factor * voxel_size)
-                    {
-                        continue;
-                    }
+                if (abs_max > outlier_factor * voxel_size)
+                {
+                    continue;
+                }
 
-                    if (!finite)
-                    {
-                        continue;
-                    }
+                if (!finite)
+                {
+                    continue;
+                }
 
-                    auto [triangles, count] = MarchingCubes(cell, iso);
+                auto [cell_triangles, count] = MarchingCubes(cell, iso);
 
 
-                    for (int n = 0; n < count; ++n)
-                    {
-                        auto tri = triangles[n];
-                        triangle_soup.push_back(tri);
-                    }
+                for (int n = 0; n < count; ++n)
+                {
+                    triangles.push_back(cell_triangles[n]);
                 }
             }
         }
+    }
+}
+
+std::vector<std::vector<SparseTSDF::Triangle>> SparseTSDF::ExtractSurface(double iso, float outlier_factor,
+                                                                          float min_weight, int threads, bool verbose)
+{
+    std::stringstream sstrm;
+    ProgressBar loading_bar(verbose ? std::cout : sstrm, "Ex. Surface", current_blocks);
+
+    // Each block generates a list of triangles
+    std::vector<std::vector<Triangle>> triangle_soup_per_block(current_blocks);
+
+#pragma omp parallel for num_threads(threads)
+    for (int b = 0; b < current_blocks; ++b)
+    {
+        ExtractSurfaceBlock(blocks[b], iso, outlier_factor, min_weight, triangle_soup_per_block[b]);
         loading_bar.addProgress(1);
     }
 
@@ -165,7 +183,7 @@ void SparseTSDF::Save(const std::string& file)
 {
     BinaryFile strm(file, std::ios_base::out);
     strm << voxel_size << voxel_size_inv << block_size_inv << hash_size << current_blocks;
-    strm << blocks;
+    WriteBlocks(strm, blocks);
     strm << first_hashed_block;
 }
 
@@ -174,7 +192,7 @@ void SparseTSDF::Load(const std::string& file)
     BinaryFile strm(file, std::ios_base::in);
     SAIGA_ASSERT(strm.strm.is_open());
     strm >> voxel_size >> voxel_size_inv >> block_size_inv >> hash_size >> current_blocks;
-    strm >> blocks;
+    ReadBlocks(strm, blocks);
     strm >> first_hashed_block;
 }
 
@@ -183,7 +201,7 @@ void SparseTSDF::SaveCompressed(const std::string& file)
 #ifdef SAIGA_USE_ZLIB
     BinaryOutputVector strm;
     strm << voxel_size << voxel_size_inv << block_size_inv << hash_size << current_blocks;
-    strm << blocks;
+    WriteBlocks(strm, blocks);
     strm << first_hashed_block;
     auto compressed = compress(strm.data.data(), strm.data.size());
     File::saveFileBinary(file, compressed.data(), compressed.size());
@@ -199,7 +217,7 @@ void SparseTSDF::LoadCompressed(const std::string& file)
     auto data            = uncompress(compressed_data.data());
     BinaryInputVector strm(data.data(), data.size());
     strm >> voxel_size >> voxel_size_inv >> block_size_inv >> hash_size >> current_blocks;
-    strm >> blocks;
+    ReadBlocks(strm, blocks);
     strm >> first_hashed_block;
 #else
     SAIGA_EXIT_ERROR("zlib not found.");
@@ -217,7 +235,7 @@ bool SparseTSDF::operator==(const SparseTSDF& other) const
 
     if (blocks.size() != other.blocks.size()) return false;
 
-    for (int i = 0; i < (int)std::min(blocks.size(), other.blocks.size()); ++i)
+    for (int i = 0; i < (int)blocks.size(); ++i)
     {
         auto& b1 = blocks[i];
         auto& b2 = other.blocks[i];
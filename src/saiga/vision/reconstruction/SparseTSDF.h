@@ -58,7 +58,6 @@ struct SAIGA_VISION_API SparseTSDF : public BlockSparseGrid<TSDFVoxel, 8>
         hash_size          = other.hash_size;
         blocks             = other.blocks;
         first_hashed_block = other.first_hashed_block;
-        hash_locks         = std::vector<SpinLock>(hash_size);
         current_blocks     = other.current_blocks.load();
     }
 
@@ -281,6 +280,11 @@ struct SAIGA_VISION_API SparseTSDF : public BlockSparseGrid<TSDFVoxel, 8>
     std::vector<std::vector<Triangle>> ExtractSurface(double iso, float outlier_factor, float min_weight, int threads,
                                                       bool verbose);
 
+    // Appends the triangles of a single block to 'triangles'. The surface of a block depends on the voxels of the
+    // block itself and on the 7 neighbouring blocks in positive x, y, z direction.
+    void ExtractSurfaceBlock(const VoxelBlock& block, double iso, float outlier_factor, float min_weight,
+                             std::vector<Triangle>& triangles);
+
     // Create a triangle mesh from the list of triangles
     UnifiedMesh CreateMesh(const std::vector<std::vector<Triangle>>& triangles, bool post_process);
 
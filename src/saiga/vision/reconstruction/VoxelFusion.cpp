@@ -49,7 +49,6 @@ void FusionScene::AnalyseSparseStructure()
 {
     ProgressBar loading_bar(params.verbose ? std::cout : strm, "Analysing  ", Size());
 
-    // #pragma omp parallel for
     for (int i = 0; i < Size(); ++i)
     {
         auto& dm  = images[i];
@@ -63,7 +62,9 @@ void FusionScene::AnalyseSparseStructure()
 
         //        std::set<std::tuple<int, int, int>> leset;
 
-        //        for (auto i : dm.depthMap.rowRange())
+        // The blocks are allocated lock-free, so the rows can be processed in parallel.
+        // AllocateAroundPoint uses the serial insert.
+#pragma omp parallel for schedule(dynamic) if (!params.point_based)
         for (int i = 0; i < dm.depthMap.rows; ++i)
         {
             for (auto j : dm.depthMap.colRange())
@@ -104,80 +105,8 @@ void FusionScene::AnalyseSparseStructure()
 
                 if (min_depth >= max_depth) continue;
 
-                vec3 rayDir = (ray_max - ray_min).normalized();
-
-                auto idCurrentVoxel = tsdf->GetBlockIndex(ray_min);
-                auto idEnd          = tsdf->GetBlockIndex(ray_max);
-
-                vec3 step        = rayDir.array().sign();
-                vec3 boundaryPos = tsdf->GlobalBlockOffset(
-                                       idCurrentVoxel + step.cast<int>().array().max(ivec3::Zero().array()).matrix()) -
-                                   make_vec3(0.5f * params.voxelSize);
-                vec3 tMax   = (boundaryPos - ray_min).array() / rayDir.array();
-                vec3 tDelta = (step * tsdf->VOXEL_BLOCK_SIZE * params.voxelSize).array() / rayDir.array();
-
-
-                ivec3 idBound = idEnd + step.cast<int>();
-
-
-                auto inf = std::numeric_limits<float>::infinity();
-                if (rayDir.x() == 0.0f)
-                {
-                    tMax.x()   = inf;
-                    tDelta.x() = inf;
-                }
-                if (rayDir.y() == 0.0f)
-                {
-                    tMax.y()   = inf;
-                    tDelta.y() = inf;
-                }
-                if (rayDir.z() == 0.0f)
-                {
-                    tMax.z()   = inf;
-                    tDelta.z() = inf;
-                }
-
-
-                if (boundaryPos.x() - ray_min.x() == 0.0f)
-                {
-                    tMax.x()   = inf;
-                    tDelta.x() = inf;
-                }
-                if (boundaryPos.y() - ray_min.y() == 0.0f)
-                {
-                    tMax.y()   = inf;
-                    tDelta.y() = inf;
-                }
-                if (boundaryPos.z() - ray_min.z() == 0.0f)
-                {
-                    tMax.z()   = inf;
-                    tDelta.z() = inf;
-                }
-
-                while (true)
-                {
-                    //                    leset.insert({idCurrentVoxel(0), idCurrentVoxel(1), idCurrentVoxel(2)});
-                    tsdf->InsertBlock(idCurrentVoxel);
-                    // Traverse voxel grid
-                    if (tMax.x() < tMax.y() && tMax.x() < tMax.z())
-                    {
-                        idCurrentVoxel.x() += step.x();
-                        if (idCurrentVoxel.x() == idBound.x()) break;
-                        tMax.x() += tDelta.x();
-                    }
-                    else if (tMax.z() < tMax.y())
-                    {
-                        idCurrentVoxel.z() += step.z();
-                        if (idCurrentVoxel.z() == idBound.z()) break;
-                        tMax.z() += tDelta.z();
-                    }
-                    else
-                    {
-                        idCurrentVoxel.y() += step.y();
-                        if (idCurrentVoxel.y() == idBound.y()) break;
-                        tMax.y() += tDelta.y();
-                    }
-                }
+                tsdf->TraverseBlocks(ray_min, ray_max,
+                                     [this](const ivec3& block_id) { tsdf->InsertBlockConcurrent(block_id); });
             }
         }
 
@@ -189,65 +118,66 @@ void FusionScene::AnalyseSparseStructure()
 
         loading_bar.addProgress(1);
     }
+    tsdf->FinishConcurrentInsertion();
 }
 
 
-void FusionScene::ComputeWeight()
+void ComputeFusionConfidence(ImageView<const float> depth_map, ImageView<const vec3> unprojected_position,
+                             const vec3& eye, ImageView<float> confidence)
 {
-    if (!params.use_confidence)
-    {
-        return;
-    }
-    ProgressBar loading_bar(params.verbose ? std::cout : strm, "Comp Weight", Size());
-#pragma omp parallel for
-    for (int i = 0; i < Size(); ++i)
+    confidence.set(0);
+    for (auto i : depth_map.rowRange(1))
     {
-        auto& dm = images[i];
-
-        dm.confidence.create(dm.depthMap.dimensions());
-        dm.confidence.makeZero();
-
-        vec3 eye = dm.V.inverse().translation().cast<float>();
-
-        for (auto i : dm.depthMap.rowRange(1))
+        for (auto j : depth_map.colRange(1))
         {
-            for (auto j : dm.depthMap.colRange(1))
+            auto depth = depth_map(i, j);
+
+            if (depth <= 0 || depth_map(i + 1, j) <= 0 || depth_map(i - 1, j) <= 0 || depth_map(i, j + 1) <= 0 ||
+                depth_map(i, j - 1) <= 0)
             {
-                auto depth = dm.depthMap(i, j);
+                continue;
+            }
 
-                if (depth <= 0 || dm.depthMap(i + 1, j) <= 0 || dm.depthMap(i - 1, j) <= 0 ||
-                    dm.depthMap(i, j + 1) <= 0 || dm.depthMap(i, j - 1) <= 0)
-                {
-                    continue;
-                }
+            const vec3& c = unprojected_position(i, j);
 
-                vec3& c = dm.unprojected_position(i, j);
+            vec3 v = (eye - c).normalized();
 
-                vec3 v = (eye - c).normalized();
+            const vec3& l = unprojected_position(i - 1, j);
+            const vec3& r = unprojected_position(i + 1, j);
 
-                vec3& l = dm.unprojected_position(i - 1, j);
-                vec3& r = dm.unprojected_position(i + 1, j);
+            const vec3& d = unprojected_position(i, j - 1);
+            const vec3& u = unprojected_position(i, j + 1);
 
-                vec3& d = dm.unprojected_position(i, j - 1);
-                vec3& u = dm.unprojected_position(i, j + 1);
+            vec3 n = (l - r).cross(d - u).normalized();
 
-                vec3 n = (l - r).cross(d - u).normalized();
 
+            float w = v.dot(n);
+            w       = clamp(w, 0, 1);
 
-                float w = v.dot(n);
-                w       = clamp(w, 0, 1);
+            float wd = 1.0 / (depth + 1);  // (params.maxIntegrationDistance - depth) / params.maxIntegrationDistance;
+            wd       = clamp(wd, 0, 1);
+
+            confidence(i, j) = w * wd;
+        }
+    }
+}
 
-                //                if (w < 0.5) w = 0;
+void FusionScene::ComputeWeight()
+{
+    if (!params.use_confidence)
+    {
+        return;
+    }
+    ProgressBar loading_bar(params.verbose ? std::cout : strm, "Comp Weight", Size());
+#pragma omp parallel for
+    for (int i = 0; i < Size(); ++i)
+    {
+        auto& dm = images[i];
 
-                float wd =
-                    1.0 / (depth + 1);  // (params.maxIntegrationDistance - depth) / params.maxIntegrationDistance;
-                wd = clamp(wd, 0, 1);
+        dm.confidence.create(dm.depthMap.dimensions());
 
-                dm.confidence(i, j) = w * wd;
-                // std::cout << "w: " << w << " " << depth << " -> " << wd << std::endl;
-            }
-        }
-        //        exit(0);
+        vec3 eye = dm.V.inverse().translation().cast<float>();
+        ComputeFusionConfidence(dm.depthMap, dm.unprojected_position, eye, dm.confidence);
         loading_bar.addProgress(1);
     }
 }
@@ -276,8 +206,8 @@ void FusionScene::Visibility()
             //            for (auto& block : tsdf->blocks)
             for (int i = 0; i < tsdf->current_blocks; ++i)
             {
-                auto block = tsdf->blocks[i];
-                Vec3 c     = tsdf->BlockCenter(block.index).cast<double>();
+                auto& block = tsdf->blocks[i];
+                Vec3 c      = tsdf->BlockCenter(block.index).cast<double>();
 
                 // project to image
                 Vec3 pos = dm.V * c;
@@ -85,6 +85,14 @@ class SAIGA_VISION_API FusionImage
 };
 
 
+// The confidence of each depth value used for FusionParams::use_confidence.
+// It depends on the angle between the surface normal and the viewing direction and on the depth.
+SAIGA_VISION_API void ComputeFusionConfidence(ImageView<const float> depth_map,
+                                              ImageView<const vec3> unprojected_position, const vec3& eye,
+                                              ImageView<float> confidence);
+
+// Batch fusion of a set of depth maps.
+// For online fusion of a depth map stream see IncrementalFusion.
 struct SAIGA_VISION_API FusionScene
 {
     // Set by the user
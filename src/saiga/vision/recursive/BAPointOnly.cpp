@@ -150,8 +150,8 @@ double BAPointOnly::computeQuadraticForm()
                 auto stereo_point = ip.GetStereoPoint(scene.bf);
 
                 Matrix<double, 3, 3> JrowPoint;
-                auto [res, depth] = BundleAdjustmentStereo(scam, ip.point, stereo_point, extr, wp, w,
-                                                           w * scene.stereo_weight, nullptr, &JrowPoint);
+                auto [res, depth] = BundleAdjustmentStereo<double>(scam, ip.point, stereo_point, extr, wp, w,
+                                                                   w * scene.stereo_weight, nullptr, &JrowPoint);
                 auto c            = res.squaredNorm();
                 chi2_per_point[i] += c;
                 chi2_sum += c;
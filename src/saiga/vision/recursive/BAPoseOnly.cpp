@@ -62,8 +62,8 @@ double BAPoseOnly::computeQuadraticForm()
                 auto stereo_point = ip.GetStereoPoint(scene.bf);
 
                 Matrix<double, 3, 6> JrowPose;
-                auto [res, depth] = BundleAdjustmentStereo(scam, ip.point, stereo_point, extr, wp, w,
-                                                           w * scene.stereo_weight, &JrowPose, nullptr);
+                auto [res, depth] = BundleAdjustmentStereo<double>(scam, ip.point, stereo_point, extr, wp, w,
+                                                                   w * scene.stereo_weight, &JrowPose, nullptr);
 
 
                 auto c = res.squaredNorm();
@@ -23,6 +23,54 @@
 
 namespace Saiga
 {
+template <typename BlockScalar, typename ParamScalar>
+struct BARec::System
+{
+    using Types   = MatrixTypes<BlockScalar>;
+    using BScalar = BlockScalar;
+    using PScalar = ParamScalar;
+
+    typename Types::BAMatrix A;
+    typename Types::BAVector b, delta_x;
+    typename Types::BASolver solver;
+
+    AlignedVector<Sophus::SE3<ParamScalar>> x_u, oldx_u;
+    AlignedVector<Vector<ParamScalar, 3>> x_v, oldx_v;
+
+    // The gradient is accumulated in the parameter precision, because near the optimum it is a sum of large terms
+    // which cancel out. Only the final value is stored in the linear system.
+    using PoseRes  = Vector<ParamScalar, blockSizeCamera>;
+    using PointRes = Vector<ParamScalar, blockSizePoint>;
+
+    // each helper thread (except the first one) gets one vector
+    std::vector<AlignedVector<typename Types::BDiag>> pointDiagTemp;
+    // each helper thread gets one vector (the first one writes directly into b if the precision is the same)
+    std::vector<AlignedVector<PointRes>> pointResTemp;
+
+    static constexpr bool same_precision = std::is_same<BlockScalar, ParamScalar>::value;
+};
+
+BARec::BARec() : BABase("Recursive BA") {}
+
+BARec::~BARec() {}
+
+template <typename F>
+auto BARec::Dispatch(F&& f)
+{
+    switch (precision)
+    {
+        case BAOptions::Precision::Mixed:
+            if (!system_mixed) system_mixed = std::make_unique<System<float, double>>();
+            return f(*system_mixed);
+        case BAOptions::Precision::Float:
+            if (!system_float) system_float = std::make_unique<System<float, float>>();
+            return f(*system_float);
+        default:
+            if (!system_double) system_double = std::make_unique<System<double, double>>();
+            return f(*system_double);
+    }
+}
+
 void BARec::reserve(int n, int m)
 {
     validImages.reserve(n);
@@ -33,15 +81,15 @@ void BARec::reserve(int n, int m)
     pointCameraCounts.reserve(m);
     pointCameraCountsScan.reserve(m);
 
-    pointDiagTemp.reserve(m);
-    pointResTemp.reserve(m);
-
     localChi2.reserve(64);
 
-    x_u.reserve(n);
-    oldx_u.reserve(n);
-    x_v.reserve(n);
-    oldx_v.reserve(n);
+    precision = baOptions.precision;
+    Dispatch([&](auto& s) {
+        s.x_u.reserve(n);
+        s.oldx_u.reserve(n);
+        s.x_v.reserve(m);
+        s.oldx_v.reserve(m);
+    });
 }
 
 void BARec::init()
@@ -131,40 +179,15 @@ void BARec::init()
         validPoints.push_back(i);
     }
 
-    n = totalN - constantN;
-    m = validPoints.size();
+    n         = totalN - constantN;
+    m         = validPoints.size();
+    precision = baOptions.precision;
 
     //    std::cout << n << " " << totalN << " " << constantN << std::endl;
 
 
     //    SAIGA_ASSERT(n > 0 && m > 0);
 
-    A.resize(n, m);
-    //    U.resize(n);
-    //    V.resize(m);
-
-    delta_x.resize(n, m);
-    b.resize(n, m);
-
-    x_u.resize(totalN);
-    oldx_u.resize(totalN);
-    x_v.resize(m);
-    oldx_v.resize(m);
-
-
-    // Make a copy of the initial parameters
-    for (auto&& info : validImages)
-    {
-        auto& img         = scene.images[info.sceneImageId];
-        x_u[info.validId] = img.se3;
-    }
-
-    for (int i = 0; i < (int)validPoints.size(); ++i)
-    {
-        auto& wp = scene.worldPoints[validPoints[i]];
-        x_v[i]   = wp.p;
-    }
-
     cameraPointCounts.clear();
     cameraPointCounts.resize(n, 0);
     cameraPointCountsScan.resize(n);
@@ -202,32 +225,10 @@ void BARec::init()
 
     SAIGA_ASSERT(test1 == observations && test2 == observations);
 
-    // preset the outer matrix structure
-    //    W.resize(n, m);
-    A.w.setZero();
-    A.w.reserve(observations);
-
-    for (int k = 0; k < A.w.outerSize(); ++k)
-    {
-        A.w.outerIndexPtr()[k] = cameraPointCountsScan[k];
-    }
-    A.w.outerIndexPtr()[A.w.outerSize()] = observations;
-
-
-    for (int i = 0; i < observations; ++i)
-    {
-        A.w.innerIndexPtr()[i] = innerElements[i];
-    }
-
     // ===== Threading Tmps ======
 
     SAIGA_ASSERT(baOptions.helper_threads > 0);
     localChi2.resize(baOptions.helper_threads);
-    pointDiagTemp.resize(baOptions.helper_threads - 1);
-    pointResTemp.resize(baOptions.helper_threads - 1);
-    for (auto& a : pointDiagTemp) a.resize(m);
-    for (auto& a : pointResTemp) a.resize(m);
-
 
 
     // Setup the linear solver and anlyze the pattern
@@ -238,14 +239,7 @@ void BARec::init()
                               : Eigen::Recursive::LinearSolverOptions::SolverType::Iterative;
     loptions.buildExplizitSchur = optimizationOptions.buildExplizitSchur;
 
-    if (baOptions.solver_threads == 1)
-    {
-        solver.analyzePattern(A, loptions);
-    }
-    else
-    {
-        solver.analyzePattern_omp(A, loptions);
-    }
+    Dispatch([&](auto& s) { initSystem(s, innerElements); });
 
 #if 0
 
@@ -339,13 +333,94 @@ void BARec::init()
     }
 }
 
+template <typename S>
+void BARec::initSystem(S& s, const std::vector<int>& innerElements)
+{
+    Scene& scene = *_scene;
+    using P      = typename S::PScalar;
+
+    auto& A = s.A;
+    A.resize(n, m);
+    //    U.resize(n);
+    //    V.resize(m);
+
+    s.delta_x.resize(n, m);
+    s.b.resize(n, m);
+
+    s.x_u.resize(totalN);
+    s.oldx_u.resize(totalN);
+    s.x_v.resize(m);
+    s.oldx_v.resize(m);
+
+
+    // Make a copy of the initial parameters
+    for (auto&& info : validImages)
+    {
+        auto& img           = scene.images[info.sceneImageId];
+        s.x_u[info.validId] = img.se3.template cast<P>();
+    }
+
+    for (int i = 0; i < (int)validPoints.size(); ++i)
+    {
+        auto& wp = scene.worldPoints[validPoints[i]];
+        s.x_v[i] = wp.p.template cast<P>();
+    }
+
+    // preset the outer matrix structure
+    //    W.resize(n, m);
+    A.w.setZero();
+    A.w.reserve(observations);
+
+    for (int k = 0; k < A.w.outerSize(); ++k)
+    {
+        A.w.outerIndexPtr()[k] = cameraPointCountsScan[k];
+    }
+    A.w.outerIndexPtr()[A.w.outerSize()] = observations;
+
+
+    for (int i = 0; i < observations; ++i)
+    {
+        A.w.innerIndexPtr()[i] = innerElements[i];
+    }
+
+    s.pointDiagTemp.resize(baOptions.helper_threads - 1);
+    s.pointResTemp.resize(baOptions.helper_threads - (S::same_precision ? 1 : 0));
+    for (auto& a : s.pointDiagTemp) a.resize(m);
+    for (auto& a : s.pointResTemp) a.resize(m);
+
+    if (baOptions.solver_threads == 1)
+    {
+        s.solver.analyzePattern(A, loptions);
+    }
+    else
+    {
+        s.solver.analyzePattern_omp(A, loptions);
+    }
+}
+
 double BARec::computeQuadraticForm()
+{
+    return Dispatch([&](auto& s) { return computeQuadraticForm(s); });
+}
+
+template <typename S>
+double BARec::computeQuadraticForm(S& s)
 {
     Scene& scene = *_scene;
 
     //    SAIGA_OPTIONAL_BLOCK_TIMER(RECURSIVE_BA_USE_TIMERS && optimizationOptions.debugOutput);
 
-    using T = BlockBAScalar;
+    // T: scalar of the linear system, P: scalar of the parameters and the residual evaluation
+    using Types = typename S::Types;
+    using T     = typename S::BScalar;
+    using P     = typename S::PScalar;
+    using BDiag    = typename Types::BDiag;
+    using WElem    = typename Types::WElem;
+    using PoseRes  = typename S::PoseRes;
+    using PointRes = typename S::PointRes;
+
+    auto& A = s.A;
+    auto& b = s.b;
     //    using KernelType = Saiga::Kernel::BAPosePointMono<T>;
 
 
@@ -371,18 +446,21 @@ double BARec::computeQuadraticForm()
         double& newChi2 = localChi2[tid];
         newChi2         = 0;
         BDiag* bdiagArray;
-        BRes* bresArray;
+        PointRes* bresArray;
 
         if (tid == 0)
         {
             // thread 0 directly writes into the recursive matrix
             bdiagArray = &A.v.diagonal()(0).get();
-            bresArray  = &b.v(0).get();
+            if constexpr (S::same_precision)
+                bresArray = &b.v(0).get();
+            else
+                bresArray = s.pointResTemp.back().data();
         }
         else
         {
-            bdiagArray = pointDiagTemp[tid - 1].data();
-            bresArray  = pointResTemp[tid - 1].data();
+            bdiagArray = s.pointDiagTemp[tid - 1].data();
+            bresArray  = s.pointResTemp[tid - 1].data();
         }
 
         // every thread has to zero its own local copy
@@ -408,22 +486,21 @@ double BARec::computeQuadraticForm()
 
 
 
-            auto& img    = scene.images[info.sceneImageId];
-            auto& extr   = x_u[info.validId];
-            auto& camera = scene.intrinsics[img.intr];
-            StereoCamera4 scam(camera, scene.bf);
+            auto& img   = scene.images[info.sceneImageId];
+            auto& extr  = s.x_u[info.validId];
+            auto camera = scene.intrinsics[img.intr].template cast<P>();
+            StereoCamera4Base<P> scam(camera, scene.bf);
 
 
 
+            // each thread can direclty right into A.u and b.u because
+            // we parallize over images
             if (!constant)
             {
-                // each thread can direclty right into A.u and b.u because
-                // we parallize over images
                 auto& targetPosePose = A.u.diagonal()(actualOffset).get();
-                auto& targetPoseRes  = b.u(actualOffset).get();
                 targetPosePose.setZero();
-                targetPoseRes.setZero();
             }
+            PoseRes targetPoseRes = PoseRes::Zero();
 
             for (auto& ip : img.stereoPoints)
             {
@@ -437,31 +514,50 @@ double BARec::computeQuadraticForm()
                     }
                     continue;
                 }
-                BlockBAScalar w = ip.weight * scene.scale();
-                int j           = pointToValidMap[ip.wp];
+                P w   = ip.weight * scene.scale();
+                int j = pointToValidMap[ip.wp];
 
 
-                auto& wp = x_v[j];
+                auto& wp = s.x_v[j];
 
                 WElem& targetPosePoint = A.w.valuePtr()[k].get();
 
-                BDiag& targetPointPoint = bdiagArray[j];
-                BRes& targetPointRes    = bresArray[j];
+                BDiag& targetPointPoint  = bdiagArray[j];
+                PointRes& targetPointRes = bresArray[j];
+
+                // Adds J^T*J in the precision of the linear system and J^T*r in the precision of the parameters
+                auto addObservation = [&](const auto& JrowPose, const auto& JrowPoint, const auto& res, P loss_weight) {
+                    constexpr int R              = std::decay_t<decltype(res)>::RowsAtCompileTime;
+                    const Matrix<T, R, 6> Jpose  = JrowPose.template cast<T>();
+                    const Matrix<T, R, 3> Jpoint = JrowPoint.template cast<T>();
+                    const T lw                   = loss_weight;
+
+                    if (!constant)
+                    {
+                        auto& targetPosePose = A.u.diagonal()(actualOffset).get();
+                        targetPosePose += lw * Jpose.transpose() * Jpose;
+                        targetPosePoint = lw * Jpose.transpose() * Jpoint;
+                        targetPoseRes -= loss_weight * JrowPose.transpose() * res;
+                    }
+                    targetPointPoint += lw * Jpoint.transpose() * Jpoint;
+                    targetPointRes -= loss_weight * JrowPoint.transpose() * res;
+                };
 
                 if (ip.IsStereoOrDepth())
                 {
-                    auto stereo_point = ip.GetStereoPoint(scene.bf);
+                    P stereo_point = ip.GetStereoPoint(scene.bf);
 
-                    Matrix<double, 3, 6> JrowPose;
-                    Matrix<double, 3, 3> JrowPoint;
-                    auto [res, depth] = BundleAdjustmentStereo(scam, ip.point, stereo_point, extr, wp, w,
-                                                               w * scene.stereo_weight, &JrowPose, &JrowPoint);
+                    Matrix<P, 3, 6> JrowPose;
+                    Matrix<P, 3, 3> JrowPoint;
+                    auto [res, depth] =
+                        BundleAdjustmentStereo<P>(scam, ip.point.template cast<P>(), stereo_point, extr, wp, w,
+                                                  w * scene.stereo_weight, &JrowPose, &JrowPoint);
 
-                    T loss_weight = 1.0;
+                    P loss_weight = 1.0;
                     auto res_2    = res.squaredNorm();
                     if (baOptions.huberStereo > 0)
                     {
-                        auto rw = Kernel::HuberLoss<T>(baOptions.huberStereo, res_2);
+                        auto rw = Kernel::HuberLoss<P>(baOptions.huberStereo, res_2);
                         //                        auto rw     = Kernel::CauchyLoss<T>(baOptions.huberStereo, res_2);
                         res_2       = rw(0);
                         loss_weight = rw(1);
@@ -470,29 +566,20 @@ double BARec::computeQuadraticForm()
 
 
                     newChi2 += res_2;
-
-                    if (!constant)
-                    {
-                        auto& targetPosePose = A.u.diagonal()(actualOffset).get();
-                        auto& targetPoseRes  = b.u(actualOffset).get();
-                        targetPosePose += loss_weight * JrowPose.transpose() * JrowPose;
-                        targetPosePoint = loss_weight * JrowPose.transpose() * JrowPoint;
-                        targetPoseRes -= loss_weight * JrowPose.transpose() * res;
-                    }
-                    targetPointPoint += loss_weight * JrowPoint.transpose() * JrowPoint;
-                    targetPointRes -= loss_weight * JrowPoint.transpose() * res;
+                    addObservation(JrowPose, JrowPoint, res, loss_weight);
                 }
                 else
                 {
-                    Matrix<double, 2, 6> JrowPose;
-                    Matrix<double, 2, 3> JrowPoint;
-                    auto [res, depth] = BundleAdjustment(camera, ip.point, extr, wp, w, &JrowPose, &JrowPoint);
+                    Matrix<P, 2, 6> JrowPose;
+                    Matrix<P, 2, 3> JrowPoint;
+                    auto [res, depth] =
+                        BundleAdjustment<P>(camera, ip.point.template cast<P>(), extr, wp, w, &JrowPose, &JrowPoint);
 
-                    T loss_weight = 1.0;
+                    P loss_weight = 1.0;
                     auto res_2    = res.squaredNorm();
                     if (baOptions.huberMono > 0)
                     {
-                        auto rw = Kernel::HuberLoss<T>(baOptions.huberMono, res_2);
+                        auto rw = Kernel::HuberLoss<P>(baOptions.huberMono, res_2);
                         //                        auto rw     = Kernel::CauchyLoss<T>(baOptions.huberMono, res_2);
                         res_2       = rw(0);
                         loss_weight = rw(1);
@@ -500,16 +587,7 @@ double BARec::computeQuadraticForm()
                     newChi2 += res_2;
 
                     //                    if (!valid_depth) loss_weight = 0;
-                    if (!constant)
-                    {
-                        auto& targetPosePose = A.u.diagonal()(actualOffset).get();
-                        auto& targetPoseRes  = b.u(actualOffset).get();
-                        targetPosePose += loss_weight * JrowPose.transpose() * JrowPose;
-                        targetPosePoint = loss_weight * JrowPose.transpose() * JrowPoint;
-                        targetPoseRes -= loss_weight * JrowPose.transpose() * res;
-                    }
-                    targetPointPoint += loss_weight * JrowPoint.transpose() * JrowPoint;
-                    targetPointRes -= loss_weight * JrowPoint.transpose() * res;
+                    addObservation(JrowPose, JrowPoint, res, loss_weight);
                 }
 
                 if (!constant)
@@ -518,6 +596,11 @@ double BARec::computeQuadraticForm()
                     ++k;
                 }
             }
+
+            if (!constant)
+            {
+                b.u(actualOffset).get() = targetPoseRes.template cast<T>();
+            }
         }
 
 #pragma omp for
@@ -525,8 +608,21 @@ double BARec::computeQuadraticForm()
         {
             for (int j = 0; j < baOptions.helper_threads - 1; ++j)
             {
-                A.v.diagonal()(i).get() += pointDiagTemp[j][i];
-                b.v(i).get() += pointResTemp[j][i];
+                A.v.diagonal()(i).get() += s.pointDiagTemp[j][i];
+            }
+
+            if constexpr (S::same_precision)
+            {
+                for (int j = 0; j < baOptions.helper_threads - 1; ++j)
+                {
+                    b.v(i).get() += s.pointResTemp[j][i];
+                }
+            }
+            else
+            {
+                PointRes sum = PointRes::Zero();
+                for (auto& temp : s.pointResTemp) sum += temp[i];
+                b.v(i).get() = sum.template cast<T>();
             }
         }
     }
@@ -544,6 +640,18 @@ double BARec::computeQuadraticForm()
 
 bool BARec::addDelta()
 {
+    return Dispatch([&](auto& s) { return addDelta(s); });
+}
+
+template <typename S>
+bool BARec::addDelta(S& s)
+{
+    using P      = typename S::PScalar;
+    auto& x_u    = s.x_u;
+    auto& oldx_u = s.oldx_u;
+    auto& x_v    = s.x_v;
+    auto& oldx_v = s.oldx_v;
+
     //#pragma omp parallel num_threads(baOptions.helper_threads)
     {
 #pragma omp for nowait
@@ -558,7 +666,7 @@ bool BARec::addDelta()
 
 
 
-            auto t = delta_x.u(offset).get();
+            auto t = s.delta_x.u(offset).get().template cast<P>();
 
             x_u[id] = Sophus::se3_expd(t) * x_u[id];
 
@@ -571,7 +679,7 @@ bool BARec::addDelta()
         for (int i = 0; i < m; ++i)
         {
             oldx_v[i] = x_v[i];
-            auto t    = delta_x.v(i).get();
+            auto t    = s.delta_x.v(i).get().template cast<P>();
             x_v[i] += t;
         }
     }
@@ -580,6 +688,17 @@ bool BARec::addDelta()
 
 void BARec::revertDelta()
 {
+    Dispatch([&](auto& s) { revertDelta(s); });
+}
+
+template <typename S>
+void BARec::revertDelta(S& s)
+{
+    auto& x_u    = s.x_u;
+    auto& oldx_u = s.oldx_u;
+    auto& x_v    = s.x_v;
+    auto& oldx_v = s.oldx_v;
+
     //#pragma omp parallel num_threads(threads)
     //#pragma omp parallel num_threads(baOptions.helper_threads)
     {
@@ -603,6 +722,12 @@ void BARec::revertDelta()
     //    x_v = oldx_v;
 }
 void BARec::finalize()
+{
+    Dispatch([&](auto& s) { finalize(s); });
+}
+
+template <typename S>
+void BARec::finalize(S& s)
 {
     Scene& scene = *_scene;
 
@@ -618,15 +743,14 @@ void BARec::finalize()
             if (info.isConstant()) continue;
 
             auto& extr = scene.images[info.sceneImageId];
-            extr.se3   = x_u[info.validId];
+            extr.se3   = s.x_u[info.validId].template cast<double>();
         }
 #pragma omp for
         for (int i = 0; i < (int)validPoints.size(); ++i)
         {
-            Eigen::Matrix<BlockBAScalar, 3, 1> t;
             auto id = validPoints[i];
             auto& p = scene.worldPoints[id].p;
-            p       = x_v[i];
+            p       = s.x_v[i].template cast<double>();
         }
     }
 }
@@ -642,10 +766,10 @@ void BARec::addLambda(double lambda)
     //    else
     //    {
     //#pragma omp parallel num_threads(baOptions.helper_threads)
-    {
-        applyLMDiagonal_omp(A.u, lambda);
-        applyLMDiagonal_omp(A.v, lambda);
-    }
+    Dispatch([&](auto& s) {
+        applyLMDiagonal_omp(s.A.u, lambda);
+        applyLMDiagonal_omp(s.A.v, lambda);
+    });
 
     //    }
 }
@@ -656,27 +780,45 @@ void BARec::solveLinearSystem()
 {
     SAIGA_OPTIONAL_BLOCK_TIMER(RECURSIVE_BA_USE_TIMERS && optimizationOptions.debugOutput);
 
-    if (baOptions.solver_threads == 1)
-    {
-        solver.solve(A, delta_x, b, loptions);
-    }
-    else
-    {
-#pragma omp parallel num_threads(baOptions.solver_threads)
+    Dispatch([&](auto& s) {
+        using S = std::decay_t<decltype(s)>;
+
+        // The residual of a float CG stagnates at ~1e-7 relative to the rhs. Iterating further only accumulates
+        // rounding errors in the search directions.
+        auto options = loptions;
+        if constexpr (std::is_same<typename S::BScalar, float>::value)
         {
-            solver.solve_omp(A, delta_x, b, loptions);
+            options.iterativeTolerance = std::max(options.iterativeTolerance, 1e-6);
         }
-    }
+
+        if (baOptions.solver_threads == 1)
+        {
+            s.solver.solve(s.A, s.delta_x, s.b, options);
+        }
+        else
+        {
+#pragma omp parallel num_threads(baOptions.solver_threads)
+            {
+                s.solver.solve_omp(s.A, s.delta_x, s.b, options);
+            }
+        }
+    });
     //#pragma omp single
 }
 
 double BARec::computeCost()
+{
+    return Dispatch([&](auto& s) { return computeCost(s); });
+}
+
+template <typename S>
+double BARec::computeCost(S& s)
 {
     Scene& scene = *_scene;
 
     SAIGA_OPTIONAL_BLOCK_TIMER(RECURSIVE_BA_USE_TIMERS && optimizationOptions.debugOutput);
 
-    using T = BlockBAScalar;
+    using P = typename S::PScalar;
 
 #pragma omp parallel num_threads(baOptions.helper_threads)
     {
@@ -690,30 +832,30 @@ double BARec::computeCost()
             auto info = validImages[valid_id];
             SAIGA_ASSERT(info);
             auto& img  = scene.images[info.sceneImageId];
-            auto& extr = x_u[info.validId];
+            auto& extr = s.x_u[info.validId];
             //            auto& extr2  = scene.extrinsics[img.extr];
             //            auto& extr   = extr2.se3;
-            auto& camera = scene.intrinsics[img.intr];
+            auto camera = scene.intrinsics[img.intr].template cast<P>();
 
-            StereoCamera4 scam(camera, scene.bf);
+            StereoCamera4Base<P> scam(camera, scene.bf);
 
             for (auto& ip : img.stereoPoints)
             {
                 if (!ip) continue;
-                BlockBAScalar w = ip.weight * scene.scale();
-                int j           = pointToValidMap[ip.wp];
+                P w   = ip.weight * scene.scale();
+                int j = pointToValidMap[ip.wp];
                 SAIGA_ASSERT(j >= 0);
-                auto& wp = x_v[j];
+                auto& wp = s.x_v[j];
 
                 if (ip.IsStereoOrDepth())
                 {
-                    auto stereo_point = ip.GetStereoPoint(scene.bf);
-                    auto [res, depth] =
-                        BundleAdjustmentStereo(scam, ip.point, stereo_point, extr, wp, w, w * scene.stereo_weight);
-                    auto res_2 = res.squaredNorm();
+                    P stereo_point    = ip.GetStereoPoint(scene.bf);
+                    auto [res, depth] = BundleAdjustmentStereo<P>(scam, ip.point.template cast<P>(), stereo_point,
+                                                                  extr, wp, w, w * scene.stereo_weight);
+                    auto res_2        = res.squaredNorm();
                     if (baOptions.huberStereo > 0)
                     {
-                        auto rw = Kernel::HuberLoss<T>(baOptions.huberStereo, res_2);
+                        auto rw = Kernel::HuberLoss<P>(baOptions.huberStereo, res_2);
                         //                        auto rw = Kernel::CauchyLoss<T>(baOptions.huberStereo, res_2);
                         res_2 = rw(0);
                     }
@@ -721,12 +863,12 @@ double BARec::computeCost()
                 }
                 else
                 {
-                    auto [res, depth] = BundleAdjustment(scam, ip.point, extr, wp, w);
+                    auto [res, depth] = BundleAdjustment<P>(scam, ip.point.template cast<P>(), extr, wp, w);
 
                     auto res_2 = res.squaredNorm();
                     if (baOptions.huberMono > 0)
                     {
-                        auto rw = Kernel::HuberLoss<T>(baOptions.huberMono, res_2);
+                        auto rw = Kernel::HuberLoss<P>(baOptions.huberMono, res_2);
                         //                        auto rw = Kernel::CauchyLoss<T>(baOptions.huberMono, res_2);
                         res_2 = rw(0);
                     }
@@ -19,38 +19,42 @@ class SAIGA_VISION_API BARec : public BABase, public LMOptimizer
     // ============== Recusrive Matrix Types ==============
     static constexpr int blockSizeCamera = 6;
     static constexpr int blockSizePoint  = 3;
-    using BlockBAScalar                  = double;
 
-    using ADiag  = Eigen::Matrix<BlockBAScalar, blockSizeCamera, blockSizeCamera, Eigen::RowMajor>;
-    using BDiag  = Eigen::Matrix<BlockBAScalar, blockSizePoint, blockSizePoint, Eigen::RowMajor>;
-    using WElem  = Eigen::Matrix<BlockBAScalar, blockSizeCamera, blockSizePoint, Eigen::RowMajor>;
-    using WTElem = Eigen::Matrix<BlockBAScalar, blockSizePoint, blockSizeCamera, Eigen::RowMajor>;
-    using ARes   = Eigen::Matrix<BlockBAScalar, blockSizeCamera, 1>;
-    using BRes   = Eigen::Matrix<BlockBAScalar, blockSizePoint, 1>;
-
-    // Block structured diagonal matrices
-    using UType = Eigen::DiagonalMatrix<Eigen::Recursive::MatrixScalar<ADiag>, -1>;
-    using VType = Eigen::DiagonalMatrix<Eigen::Recursive::MatrixScalar<BDiag>, -1>;
-
-    // Block structured vectors
-    using DAType = Eigen::Matrix<Eigen::Recursive::MatrixScalar<ARes>, -1, 1>;
-    using DBType = Eigen::Matrix<Eigen::Recursive::MatrixScalar<BRes>, -1, 1>;
-
-    // Block structured sparse matrix
-    using WType  = Eigen::SparseMatrix<Eigen::Recursive::MatrixScalar<WElem>, Eigen::RowMajor>;
-    using WTType = Eigen::SparseMatrix<Eigen::Recursive::MatrixScalar<WTElem>, Eigen::RowMajor>;
-    using SType  = Eigen::SparseMatrix<Eigen::Recursive::MatrixScalar<ADiag>, Eigen::RowMajor>;
-
-
-    using BAMatrix = Eigen::Recursive::SymmetricMixedMatrix2<UType, VType, WType>;
-    using BAVector = Eigen::Recursive::MixedVector2<DAType, DBType>;
-    using BASolver = Eigen::Recursive::MixedSymmetricRecursiveSolver<BAMatrix, BAVector>;
+    // The block types of the linear system. BlockBAScalar is double or float depending on BAOptions::precision.
+    template <typename BlockBAScalar>
+    struct MatrixTypes
+    {
+        using ADiag  = Eigen::Matrix<BlockBAScalar, blockSizeCamera, blockSizeCamera, Eigen::RowMajor>;
+        using BDiag  = Eigen::Matrix<BlockBAScalar, blockSizePoint, blockSizePoint, Eigen::RowMajor>;
+        using WElem  = Eigen::Matrix<BlockBAScalar, blockSizeCamera, blockSizePoint, Eigen::RowMajor>;
+        using WTElem = Eigen::Matrix<BlockBAScalar, blockSizePoint, blockSizeCamera, Eigen::RowMajor>;
+        using ARes   = Eigen::Matrix<BlockBAScalar, blockSizeCamera, 1>;
+        using BRes   = Eigen::Matrix<BlockBAScalar, blockSizePoint, 1>;
+
+        // Block structured diagonal matrices
+        using UType = Eigen::DiagonalMatrix<Eigen::Recursive::MatrixScalar<ADiag>, -1>;
+        using VType = Eigen::DiagonalMatrix<Eigen::Recursive::MatrixScalar<BDiag>, -1>;
+
+        // Block structured vectors
+        using DAType = Eigen::Matrix<Eigen::Recursive::MatrixScalar<ARes>, -1, 1>;
+        using DBType = Eigen::Matrix<Eigen::Recursive::MatrixScalar<BRes>, -1, 1>;
+
+        // Block structured sparse matrix
+        using WType  = Eigen::SparseMatrix<Eigen::Recursive::MatrixScalar<WElem>, Eigen::RowMajor>;
+        using WTType = Eigen::SparseMatrix<Eigen::Recursive::MatrixScalar<WTElem>, Eigen::RowMajor>;
+        using SType  = Eigen::SparseMatrix<Eigen::Recursive::MatrixScalar<ADiag>, Eigen::RowMajor>;
+
+
+        using BAMatrix = Eigen::Recursive::SymmetricMixedMatrix2<UType, VType, WType>;
+        using BAVector = Eigen::Recursive::MixedVector2<DAType, DBType>;
+        using BASolver = Eigen::Recursive::MixedSymmetricRecursiveSolver<BAMatrix, BAVector>;
+    };
 
    public:
     EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 
-    BARec() : BABase("Recursive BA") {}
-    virtual ~BARec() {}
+    BARec();
+    virtual ~BARec();
     virtual void create(Scene& scene) override { _scene = &scene; }
 
     // resserve space for n cameras and m points
@@ -64,13 +68,21 @@ class SAIGA_VISION_API BARec : public BABase, public LMOptimizer
     int totalN;     // with constant images
     int constantN;  // only constant images  n + constantN == totalN
 
+    // The linear system and the parameters in the precision selected by BAOptions::precision.
+    // Defined in BARecursive.cpp.
+    template <typename BlockScalar, typename ParamScalar>
+    struct System;
 
-    BAMatrix A;
-    BAVector x, b, delta_x;
-    BASolver solver;
+    std::unique_ptr<System<double, double>> system_double;
+    std::unique_ptr<System<float, double>> system_mixed;
+    std::unique_ptr<System<float, float>> system_float;
 
-    AlignedVector<SE3> x_u, oldx_u;
-    AlignedVector<Vec3> x_v, oldx_v;
+    // The precision of the last init()
+    BAOptions::Precision precision = BAOptions::Precision::Double;
+
+    // Calls f with the system of the current precision
+    template <typename F>
+    auto Dispatch(F&& f);
 
     // ============== Structure information ==============
 
@@ -113,9 +125,6 @@ class SAIGA_VISION_API BARec : public BABase, public LMOptimizer
     Eigen::Recursive::LinearSolverOptions loptions;
     // ============= Multi Threading Stuff ===========
     //    int threads = 1;
-    // each thread gets one vector
-    std::vector<AlignedVector<BDiag>> pointDiagTemp;
-    std::vector<AlignedVector<BRes>> pointResTemp;
     std::vector<double> localChi2;
     double chi2_sum;
 
@@ -130,6 +139,19 @@ class SAIGA_VISION_API BARec : public BABase, public LMOptimizer
     virtual void solveLinearSystem() override;
     virtual double computeCost() override;
     virtual void finalize() override;
+
+    template <typename S>
+    void initSystem(S& s, const std::vector<int>& innerElements);
+    template <typename S>
+    double computeQuadraticForm(S& s);
+    template <typename S>
+    bool addDelta(S& s);
+    template <typename S>
+    void revertDelta(S& s);
+    template <typename S>
+    double computeCost(S& s);
+    template <typename S>
+    void finalize(S& s);
 };
 
 
@@ -0,0 +1,641 @@
+/**
+ * Copyright (c) 2021 Darius Rückert
+ * Licensed under the MIT License.
+ * See LICENSE file for more information.
+ */
+#include "BASlidingWindow.h"
+
+#include "saiga/vision/kernels/BA.h"
+#include "saiga/vision/kernels/Robust.h"
+#include "saiga/vision/util/LM.h"
+
+namespace Saiga
+{
+namespace
+{
+// Pseudo inverse of a symmetric positive semi-definite matrix. Eigenvalues below eps * max_eigenvalue are treated as
+// zero. Used for the marginalization, where the eliminated blocks can be rank deficient (gauge freedom, points with a
+// single observation).
+template <typename Derived>
+Eigen::Matrix<typename Derived::Scalar, Derived::RowsAtCompileTime, Derived::ColsAtCompileTime> PseudoInverse(
+    const Eigen::MatrixBase<Derived>& A, double eps = 1e-10)
+{
+    using MatrixType = Eigen::Matrix<typename Derived::Scalar, Derived::RowsAtCompileTime, Derived::ColsAtCompileTime>;
+    Eigen::SelfAdjointEigenSolver<MatrixType> es(A);
+    auto values    = es.eigenvalues();
+    double max_val = values.size() > 0 ? values.maxCoeff() : 0;
+    for (int i = 0; i < values.size(); ++i)
+    {
+        values(i) = values(i) > eps * max_val ? 1.0 / values(i) : 0;
+    }
+    return es.eigenvectors() * values.asDiagonal() * es.eigenvectors().transpose();
+}
+}  // namespace
+
+void BASlidingWindow::create(Scene& scene)
+{
+    _scene = &scene;
+
+    keyframes.clear();
+    keyframe_index.clear();
+    keyframe_observations.clear();
+    keyframe_fixed_observations.clear();
+    points.clear();
+    free_slots.clear();
+    point_slot.clear();
+    point_marginalized.clear();
+    num_points       = 0;
+    num_observations = 0;
+
+    prior_J.resize(0, 0);
+    prior_r.resize(0);
+    prior_x0.clear();
+}
+
+void BASlidingWindow::ResizeMaps()
+{
+    Scene& scene = *_scene;
+    if (point_slot.size() < scene.worldPoints.size())
+    {
+        point_slot.resize(scene.worldPoints.size(), -1);
+        point_marginalized.resize(scene.worldPoints.size(), false);
+    }
+    if (keyframe_index.size() < scene.images.size())
+    {
+        keyframe_index.resize(scene.images.size(), -1);
+    }
+}
+
+void BASlidingWindow::AddKeyframe(int image_id)
+{
+    Scene& scene = *_scene;
+    ResizeMaps();
+    SAIGA_ASSERT(image_id >= 0 && image_id < (int)scene.images.size());
+    SAIGA_ASSERT(keyframe_index[image_id] == -1, "The keyframe is already part of the window.");
+
+    auto& img = scene.images[image_id];
+
+    keyframe_index[image_id] = keyframes.size();
+    keyframes.push_back(image_id);
+
+    std::vector<int> observations, fixed_observations;
+    for (int i = 0; i < (int)img.stereoPoints.size(); ++i)
+    {
+        auto& ip = img.stereoPoints[i];
+        if (ip.wp == -1 || !scene.worldPoints[ip.wp].valid) continue;
+
+        if (point_marginalized[ip.wp])
+        {
+            fixed_observations.push_back(i);
+            continue;
+        }
+
+        int& slot = point_slot[ip.wp];
+        if (slot == -1)
+        {
+            if (free_slots.empty())
+            {
+                slot = points.size();
+                points.emplace_back();
+            }
+            else
+            {
+                slot = free_slots.back();
+                free_slots.pop_back();
+            }
+            points[slot].wp = ip.wp;
+            num_points++;
+        }
+        points[slot].observations.emplace_back(image_id, i);
+        observations.push_back(i);
+    }
+    num_observations += observations.size() + fixed_observations.size();
+    keyframe_observations.push_back(std::move(observations));
+    keyframe_fixed_observations.push_back(std::move(fixed_observations));
+
+    // The new keyframe is not constrained by the prior -> zero columns
+    int cols = blockSizeCamera * keyframes.size();
+    prior_J.conservativeResize(prior_J.rows(), cols);
+    prior_J.rightCols<blockSizeCamera>().setZero();
+    prior_x0.push_back(img.se3);
+}
+
+void BASlidingWindow::RemovePoint(int slot)
+{
+    auto& wp = points[slot];
+    SAIGA_ASSERT(wp.wp != -1);
+
+    for (auto [image_id, ip] : wp.observations)
+    {
+        auto& obs = keyframe_observations[keyframe_index[image_id]];
+        auto it   = std::find(obs.begin(), obs.end(), ip);
+        SAIGA_ASSERT(it != obs.end());
+        *it = obs.back();
+        obs.pop_back();
+    }
+    num_observations -= wp.observations.size();
+
+    point_slot[wp.wp] = -1;
+    wp.wp             = -1;
+    wp.observations.clear();
+    free_slots.push_back(slot);
+    num_points--;
+}
+
+Eigen::VectorXd BASlidingWindow::PriorDelta(const AlignedVector<SE3>& poses)
+{
+    SAIGA_ASSERT(poses.size() == prior_x0.size());
+    Eigen::VectorXd delta(blockSizeCamera * poses.size());
+    for (int i = 0; i < (int)poses.size(); ++i)
+    {
+        delta.segment<blockSizeCamera>(i * blockSizeCamera) = Sophus::se3_logd(poses[i] * prior_x0[i].inverse());
+    }
+    return delta;
+}
+
+double BASlidingWindow::PriorCost()
+{
+    if (prior_J.rows() == 0) return 0;
+    Scene& scene = *_scene;
+
+    AlignedVector<SE3> poses;
+    for (auto image_id : keyframes) poses.push_back(scene.images[image_id].se3);
+    return (prior_J * PriorDelta(poses) + prior_r).squaredNorm();
+}
+
+void BASlidingWindow::MarginalizeKeyframe(int image_id)
+{
+    Scene& scene = *_scene;
+    SAIGA_ASSERT(image_id >= 0 && image_id < (int)keyframe_index.size());
+    int k = keyframe_index[image_id];
+    SAIGA_ASSERT(k != -1, "The keyframe is not part of the window.");
+
+    int N    = keyframes.size();
+    int dims = blockSizeCamera * N;
+
+    AlignedVector<SE3> poses;
+    for (auto id : keyframes) poses.push_back(scene.images[id].se3);
+
+    // 1. The old prior linearized at the current poses
+    Eigen::MatrixXd H = Eigen::MatrixXd::Zero(dims, dims);
+    Eigen::VectorXd b = Eigen::VectorXd::Zero(dims);
+    if (prior_J.rows() > 0)
+    {
+        Eigen::VectorXd r = prior_J * PriorDelta(poses) + prior_r;
+        H                 = prior_J.transpose() * prior_J;
+        b                 = -prior_J.transpose() * r;
+    }
+
+    // 2. Add the observations of fixed points and all observations of the points seen by the keyframe. Then
+    // eliminate the points.
+    auto& kf_img = scene.images[image_id];
+    if (!kf_img.constant)
+    {
+        for (auto i : keyframe_fixed_observations[k])
+        {
+            auto& ip = kf_img.stereoPoints[i];
+            if (ip.outlier) continue;
+
+            Matrix<double, 3, 6> JPose;
+            Vec3 res;
+            EvaluateObservation(kf_img, ip, kf_img.se3, scene.worldPoints[ip.wp].p, &JPose, nullptr, &res);
+            H.block<6, 6>(k * 6, k * 6) += JPose.transpose() * JPose;
+            b.segment<6>(k * 6) -= JPose.transpose() * res;
+        }
+    }
+
+    std::vector<int> marg_slots;
+    for (auto i : keyframe_observations[k])
+    {
+        marg_slots.push_back(point_slot[kf_img.stereoPoints[i].wp]);
+    }
+    std::sort(marg_slots.begin(), marg_slots.end());
+    marg_slots.erase(std::unique(marg_slots.begin(), marg_slots.end()), marg_slots.end());
+
+    std::vector<int> obs_kf;
+    AlignedVector<WElem> obs_W;
+    for (auto slot : marg_slots)
+    {
+        auto& wp   = points[slot];
+        Vec3 point = scene.worldPoints[wp.wp].p;
+
+        PointDiag Vj = PointDiag::Zero();
+        Vec3 bvj     = Vec3::Zero();
+        obs_kf.clear();
+        obs_W.clear();
+
+        for (auto [img_id, i] : wp.observations)
+        {
+            auto& img = scene.images[img_id];
+            auto& ip  = img.stereoPoints[i];
+            if (ip.outlier) continue;
+
+            Matrix<double, 3, 6> JPose;
+            Matrix<double, 3, 3> JPoint;
+            Vec3 res;
+            EvaluateObservation(img, ip, img.se3, point, &JPose, &JPoint, &res);
+
+            Vj += JPoint.transpose() * JPoint;
+            bvj -= JPoint.transpose() * res;
+
+            if (img.constant) continue;
+            int kf = keyframe_index[img_id];
+            H.block<6, 6>(kf * 6, kf * 6) += JPose.transpose() * JPose;
+            b.segment<6>(kf * 6) -= JPose.transpose() * res;
+            obs_kf.push_back(kf);
+            obs_W.push_back(JPose.transpose() * JPoint);
+        }
+
+        PointDiag Vj_inv = PseudoInverse(Vj);
+        Vec3 q           = Vj_inv * bvj;
+        for (int a = 0; a < (int)obs_kf.size(); ++a)
+        {
+            WElem WV = obs_W[a] * Vj_inv;
+            b.segment<6>(obs_kf[a] * 6) -= obs_W[a] * q;
+            for (int c = 0; c < (int)obs_kf.size(); ++c)
+            {
+                H.block<6, 6>(obs_kf[a] * 6, obs_kf[c] * 6) -= WV * obs_W[c].transpose();
+            }
+        }
+    }
+
+    // 3. Eliminate the keyframe. A constant keyframe has no entries in H and is just removed.
+    int rdims = dims - blockSizeCamera;
+    std::vector<int> keep;
+    for (int i = 0; i < dims; ++i)
+    {
+        if (i / blockSizeCamera != k) keep.push_back(i);
+    }
+
+    Eigen::MatrixXd Hrr(rdims, rdims);
+    Eigen::MatrixXd Hrk(rdims, blockSizeCamera);
+    Eigen::VectorXd br(rdims);
+    for (int i = 0; i < rdims; ++i)
+    {
+        for (int j = 0; j < rdims; ++j) Hrr(i, j) = H(keep[i], keep[j]);
+        Hrk.row(i) = H.block<1, blockSizeCamera>(keep[i], k * blockSizeCamera);
+        br(i)      = b(keep[i]);
+    }
+    PoseDiag Hkk_inv = PseudoInverse(H.block<6, 6>(k * 6, k * 6));
+
+    Eigen::MatrixXd Hm = Hrr - Hrk * Hkk_inv * Hrk.transpose();
+    Eigen::VectorXd bm = br - Hrk * Hkk_inv * b.segment<6>(k * 6);
+    Hm                 = 0.5 * (Hm + Hm.transpose()).eval();
+
+    // 4. Square root form: Hm = J^T J and bm = -J^T r
+    Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> es(Hm);
+    Eigen::VectorXd values = es.eigenvalues();
+    double max_val         = values.size() > 0 ? values.maxCoeff() : 0;
+    Eigen::VectorXd sqrt_values(values.size()), sqrt_values_inv(values.size());
+    for (int i = 0; i < values.size(); ++i)
+    {
+        bool valid         = values(i) > 1e-10 * max_val && values(i) > 0;
+        sqrt_values(i)     = valid ? sqrt(values(i)) : 0;
+        sqrt_values_inv(i) = valid ? 1.0 / sqrt(values(i)) : 0;
+    }
+    prior_J = sqrt_values.asDiagonal() * es.eigenvectors().transpose();
+    prior_r = -(sqrt_values_inv.asDiagonal() * es.eigenvectors().transpose() * bm);
+
+    // The new linearization point
+    poses.erase(poses.begin() + k);
+    prior_x0 = poses;
+
+    // 5. Update the structure
+    for (auto slot : marg_slots)
+    {
+        point_marginalized[points[slot].wp] = true;
+        RemovePoint(slot);
+    }
+    SAIGA_ASSERT(keyframe_observations[k].empty());
+    num_observations -= keyframe_fixed_observations[k].size();
+
+    keyframes.erase(keyframes.begin() + k);
+    keyframe_observations.erase(keyframe_observations.begin() + k);
+    keyframe_fixed_observations.erase(keyframe_fixed_observations.begin() + k);
+    keyframe_index[image_id] = -1;
+    for (int i = k; i < (int)keyframes.size(); ++i)
+    {
+        keyframe_index[keyframes[i]] = i;
+    }
+}
+
+double BASlidingWindow::EvaluateObservation(const SceneImage& img, StereoImagePoint& ip, const SE3& pose,
+                                            const Vec3& point, Matrix<double, 3, 6>* JPose,
+                                            Matrix<double, 3, 3>* JPoint, Vec3* res)
+{
+    Scene& scene = *_scene;
+    auto& camera = scene.intrinsics[img.intr];
+    double w     = ip.weight * scene.scale();
+
+    double loss_weight = 1.0;
+    double res_2;
+    if (ip.IsStereoOrDepth())
+    {
+        StereoCamera4 scam(camera, scene.bf);
+        auto stereo_point = ip.GetStereoPoint(scene.bf);
+        auto [r, depth]   = BundleAdjustmentStereo<double>(scam, ip.point, stereo_point, pose, point, w,
+                                                         w * scene.stereo_weight, JPose, JPoint);
+
+        res_2 = r.squaredNorm();
+        if (baOptions.huberStereo > 0)
+        {
+            auto rw     = Kernel::HuberLoss<double>(baOptions.huberStereo, res_2);
+            res_2       = rw(0);
+            loss_weight = rw(1);
+        }
+        if (res) *res = r;
+    }
+    else
+    {
+        Matrix<double, 2, 6> JrowPose;
+        Matrix<double, 2, 3> JrowPoint;
+        auto [r, depth] = BundleAdjustment<double>(camera, ip.point, pose, point, w, JPose ? &JrowPose : nullptr,
+                                                   JPoint ? &JrowPoint : nullptr);
+
+        res_2 = r.squaredNorm();
+        if (baOptions.huberMono > 0)
+        {
+            auto rw     = Kernel::HuberLoss<double>(baOptions.huberMono, res_2);
+            res_2       = rw(0);
+            loss_weight = rw(1);
+        }
+
+        if (JPose)
+        {
+            JPose->topRows<2>() = JrowPose;
+            JPose->row(2).setZero();
+        }
+        if (JPoint)
+        {
+            JPoint->topRows<2>() = JrowPoint;
+            JPoint->row(2).setZero();
+        }
+        if (res) *res = Vec3(r(0), r(1), 0);
+    }
+
+    // Scale the Jacobians and the residual so that J^T*J and J^T*r include the robust weight
+    if (loss_weight != 1.0)
+    {
+        double s = sqrt(loss_weight);
+        if (JPose) *JPose *= s;
+        if (JPoint) *JPoint *= s;
+        if (res) *res *= s;
+    }
+    return res_2;
+}
+
+void BASlidingWindow::init()
+{
+    Scene& scene = *_scene;
+    int N        = keyframes.size();
+
+    variable_index.resize(N);
+    n = 0;
+    x_u.resize(N);
+    for (int i = 0; i < N; ++i)
+    {
+        auto& img         = scene.images[keyframes[i]];
+        variable_index[i] = img.constant ? -1 : n++;
+        x_u[i]            = img.se3;
+    }
+
+    int num_slots = points.size();
+    x_v.resize(num_slots);
+    W_offset.resize(num_slots);
+    int observations = 0;
+    for (int j = 0; j < num_slots; ++j)
+    {
+        W_offset[j] = observations;
+        observations += points[j].observations.size();
+        if (points[j].wp != -1) x_v[j] = scene.worldPoints[points[j].wp].p;
+    }
+    W.resize(observations);
+
+    U.resize(n * blockSizeCamera, n * blockSizeCamera);
+    bu.resize(n * blockSizeCamera);
+    V.resize(num_slots);
+    Vinv.resize(num_slots);
+    bv.resize(num_slots);
+    dv.resize(num_slots);
+
+    prior_J_variable.resize(prior_J.rows(), n * blockSizeCamera);
+    for (int i = 0; i < N; ++i)
+    {
+        if (variable_index[i] == -1) continue;
+        prior_J_variable.middleCols<blockSizeCamera>(variable_index[i] * blockSizeCamera) =
+            prior_J.middleCols<blockSizeCamera>(i * blockSizeCamera);
+    }
+
+    if (optimizationOptions.debugOutput)
+    {
+        std::cout << "Sliding Window: " << N << " keyframes (" << N - n << " constant), " << num_points
+                  << " points, " << num_observations << " observations, prior " << prior_J.rows() << "x"
+                  << prior_J.cols() << std::endl;
+    }
+}
+
+double BASlidingWindow::computeQuadraticForm()
+{
+    Scene& scene = *_scene;
+
+    U.setZero();
+    bu.setZero();
+    double chi2 = 0;
+
+    if (prior_J.rows() > 0)
+    {
+        Eigen::VectorXd r = prior_J * PriorDelta(x_u) + prior_r;
+        chi2 += r.squaredNorm();
+        U += prior_J_variable.transpose() * prior_J_variable;
+        bu -= prior_J_variable.transpose() * r;
+    }
+
+    // Pose only observations of fixed points
+    for (int kf = 0; kf < (int)keyframes.size(); ++kf)
+    {
+        int vi = variable_index[kf];
+        if (vi == -1) continue;
+        auto& img = scene.images[keyframes[kf]];
+        for (auto i : keyframe_fixed_observations[kf])
+        {
+            auto& ip = img.stereoPoints[i];
+            if (ip.outlier) continue;
+
+            Matrix<double, 3, 6> JPose;
+            Vec3 res;
+            chi2 += EvaluateObservation(img, ip, x_u[kf], scene.worldPoints[ip.wp].p, &JPose, nullptr, &res);
+            U.block<6, 6>(vi * 6, vi * 6) += JPose.transpose() * JPose;
+            bu.segment<6>(vi * 6) -= JPose.transpose() * res;
+        }
+    }
+
+    for (int j = 0; j < (int)points.size(); ++j)
+    {
+        auto& wp = points[j];
+        if (wp.wp == -1) continue;
+
+        V[j].setZero();
+        bv[j].setZero();
+        for (int o = 0; o < (int)wp.observations.size(); ++o)
+        {
+            auto [image_id, i] = wp.observations[o];
+            int kf             = keyframe_index[image_id];
+            int vi             = variable_index[kf];
+            auto& img          = scene.images[image_id];
+            auto& ip           = img.stereoPoints[i];
+            auto& Wo           = W[W_offset[j] + o];
+            Wo.setZero();
+            if (ip.outlier) continue;
+
+            Matrix<double, 3, 6> JPose;
+            Matrix<double, 3, 3> JPoint;
+            Vec3 res;
+            chi2 += EvaluateObservation(img, ip, x_u[kf], x_v[j], &JPose, &JPoint, &res);
+
+            V[j] += JPoint.transpose() * JPoint;
+            bv[j] -= JPoint.transpose() * res;
+            if (vi == -1) continue;
+
+            U.block<6, 6>(vi * 6, vi * 6) += JPose.transpose() * JPose;
+            bu.segment<6>(vi * 6) -= JPose.transpose() * res;
+            Wo = JPose.transpose() * JPoint;
+        }
+    }
+    return chi2;
+}
+
+void BASlidingWindow::addLambda(double lambda)
+{
+    applyLMDiagonalInner(U, lambda);
+    for (int j = 0; j < (int)points.size(); ++j)
+    {
+        if (points[j].wp == -1) continue;
+        applyLMDiagonalInner(V[j], lambda);
+    }
+}
+
+void BASlidingWindow::solveLinearSystem()
+{
+    // Schur complement onto the poses
+    S   = U;
+    rhs = bu;
+    for (int j = 0; j < (int)points.size(); ++j)
+    {
+        auto& wp = points[j];
+        if (wp.wp == -1) continue;
+
+        Vinv[j] = V[j].inverse();
+        Vec3 q  = Vinv[j] * bv[j];
+        for (int a = 0; a < (int)wp.observations.size(); ++a)
+        {
+            int va = variable_index[keyframe_index[wp.observations[a].first]];
+            if (va == -1) continue;
+
+            auto& Wa = W[W_offset[j] + a];
+            WElem WV = Wa * Vinv[j];
+            rhs.segment<6>(va * 6) -= Wa * q;
+            for (int c = 0; c < (int)wp.observations.size(); ++c)
+            {
+                int vc = variable_index[keyframe_index[wp.observations[c].first]];
+                if (vc == -1) continue;
+                S.block<6, 6>(va * 6, vc * 6) -= WV * W[W_offset[j] + c].transpose();
+            }
+        }
+    }
+
+    du = S.ldlt().solve(rhs);
+
+    // Back substitution
+    for (int j = 0; j < (int)points.size(); ++j)
+    {
+        auto& wp = points[j];
+        if (wp.wp == -1) continue;
+
+        Vec3 r = bv[j];
+        for (int a = 0; a < (int)wp.observations.size(); ++a)
+        {
+            int va = variable_index[keyframe_index[wp.observations[a].first]];
+            if (va == -1) continue;
+            r -= W[W_offset[j] + a].transpose() * du.segment<6>(va * 6);
+        }
+        dv[j] = Vinv[j] * r;
+    }
+}
+
+bool BASlidingWindow::addDelta()
+{
+    oldx_u = x_u;
+    oldx_v = x_v;
+    for (int i = 0; i < (int)x_u.size(); ++i)
+    {
+        int vi = variable_index[i];
+        if (vi == -1) continue;
+        x_u[i] = Sophus::se3_expd(du.segment<6>(vi * 6)) * x_u[i];
+    }
+    for (int j = 0; j < (int)points.size(); ++j)
+    {
+        if (points[j].wp == -1) continue;
+        x_v[j] += dv[j];
+    }
+    return true;
+}
+
+void BASlidingWindow::revertDelta()
+{
+    x_u.swap(oldx_u);
+    x_v.swap(oldx_v);
+}
+
+double BASlidingWindow::computeCost()
+{
+    Scene& scene = *_scene;
+
+    double chi2 = 0;
+    if (prior_J.rows() > 0)
+    {
+        chi2 += (prior_J * PriorDelta(x_u) + prior_r).squaredNorm();
+    }
+
+    for (int kf = 0; kf < (int)keyframes.size(); ++kf)
+    {
+        if (variable_index[kf] == -1) continue;
+        auto& img = scene.images[keyframes[kf]];
+        for (auto i : keyframe_fixed_observations[kf])
+        {
+            auto& ip = img.stereoPoints[i];
+            if (ip.outlier) continue;
+            chi2 += EvaluateObservation(img, ip, x_u[kf], scene.worldPoints[ip.wp].p);
+        }
+    }
+
+    for (int j = 0; j < (int)points.size(); ++j)
+    {
+        auto& wp = points[j];
+        if (wp.wp == -1) continue;
+        for (auto [image_id, i] : wp.observations)
+        {
+            auto& img = scene.images[image_id];
+            auto& ip  = img.stereoPoints[i];
+            if (ip.outlier) continue;
+            chi2 += EvaluateObservation(img, ip, x_u[keyframe_index[image_id]], x_v[j]);
+        }
+    }
+    return chi2;
+}
+
+void BASlidingWindow::finalize()
+{
+    Scene& scene = *_scene;
+    for (int i = 0; i < (int)keyframes.size(); ++i)
+    {
+        if (variable_index[i] == -1) continue;
+        scene.images[keyframes[i]].se3 = x_u[i];
+    }
+    for (int j = 0; j < (int)points.size(); ++j)
+    {
+        if (points[j].wp == -1) continue;
+        scene.worldPoints[points[j].wp].p = x_v[j];
+    }
+}
+
+}  // namespace Saiga
@@ -0,0 +1,175 @@
+/**
+ * Copyright (c) 2021 Darius Rückert
+ * Licensed under the MIT License.
+ * See LICENSE file for more information.
+ */
+
+
+#pragma once
+#include "saiga/vision/ba/BABase.h"
+#include "saiga/vision/scene/Scene.h"
+
+#include "Recursive.h"
+
+namespace Saiga
+{
+/**
+ * Incremental local bundle adjustment over a sliding window of keyframes.
+ *
+ * In contrast to BARec, the structure of the problem (keyframes, points and observations) is not rebuilt before each
+ * solve. AddKeyframe() and MarginalizeKeyframe() only update the parts of the structure which belong to the added
+ * or removed keyframe. The cost of a solve therefore depends only on the window size and not on the length of the
+ * session.
+ *
+ * The linear system is reduced to the poses with the Schur complement. Because a local window has only a few
+ * keyframes, the reduced camera system is stored densely and solved with a LDLT.
+ *
+ * Marginalization:
+ *  A removed keyframe is marginalized together with all points it observes. The linearized observations of these
+ *  points are combined with the previous prior and the keyframe and the points are eliminated with the Schur
+ *  complement. The result is a dense Gaussian prior on the remaining keyframes of the window. It is stored in square
+ *  root form |J * delta + r|^2, where delta is the decoupled SE3 increment of each keyframe from the linearization
+ *  point. Marginalized points leave the window. Their observations in keyframes which are added later are new
+ *  measurements and constrain the pose of these keyframes, but the point itself is kept fixed.
+ *
+ * Constant keyframes (SceneImage::constant) can be part of the window. They constrain the points, but are not
+ * optimized and not part of the prior.
+ *
+ * Usage:
+ *
+ *   BASlidingWindow ba;
+ *   ba.create(scene);
+ *   for (int kf : new_keyframes)
+ *   {
+ *       ba.AddKeyframe(kf);
+ *       if (ba.Keyframes().size() > window_size) ba.MarginalizeKeyframe(ba.Keyframes().front());
+ *       ba.initAndSolve();
+ *   }
+ */
+class SAIGA_VISION_API BASlidingWindow : public BABase, public LMOptimizer
+{
+   public:
+    static constexpr int blockSizeCamera = 6;
+    static constexpr int blockSizePoint  = 3;
+
+    using PoseDiag  = Eigen::Matrix<double, blockSizeCamera, blockSizeCamera>;
+    using PointDiag = Eigen::Matrix<double, blockSizePoint, blockSizePoint>;
+    using WElem     = Eigen::Matrix<double, blockSizeCamera, blockSizePoint>;
+
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    BASlidingWindow() : BABase("Sliding Window BA") {}
+    virtual ~BASlidingWindow() {}
+
+    // Resets the window and the prior.
+    virtual void create(Scene& scene) override;
+
+    // Adds scene.images[image_id] to the window.
+    // The observations of the image are read here. Changes of the image observations afterwards are not tracked.
+    void AddKeyframe(int image_id);
+
+    // Removes the keyframe from the window and marginalizes it together with all points it observes.
+    // The current values of the scene are used as linearization point.
+    void MarginalizeKeyframe(int image_id);
+
+    // Image ids of the keyframes in the window (oldest first).
+    const std::vector<int>& Keyframes() const { return keyframes; }
+
+    int NumPoints() const { return num_points; }
+    int NumObservations() const { return num_observations; }
+
+    // Cost of the prior at the current scene values.
+    double PriorCost();
+
+   private:
+    Scene* _scene = nullptr;
+
+    // ============== Structure information ==============
+
+    // Image ids of the window (oldest first) and the index of each image in this array (-1 if not in the window)
+    std::vector<int> keyframes;
+    std::vector<int> keyframe_index;
+
+    // Indices into SceneImage::stereoPoints of the observations added to the window. Parallel to 'keyframes'.
+    std::vector<std::vector<int>> keyframe_observations;
+
+    // Observations of already marginalized (fixed) points. Parallel to 'keyframes'.
+    std::vector<std::vector<int>> keyframe_fixed_observations;
+
+    struct WindowPoint
+    {
+        // -1 for unused slots
+        int wp = -1;
+
+        // (image id, index into SceneImage::stereoPoints)
+        std::vector<std::pair<int, int>> observations;
+    };
+
+    // Points are stored in slots which are reused after the point left the window
+    std::vector<WindowPoint> points;
+    std::vector<int> free_slots;
+    int num_points       = 0;
+    int num_observations = 0;
+
+    // Slot of each world point (-1 if not in the window) and whether it has been marginalized
+    std::vector<int> point_slot;
+    std::vector<char> point_marginalized;
+
+    // Makes sure that the per world point arrays are large enough for the scene
+    void ResizeMaps();
+    void RemovePoint(int slot);
+
+    // ============== Prior ==============
+
+    // |prior_J * delta + prior_r|^2 with delta = (se3_logd(x_i * prior_x0_i^-1))_i of all keyframes in the window.
+    // Constant keyframes have zero columns.
+    Eigen::MatrixXd prior_J;
+    Eigen::VectorXd prior_r;
+    AlignedVector<SE3> prior_x0;
+
+    Eigen::VectorXd PriorDelta(const AlignedVector<SE3>& poses);
+
+    // ============== Linear system ==============
+
+    // Variable index of each keyframe (-1 for constant keyframes)
+    std::vector<int> variable_index;
+    int n = 0;
+
+    AlignedVector<SE3> x_u, oldx_u;
+    AlignedVector<Vec3> x_v, oldx_v;
+
+    // Dense reduced camera system
+    Eigen::MatrixXd U, S;
+    Eigen::VectorXd bu, du, rhs;
+
+    AlignedVector<PointDiag> V, Vinv;
+    AlignedVector<Vec3> bv, dv;
+
+    // Columns of prior_J which belong to the variable keyframes
+    Eigen::MatrixXd prior_J_variable;
+
+    // W blocks of all observations of the point in slot j start at W_offset[j]
+    std::vector<int> W_offset;
+    AlignedVector<WElem> W;
+
+    // Evaluates the (robust) squared residual of one observation.
+    // If JPose/JPoint are given, they are filled with the Jacobians of the weighted residual and 'res' with the
+    // weighted residual. Mono observations have a zero third row.
+    double EvaluateObservation(const SceneImage& img, StereoImagePoint& ip, const SE3& pose, const Vec3& point,
+                               Matrix<double, 3, 6>* JPose = nullptr, Matrix<double, 3, 3>* JPoint = nullptr,
+                               Vec3* res = nullptr);
+
+    // ============== LM Functions ==============
+
+    virtual void init() override;
+    virtual double computeQuadraticForm() override;
+    virtual void addLambda(double lambda) override;
+    virtual bool addDelta() override;
+    virtual void revertDelta() override;
+    virtual void solveLinearSystem() override;
+    virtual double computeCost() override;
+    virtual void finalize() override;
+};
+
+
+}  // namespace Saiga
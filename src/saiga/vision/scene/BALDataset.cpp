@@ -6,11 +6,13 @@
 
 #include "BALDataset.h"
 
+#include "saiga/core/util/StreamingFileReader.h"
+#include "saiga/core/util/Thread/omp.h"
 #include "saiga/core/util/assert.h"
-#include "saiga/core/util/file.h"
-#include "saiga/core/util/tostring.h"
 
-#include <fstream>
+#include <charconv>
+#include <cstring>
+#include <future>
 
 #ifdef SAIGA_USE_CERES
 #    include "saiga/vision/ceres/CeresBAL.h"
@@ -20,53 +22,170 @@
 
 namespace Saiga
 {
-BALDataset::BALDataset(const std::string& file)
+namespace
+{
+inline bool IsSpace(char c)
+{
+    return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+// Parses the next number in [p, end) and returns the position after it.
+template <typename T>
+inline const char* ParseNumber(const char* p, const char* end, T& value)
+{
+    while (p < end && IsSpace(*p)) ++p;
+    if (p < end && *p == '+') ++p;
+    auto [ptr, ec] = std::from_chars(p, end, value);
+    SAIGA_ASSERT(ec == std::errc(), "Invalid number in BAL file.");
+    return ptr;
+}
+
+// Parses all numbers in [p, end)
+inline void ParseNumbers(const char* p, const char* end, std::vector<double>& result)
+{
+    while (true)
+    {
+        while (p < end && IsSpace(*p)) ++p;
+        if (p == end) break;
+        double v;
+        p = ParseNumber(p, end, v);
+        result.push_back(v);
+    }
+}
+}  // namespace
+
+BALDataset::BALDataset(const std::string& file, size_t block_size)
 {
     std::cout << "> Loading BALDataset " << file << std::endl;
 
-    auto data = File::loadFileStringArray(file);
+    StreamingFileReader reader(file);
+    SAIGA_ASSERT(reader.valid(), "Could not open BAL file " + file);
 
-    int num_cameras, num_points, num_observations;
+    // The file is parsed in blocks. The next block is read (and decompressed) by a second thread while the current
+    // block is parsed. Only complete lines are parsed, the remaining bytes are moved to the next block.
+    SAIGA_ASSERT(block_size > 0);
 
-    std::stringstream in(data.front());
-    in >> num_cameras >> num_points >> num_observations;
+    int num_threads = OMP::getMaxThreads();
 
-    cameras.resize(num_cameras);
-    observations.resize(num_observations);
-    points.resize(num_points);
+    int num_cameras = -1, num_points = 0, num_observations = 0;
+    int64_t num_params = 0;
 
+    int64_t observations_done = 0;
+    int64_t params_done       = 0;
+    std::vector<double> params;
 
+    std::vector<char> block, next_block;
+    std::vector<const char*> line_begin;
+    std::vector<std::vector<double>> local_params(num_threads);
 
-    int start = 1;
-#pragma omp parallel for
-    for (int i = 0; i < num_observations; ++i)
+    auto read_next = [&]() {
+        reader.read(next_block, block_size);
+        return reader.eof();
+    };
+    auto next = std::async(std::launch::async, read_next);
+
+    bool last_block = false;
+    while (!last_block)
     {
-        std::stringstream in(data[start + i]);
-        BALObservation o;
-        in >> o.camera_index >> o.point_index >> o.point[0] >> o.point[1];
-        observations[i] = (o);
+        last_block = next.get();
+        block.insert(block.end(), next_block.begin(), next_block.end());
+        if (!last_block) next = std::async(std::launch::async, read_next);
+
+        // Parse up to the end of the last complete line
+        const char* p   = block.data();
+        const char* end = p + block.size();
+        if (!last_block)
+        {
+            while (end > p && end[-1] != '\n') --end;
+            if (end == p) continue;
+        }
+
+        if (num_cameras < 0)
+        {
+            p = ParseNumber(p, end, num_cameras);
+            p = ParseNumber(p, end, num_points);
+            p = ParseNumber(p, end, num_observations);
+            SAIGA_ASSERT(num_cameras >= 0 && num_points >= 0 && num_observations >= 0, "Invalid BAL header.");
+
+            cameras.resize(num_cameras);
+            points.resize(num_points);
+            observations.resize(num_observations);
+            num_params = int64_t(num_cameras) * 9 + int64_t(num_points) * 3;
+            params.resize(num_params);
+        }
+
+        // Observations: One observation per line. The lines are found sequentially and parsed in parallel.
+        if (observations_done < num_observations)
+        {
+            line_begin.clear();
+            int64_t remaining = num_observations - observations_done;
+            while ((int64_t)line_begin.size() < remaining)
+            {
+                while (p < end && IsSpace(*p)) ++p;
+                if (p == end) break;
+                line_begin.push_back(p);
+                auto line_end = (const char*)std::memchr(p, '\n', end - p);
+                p             = line_end ? line_end + 1 : end;
+            }
+
+            int n = line_begin.size();
+#pragma omp parallel for num_threads(num_threads)
+            for (int i = 0; i < n; ++i)
+            {
+                auto& o        = observations[observations_done + i];
+                const char* lp = line_begin[i];
+                lp             = ParseNumber(lp, end, o.camera_index);
+                lp             = ParseNumber(lp, end, o.point_index);
+                lp             = ParseNumber(lp, end, o.point[0]);
+                lp             = ParseNumber(lp, end, o.point[1]);
+            }
+            observations_done += n;
+        }
+
+        // Camera and point parameters: The remaining range is split at whitespace into one piece per thread.
+        if (observations_done == num_observations && p < end)
+        {
+            std::vector<const char*> piece(num_threads + 1, end);
+            piece[0] = p;
+            for (int t = 1; t < num_threads; ++t)
+            {
+                const char* q = std::max(piece[t - 1], p + (end - p) * t / num_threads);
+                while (q < end && !IsSpace(*q)) ++q;
+                piece[t] = q;
+            }
+
+#pragma omp parallel for num_threads(num_threads)
+            for (int t = 0; t < num_threads; ++t)
+            {
+                local_params[t].clear();
+                ParseNumbers(piece[t], piece[t + 1], local_params[t]);
+            }
+
+            for (auto& l : local_params)
+            {
+                SAIGA_ASSERT(params_done + (int64_t)l.size() <= num_params, "Too many values in BAL file.");
+                std::copy(l.begin(), l.end(), params.begin() + params_done);
+                params_done += l.size();
+            }
+            p = end;
+        }
+
+        block.erase(block.begin(), block.begin() + (p - block.data()));
     }
 
-    start += num_observations;
+    SAIGA_ASSERT(num_cameras >= 0, "Empty BAL file.");
+    SAIGA_ASSERT(observations_done == num_observations && params_done == num_params, "Truncated BAL file.");
+
 #pragma omp parallel for
     for (int i = 0; i < num_cameras; ++i)
     {
+        const double* c_params = params.data() + int64_t(i) * 9;
         BALCamera c;
-        Vec3 r;
-        Vec3 t;
-
-
-        r(0) = Saiga::to_double(data[start + i * 9 + 0]);
-        r(1) = Saiga::to_double(data[start + i * 9 + 1]);
-        r(2) = Saiga::to_double(data[start + i * 9 + 2]);
-
-        t(0) = Saiga::to_double(data[start + i * 9 + 3]);
-        t(1) = Saiga::to_double(data[start + i * 9 + 4]);
-        t(2) = Saiga::to_double(data[start + i * 9 + 5]);
-
-        c.f  = Saiga::to_double(data[start + i * 9 + 6]);
-        c.k1 = Saiga::to_double(data[start + i * 9 + 7]);
-        c.k2 = Saiga::to_double(data[start + i * 9 + 8]);
+        Vec3 r(c_params[0], c_params[1], c_params[2]);
+        Vec3 t(c_params[3], c_params[4], c_params[5]);
+        c.f  = c_params[6];
+        c.k1 = c_params[7];
+        c.k2 = c_params[8];
 
         auto angle           = r.norm();
         Eigen::Vector3d axis = angle > 0.00001 ? r / angle : Eigen::Vector3d(0, 1, 0);
@@ -74,21 +193,20 @@ BALDataset::BALDataset(const std::string& file)
         c.se3      = SE3((Quat)a, t);
         cameras[i] = (c);
     }
-    start += num_cameras * 9;
 
+    const double* p_params = params.data() + int64_t(num_cameras) * 9;
 #pragma omp parallel for
     for (int i = 0; i < num_points; ++i)
     {
-        BALPoint p;
-
-        p.point(0) = Saiga::to_double(data[start + i * 3 + 0]);
-        p.point(1) = Saiga::to_double(data[start + i * 3 + 1]);
-        p.point(2) = Saiga::to_double(data[start + i * 3 + 2]);
-
-
-        points[i] = (p);
+        points[i].point = Vec3(p_params[i * 3 + 0], p_params[i * 3 + 1], p_params[i * 3 + 2]);
     }
 
+    for (auto& o : observations)
+    {
+        SAIGA_ASSERT(o.camera_index >= 0 && o.camera_index < num_cameras && o.point_index >= 0 &&
+                         o.point_index < num_points,
+                     "Invalid index in BAL file.");
+    }
 
     undistortAll();
     std::cout << "> Done. num_cameras " << num_cameras << " num_points " << num_points << " num_observations "
@@ -167,32 +285,40 @@ double BALDataset::rms()
 
 Scene BALDataset::makeScene()
 {
-    SAIGA_EXIT_ERROR("not implemented after extrinsic change");
     Scene scene;
-    std::vector<double> fs;
-    for (BALCamera& c : cameras)
-    {
-        int id = scene.images.size();
+    scene.images.resize(cameras.size());
+    scene.intrinsics.resize(cameras.size());
+    scene.worldPoints.resize(points.size());
 
-        SceneImage si;
-        si.intr = id;
-        scene.images.push_back(si);
-        scene.intrinsics.push_back(c.intr());
-        fs.push_back(c.f);
+    // Number of observations per image
+    std::vector<int> image_offset(cameras.size() + 1, 0);
+    for (auto& o : observations)
+    {
+        image_offset[o.camera_index + 1]++;
     }
 
-    for (BALObservation& o : observations)
+#pragma omp parallel for
+    for (int i = 0; i < (int)cameras.size(); ++i)
     {
-        SAIGA_ASSERT(o.camera_index >= 0 && o.camera_index < (int)scene.images.size());
-        SceneImage& i = scene.images[o.camera_index];
-        i.stereoPoints.push_back(o.ip());
+        SceneImage& si = scene.images[i];
+        si.se3         = cameras[i].extr().first;
+        si.intr        = i;
+        si.stereoPoints.resize(image_offset[i + 1]);
+        scene.intrinsics[i] = cameras[i].intr();
     }
 
-    for (BALPoint& p : points)
+    // The observations are added in file order
+    std::fill(image_offset.begin(), image_offset.end(), 0);
+    for (auto& o : observations)
     {
-        scene.worldPoints.push_back(p.wp());
+        scene.images[o.camera_index].stereoPoints[image_offset[o.camera_index]++] = o.ip();
     }
 
+#pragma omp parallel for
+    for (int i = 0; i < (int)points.size(); ++i)
+    {
+        scene.worldPoints[i] = points[i].wp();
+    }
 
     // the datasets already have an reasonable scale
     scene.globalScale = 1;
@@ -29,6 +29,8 @@ namespace Saiga
  *
  * r(p) = 1.0 + k1 * ||p||^2 + k2 * ||p||^4.
  *
+ * The file can be plain text or compressed with gzip (.gz) or bzip2 (.bz2). It is read in blocks by a background
+ * thread and the blocks are parsed in parallel.
  */
 class SAIGA_VISION_API BALDataset
 {
@@ -117,7 +119,8 @@ class SAIGA_VISION_API BALDataset
         }
     };
 
-    BALDataset(const std::string& file);
+    // The file is read and parsed in blocks of 'block_size' bytes. Lines can span multiple blocks.
+    BALDataset(const std::string& file, size_t block_size = 32 * 1024 * 1024);
     void undistortAll();
     double rms();
 
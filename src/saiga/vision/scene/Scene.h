@@ -256,8 +256,19 @@ class SAIGA_VISION_API Scene
 
     // returns true if the scene was changed by a user action
     bool imgui();
+
+    // Text format. load() also detects and reads the binary format.
     void save(const std::string& file);
     void load(const std::string& file);
+
+    // Versioned binary format with contiguous arrays for the intrinsics, extrinsics, observations and world points.
+    // The file is memory mapped during loading and the arrays are copied directly to the scene. With 'compress' every
+    // section is zlib compressed (if this makes it smaller).
+    // The file is only valid on machines with the same endianness.
+    void saveBinary(const std::string& file, bool compress = false);
+
+    // Returns false if the file could not be opened or is not a valid binary scene file.
+    bool loadBinary(const std::string& file);
     double chi2Huber(double huber);
 };
 
@@ -5,15 +5,85 @@
  */
 
 #include "saiga/core/imgui/imgui.h"
+#include "saiga/core/util/MemoryMappedFile.h"
 #include "saiga/core/util/assert.h"
 #include "saiga/core/util/fileChecker.h"
+#include "saiga/core/util/zlib.h"
 #include "saiga/vision/util/Random.h"
 
 #include "Scene.h"
 
+#include <cstring>
 #include <fstream>
 namespace Saiga
 {
+/**
+ * Binary scene file.
+ *
+ * The header is followed by the sections. All offsets are in bytes relative to the start of the file and aligned to
+ * 64 bytes. A section is either stored raw or zlib compressed (see Saiga::compress). The raw sections are:
+ *
+ *   Intrinsics          double[5]  [num_intrinsics]   fx fy cx cy s
+ *   Extrinsics          double[14] [num_images]       se3 params, velocity params
+ *   ImageInfo           int32[2]   [num_images]       intr, constant
+ *   ObservationOffsets  int64      [num_images + 1]   Observations of image i: [offsets[i], offsets[i+1])
+ *   Observations        SceneFileObservation [num_observations]
+ *   WorldPoints         double[3]  [num_world_points]
+ */
+namespace
+{
+enum SceneFileSection
+{
+    Intrinsics = 0,
+    Extrinsics,
+    ImageInfo,
+    ObservationOffsets,
+    Observations,
+    WorldPoints,
+    NumSections,
+};
+
+struct SceneFileSectionInfo
+{
+    uint64_t offset      = 0;
+    uint64_t stored_size = 0;
+    uint64_t size        = 0;
+    int32_t compressed   = 0;
+    int32_t padding      = 0;
+};
+
+struct SceneFileHeader
+{
+    char magic[8]            = {};
+    int32_t version          = 0;
+    int32_t padding          = 0;
+    int64_t num_intrinsics   = 0;
+    int64_t num_images       = 0;
+    int64_t num_world_points = 0;
+    int64_t num_observations = 0;
+    double bf                = 1;
+    double global_scale      = 1;
+    SceneFileSectionInfo sections[NumSections];
+    uint64_t total_size = 0;
+};
+
+struct SceneFileObservation
+{
+    int32_t wp;
+    float weight;
+    double depth;
+    double point[2];
+};
+
+constexpr char kSceneFileMagic[9] = "SAIGASCN";
+constexpr int kSceneFileVersion   = 1;
+
+size_t Align64(size_t bytes)
+{
+    return (bytes + 63) / 64 * 64;
+}
+}  // namespace
+
 bool Scene::imgui()
 {
     ImGui::PushID(473441235);
@@ -135,6 +205,20 @@ void Scene::load(const std::string& file)
     std::ifstream strm(f);
     SAIGA_ASSERT(strm.is_open());
 
+    {
+        char magic[8] = {};
+        strm.read(magic, 8);
+        if (strm && std::memcmp(magic, kSceneFileMagic, 8) == 0)
+        {
+            strm.close();
+            bool loaded = loadBinary(file);
+            SAIGA_ASSERT(loaded);
+            return;
+        }
+        strm.clear();
+        strm.seekg(0);
+    }
+
 
     auto consumeComment = [&]() {
         while (true)
@@ -200,6 +284,262 @@ void Scene::load(const std::string& file)
 }
 
 
+void Scene::saveBinary(const std::string& file, bool compress)
+{
+    SAIGA_ASSERT(valid());
+    std::cout << "Saving binary scene to " << file << "." << std::endl;
+
+    SceneFileHeader h;
+    std::memcpy(h.magic, kSceneFileMagic, 8);
+    h.version          = kSceneFileVersion;
+    h.num_intrinsics   = intrinsics.size();
+    h.num_images       = images.size();
+    h.num_world_points = worldPoints.size();
+    h.bf               = bf;
+    h.global_scale     = globalScale;
+
+    std::vector<int64_t> offsets(images.size() + 1, 0);
+    for (int i = 0; i < (int)images.size(); ++i)
+    {
+        offsets[i + 1] = offsets[i] + images[i].stereoPoints.size();
+    }
+    h.num_observations = offsets.back();
+
+    std::vector<std::vector<char>> sections(NumSections);
+    sections[Intrinsics].resize(sizeof(double) * 5 * h.num_intrinsics);
+    sections[Extrinsics].resize(sizeof(double) * 14 * h.num_images);
+    sections[ImageInfo].resize(sizeof(int32_t) * 2 * h.num_images);
+    sections[ObservationOffsets].resize(sizeof(int64_t) * (h.num_images + 1));
+    sections[Observations].resize(sizeof(SceneFileObservation) * h.num_observations);
+    sections[WorldPoints].resize(sizeof(double) * 3 * h.num_world_points);
+
+    auto* intr_data = reinterpret_cast<double*>(sections[Intrinsics].data());
+    auto* extr_data = reinterpret_cast<double*>(sections[Extrinsics].data());
+    auto* info_data = reinterpret_cast<int32_t*>(sections[ImageInfo].data());
+    auto* obs_data  = reinterpret_cast<SceneFileObservation*>(sections[Observations].data());
+    auto* wp_data   = reinterpret_cast<double*>(sections[WorldPoints].data());
+
+    for (int i = 0; i < (int)intrinsics.size(); ++i)
+    {
+        Vec5 c = intrinsics[i].coeffs();
+        std::copy(c.data(), c.data() + 5, intr_data + 5 * i);
+    }
+    std::memcpy(sections[ObservationOffsets].data(), offsets.data(), sections[ObservationOffsets].size());
+
+#pragma omp parallel for schedule(dynamic, 16)
+    for (int i = 0; i < (int)images.size(); ++i)
+    {
+        auto& img = images[i];
+        std::copy(img.se3.data(), img.se3.data() + 7, extr_data + 14 * i);
+        std::copy(img.velocity.data(), img.velocity.data() + 7, extr_data + 14 * i + 7);
+        info_data[2 * i + 0] = img.intr;
+        info_data[2 * i + 1] = img.constant;
+        for (int j = 0; j < (int)img.stereoPoints.size(); ++j)
+        {
+            auto& ip = img.stereoPoints[j];
+            obs_data[offsets[i] + j] = {ip.wp, ip.weight, ip.depth, {ip.point.x(), ip.point.y()}};
+        }
+    }
+
+#pragma omp parallel for
+    for (int i = 0; i < (int)worldPoints.size(); ++i)
+    {
+        std::copy(worldPoints[i].p.data(), worldPoints[i].p.data() + 3, wp_data + 3 * i);
+    }
+
+    if (compress)
+    {
+#ifdef SAIGA_USE_ZLIB
+        for (int s = 0; s < NumSections; ++s)
+        {
+            h.sections[s].size = sections[s].size();
+            auto compressed    = Saiga::compress(sections[s].data(), sections[s].size());
+            if (compressed.size() < sections[s].size())
+            {
+                sections[s].assign(compressed.begin(), compressed.end());
+                h.sections[s].compressed = 1;
+            }
+        }
+#else
+        SAIGA_EXIT_ERROR("zlib not found.");
+#endif
+    }
+
+    size_t offset = Align64(sizeof(SceneFileHeader));
+    for (int s = 0; s < NumSections; ++s)
+    {
+        if (!h.sections[s].compressed) h.sections[s].size = sections[s].size();
+        h.sections[s].offset      = offset;
+        h.sections[s].stored_size = sections[s].size();
+        offset += Align64(sections[s].size());
+    }
+    h.total_size = offset;
+
+    std::ofstream strm(file, std::ios_base::out | std::ios_base::binary);
+    SAIGA_ASSERT(strm.is_open());
+    std::vector<char> zeros(64, 0);
+    strm.write(reinterpret_cast<const char*>(&h), sizeof(SceneFileHeader));
+    strm.write(zeros.data(), Align64(sizeof(SceneFileHeader)) - sizeof(SceneFileHeader));
+    for (int s = 0; s < NumSections; ++s)
+    {
+        strm.write(sections[s].data(), sections[s].size());
+        strm.write(zeros.data(), Align64(sections[s].size()) - sections[s].size());
+    }
+    SAIGA_ASSERT(strm.good());
+}
+
+bool Scene::loadBinary(const std::string& file)
+{
+    std::cout << "Loading binary scene from " << file << "." << std::endl;
+
+    (*this)       = Scene();
+    std::string f = SearchPathes::data(file);
+    if (f.empty())
+    {
+        std::cout << "could not find file " << file << std::endl;
+        return false;
+    }
+
+    MemoryMappedFile mapped(f);
+    if (!mapped.valid() || mapped.size() < sizeof(SceneFileHeader))
+    {
+        std::cout << "could not map file " << f << std::endl;
+        return false;
+    }
+
+    auto invalid = [&](const std::string& reason) {
+        std::cout << "Invalid binary scene file " << f << ": " << reason << std::endl;
+        (*this) = Scene();
+        return false;
+    };
+
+    SceneFileHeader h;
+    std::memcpy(&h, mapped.data(), sizeof(SceneFileHeader));
+
+    if (std::memcmp(h.magic, kSceneFileMagic, 8) != 0) return invalid("magic");
+    if (h.version != kSceneFileVersion) return invalid("version " + std::to_string(h.version));
+    if (h.total_size > mapped.size()) return invalid("truncated");
+
+    // Limits against overflows in the size computations below
+    constexpr int64_t max_count = int64_t(1) << 40;
+    for (int64_t count : {h.num_intrinsics, h.num_images, h.num_world_points, h.num_observations})
+    {
+        if (count < 0 || count > max_count) return invalid("count");
+    }
+    if (h.num_images >= std::numeric_limits<int>::max() || h.num_world_points >= std::numeric_limits<int>::max())
+    {
+        return invalid("count");
+    }
+
+    uint64_t expected_size[NumSections];
+    expected_size[Intrinsics]         = sizeof(double) * 5 * h.num_intrinsics;
+    expected_size[Extrinsics]         = sizeof(double) * 14 * h.num_images;
+    expected_size[ImageInfo]          = sizeof(int32_t) * 2 * h.num_images;
+    expected_size[ObservationOffsets] = sizeof(int64_t) * (h.num_images + 1);
+    expected_size[Observations]       = sizeof(SceneFileObservation) * h.num_observations;
+    expected_size[WorldPoints]        = sizeof(double) * 3 * h.num_world_points;
+
+    // Uncompressed sections are read directly from the mapped file
+    const char* section_data[NumSections];
+    std::vector<unsigned char> uncompressed[NumSections];
+    for (int s = 0; s < NumSections; ++s)
+    {
+        auto& info = h.sections[s];
+        if (info.offset % 64 != 0 || info.offset > h.total_size || info.stored_size > h.total_size - info.offset ||
+            info.size != expected_size[s])
+        {
+            return invalid("section " + std::to_string(s));
+        }
+
+        section_data[s] = mapped.data() + info.offset;
+        if (info.compressed == 1)
+        {
+#ifdef SAIGA_USE_ZLIB
+            // Header of Saiga::compress: magic, compressed size, uncompressed size
+            uint64_t zheader[3];
+            if (info.stored_size < sizeof(zheader)) return invalid("section " + std::to_string(s));
+
+            // Deflate can't compress more than ~1032:1. A larger size is a corrupted header, which would otherwise
+            // allocate an arbitrary amount of memory.
+            if (info.size / 1032 > info.stored_size) return invalid("compressed section " + std::to_string(s));
+            std::memcpy(zheader, section_data[s], sizeof(zheader));
+            if (zheader[2] != info.size || !uncompress(section_data[s], info.stored_size, uncompressed[s]))
+            {
+                return invalid("compressed section " + std::to_string(s));
+            }
+            section_data[s] = reinterpret_cast<const char*>(uncompressed[s].data());
+#else
+            return invalid("zlib not found");
+#endif
+        }
+        else if (info.compressed != 0 || info.stored_size != info.size)
+        {
+            return invalid("section " + std::to_string(s));
+        }
+    }
+
+    auto* intr_data = reinterpret_cast<const double*>(section_data[Intrinsics]);
+    auto* extr_data = reinterpret_cast<const double*>(section_data[Extrinsics]);
+    auto* info_data = reinterpret_cast<const int32_t*>(section_data[ImageInfo]);
+    auto* offsets   = reinterpret_cast<const int64_t*>(section_data[ObservationOffsets]);
+    auto* obs_data  = reinterpret_cast<const SceneFileObservation*>(section_data[Observations]);
+    auto* wp_data   = reinterpret_cast<const double*>(section_data[WorldPoints]);
+
+    if (offsets[0] != 0 || offsets[h.num_images] != h.num_observations) return invalid("observation offsets");
+    for (int64_t i = 0; i < h.num_images; ++i)
+    {
+        if (offsets[i + 1] < offsets[i]) return invalid("observation offsets");
+        if (info_data[2 * i] < 0 || info_data[2 * i] >= h.num_intrinsics) return invalid("image intrinsics");
+    }
+    for (int64_t i = 0; i < h.num_observations; ++i)
+    {
+        if (obs_data[i].wp < -1 || obs_data[i].wp >= h.num_world_points) return invalid("observation world point");
+    }
+
+    bf          = h.bf;
+    globalScale = h.global_scale;
+    intrinsics.resize(h.num_intrinsics);
+    images.resize(h.num_images);
+    worldPoints.resize(h.num_world_points);
+
+    for (int i = 0; i < (int)intrinsics.size(); ++i)
+    {
+        intrinsics[i] = Vec5(Eigen::Map<const Vec5>(intr_data + 5 * i));
+    }
+
+#pragma omp parallel for schedule(dynamic, 16)
+    for (int i = 0; i < (int)images.size(); ++i)
+    {
+        auto& img = images[i];
+        std::copy(extr_data + 14 * i, extr_data + 14 * i + 7, img.se3.data());
+        std::copy(extr_data + 14 * i + 7, extr_data + 14 * i + 14, img.velocity.data());
+        img.intr     = info_data[2 * i + 0];
+        img.constant = info_data[2 * i + 1];
+
+        img.stereoPoints.resize(offsets[i + 1] - offsets[i]);
+        for (int j = 0; j < (int)img.stereoPoints.size(); ++j)
+        {
+            auto& o      = obs_data[offsets[i] + j];
+            auto& ip     = img.stereoPoints[j];
+            ip.wp        = o.wp;
+            ip.weight    = o.weight;
+            ip.depth     = o.depth;
+            ip.point     = Vec2(o.point[0], o.point[1]);
+        }
+    }
+
+#pragma omp parallel for
+    for (int i = 0; i < (int)worldPoints.size(); ++i)
+    {
+        worldPoints[i].p = Vec3(wp_data[3 * i + 0], wp_data[3 * i + 1], wp_data[3 * i + 2]);
+    }
+
+    fixWorldPointReferences();
+    if (!valid()) return invalid("scene");
+    return true;
+}
+
+
 std::ostream& operator<<(std::ostream& strm, Scene& scene)
 {
     strm << "[Scene]" << std::endl;
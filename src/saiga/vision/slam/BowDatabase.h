@@ -0,0 +1,285 @@
+/**
+ * Copyright (c) 2021 Darius Rückert
+ * Licensed under the MIT License.
+ * See LICENSE file for more information.
+ *
+ * Inverted file database for the MiniBow2 vocabulary. Based on the idea of TemplatedDatabase of DBoW2.
+ */
+#pragma once
+
+#include "saiga/core/util/DataStructures/ArrayView.h"
+#include "saiga/vision/slam/MiniBow2.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace MiniBow2
+{
+/**
+ * A database of bow vectors with one inverted posting list per word.
+ *
+ * A query only touches the posting lists of the words in the query vector. The L1-score of the vocabulary
+ *      score(a, b) = -0.5 * sum_{w in a and b} ( |a_w - b_w| - |a_w| - |b_w| )
+ * has only contributions from shared words, therefore the result is identical to a linear search with
+ * FeatureVector::score.
+ *
+ * Entries are identified by a user defined non-negative id (for example the keyframe id). The ids should be
+ * reasonably dense because they are used as an index into an array.
+ * Entries can be added and removed in any order. Removing an entry costs O(number of words of the entry).
+ *
+ * Optionally, the FeatureVector of each entry is stored as well (direct index). It can be used for guided matching
+ * between a query and a database entry.
+ *
+ * The query functions are const and can be called from multiple threads in parallel.
+ */
+class BowDatabase
+{
+   public:
+    using EntryId = int;
+
+    struct QueryResult
+    {
+        EntryId id;
+        WordValue score;
+    };
+
+    BowDatabase(int num_words = 0, bool use_direct_index = false)
+        : use_direct_index(use_direct_index), inverted_file(num_words)
+    {
+    }
+
+    template <typename Descriptor>
+    BowDatabase(const TemplatedVocabulary<Descriptor>& voc, bool use_direct_index = false)
+        : BowDatabase(voc.size(), use_direct_index)
+    {
+    }
+
+    void clear()
+    {
+        for (auto& list : inverted_file) list.clear();
+        entries.clear();
+        free_slots.clear();
+        id_to_slot.clear();
+        num_entries = 0;
+    }
+
+    int size() const { return num_entries; }
+    bool usesDirectIndex() const { return use_direct_index; }
+
+    bool contains(EntryId id) const { return id >= 0 && id < (int)id_to_slot.size() && id_to_slot[id] >= 0; }
+
+    /**
+     * Adds a new entry to the database. If an entry with this id already exists it is replaced.
+     * The feature vector is only stored if the direct index is enabled.
+     */
+    void add(EntryId id, const BowVector& v, const FeatureVector& fv = FeatureVector())
+    {
+        SAIGA_ASSERT(id >= 0);
+        if (contains(id)) remove(id);
+
+        int slot;
+        if (free_slots.empty())
+        {
+            slot = entries.size();
+            entries.emplace_back();
+        }
+        else
+        {
+            slot = free_slots.back();
+            free_slots.pop_back();
+        }
+
+        if (id >= (int)id_to_slot.size()) id_to_slot.resize(id + 1, -1);
+        id_to_slot[id] = slot;
+
+        auto& e = entries[slot];
+        e.id    = id;
+        e.valid = true;
+        e.bow   = v;
+        if (use_direct_index) e.features = fv;
+
+        e.positions.resize(v.size());
+        for (int i = 0; i < (int)v.size(); ++i)
+        {
+            WordId wid = v[i].first;
+            if (wid >= (int)inverted_file.size()) inverted_file.resize(wid + 1);
+            auto& list     = inverted_file[wid];
+            e.positions[i] = list.size();
+            list.push_back({slot, i, v[i].second});
+        }
+        num_entries++;
+    }
+
+    // Removes the entry from all posting lists. The order inside the posting lists is not preserved.
+    void remove(EntryId id)
+    {
+        if (!contains(id)) return;
+        int slot = id_to_slot[id];
+        auto& e  = entries[slot];
+
+        for (int i = 0; i < (int)e.bow.size(); ++i)
+        {
+            auto& list = inverted_file[e.bow[i].first];
+            int pos    = e.positions[i];
+
+            // Move the last element into the gap
+            auto last = list.back();
+            list.pop_back();
+            if (pos < (int)list.size())
+            {
+                list[pos]                                         = last;
+                entries[last.slot].positions[last.index_in_entry] = pos;
+            }
+        }
+
+        e.valid = false;
+        e.bow.clear();
+        e.features.clear();
+        e.positions.clear();
+        id_to_slot[id] = -1;
+        free_slots.push_back(slot);
+        num_entries--;
+    }
+
+    const BowVector& bowVector(EntryId id) const
+    {
+        SAIGA_ASSERT(contains(id));
+        return entries[id_to_slot[id]].bow;
+    }
+
+    // The feature vector of the entry. Requires the direct index.
+    const FeatureVector& featureVector(EntryId id) const
+    {
+        SAIGA_ASSERT(use_direct_index && contains(id));
+        return entries[id_to_slot[id]].features;
+    }
+
+    // Number of entries which contain this word.
+    int numEntriesWithWord(WordId wid) const
+    {
+        return wid < (int)inverted_file.size() ? (int)inverted_file[wid].size() : 0;
+    }
+
+    /**
+     * Returns the k entries with the highest score, sorted by descending score. Ties are resolved by the smaller id.
+     * Entries with a score below min_score and the entry 'ignore_id' (for example the query keyframe itself) are
+     * skipped. Only entries which share at least one word with the query are returned.
+     */
+    void query(const BowVector& v, int k, std::vector<QueryResult>& results, WordValue min_score = 0,
+               EntryId ignore_id = -1) const
+    {
+        QueryBuffer buffer;
+        query(v, k, results, min_score, ignore_id, buffer);
+    }
+
+    /**
+     * Runs multiple queries in parallel.
+     * results[i] is the result of queries[i]. ignore_ids is optional and must have the same size as queries.
+     */
+    void query(Saiga::ArrayView<const BowVector> queries, int k, std::vector<std::vector<QueryResult>>& results,
+               WordValue min_score = 0, Saiga::ArrayView<const EntryId> ignore_ids = {}, int num_threads = 1) const
+    {
+        SAIGA_ASSERT(ignore_ids.empty() || ignore_ids.size() == queries.size());
+        results.resize(queries.size());
+
+#pragma omp parallel num_threads(num_threads)
+        {
+            QueryBuffer buffer;
+#pragma omp for schedule(dynamic)
+            for (int i = 0; i < (int)queries.size(); ++i)
+            {
+                query(queries[i], k, results[i], min_score, ignore_ids.empty() ? -1 : ignore_ids[i], buffer);
+            }
+        }
+    }
+
+   private:
+    struct Posting
+    {
+        int slot;
+        // Position of this word in the bow vector of the entry
+        int index_in_entry;
+        WordValue value;
+    };
+
+    struct Entry
+    {
+        EntryId id = -1;
+        bool valid = false;
+        BowVector bow;
+        FeatureVector features;
+        // Position in the posting list of each word of 'bow'
+        std::vector<int> positions;
+    };
+
+    bool use_direct_index;
+    int num_entries = 0;
+
+    std::vector<std::vector<Posting>> inverted_file;
+    std::vector<Entry> entries;
+    std::vector<int> free_slots;
+    std::vector<int> id_to_slot;
+
+    // Per slot score accumulator of one query. The buffer is reset after each query so it can be reused by the
+    // next query of the same thread.
+    struct QueryBuffer
+    {
+        std::vector<WordValue> accumulator;
+        std::vector<char> is_touched;
+        std::vector<int> touched;
+    };
+
+    void query(const BowVector& v, int k, std::vector<QueryResult>& results, WordValue min_score, EntryId ignore_id,
+               QueryBuffer& buffer) const
+    {
+        results.clear();
+        if (k <= 0) return;
+
+        auto& accumulator = buffer.accumulator;
+        auto& is_touched  = buffer.is_touched;
+        auto& touched     = buffer.touched;
+        accumulator.resize(entries.size(), 0);
+        is_touched.resize(entries.size(), 0);
+        touched.clear();
+
+        for (auto& [wid, qvalue] : v)
+        {
+            if (wid >= (int)inverted_file.size()) continue;
+            for (auto& p : inverted_file[wid])
+            {
+                if (!is_touched[p.slot])
+                {
+                    is_touched[p.slot] = 1;
+                    touched.push_back(p.slot);
+                }
+                // Same as FeatureVector::score
+                accumulator[p.slot] += std::abs(qvalue - p.value) - std::abs(qvalue) - std::abs(p.value);
+            }
+        }
+
+        for (int slot : touched)
+        {
+            WordValue score   = accumulator[slot] * WordValue(-0.5);
+            accumulator[slot] = 0;
+            is_touched[slot]  = 0;
+            EntryId id        = entries[slot].id;
+            if (id == ignore_id || score < min_score) continue;
+            results.push_back({id, score});
+        }
+
+        auto compare = [](const QueryResult& a, const QueryResult& b) {
+            return a.score > b.score || (a.score == b.score && a.id < b.id);
+        };
+        if ((int)results.size() > k)
+        {
+            std::partial_sort(results.begin(), results.begin() + k, results.end(), compare);
+            results.resize(k);
+        }
+        else
+        {
+            std::sort(results.begin(), results.end(), compare);
+        }
+    }
+};
+
+}  // namespace MiniBow2
@@ -8,6 +8,7 @@
  *  - Removed support for non-ORB feature descriptors
  *  - Optimized loading, saving, matching
  *  - Removed dependency to opencv
+ *  - Flat tree layout for transform and a memory mappable file format
  *
  * Original License: BSD-like
  *          https://github.com/dorian3d/DBoW2/blob/master/LICENSE.txt
@@ -18,18 +19,26 @@
 #pragma once
 
 #include "saiga/core/time/all.h"
+#include "saiga/core/util/Align.h"
 #include "saiga/core/util/BinaryFile.h"
+#include "saiga/core/util/MemoryMappedFile.h"
 #include "saiga/vision/features/Features.h"
+#include "saiga/vision/features/HammingMatcher.h"
 
 #include <algorithm>
 #include <array>
 #include <cassert>
 #include <cmath>
 #include <cstdlib>
+#include <cstring>
+#include <chrono>
 #include <fstream>
+#include <functional>
 #include <iostream>
 #include <map>
+#include <memory>
 #include <numeric>
+#include <random>
 #include <string>
 #include <vector>
 
@@ -171,6 +180,114 @@ class FeatureVector : public std::vector<std::pair<NodeId, std::vector<int>>>
 
 
 
+struct VocabularyTrainingProgress
+{
+    /// Current level of the tree (1..L). The final weighting pass is level L+1.
+    int level;
+    /// Descriptors clustered (or transformed in the weighting pass) in this level so far
+    size_t descriptors;
+    /// Time since the start of the training
+    double seconds;
+    /// Throughput of the current level
+    double descriptors_per_second;
+};
+
+struct VocabularyTrainingOptions
+{
+    int num_threads = 1;
+
+    /// Maximum number of k-means iterations per node. 0 iterates until the assignment does not change.
+    int max_iterations = 0;
+
+    /// If > 0, nodes with more descriptors use mini-batch k-means with batches of this size. The centers are the
+    /// majority vote of all descriptors assigned so far (Sculley, "Web-Scale K-Means Clustering").
+    int mini_batch_size = 0;
+
+    /// Streaming training only: the descriptors of each node are a random sample (reservoir sampling) of at most this
+    /// size. 0 keeps all descriptors of a node in memory.
+    int max_samples_per_node = 0;
+
+    /// The result only depends on the seed and not on the number of threads.
+    /// If 0, the seed is drawn from rand().
+    uint64_t seed = 0;
+
+    /// Called at least once per level and otherwise at most every 'progress_interval' seconds.
+    std::function<void(const VocabularyTrainingProgress&)> progress;
+    double progress_interval = 1;
+};
+
+/**
+ * Per bit counts of a set of ORB descriptors for the k-means training.
+ * The mean is the majority vote of each bit (same as MeanMatcher).
+ */
+struct DescriptorBitCounts
+{
+    std::array<int, 256> counts;
+    int n;
+
+    DescriptorBitCounts() { clear(); }
+
+    void clear()
+    {
+        counts.fill(0);
+        n = 0;
+    }
+
+    void add(const Descriptor& d)
+    {
+        for (int w = 0; w < 4; ++w)
+        {
+            for (int b = 0; b < 64; ++b) counts[w * 64 + b] += (d[w] >> b) & 1;
+        }
+        n++;
+    }
+
+    void add(const DescriptorBitCounts& other)
+    {
+        for (int i = 0; i < 256; ++i) counts[i] += other.counts[i];
+        n += other.n;
+    }
+
+    Descriptor mean() const
+    {
+        Descriptor d;
+        d.fill(0);
+        const int half = n / 2 + n % 2;
+        for (int w = 0; w < 4; ++w)
+        {
+            for (int b = 0; b < 64; ++b)
+            {
+                if (n > 0 && counts[w * 64 + b] >= half) d[w] |= uint64_t(1) << b;
+            }
+        }
+        return d;
+    }
+};
+
+// Combines a seed with a value (splitmix64), used to get an independent random generator for each tree node.
+inline uint64_t mixSeed(uint64_t seed, uint64_t value)
+{
+    uint64_t z = seed + 0x9E3779B97F4A7C15ull * (value + 1);
+    z          = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z          = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+/**
+ * Vocabulary tree of ORB descriptors.
+ *
+ * After training or loading, the tree is stored in a flat, pointer free layout (see FlatHeader). The children of a
+ * node are one block with the descriptors in SoA layout, so that the distances of a feature to all children are
+ * computed by one SIMD kernel (HammingDistances). The blocks are sorted breadth first, therefore the upper levels,
+ * which are visited by every feature, are close together in memory.
+ *
+ * The tree is trained level by level with hierarchical k-means. All nodes of a level are independent: the few large
+ * nodes of the upper levels are clustered with parallel loops, the many small nodes of the lower levels are
+ * distributed to the threads.
+ *
+ * The flat layout is also the file format of saveFlat. Such files are memory mapped by loadRaw, which makes loading
+ * even large vocabularies almost instant.
+ */
 template <class Descriptor>
 class TemplatedVocabulary
 {
@@ -191,12 +308,27 @@ class TemplatedVocabulary
      */
     TemplatedVocabulary(const std::string& filename) { loadRaw(filename); }
 
+    /**
+     * Calls the given function once for each training image.
+     */
+    using TrainingSource = std::function<void(const std::function<void(const std::vector<Descriptor>&)>&)>;
+
     /**
      * Creates a vocabulary from the training features with the already
      * defined parameters
      * @param training_features
      */
-    void create(const std::vector<std::vector<Descriptor>>& training_features);
+    void create(const std::vector<std::vector<Descriptor>>& training_features,
+                const VocabularyTrainingOptions& options = VocabularyTrainingOptions());
+
+    /**
+     * Creates a vocabulary from a stream of training images, which is never kept in memory as a whole.
+     * The tree is built level by level with one pass over the stream per level and a final pass for the weights. The
+     * source is therefore called L+1 times and must return the same images in the same order every time.
+     *
+     * With max_samples_per_node = 0 the result is identical to the in-memory create().
+     */
+    void create(const TrainingSource& source, const VocabularyTrainingOptions& options = VocabularyTrainingOptions());
 
     /**
      * Creates a vocabulary from the training features, setting the branching
@@ -216,13 +348,13 @@ class TemplatedVocabulary
      * Returns the number of words in the vocabulary
      * @return number of words
      */
-    inline unsigned int size() const { return m_words.size(); }
+    inline unsigned int size() const { return flat.num_words; }
 
     /**
      * Returns whether the vocabulary is empty (i.e. it has not been trained)
      * @return true iff the vocabulary is empty
      */
-    inline bool empty() const { return m_words.empty(); }
+    inline bool empty() const { return flat.num_words == 0; }
 
     /**
      * Transforms a set of descriptores into a bow vector
@@ -291,24 +423,72 @@ class TemplatedVocabulary
      * @param wid word id
      * @return descriptor
      */
-    inline Descriptor getWord(WordId wid) const { return m_words[wid]->descriptor; }
+    Descriptor getWord(WordId wid) const;
 
     /**
      * Returns the weight of a word
      * @param wid word id
      * @return weight
      */
-    inline WordValue getWordWeight(WordId wid) const { return m_words[wid]->weight; }
+    inline WordValue getWordWeight(WordId wid) const { return flatArray<float>(flat.node_weight)[wordNode(wid)]; }
 
     /**
-     * Changes the scoring method
-     * @param type new scoring type
+     * Loads a vocabulary saved by saveRaw or saveFlat.
+     * Files in the flat format are memory mapped instead of read.
      */
+    void loadRaw(const std::string& file);
+    void saveRaw(const std::string& file) const;
 
+    /**
+     * Saves the vocabulary in the flat binary format.
+     * The file is only valid on machines with the same endianness.
+     */
+    void saveFlat(const std::string& file) const;
 
+    /**
+     * Header of the flat tree layout. All offsets are in bytes relative to the start of the header and aligned to
+     * 64 bytes. The arrays are:
+     *
+     *   node_parent        int32   [num_nodes]             Parent node (0 for the root)
+     *   node_word          int32   [num_nodes]             Word id if the node is a leaf
+     *   node_block         int32   [num_nodes]             Block of the children or -1 if the node is a leaf
+     *   node_weight        float   [num_nodes]             Weight if the node is a word
+     *   word_node          int32   [num_words]             Node of each word
+     *   block_children     int32   [num_blocks * kpad]     Child nodes, padded with -1
+     *   block_num_children int32   [num_blocks]
+     *   block_words        uint64  [num_blocks * 4 * kpad] Child descriptors in SoA layout, padded with 0
+     *
+     * kpad is the branching factor rounded up to a multiple of 8, so that the distance kernels never need a scalar
+     * remainder loop.
+     */
+    struct FlatHeader
+    {
+        char magic[8]      = {};
+        int32_t version    = 0;
+        int32_t k          = 0;
+        int32_t L          = 0;
+        int32_t kpad       = 0;
+        int32_t num_nodes  = 0;
+        int32_t num_words  = 0;
+        int32_t num_blocks = 0;
+        int32_t padding    = 0;
+
+        uint64_t node_parent        = 0;
+        uint64_t node_word          = 0;
+        uint64_t node_block         = 0;
+        uint64_t node_weight        = 0;
+        uint64_t word_node          = 0;
+        uint64_t block_children     = 0;
+        uint64_t block_num_children = 0;
+        uint64_t block_words        = 0;
+        uint64_t total_size         = 0;
+    };
+    static constexpr char kFlatMagic[9] = "MBOW2FLT";
+    static constexpr int kFlatVersion   = 1;
+    static constexpr int kMaxBranching  = 64;
 
-    void saveRaw(const std::string& file) const;
-    void loadRaw(const std::string& file);
+    /// Iteration limit of mini-batch k-means if VocabularyTrainingOptions::max_iterations is 0.
+    static constexpr int kMaxMiniBatchIterations = 100;
 
 
 
@@ -372,23 +552,61 @@ class TemplatedVocabulary
 
 
     /**
-     * Creates a level in the tree, under the parent, by running kmeans with
-     * a descriptor set, and recursively creates the subsequent levels too
-     * @param parent_id id of parent node
-     * @param descriptors descriptors to run the kmeans on
-     * @param current_level current level in the tree
+     * Counts the processed descriptors of the current level and calls the progress callback of the options.
+     */
+    struct ProgressReporter
+    {
+        using Clock = std::chrono::steady_clock;
+
+        const VocabularyTrainingOptions* options;
+        Clock::time_point start, level_start, last_report;
+        int level          = 0;
+        size_t descriptors = 0;
+
+        ProgressReporter(const VocabularyTrainingOptions& options) : options(&options), start(Clock::now()) {}
+
+        void beginLevel(int l)
+        {
+            level       = l;
+            descriptors = 0;
+            level_start = last_report = Clock::now();
+        }
+
+        // Reports the progress if the interval has passed or 'force' is set.
+        void add(size_t n, bool force = false)
+        {
+            descriptors += n;
+            if (!options->progress) return;
+
+            auto now = Clock::now();
+            if (!force && std::chrono::duration<double>(now - last_report).count() < options->progress_interval) return;
+            last_report = now;
+
+            double level_seconds = std::chrono::duration<double>(now - level_start).count();
+            VocabularyTrainingProgress p;
+            p.level                  = level;
+            p.descriptors            = descriptors;
+            p.seconds                = std::chrono::duration<double>(now - start).count();
+            p.descriptors_per_second = level_seconds > 0 ? descriptors / level_seconds : 0;
+            options->progress(p);
+        }
+    };
+
+    /**
+     * Runs k-means on the descriptors of each frontier node and appends the resulting clusters as children.
+     * assignments[i][j] is the child index of descriptor j of frontier node i.
      */
-    void HKmeansStep(NodeId parent_id, const std::vector<pDescriptor>& descriptors, int current_level);
+    void clusterLevel(const std::vector<NodeId>& frontier_nodes, const std::vector<std::vector<pDescriptor>>& frontier,
+                      const VocabularyTrainingOptions& options, uint64_t seed, ProgressReporter& progress,
+                      std::vector<std::vector<int>>& assignments);
 
     /**
-     * Creates k clusters from the given descriptors with some seeding algorithm.
-     * @note In this class, kmeans++ is used, but this function should be
-     *   overriden by inherited classes.
+     * k-means with kmeans++ seeding. 'assignment' is the cluster index of each descriptor.
+     * The result is independent of num_threads.
      */
-    void initiateClusters(const std::vector<pDescriptor>& descriptors, std::vector<Descriptor>& clusters) const
-    {
-        initiateClustersKMpp(descriptors, clusters);
-    }
+    void kmeans(const std::vector<pDescriptor>& descriptors, uint64_t seed, int num_threads,
+                const VocabularyTrainingOptions& options, std::vector<Descriptor>& clusters,
+                std::vector<int>& assignment) const;
 
     /**
      * Creates k clusters from the given descriptor sets by running the
@@ -396,7 +614,13 @@ class TemplatedVocabulary
      * @param descriptors
      * @param clusters resulting clusters
      */
-    void initiateClustersKMpp(const std::vector<pDescriptor>& descriptors, std::vector<Descriptor>& clusters) const;
+    void initiateClustersKMpp(const std::vector<pDescriptor>& descriptors, std::mt19937_64& gen, int num_threads,
+                              std::vector<Descriptor>& clusters) const;
+
+    /**
+     * Propagates a descriptor down the tree under construction (m_nodes) until a leaf.
+     */
+    NodeId descendTrainingTree(const Descriptor& feature) const;
 
     /**
      * Create the words of the vocabulary once the tree has been built
@@ -405,36 +629,32 @@ class TemplatedVocabulary
 
     /**
      * Sets the weights of the nodes of tree according to the given features.
-     * Before calling this function, the nodes and the words must be already
-     * created (by calling HKmeansStep and createWords)
-     * @param features
+     * Before calling this function, the tree must be compiled.
+     * @param source
      */
-    void setNodeWeights(const std::vector<std::vector<Descriptor>>& features);
+    void setNodeWeights(const TrainingSource& source, int num_threads, ProgressReporter& progress);
 
     /**
-     * Returns a random number in the range [min..max]
-     * @param min
-     * @param max
-     * @return random T number in [min..max]
+     * Builds the flat layout from m_nodes and m_words. Afterwards, all read-only functions (transform, getWord, ...)
+     * use only the flat layout.
      */
-    template <class T>
-    static T RandomValue(T min, T max)
-    {
-        return ((T)rand() / (T)RAND_MAX) * (max - min) + min;
-    }
+    void compile();
 
     /**
-     * Returns a random int in the range [min..max]
-     * @param min
-     * @param max
-     * @return random int in [min..max]
+     * Sets 'flat' from the header at the beginning of 'data' and validates all offsets.
      */
-    static int RandomInt(int min, int max)
+    void parseFlat(const char* data, size_t size);
+
+    const char* flatData() const { return flat_file ? flat_file->data() : flat_buffer.data(); }
+
+    template <typename T>
+    const T* flatArray(uint64_t offset) const
     {
-        int d = max - min + 1;
-        return int(((double)rand() / ((double)RAND_MAX + 1.0)) * d) + min;
+        return reinterpret_cast<const T*>(flatData() + offset);
     }
 
+    NodeId wordNode(WordId wid) const { return flatArray<int32_t>(flat.word_node)[wid]; }
+
    protected:
     /// Branching factor
     int m_k;
@@ -447,8 +667,14 @@ class TemplatedVocabulary
 
     /// Words of the vocabulary (tree leaves)
     /// this condition holds: m_words[wid]->word_id == wid
+    /// m_nodes and m_words are only used during training. They are empty after create() and loadRaw().
     std::vector<Node*> m_words;
 
+    /// The flat tree layout. The data is either owned by flat_buffer or a memory mapped file.
+    FlatHeader flat;
+    Saiga::AlignedVector<char, 64> flat_buffer;
+    std::shared_ptr<Saiga::MemoryMappedFile> flat_file;
+
 
     mutable std::vector<std::pair<WordId, WordValue>> tmp_bow_data;
     mutable std::vector<std::pair<NodeId, int>> tmp_feature_data;
@@ -458,32 +684,166 @@ class TemplatedVocabulary
 // --------------------------------------------------------------------------
 
 template <class Descriptor>
-void TemplatedVocabulary<Descriptor>::create(const std::vector<std::vector<Descriptor>>& training_features)
+void TemplatedVocabulary<Descriptor>::create(const std::vector<std::vector<Descriptor>>& training_features,
+                                             const VocabularyTrainingOptions& options)
 {
+    SAIGA_ASSERT(options.num_threads > 0);
+    const uint64_t seed = options.seed != 0 ? options.seed : uint64_t(rand());
+    ProgressReporter progress(options);
+
     m_nodes.clear();
     m_words.clear();
 
-    // expected_nodes = Sum_{i=0..L} ( k^i )
-    int expected_nodes = (int)((std::pow((double)m_k, (double)m_L + 1) - 1) / (m_k - 1));
+    // create root
+    m_nodes.push_back(Node(0));
 
-    m_nodes.reserve(expected_nodes);  // avoid allocations when creating the tree
+    // The leaves which are clustered in the current level and their descriptors
+    std::vector<NodeId> frontier_nodes = {0};
+    std::vector<std::vector<pDescriptor>> frontier(1);
+    getFeatures(training_features, frontier[0]);
 
+    std::vector<std::vector<int>> assignments;
+    for (int level = 1; level <= m_L && !frontier.empty(); ++level)
+    {
+        progress.beginLevel(level);
+        clusterLevel(frontier_nodes, frontier, options, seed, progress, assignments);
+        if (level == m_L) break;
+
+        // Children with more than one descriptor are clustered in the next level
+        std::vector<NodeId> next_nodes;
+        std::vector<std::vector<pDescriptor>> next;
+        for (size_t i = 0; i < frontier.size(); ++i)
+        {
+            const std::vector<NodeId>& children_ids = m_nodes[frontier_nodes[i]].children;
 
-    std::vector<pDescriptor> features;
-    getFeatures(training_features, features);
+            std::vector<std::vector<pDescriptor>> groups(children_ids.size());
+            for (size_t j = 0; j < frontier[i].size(); ++j)
+            {
+                groups[assignments[i][j]].push_back(frontier[i][j]);
+            }
+
+            for (size_t c = 0; c < children_ids.size(); ++c)
+            {
+                if (groups[c].size() > 1)
+                {
+                    next_nodes.push_back(children_ids[c]);
+                    next.push_back(std::move(groups[c]));
+                }
+            }
+        }
+        frontier_nodes = std::move(next_nodes);
+        frontier       = std::move(next);
+    }
+    frontier.clear();
+    assignments.clear();
+
+    // create the words
+    createWords();
+
+    // and set the weight of each node of the tree
+    compile();
+    TrainingSource source = [&](const std::function<void(const std::vector<Descriptor>&)>& f) {
+        for (auto& image : training_features) f(image);
+    };
+    setNodeWeights(source, options.num_threads, progress);
+    compile();
+
+    m_nodes.clear();
+    m_words.clear();
+}
+
+// --------------------------------------------------------------------------
+
+template <class Descriptor>
+void TemplatedVocabulary<Descriptor>::create(const TrainingSource& source, const VocabularyTrainingOptions& options)
+{
+    SAIGA_ASSERT(options.num_threads > 0);
+    SAIGA_ASSERT(options.max_samples_per_node >= 0);
+    const uint64_t seed = options.seed != 0 ? options.seed : uint64_t(rand());
+    ProgressReporter progress(options);
 
+    m_nodes.clear();
+    m_words.clear();
 
     // create root
-    m_nodes.push_back(Node(0));  // root
+    m_nodes.push_back(Node(0));
 
-    // create the tree
-    HKmeansStep(0, features, 1);
+    std::vector<NodeId> frontier_nodes = {0};
+    std::vector<std::vector<int>> assignments;
+
+    for (int level = 1; level <= m_L && !frontier_nodes.empty(); ++level)
+    {
+        progress.beginLevel(level);
+
+        // 1. One pass over the stream: each descriptor is propagated down the current tree. If it ends in a frontier
+        // node, it is added to the sample of this node.
+        std::vector<int> frontier_index(m_nodes.size(), -1);
+        for (size_t i = 0; i < frontier_nodes.size(); ++i) frontier_index[frontier_nodes[i]] = i;
+
+        std::vector<std::vector<Descriptor>> samples(frontier_nodes.size());
+        std::vector<size_t> seen(frontier_nodes.size(), 0);
+        std::mt19937_64 gen(mixSeed(~seed, level));
+        std::vector<NodeId> leaves;
+
+        source([&](const std::vector<Descriptor>& image) {
+            const int N = image.size();
+            leaves.resize(N);
+#pragma omp parallel for num_threads(options.num_threads)
+            for (int i = 0; i < N; ++i)
+            {
+                leaves[i] = descendTrainingTree(image[i]);
+            }
+
+            for (int i = 0; i < N; ++i)
+            {
+                int f = frontier_index[leaves[i]];
+                if (f < 0) continue;
+
+                auto& sample = samples[f];
+                size_t count = ++seen[f];
+                if (options.max_samples_per_node == 0 || (int)sample.size() < options.max_samples_per_node)
+                {
+                    sample.push_back(image[i]);
+                }
+                else
+                {
+                    // Reservoir sampling
+                    size_t r = std::uniform_int_distribution<size_t>(0, count - 1)(gen);
+                    if (r < sample.size()) sample[r] = image[i];
+                }
+            }
+        });
+
+        // 2. Cluster the samples. Same as in the in-memory create(), nodes with less than 2 descriptors stay leaves.
+        std::vector<NodeId> nodes;
+        std::vector<std::vector<pDescriptor>> frontier;
+        for (size_t i = 0; i < frontier_nodes.size(); ++i)
+        {
+            if (samples[i].size() <= 1) continue;
+            nodes.push_back(frontier_nodes[i]);
+            frontier.emplace_back();
+            for (auto& d : samples[i]) frontier.back().push_back(&d);
+        }
+        clusterLevel(nodes, frontier, options, seed, progress, assignments);
+
+        frontier_nodes.clear();
+        if (level < m_L)
+        {
+            for (NodeId id : nodes)
+            {
+                for (NodeId child : m_nodes[id].children) frontier_nodes.push_back(child);
+            }
+        }
+    }
+    assignments.clear();
 
-    // create the words
     createWords();
+    compile();
+    setNodeWeights(source, options.num_threads, progress);
+    compile();
 
-    // and set the weight of each node of the tree
-    setNodeWeights(training_features);
+    m_nodes.clear();
+    m_words.clear();
 }
 
 // --------------------------------------------------------------------------
@@ -509,189 +869,158 @@ void TemplatedVocabulary<Descriptor>::getFeatures(const std::vector<std::vector<
 // --------------------------------------------------------------------------
 
 template <class Descriptor>
-void TemplatedVocabulary<Descriptor>::HKmeansStep(NodeId parent_id, const std::vector<pDescriptor>& descriptors,
-                                                  int current_level)
+void TemplatedVocabulary<Descriptor>::clusterLevel(const std::vector<NodeId>& frontier_nodes,
+                                                   const std::vector<std::vector<pDescriptor>>& frontier,
+                                                   const VocabularyTrainingOptions& options, uint64_t seed,
+                                                   ProgressReporter& progress,
+                                                   std::vector<std::vector<int>>& assignments)
 {
-    if (descriptors.empty()) return;
-
-    // features associated to each cluster
-    std::vector<Descriptor> clusters;
-    std::vector<std::vector<unsigned int>> groups;  // groups[i] = [j1, j2, ...]
-                                                    // j1, j2, ... indices of descriptors associated to cluster i
-
-    clusters.reserve(m_k);
-    groups.reserve(m_k);
-
-    // const int msizes[] = { m_k, descriptors.size() };
-    // cv::SparseMat assoc(2, msizes, CV_8U);
-    // cv::SparseMat last_assoc(2, msizes, CV_8U);
-    //// assoc.row(cluster_idx).col(descriptor_idx) = 1 iif associated
+    const int N = frontier.size();
+    std::vector<std::vector<Descriptor>> clusters(N);
+    assignments.resize(N);
 
-    if ((int)descriptors.size() <= m_k)
+    // Each node has its own random generator, therefore the result is independent of the processing order.
+    if (N < options.num_threads * 4)
     {
-        // trivial case: one cluster per feature
-        groups.resize(descriptors.size());
-
-        for (unsigned int i = 0; i < descriptors.size(); i++)
+        // Few large nodes: parallel loops inside k-means
+        for (int i = 0; i < N; ++i)
         {
-            groups[i].push_back(i);
-
-#ifdef USE_CV_FORB
-            clusters.push_back(descriptors[i]->clone());
-#else
-            clusters.push_back(*descriptors[i]);
-#endif
+            kmeans(frontier[i], mixSeed(seed, frontier_nodes[i]), options.num_threads, options, clusters[i],
+                   assignments[i]);
+            progress.add(frontier[i].size());
         }
     }
     else
     {
-        // select clusters and groups with kmeans
-
-        bool first_time = true;
-        bool goon       = true;
-
-        // to check if clusters move after iterations
-        std::vector<int> last_association, current_association;
-
-        while (goon)
+        // Many small nodes: one node per thread
+#pragma omp parallel for num_threads(options.num_threads) schedule(dynamic)
+        for (int i = 0; i < N; ++i)
         {
-            // 1. Calculate clusters
-
-            if (first_time)
+            kmeans(frontier[i], mixSeed(seed, frontier_nodes[i]), 1, options, clusters[i], assignments[i]);
+#pragma omp critical
             {
-                // random sample
-                initiateClusters(descriptors, clusters);
+                progress.add(frontier[i].size());
             }
-            else
-            {
-                // calculate cluster centres
-
-                for (unsigned int c = 0; c < clusters.size(); ++c)
-                {
-                    std::vector<pDescriptor> cluster_descriptors;
-                    cluster_descriptors.reserve(groups[c].size());
-
-                    /*
-                    for(unsigned int d = 0; d < descriptors.size(); ++d)
-                    {
-                      if( assoc.find<unsigned char>(c, d) )
-                      {
-                        cluster_descriptors.push_back(descriptors[d]);
-                      }
-                    }
-                    */
-
-                    std::vector<unsigned int>::const_iterator vit;
-                    for (vit = groups[c].begin(); vit != groups[c].end(); ++vit)
-                    {
-                        cluster_descriptors.push_back(descriptors[*vit]);
-                    }
-
-
-                    Saiga::MeanMatcher<Descriptor> mm;
-                    clusters[c] = mm.MeanDescriptorp(cluster_descriptors);
-                    //                    clusters[c] = F::meanValue(cluster_descriptors);
-                }
+        }
+    }
+    progress.add(0, true);
 
-            }  // if(!first_time)
+    // create nodes
+    for (int i = 0; i < N; ++i)
+    {
+        NodeId parent_id = frontier_nodes[i];
+        for (auto& cluster : clusters[i])
+        {
+            NodeId id = m_nodes.size();
+            m_nodes.push_back(Node(id));
+            m_nodes.back().descriptor = cluster;
+            m_nodes.back().parent     = parent_id;
+            m_nodes[parent_id].children.push_back(id);
+        }
+    }
+}
 
-            // 2. Associate features with clusters
+// --------------------------------------------------------------------------
 
-            // calculate distances to cluster centers
-            groups.clear();
-            groups.resize(clusters.size(), std::vector<unsigned int>());
-            current_association.resize(descriptors.size());
+template <class Descriptor>
+void TemplatedVocabulary<Descriptor>::kmeans(const std::vector<pDescriptor>& descriptors, uint64_t seed,
+                                             int num_threads, const VocabularyTrainingOptions& options,
+                                             std::vector<Descriptor>& clusters, std::vector<int>& assignment) const
+{
+    const int N = descriptors.size();
+    clusters.clear();
+    assignment.assign(N, -1);
 
-            // assoc.clear();
+    if (N <= m_k)
+    {
+        // trivial case: one cluster per feature
+        for (int i = 0; i < N; ++i)
+        {
+            clusters.push_back(*descriptors[i]);
+            assignment[i] = i;
+        }
+        return;
+    }
 
-            typename std::vector<pDescriptor>::const_iterator fit;
-            // unsigned int d = 0;
-            for (fit = descriptors.begin(); fit != descriptors.end(); ++fit)  //, ++d)
+    std::mt19937_64 gen(seed);
+    initiateClustersKMpp(descriptors, gen, num_threads, clusters);
+    const int K = clusters.size();
+
+    // Assigns the descriptors to the nearest cluster and accumulates the bit counts of each cluster.
+    // The counts are integer sums, so the result does not depend on the number of threads.
+    // Returns the number of changed assignments.
+    std::vector<DescriptorBitCounts> counts(K);
+    auto assign = [&](const int* indices, int n, bool update_assignment) {
+        int changed = 0;
+#pragma omp parallel num_threads(num_threads) reduction(+ : changed)
+        {
+            std::vector<DescriptorBitCounts> local_counts(K);
+#pragma omp for
+            for (int j = 0; j < n; ++j)
             {
-                auto best_dist        = Saiga::distance(*(*fit), clusters[0]);
-                unsigned int icluster = 0;
-
-                for (unsigned int c = 1; c < clusters.size(); ++c)
+                int i               = indices ? indices[j] : j;
+                const Descriptor& d = *descriptors[i];
+                auto best_dist      = Saiga::distance(d, clusters[0]);
+                int icluster        = 0;
+                for (int c = 1; c < K; ++c)
                 {
-                    auto dist = Saiga::distance(*(*fit), clusters[c]);
+                    auto dist = Saiga::distance(d, clusters[c]);
                     if (dist < best_dist)
                     {
                         best_dist = dist;
                         icluster  = c;
                     }
                 }
+                local_counts[icluster].add(d);
 
-                // assoc.ref<unsigned char>(icluster, d) = 1;
-
-                groups[icluster].push_back(fit - descriptors.begin());
-                current_association[fit - descriptors.begin()] = icluster;
-            }
-
-            // kmeans++ ensures all the clusters has any feature associated with them
-
-            // 3. check convergence
-            if (first_time)
-            {
-                first_time = false;
-            }
-            else
-            {
-                // goon = !eqUChar(last_assoc, assoc);
-
-                goon = false;
-                for (unsigned int i = 0; i < current_association.size(); i++)
+                if (update_assignment && assignment[i] != icluster)
                 {
-                    if (current_association[i] != last_association[i])
-                    {
-                        goon = true;
-                        break;
-                    }
+                    assignment[i] = icluster;
+                    changed++;
                 }
             }
-
-            if (goon)
+#pragma omp critical
             {
-                // copy last feature-cluster association
-                last_association = current_association;
-                // last_assoc = assoc.clone();
+                for (int c = 0; c < K; ++c) counts[c].add(local_counts[c]);
             }
+        }
+        return changed;
+    };
 
-        }  // while(goon)
-
-    }  // if must run kmeans
-
-    // create nodes
-    for (unsigned int i = 0; i < clusters.size(); ++i)
-    {
-        NodeId id = m_nodes.size();
-        m_nodes.push_back(Node(id));
-        m_nodes.back().descriptor = clusters[i];
-        m_nodes.back().parent     = parent_id;
-        m_nodes[parent_id].children.push_back(id);
-    }
-
-    // go on with the next level
-    if (current_level < m_L)
+    if (options.mini_batch_size > 0 && N > options.mini_batch_size)
     {
-        // iterate again with the resulting clusters
-        const std::vector<NodeId>& children_ids = m_nodes[parent_id].children;
-        for (unsigned int i = 0; i < clusters.size(); ++i)
+        // Mini-batch k-means: the counts are accumulated over all batches, so each center is the mean of all
+        // descriptors assigned to it so far.
+        const int max_iterations = options.max_iterations > 0 ? options.max_iterations : kMaxMiniBatchIterations;
+        std::vector<int> batch(options.mini_batch_size);
+        std::uniform_int_distribution<int> dis(0, N - 1);
+        for (int it = 0; it < max_iterations; ++it)
         {
-            NodeId id = children_ids[i];
-
-            std::vector<pDescriptor> child_features;
-            child_features.reserve(groups[i].size());
+            for (auto& i : batch) i = dis(gen);
+            assign(batch.data(), batch.size(), false);
 
-            std::vector<unsigned int>::const_iterator vit;
-            for (vit = groups[i].begin(); vit != groups[i].end(); ++vit)
+            bool moved = false;
+            for (int c = 0; c < K; ++c)
             {
-                child_features.push_back(descriptors[*vit]);
+                if (counts[c].n == 0) continue;
+                Descriptor mean = counts[c].mean();
+                moved |= mean != clusters[c];
+                clusters[c] = mean;
             }
+            if (!moved) break;
+        }
+        assign(nullptr, N, true);
+    }
+    else
+    {
+        for (int it = 1;; ++it)
+        {
+            for (auto& c : counts) c.clear();
+            int changed = assign(nullptr, N, true);
 
-            if (child_features.size() > 1)
-            {
-                HKmeansStep(id, child_features, current_level + 1);
-            }
+            // The clusters must match the last assignment, because it defines the descriptors of the child nodes
+            if (changed == 0 || it == options.max_iterations) break;
+            for (int c = 0; c < K; ++c) clusters[c] = counts[c].mean();
         }
     }
 }
@@ -700,6 +1029,7 @@ void TemplatedVocabulary<Descriptor>::HKmeansStep(NodeId parent_id, const std::v
 
 template <class Descriptor>
 void TemplatedVocabulary<Descriptor>::initiateClustersKMpp(const std::vector<pDescriptor>& pfeatures,
+                                                           std::mt19937_64& gen, int num_threads,
                                                            std::vector<Descriptor>& clusters) const
 {
     // Implements kmeans++ seeding algorithm
@@ -713,77 +1043,91 @@ void TemplatedVocabulary<Descriptor>::initiateClustersKMpp(const std::vector<pDe
     // 5. Now that the initial centers have been chosen, proceed using standard k-means
     //    clustering.
 
+    const int N = pfeatures.size();
     clusters.resize(0);
     clusters.reserve(m_k);
-    std::vector<double> min_dists(pfeatures.size(), std::numeric_limits<double>::max());
-
-    // 1.
+    std::vector<int> min_dists(N, std::numeric_limits<int>::max());
 
-    int ifeature = RandomInt(0, pfeatures.size() - 1);
+    // The distances are summed up in fixed chunks, which are also used to find the sampled point in step 3.
+    // Integer sums are exact, so the result does not depend on the number of threads.
+    const int chunk_size = 4096;
+    const int num_chunks = Saiga::iDivUp(N, chunk_size);
+    std::vector<int64_t> chunk_sums(num_chunks);
 
-// create first cluster
-#ifdef USE_CV_FORB
-    clusters.push_back(pfeatures[ifeature]->clone());
-#else
-    clusters.push_back(*pfeatures[ifeature]);
-#endif
-
-    // compute the initial distances
-    typename std::vector<pDescriptor>::const_iterator fit;
-    std::vector<double>::iterator dit;
-    dit = min_dists.begin();
-    for (fit = pfeatures.begin(); fit != pfeatures.end(); ++fit, ++dit)
-    {
-        *dit = Saiga::distance(*(*fit), clusters.back());
-    }
+    // 1.
+    clusters.push_back(*pfeatures[std::uniform_int_distribution<int>(0, N - 1)(gen)]);
 
     while ((int)clusters.size() < m_k)
     {
         // 2.
-        dit = min_dists.begin();
-        for (fit = pfeatures.begin(); fit != pfeatures.end(); ++fit, ++dit)
+#pragma omp parallel for num_threads(num_threads)
+        for (int c = 0; c < num_chunks; ++c)
         {
-            if (*dit > 0)
+            int64_t sum = 0;
+            for (int i = c * chunk_size; i < std::min(N, (c + 1) * chunk_size); ++i)
             {
-                auto dist = Saiga::distance(*(*fit), clusters.back());
-                if (dist < *dit) *dit = dist;
+                if (min_dists[i] > 0)
+                {
+                    min_dists[i] = std::min<int>(min_dists[i], Saiga::distance(*pfeatures[i], clusters.back()));
+                }
+                sum += min_dists[i];
             }
+            chunk_sums[c] = sum;
         }
 
         // 3.
-        double dist_sum = std::accumulate(min_dists.begin(), min_dists.end(), 0.0);
+        int64_t dist_sum = std::accumulate(chunk_sums.begin(), chunk_sums.end(), int64_t(0));
+        if (dist_sum == 0) break;
 
-        if (dist_sum > 0)
+        double cut_d;
+        do
         {
-            double cut_d;
-            do
-            {
-                cut_d = RandomValue<double>(0, dist_sum);
-            } while (cut_d == 0.0);
+            cut_d = std::uniform_real_distribution<double>(0, dist_sum)(gen);
+        } while (cut_d == 0.0);
+
+        // The first point with a prefix sum >= cut_d
+        int chunk        = 0;
+        int64_t d_up_now = 0;
+        while (chunk < num_chunks - 1 && d_up_now + chunk_sums[chunk] < cut_d) d_up_now += chunk_sums[chunk++];
 
-            double d_up_now = 0;
-            for (dit = min_dists.begin(); dit != min_dists.end(); ++dit)
+        int end      = std::min(N, (chunk + 1) * chunk_size);
+        int ifeature = end - 1;
+        for (int i = chunk * chunk_size; i < end; ++i)
+        {
+            d_up_now += min_dists[i];
+            if (d_up_now >= cut_d)
             {
-                d_up_now += *dit;
-                if (d_up_now >= cut_d) break;
+                ifeature = i;
+                break;
             }
+        }
+        clusters.push_back(*pfeatures[ifeature]);
+    }
+}
 
-            if (dit == min_dists.end())
-                ifeature = pfeatures.size() - 1;
-            else
-                ifeature = dit - min_dists.begin();
-
-#ifdef USE_CV_FORB
-            clusters.push_back(pfeatures[ifeature]->clone());
-#else
-            clusters.push_back(*pfeatures[ifeature]);
-#endif
-
-        }  // if dist_sum > 0
-        else
-            break;
+// --------------------------------------------------------------------------
 
-    }  // while(used_clusters < m_k)
+template <class Descriptor>
+NodeId TemplatedVocabulary<Descriptor>::descendTrainingTree(const Descriptor& feature) const
+{
+    NodeId id = 0;
+    while (!m_nodes[id].isLeaf())
+    {
+        auto& children = m_nodes[id].children;
+        NodeId best    = children[0];
+        auto best_d    = Saiga::distance(feature, m_nodes[best].descriptor);
+        for (size_t c = 1; c < children.size(); ++c)
+        {
+            auto d = Saiga::distance(feature, m_nodes[children[c]].descriptor);
+            if (d < best_d)
+            {
+                best_d = d;
+                best   = children[c];
+            }
+        }
+        id = best;
+    }
+    return id;
 }
 
 // --------------------------------------------------------------------------
@@ -814,11 +1158,11 @@ void TemplatedVocabulary<Descriptor>::createWords()
 // --------------------------------------------------------------------------
 
 template <class Descriptor>
-void TemplatedVocabulary<Descriptor>::setNodeWeights(const std::vector<std::vector<Descriptor>>& training_features)
+void TemplatedVocabulary<Descriptor>::setNodeWeights(const TrainingSource& source, int num_threads,
+                                                     ProgressReporter& progress)
 {
     const unsigned int NWords = m_words.size();
-    const unsigned int NDocs  = training_features.size();
-
+    unsigned int NDocs        = 0;
 
     // IDF and TF-IDF: we calculte the idf path now
 
@@ -826,27 +1170,32 @@ void TemplatedVocabulary<Descriptor>::setNodeWeights(const std::vector<std::vect
     // The complete tf-idf score is calculated in ::transform
 
     std::vector<unsigned int> Ni(NWords, 0);
-    std::vector<bool> counted(NWords, false);
-
-    typename std::vector<std::vector<Descriptor>>::const_iterator mit;
-    typename std::vector<Descriptor>::const_iterator fit;
-
-    for (mit = training_features.begin(); mit != training_features.end(); ++mit)
-    {
-        fill(counted.begin(), counted.end(), false);
-
-        for (fit = mit->begin(); fit < mit->end(); ++fit)
+    // The last document which contained the word
+    std::vector<int> counted(NWords, -1);
+    std::vector<WordId> word_ids;
+
+    progress.beginLevel(m_L + 1);
+    source([&](const std::vector<Descriptor>& image) {
+        const int N = image.size();
+        word_ids.resize(N);
+#pragma omp parallel for num_threads(num_threads)
+        for (int i = 0; i < N; ++i)
         {
-            WordId word_id = std::get<0>(transform(*fit, 0));
-
+            word_ids[i] = std::get<0>(transform(image[i], 0));
+        }
 
-            if (!counted[word_id])
+        for (WordId word_id : word_ids)
+        {
+            if (counted[word_id] != (int)NDocs)
             {
                 Ni[word_id]++;
-                counted[word_id] = true;
+                counted[word_id] = NDocs;
             }
         }
-    }
+        NDocs++;
+        progress.add(N);
+    });
+    progress.add(0, true);
 
     // set ln(N/Ni)
     for (unsigned int i = 0; i < NWords; i++)
@@ -864,16 +1213,15 @@ void TemplatedVocabulary<Descriptor>::setNodeWeights(const std::vector<std::vect
 template <class Descriptor>
 float TemplatedVocabulary<Descriptor>::getEffectiveLevels() const
 {
+    const int32_t* node_parent = flatArray<int32_t>(flat.node_parent);
+
     long sum = 0;
-    typename std::vector<Node*>::const_iterator wit;
-    for (wit = m_words.begin(); wit != m_words.end(); ++wit)
+    for (WordId wid = 0; wid < flat.num_words; ++wid)
     {
-        const Node* p = *wit;
-
-        for (; p->id != 0; sum++) p = &m_nodes[p->parent];
+        for (NodeId p = wordNode(wid); p != 0; sum++) p = node_parent[p];
     }
 
-    return (float)((double)sum / (double)m_words.size());
+    return (float)((double)sum / (double)flat.num_words);
 }
 
 
@@ -938,58 +1286,77 @@ template <class Descriptor>
 std::tuple<WordId, WordValue, NodeId> TemplatedVocabulary<Descriptor>::transform(const Descriptor& feature,
                                                                                  int levelsup) const
 {
-    // propagate the feature down the tree
-    //    std::vector<NodeId> nodes;
-    //    typename std::vector<NodeId>::const_iterator nit;
+    SAIGA_DEBUG_ASSERT(flat.num_nodes > 0);
+    const int32_t* node_block     = flatArray<int32_t>(flat.node_block);
+    const int32_t* children       = flatArray<int32_t>(flat.block_children);
+    const int32_t* num_children   = flatArray<int32_t>(flat.block_num_children);
+    const uint64_t* block_words   = flatArray<uint64_t>(flat.block_words);
+    const int kpad                = flat.kpad;
+    const size_t block_word_count = size_t(4) * kpad;
 
     // level at which the node must be stored in nid, if given
     const int nid_level = m_L - levelsup;
 
-    NodeId nid = 0;
-
+    NodeId nid        = 0;
     NodeId final_id   = 0;  // root
     int current_level = 0;
 
-    do
+    // propagate the feature down the tree
+    // The distances to all (padded) children of a node are computed at once
+    int distances[kMaxBranching];
+    int block;
+    while ((block = node_block[final_id]) >= 0)
     {
         ++current_level;
-        auto& nodes = m_nodes[final_id].children;
-        final_id    = nodes[0];
-
-        auto best_d = Saiga::distance(feature, m_nodes[final_id].descriptor);
+        Saiga::HammingDistances(feature, block_words + block * block_word_count, kpad, kpad, distances);
 
-        for (auto nit = nodes.begin() + 1; nit != nodes.end(); ++nit)
+        // The first child with the minimum distance, same as the linear search over the nodes
+        const int n = num_children[block];
+        int best    = 0;
+        for (int c = 1; c < n; ++c)
         {
-            NodeId id = *nit;
-            auto d    = Saiga::distance(feature, m_nodes[id].descriptor);
-            if (d < best_d)
-            {
-                best_d   = d;
-                final_id = id;
-            }
+            if (distances[c] < distances[best]) best = c;
         }
+        final_id = children[size_t(block) * kpad + best];
 
         if (current_level == nid_level) nid = final_id;
-
-    } while (!m_nodes[final_id].isLeaf());
+    }
 
     // turn node id into word id
-    WordId word_id   = m_nodes[final_id].word_id;
-    WordValue weight = m_nodes[final_id].weight;
+    WordId word_id   = flatArray<int32_t>(flat.node_word)[final_id];
+    WordValue weight = flatArray<float>(flat.node_weight)[final_id];
 
     return {word_id, weight, nid};
 }
 
 // --------------------------------------------------------------------------
 
+template <class Descriptor>
+Descriptor TemplatedVocabulary<Descriptor>::getWord(WordId wid) const
+{
+    NodeId node  = wordNode(wid);
+    int block    = flatArray<int32_t>(flat.node_block)[flatArray<int32_t>(flat.node_parent)[node]];
+    auto* childs = flatArray<int32_t>(flat.block_children) + size_t(block) * flat.kpad;
+    int slot     = std::find(childs, childs + flat.kpad, node) - childs;
+
+    const uint64_t* words = flatArray<uint64_t>(flat.block_words) + size_t(block) * 4 * flat.kpad;
+    Descriptor d;
+    for (int k = 0; k < 4; ++k) d[k] = words[k * flat.kpad + slot];
+    return d;
+}
+
+// --------------------------------------------------------------------------
+
 template <class Descriptor>
 NodeId TemplatedVocabulary<Descriptor>::getParentNode(WordId wid, int levelsup) const
 {
-    NodeId ret = m_words[wid]->id;    // node id
+    const int32_t* node_parent = flatArray<int32_t>(flat.node_parent);
+
+    NodeId ret = wordNode(wid);       // node id
     while (levelsup > 0 && ret != 0)  // ret == 0 --> root
     {
         --levelsup;
-        ret = m_nodes[ret].parent;
+        ret = node_parent[ret];
     }
     return ret;
 }
@@ -999,11 +1366,16 @@ NodeId TemplatedVocabulary<Descriptor>::getParentNode(WordId wid, int levelsup)
 template <class Descriptor>
 void TemplatedVocabulary<Descriptor>::getWordsFromNode(NodeId nid, std::vector<WordId>& words) const
 {
+    const int32_t* node_block   = flatArray<int32_t>(flat.node_block);
+    const int32_t* node_word    = flatArray<int32_t>(flat.node_word);
+    const int32_t* children     = flatArray<int32_t>(flat.block_children);
+    const int32_t* num_children = flatArray<int32_t>(flat.block_num_children);
+
     words.clear();
 
-    if (m_nodes[nid].isLeaf())
+    if (node_block[nid] < 0)
     {
-        words.push_back(m_nodes[nid].word_id);
+        words.push_back(node_word[nid]);
     }
     else
     {
@@ -1017,17 +1389,17 @@ void TemplatedVocabulary<Descriptor>::getWordsFromNode(NodeId nid, std::vector<W
             NodeId parentid = parents.back();
             parents.pop_back();
 
-            const std::vector<NodeId>& child_ids = m_nodes[parentid].children;
-            std::vector<NodeId>::const_iterator cit;
+            const int block         = node_block[parentid];
+            const int32_t* child_ids = children + size_t(block) * flat.kpad;
 
-            for (cit = child_ids.begin(); cit != child_ids.end(); ++cit)
+            for (int c = 0; c < num_children[block]; ++c)
             {
-                const Node& child_node = m_nodes[*cit];
+                NodeId child = child_ids[c];
 
-                if (child_node.isLeaf())
-                    words.push_back(child_node.word_id);
+                if (node_block[child] < 0)
+                    words.push_back(node_word[child]);
                 else
-                    parents.push_back(*cit);
+                    parents.push_back(child);
 
             }  // for each child
         }      // while !parents.empty
@@ -1037,6 +1409,33 @@ void TemplatedVocabulary<Descriptor>::getWordsFromNode(NodeId nid, std::vector<W
 template <class Descriptor>
 void TemplatedVocabulary<Descriptor>::loadRaw(const std::string& file)
 {
+    {
+        // Flat files are memory mapped
+        char magic[8] = {};
+        std::ifstream strm(file, std::ios_base::in | std::ios_base::binary);
+        if (!strm.is_open())
+        {
+            throw std::runtime_error("Could not load Voc file.");
+        }
+        strm.read(magic, 8);
+        if (strm && std::memcmp(magic, kFlatMagic, 8) == 0)
+        {
+            auto mapped = std::make_shared<Saiga::MemoryMappedFile>(file);
+            if (!mapped->valid())
+            {
+                throw std::runtime_error("Could not map Voc file.");
+            }
+            m_nodes.clear();
+            m_words.clear();
+            flat_buffer.clear();
+            parseFlat(mapped->data(), mapped->size());
+            flat_file = mapped;
+            m_k       = flat.k;
+            m_L       = flat.L;
+            return;
+        }
+    }
+
     Saiga::BinaryFile bf(file, std::ios_base::in);
     if (!bf.strm.is_open())
     {
@@ -1050,6 +1449,7 @@ void TemplatedVocabulary<Descriptor>::loadRaw(const std::string& file)
 
     size_t nodecount;
     bf >> nodecount;
+    m_nodes.clear();
     m_nodes.resize(nodecount);
     for (Node& n : m_nodes)
     {
@@ -1068,6 +1468,10 @@ void TemplatedVocabulary<Descriptor>::loadRaw(const std::string& file)
     {
         m_words[i] = &m_nodes[words[i].second];
     }
+
+    compile();
+    m_nodes.clear();
+    m_words.clear();
 }
 
 
@@ -1075,25 +1479,239 @@ void TemplatedVocabulary<Descriptor>::loadRaw(const std::string& file)
 template <class Descriptor>
 void TemplatedVocabulary<Descriptor>::saveRaw(const std::string& file) const
 {
+    const int32_t* node_parent  = flatArray<int32_t>(flat.node_parent);
+    const int32_t* node_word    = flatArray<int32_t>(flat.node_word);
+    const float* node_weight    = flatArray<float>(flat.node_weight);
+    const int32_t* children     = flatArray<int32_t>(flat.block_children);
+    const int32_t* num_children = flatArray<int32_t>(flat.block_num_children);
+
+    // The descriptor of each node is stored in the block of its parent
+    std::vector<Descriptor> descriptors(flat.num_nodes);
+    for (int i = 0; i < flat.num_nodes; ++i) descriptors[i].fill(0);
+    for (int b = 0; b < flat.num_blocks; ++b)
+    {
+        const uint64_t* words = flatArray<uint64_t>(flat.block_words) + size_t(b) * 4 * flat.kpad;
+        for (int c = 0; c < num_children[b]; ++c)
+        {
+            auto& d = descriptors[children[size_t(b) * flat.kpad + c]];
+            for (int k = 0; k < 4; ++k) d[k] = words[k * flat.kpad + c];
+        }
+    }
+
     Saiga::BinaryFile bf(file, std::ios_base::out);
     bf << m_k << m_L << int(0) << int(0);
-    bf << (size_t)m_nodes.size();
-    for (const Node& n : m_nodes)
+    bf << (size_t)flat.num_nodes;
+    for (NodeId id = 0; id < flat.num_nodes; ++id)
     {
-        double weight = n.weight;
-        bf << n.id << n.parent << weight << n.word_id << n.descriptor;
+        double weight = node_weight[id];
+        bf << id << node_parent[id] << weight << node_word[id] << descriptors[id];
     }
     // words
     std::vector<std::pair<int, int>> words;
-    for (auto i = 0; i < m_words.size(); ++i)
+    for (auto i = 0; i < flat.num_words; ++i)
     {
-        words.emplace_back(i, m_words[i]->id);
+        words.emplace_back(i, wordNode(i));
     }
     bf << words;
 }
 
+template <class Descriptor>
+void TemplatedVocabulary<Descriptor>::saveFlat(const std::string& file) const
+{
+    std::ofstream strm(file, std::ios_base::out | std::ios_base::binary);
+    if (!strm.is_open())
+    {
+        throw std::runtime_error("Could not save Voc file.");
+    }
+    strm.write(flatData(), flat.total_size);
+}
+
+template <class Descriptor>
+void TemplatedVocabulary<Descriptor>::compile()
+{
+    static_assert(std::is_same<Descriptor, Saiga::DescriptorORB>::value,
+                  "The flat vocabulary supports only ORB descriptors.");
+    SAIGA_ASSERT(m_k <= kMaxBranching);
+
+    FlatHeader h;
+    std::memcpy(h.magic, kFlatMagic, 8);
+    h.version   = kFlatVersion;
+    h.k         = m_k;
+    h.L         = m_L;
+    h.kpad      = Saiga::iAlignUp(m_k, 8);
+    h.num_nodes = m_nodes.size();
+    h.num_words = m_words.size();
+
+    // Blocks in breadth first order
+    std::vector<NodeId> block_parent;
+    std::vector<int> node_block(m_nodes.size(), -1);
+    if (!m_nodes.empty() && !m_nodes[0].isLeaf()) block_parent.push_back(0);
+    for (size_t b = 0; b < block_parent.size(); ++b)
+    {
+        node_block[block_parent[b]] = b;
+        for (NodeId c : m_nodes[block_parent[b]].children)
+        {
+            if (!m_nodes[c].isLeaf()) block_parent.push_back(c);
+        }
+    }
+    h.num_blocks = block_parent.size();
+
+    auto align64  = [](size_t bytes) { return (bytes + 63) / 64 * 64; };
+    size_t offset = align64(sizeof(FlatHeader));
+    auto section  = [&](uint64_t& dst, size_t bytes) {
+        dst = offset;
+        offset += align64(bytes);
+    };
+    section(h.node_parent, sizeof(int32_t) * h.num_nodes);
+    section(h.node_word, sizeof(int32_t) * h.num_nodes);
+    section(h.node_block, sizeof(int32_t) * h.num_nodes);
+    section(h.node_weight, sizeof(float) * h.num_nodes);
+    section(h.word_node, sizeof(int32_t) * h.num_words);
+    section(h.block_children, sizeof(int32_t) * h.num_blocks * h.kpad);
+    section(h.block_num_children, sizeof(int32_t) * h.num_blocks);
+    section(h.block_words, sizeof(uint64_t) * h.num_blocks * 4 * h.kpad);
+    h.total_size = offset;
+
+    Saiga::AlignedVector<char, 64> buffer(h.total_size, 0);
+    char* data = buffer.data();
+    std::memcpy(data, &h, sizeof(FlatHeader));
+
+    auto* node_parent        = reinterpret_cast<int32_t*>(data + h.node_parent);
+    auto* node_word          = reinterpret_cast<int32_t*>(data + h.node_word);
+    auto* node_blocks        = reinterpret_cast<int32_t*>(data + h.node_block);
+    auto* node_weight        = reinterpret_cast<float*>(data + h.node_weight);
+    auto* word_node          = reinterpret_cast<int32_t*>(data + h.word_node);
+    auto* block_children     = reinterpret_cast<int32_t*>(data + h.block_children);
+    auto* block_num_children = reinterpret_cast<int32_t*>(data + h.block_num_children);
+    auto* block_words        = reinterpret_cast<uint64_t*>(data + h.block_words);
+
+    for (NodeId i = 0; i < h.num_nodes; ++i)
+    {
+        node_parent[i] = m_nodes[i].parent;
+        node_word[i]   = m_nodes[i].word_id;
+        node_blocks[i] = node_block[i];
+        node_weight[i] = m_nodes[i].weight;
+    }
+    for (WordId w = 0; w < h.num_words; ++w)
+    {
+        word_node[w] = m_words[w]->id;
+    }
+    for (int b = 0; b < h.num_blocks; ++b)
+    {
+        auto& childs          = m_nodes[block_parent[b]].children;
+        int32_t* children     = block_children + size_t(b) * h.kpad;
+        uint64_t* words       = block_words + size_t(b) * 4 * h.kpad;
+        block_num_children[b] = childs.size();
+        for (int c = 0; c < h.kpad; ++c)
+        {
+            bool used   = c < (int)childs.size();
+            children[c] = used ? childs[c] : -1;
+            for (int k = 0; k < 4; ++k)
+            {
+                words[k * h.kpad + c] = used ? m_nodes[childs[c]].descriptor[k] : 0;
+            }
+        }
+    }
+
+    flat_file.reset();
+    flat_buffer = std::move(buffer);
+    parseFlat(flat_buffer.data(), flat_buffer.size());
+}
+
+template <class Descriptor>
+void TemplatedVocabulary<Descriptor>::parseFlat(const char* data, size_t size)
+{
+    if (size < sizeof(FlatHeader))
+    {
+        throw std::runtime_error("Invalid flat Voc file.");
+    }
+    FlatHeader h;
+    std::memcpy(&h, data, sizeof(FlatHeader));
+
+    bool valid = std::memcmp(h.magic, kFlatMagic, 8) == 0 && h.version == kFlatVersion && h.total_size <= size &&
+                 h.k > 0 && h.k <= kMaxBranching && h.kpad == Saiga::iAlignUp(h.k, 8) && h.num_nodes >= 0 &&
+                 h.num_words >= 0 && h.num_blocks >= 0;
+
+    // Every section must be inside the file. The counts are non-negative int32 and kpad <= 64, therefore the section
+    // sizes can not overflow in 64 bit. The offsets are compared without computing offset + bytes.
+    const uint64_t num_nodes = h.num_nodes, num_words = h.num_words, num_blocks = h.num_blocks, kpad = h.kpad;
+    auto section_valid = [&h](uint64_t offset, uint64_t bytes) {
+        return offset % 64 == 0 && offset <= h.total_size && bytes <= h.total_size - offset;
+    };
+    valid = valid && section_valid(h.node_parent, sizeof(int32_t) * num_nodes) &&
+            section_valid(h.node_word, sizeof(int32_t) * num_nodes) &&
+            section_valid(h.node_block, sizeof(int32_t) * num_nodes) &&
+            section_valid(h.node_weight, sizeof(float) * num_nodes) &&
+            section_valid(h.word_node, sizeof(int32_t) * num_words) &&
+            section_valid(h.block_children, sizeof(int32_t) * num_blocks * kpad) &&
+            section_valid(h.block_num_children, sizeof(int32_t) * num_blocks) &&
+            section_valid(h.block_words, sizeof(uint64_t) * num_blocks * 4 * kpad);
+    if (!valid)
+    {
+        throw std::runtime_error("Invalid flat Voc file.");
+    }
+
+    // The indices are checked once here, so that transform() and the other accessors can use them without checks.
+    // Every node except the root is a child of its parent's block and has a larger id than its parent. This
+    // guarantees that the descent in transform() and the parent loops terminate.
+    auto* node_parent        = reinterpret_cast<const int32_t*>(data + h.node_parent);
+    auto* node_word          = reinterpret_cast<const int32_t*>(data + h.node_word);
+    auto* node_block         = reinterpret_cast<const int32_t*>(data + h.node_block);
+    auto* word_node          = reinterpret_cast<const int32_t*>(data + h.word_node);
+    auto* block_children     = reinterpret_cast<const int32_t*>(data + h.block_children);
+    auto* block_num_children = reinterpret_cast<const int32_t*>(data + h.block_num_children);
+
+    if (h.num_nodes == 0)
+    {
+        valid = h.num_words == 0 && h.num_blocks == 0;
+    }
+
+    std::vector<int32_t> block_owner(h.num_blocks, -1);
+    for (int32_t i = 0; i < h.num_nodes && valid; ++i)
+    {
+        int32_t b = node_block[i];
+        valid &= i == 0 ? node_parent[i] == 0 : (node_parent[i] >= 0 && node_parent[i] < i);
+        valid &= b >= -1 && b < h.num_blocks;
+        if (!valid) break;
+        if (b < 0)
+        {
+            valid &= node_word[i] >= 0 && node_word[i] < h.num_words;
+        }
+        else
+        {
+            valid &= block_owner[b] == -1;
+            block_owner[b] = i;
+        }
+    }
+    for (int32_t w = 0; w < h.num_words && valid; ++w)
+    {
+        valid &= word_node[w] >= 0 && word_node[w] < h.num_nodes && node_block[word_node[w]] < 0;
+    }
 
+    std::vector<char> is_child(h.num_nodes, 0);
+    for (int32_t b = 0; b < h.num_blocks && valid; ++b)
+    {
+        int32_t owner = block_owner[b];
+        int32_t n     = block_num_children[b];
+        valid &= owner >= 0 && n > 0 && n <= h.k;
+        for (int32_t c = 0; c < n && valid; ++c)
+        {
+            int32_t child = block_children[size_t(b) * kpad + c];
+            valid &= child > owner && child < h.num_nodes && node_parent[child] == owner && !is_child[child];
+            if (valid) is_child[child] = 1;
+        }
+    }
+    for (int32_t i = 1; i < h.num_nodes && valid; ++i)
+    {
+        valid &= is_child[i];
+    }
 
+    if (!valid)
+    {
+        throw std::runtime_error("Invalid flat Voc file.");
+    }
+    flat = h;
+}
 // --------------------------------------------------------------------------
 
 /**
@@ -9,6 +9,11 @@
 #include "saiga/core/util/Thread/omp.h"
 #include "saiga/vision/VisionTypes.h"
 
+#include "RansacKernels.h"
+
+#include <algorithm>
+#include <numeric>
+
 
 namespace Saiga
 {
@@ -21,6 +26,7 @@ SAIGA_VISION_API extern uint64_t ransacRandomSeed;
 
 struct RansacParameters
 {
+    // Upper bound of the number of iterations.
     int maxIterations = -1;
 
     // compared to the value which is returned from computeResidual.
@@ -34,9 +40,64 @@ struct RansacParameters
     // Number of omp threads in that group
     // Note:
     int threads = 1;
+
+    // Adaptive termination.
+    // The number of iterations is reduced to log(1 - confidence) / log(1 - w^ModelSize), where w is the inlier ratio of
+    // the best model found so far. Typical values are 0.99 - 0.9999.
+    // The default (1) disables the early termination and always runs maxIterations.
+    double confidence = 1;
+
+    enum class Verification
+    {
+        // Compute the residuals of all points for every hypothesis
+        Full,
+        // T(d,d) test: Check d random points first and reject the hypothesis if one of them is an outlier
+        Tdd,
+        // Wald's sequential probability ratio test (Matas and Chum 2005):
+        // The points are evaluated in random order (in blocks of 16 consecutive points) and a hypothesis is rejected
+        // as soon as the likelihood ratio of 'bad model' against 'good model' exceeds the decision threshold.
+        SPRT,
+    };
+    Verification verification = Verification::Full;
+
+    // Number of points of the T(d,d) test
+    int tdd_d = 1;
+
+    // SPRT: Initial estimate of the probability that a point is consistent with a bad model.
+    // It is updated from the rejected hypotheses.
+    double sprt_delta = 0.05;
+
+    // SPRT: Initial estimate of the inlier ratio. It is updated from the best model.
+    double sprt_epsilon = 0.2;
+
+    // SPRT: Time to compute one hypothesis in units of one residual evaluation.
+    double sprt_model_time = 200;
+
+    // PROSAC (Chum and Matas 2005): Draw the samples progressively from the best points instead of uniformly.
+    // The input points must be sorted by match quality (best first).
+    bool prosac = false;
+
+    // The SIMD kernel of solvers with batched residuals (see RansacKernels.h).
+    // If the kernel is not supported by the cpu, the next best supported kernel is used.
+    RansacKernel kernel = RansacKernel::Auto;
 };
 
 
+/**
+ * Base class of all ransac solvers.
+ *
+ * The derived class implements
+ *   bool computeModel(const Subset& set, Model& model);
+ *   double computeResidual(const Model& model, int i);
+ * and calls compute() from all threads of an omp parallel region with params.threads threads.
+ * Optionally, the derived class can shadow computeInliers() with a batched implementation, for example with one of
+ * the SIMD kernels of RansacKernels.h.
+ *
+ * Each thread only stores its best hypothesis and two inlier masks, so the memory is O(threads * N) independent of
+ * the number of iterations. The iterations are processed in rounds. After each round the iteration bound (see
+ * RansacParameters::confidence) and the SPRT parameters are updated from the best model of all threads.
+ * The results are deterministic for a fixed number of threads.
+ */
 template <typename Derived, typename Model, int ModelSize>
 class RansacBase
 {
@@ -46,27 +107,46 @@ class RansacBase
         params = _params;
         SAIGA_ASSERT(params.maxIterations > 0);
         SAIGA_ASSERT(OMP::getNumThreads() == 1);
-
-        numInliers.resize(params.maxIterations);
-        models.resize(params.maxIterations);
-
-        residuals.resize(params.maxIterations);
-        for (auto&& r : residuals) r.reserve(params.reserveN);
-
-        inliers.resize(params.maxIterations);
-        for (auto&& r : inliers) r.reserve(params.reserveN);
-
         SAIGA_ASSERT(params.threads >= 1);
+        SAIGA_ASSERT(params.tdd_d >= 1);
+
         generators.resize(params.threads);
-        threadLocalBestModel.resize(params.threads);
+        threadStates.resize(params.threads);
         for (int i = 0; i < params.threads; ++i)
         {
             generators[i].seed(ransacRandomSeed + 6643838879UL * i);
+
+            auto& state = threadStates[i]();
+            state.inlierMask.reserve(params.reserveN);
+            state.candidateMask.reserve(params.reserveN);
         }
+        orderGenerator.seed(ransacRandomSeed + 2731733UL);
+        kernel = SupportedRansacKernel(params.kernel);
+        bestInlierMask.reserve(params.reserveN);
+        evaluationOrder.reserve(params.reserveN);
     }
 
     const RansacParameters& Params() const { return params; }
 
+    // Number of hypotheses generated by the last compute()
+    int NumIterations() const { return numIterations; }
+
+    RansacKernel UsedKernel() const { return kernel; }
+
+    // Evaluates the points [begin, end) and sets mask[j] = (residual_j < residualThreshold).
+    // Returns the number of inliers.
+    int computeInliers(const Model& model, int begin, int end, char* mask)
+    {
+        int count = 0;
+        for (int j = begin; j < end; ++j)
+        {
+            bool inl = derived().computeResidual(model, j) < params.residualThreshold;
+            mask[j]  = inl;
+            count += inl;
+        }
+        return count;
+    }
+
    protected:
     // indices of subset
     using Subset = std::array<int, ModelSize>;
@@ -75,99 +155,295 @@ class RansacBase
     RansacBase(const RansacParameters& _params) { init(_params); }
 
 
-
+    // Returns the number of inliers of the best model.
+    // The result is stored in bestModel and bestInlierMask.
     int compute(int _N)
     {
         SAIGA_ASSERT(params.maxIterations > 0);
         SAIGA_ASSERT(OMP::getNumThreads() == params.threads);
 
-        int tid = OMP::getThreadNum();
-        // compute random sample subsets
-        std::uniform_int_distribution<int> dis(0, _N - 1);
-        auto& gen = generators[tid];
+        int tid     = OMP::getThreadNum();
+        auto& gen   = generators[tid];
+        auto& state = threadStates[tid]();
 
+        state.numInliers         = 0;
+        state.rejectedTested     = 0;
+        state.rejectedConsistent = 0;
+        state.inlierMask.resize(_N);
+        state.candidateMask.resize(_N);
 
-        auto& bestModel = threadLocalBestModel[tid]();
-        bestModel       = {0, 0};
-
-
-#pragma omp for
-        for (int it = 0; it < params.maxIterations; ++it)
+#pragma omp single
         {
-            auto& model     = models[it];
-            auto& inlier    = inliers[it];
-            auto& residual  = residuals[it];
-            auto& numInlier = numInliers[it];
+            N              = _N;
+            iterationBound = N >= ModelSize ? params.maxIterations : 0;
+            numIterations  = 0;
 
-            numInlier = 0;
-            residual.resize(_N);
-            inlier.resize(_N);
-
-            Subset set;
-            for (auto j : Range(0, ModelSize))
+            if (params.verification == RansacParameters::Verification::SPRT)
             {
-                auto idx = dis(gen);
-                set[j]   = idx;
+                evaluationOrder.resize(iDivUp(N, sprtBlockSize));
+                std::iota(evaluationOrder.begin(), evaluationOrder.end(), 0);
+                std::shuffle(evaluationOrder.begin(), evaluationOrder.end(), orderGenerator);
+                sprtDelta   = params.sprt_delta;
+                sprtEpsilon = params.sprt_epsilon;
+                updateSPRTThreshold();
             }
 
-            if (!derived().computeModel(set, model)) continue;
+            if (params.prosac && N >= ModelSize) computeProsacGrowth();
+        }
 
-            for (int j = 0; j < _N; ++j)
-            {
-                residual[j] = derived().computeResidual(model, j);
+        int roundSize = params.threads * iterationsPerRound;
+        for (int begin = 0; begin < iterationBound; begin += roundSize)
+        {
+            int end = std::min(begin + roundSize, iterationBound);
 
-                bool inl  = residual[j] < params.residualThreshold;
-                inlier[j] = inl;
-                numInlier += inl;
+#pragma omp for schedule(static)
+            for (int it = begin; it < end; ++it)
+            {
+                evaluateHypothesis(it, gen, state);
             }
 
-            if (numInlier > bestModel.first)
+#pragma omp single
             {
-                bestModel.first  = numInlier;
-                bestModel.second = it;
+                numIterations = end;
+                updateBound();
             }
         }
 
 #pragma omp single
         {
-            N             = _N;
-            bestIdx       = 0;
-            int bestCount = 0;
-            for (int th = 0; th < params.threads; ++th)
+            int bestThread = 0;
+            for (int th = 1; th < params.threads; ++th)
             {
-                auto&& thbestModel = threadLocalBestModel[th]();
-                auto inl           = thbestModel.first;
-                auto it            = thbestModel.second;
-                //                std::cout << "th best " << th << " " << it << " " << inl << std::endl;
-                if (inl > bestCount)
-                {
-                    bestCount = inl;
-                    bestIdx   = it;
-                }
+                if (threadStates[th]().numInliers > threadStates[bestThread]().numInliers) bestThread = th;
+            }
+            auto& best     = threadStates[bestThread]();
+            bestNumInliers = best.numInliers;
+            bestModel      = best.model;
+            if (bestNumInliers > 0)
+            {
+                bestInlierMask = best.inlierMask;
+            }
+            else
+            {
+                bestInlierMask.assign(N, 0);
             }
         }
-        return bestIdx;
+        return bestNumInliers;
     }
 
 
     // total number of sample points
     int N;
     RansacParameters params;
-    AlignedVector<std::vector<double>> residuals;
-    AlignedVector<std::vector<char>> inliers;
-    AlignedVector<int> numInliers;
-    AlignedVector<Model> models;
+    RansacKernel kernel = RansacKernel::Scalar;
+
+    // The result of compute()
+    Model bestModel;
+    std::vector<char> bestInlierMask;
+    int bestNumInliers = 0;
+
+   private:
+    static constexpr int iterationsPerRound = 16;
+
+    // The SPRT evaluates blocks of consecutive points in random order, so that batched kernels can be used
+    static constexpr int sprtBlockSize = 16;
+
+    struct ThreadState
+    {
+        Model model, candidate;
+        int numInliers = 0;
+        std::vector<char> inlierMask, candidateMask;
+
+        // Number of tested and consistent points of the hypotheses rejected by the SPRT
+        long rejectedTested     = 0;
+        long rejectedConsistent = 0;
+    };
 
     // make sure we don't run into false sharing
-    AlignedVector<AlignedStruct<std::pair<int, int>, SAIGA_CACHE_LINE_SIZE>> threadLocalBestModel;
+    AlignedVector<AlignedStruct<ThreadState, SAIGA_CACHE_LINE_SIZE>> threadStates;
 
     // each thread has one generator
     std::vector<std::mt19937> generators;
+    std::mt19937 orderGenerator;
 
-    int bestIdx;
+    int iterationBound = 0;
+    int numIterations  = 0;
+
+    // SPRT state. The likelihood ratio is accumulated in the log domain.
+    std::vector<int> evaluationOrder;
+    double sprtDelta, sprtEpsilon, sprtThreshold;
+    double sprtLogInlier, sprtLogOutlier, sprtLogThreshold;
+
+    // PROSAC: prosacGrowth[n - ModelSize] is the iteration after which the sampling set grows beyond the n best points
+    std::vector<int> prosacGrowth;
 
-   private:
     Derived& derived() { return *static_cast<Derived*>(this); }
+
+    void sample(int it, std::mt19937& gen, Subset& set)
+    {
+        int n = N;
+        int k = 0;
+        if (params.prosac)
+        {
+            n = ModelSize + (std::upper_bound(prosacGrowth.begin(), prosacGrowth.end(), it + 1) - prosacGrowth.begin());
+            if (n < N)
+            {
+                // The newest point of the sampling set is always part of the sample
+                set[k++] = n - 1;
+                n--;
+            }
+        }
+
+        std::uniform_int_distribution<int> dis(0, n - 1);
+        while (k < ModelSize)
+        {
+            int idx = dis(gen);
+            if (std::find(set.begin(), set.begin() + k, idx) == set.begin() + k) set[k++] = idx;
+        }
+    }
+
+    void evaluateHypothesis(int it, std::mt19937& gen, ThreadState& state)
+    {
+        Subset set;
+        sample(it, gen, set);
+
+        auto& model = state.candidate;
+        if (!derived().computeModel(set, model)) return;
+
+        int numInlier = 0;
+        auto& mask    = state.candidateMask;
+        switch (params.verification)
+        {
+            case RansacParameters::Verification::Tdd:
+            {
+                std::uniform_int_distribution<int> dis(0, N - 1);
+                for (int d = 0; d < params.tdd_d; ++d)
+                {
+                    if (derived().computeResidual(model, dis(gen)) >= params.residualThreshold) return;
+                }
+            }
+                [[fallthrough]];
+            case RansacParameters::Verification::Full:
+            {
+                numInlier = derived().computeInliers(model, 0, N, mask.data());
+                break;
+            }
+            case RansacParameters::Verification::SPRT:
+            {
+                double logLambda = 0;
+                int tested       = 0;
+                for (auto block : evaluationOrder)
+                {
+                    int begin = block * sprtBlockSize;
+                    int end   = std::min(begin + sprtBlockSize, N);
+                    int inl   = derived().computeInliers(model, begin, end, mask.data());
+                    numInlier += inl;
+                    tested += end - begin;
+                    logLambda += inl * sprtLogInlier + (end - begin - inl) * sprtLogOutlier;
+                    if (logLambda > sprtLogThreshold)
+                    {
+                        state.rejectedTested += tested;
+                        state.rejectedConsistent += numInlier;
+                        return;
+                    }
+                }
+                break;
+            }
+        }
+
+        if (numInlier > state.numInliers)
+        {
+            state.numInliers = numInlier;
+            state.model      = model;
+            std::swap(state.inlierMask, state.candidateMask);
+        }
+    }
+
+    // Called by one thread after each round
+    void updateBound()
+    {
+        int best            = 0;
+        long rejectedTested = 0, rejectedConsistent = 0;
+        for (auto& s : threadStates)
+        {
+            best = std::max(best, s().numInliers);
+            rejectedTested += s().rejectedTested;
+            rejectedConsistent += s().rejectedConsistent;
+        }
+
+        // Probability that a good sample is not rejected by the verification
+        double acceptProbability = 1;
+        if (params.verification == RansacParameters::Verification::SPRT)
+        {
+            if (rejectedTested > 0) sprtDelta = std::clamp(double(rejectedConsistent) / rejectedTested, 1e-4, 0.5);
+            if (best > 0) sprtEpsilon = std::min(double(best) / N, 1 - 1e-6);
+            updateSPRTThreshold();
+            acceptProbability = 1 - 1 / sprtThreshold;
+        }
+        else if (params.verification == RansacParameters::Verification::Tdd && best > 0)
+        {
+            acceptProbability = std::pow(double(best) / N, params.tdd_d);
+        }
+
+        if (params.confidence < 1 && best > 0)
+        {
+            double goodSample = std::pow(double(best) / N, ModelSize) * acceptProbability;
+            double k          = params.maxIterations;
+            if (goodSample >= 1)
+            {
+                k = 1;
+            }
+            else if (goodSample > 0)
+            {
+                k = std::ceil(std::log(1 - params.confidence) / std::log(1 - goodSample));
+            }
+            iterationBound = (int)std::min<double>(iterationBound, std::max(k, 1.0));
+        }
+    }
+
+    void updateSPRTThreshold()
+    {
+        sprtLogInlier  = std::log(sprtDelta / sprtEpsilon);
+        sprtLogOutlier = std::log((1 - sprtDelta) / (1 - sprtEpsilon));
+        if (sprtEpsilon <= sprtDelta)
+        {
+            // Bad and good models can not be distinguished -> no early rejection
+            sprtThreshold    = std::numeric_limits<double>::infinity();
+            sprtLogThreshold = sprtThreshold;
+            return;
+        }
+        // Optimal decision threshold A = K + 1 + log(A) (Matas and Chum 2005, eq. 2)
+        double C = (1 - sprtDelta) * std::log((1 - sprtDelta) / (1 - sprtEpsilon)) +
+                   sprtDelta * std::log(sprtDelta / sprtEpsilon);
+        double K = params.sprt_model_time * C;
+        double A = K + 1;
+        for (int i = 0; i < 10; ++i)
+        {
+            A = K + 1 + std::log(A);
+        }
+        sprtThreshold    = std::max(A, 1.0 + 1e-5);
+        sprtLogThreshold = std::log(sprtThreshold);
+    }
+
+    void computeProsacGrowth()
+    {
+        // T_n: expected number of samples drawn from the n best points (T_N = maxIterations)
+        double Tn = params.maxIterations;
+        for (int i = 0; i < ModelSize; ++i)
+        {
+            Tn *= double(ModelSize - i) / (N - i);
+        }
+
+        prosacGrowth.resize(N - ModelSize);
+        int Tn_prime = 1;
+        for (int n = ModelSize; n < N; ++n)
+        {
+            prosacGrowth[n - ModelSize] = Tn_prime;
+            double Tn_next              = Tn * (n + 1) / (n + 1 - ModelSize);
+            Tn_prime += std::ceil(Tn_next - Tn);
+            Tn = Tn_next;
+        }
+    }
 };
 
 inline int RansacIterationsFromProbability(int input_N, double probability, int minInliers, int maxIterations)
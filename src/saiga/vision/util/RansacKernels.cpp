@@ -0,0 +1,484 @@
+/**
+ * Copyright (c) 2021 Darius Rückert
+ * Licensed under the MIT License.
+ * See LICENSE file for more information.
+ */
+
+#include "RansacKernels.h"
+
+#include "saiga/core/math/imath.h"
+#include "saiga/core/util/CpuFeatures.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(SAIGA_HAS_TARGET_ATTRIBUTE) || defined(__AVX2__)
+#    include <immintrin.h>
+#    define SAIGA_RANSAC_AVX2
+#endif
+
+#if defined(SAIGA_HAS_TARGET_ATTRIBUTE) || defined(__AVX512F__)
+#    define SAIGA_RANSAC_AVX512
+#endif
+
+namespace Saiga
+{
+RansacKernel SupportedRansacKernel(RansacKernel kernel)
+{
+    auto& cpu = GetCpuFeatures();
+
+    // The AVX-512 kernels only use AVX-512F instructions, but SAIGA_TARGET_AVX512 also enables BW.
+    // VPOPCNTDQ is not enabled, so the kernels also run on Skylake-X and Cascade Lake.
+    bool avx512 = cpu.avx512f && cpu.avx512bw;
+    bool avx2   = cpu.avx2 && cpu.fma;
+#if !defined(SAIGA_RANSAC_AVX512)
+    avx512 = false;
+#endif
+#if !defined(SAIGA_RANSAC_AVX2)
+    avx2 = false;
+#endif
+
+    if (kernel == RansacKernel::Auto || kernel == RansacKernel::AVX512)
+    {
+        kernel = avx512 ? RansacKernel::AVX512 : RansacKernel::AVX2;
+    }
+    if (kernel == RansacKernel::AVX2 && !avx2)
+    {
+        kernel = RansacKernel::Scalar;
+    }
+    return kernel;
+}
+
+void RansacPointSet::Set(ArrayView<const Vec2> points1, ArrayView<const Vec2> points2)
+{
+    SAIGA_ASSERT(points1.size() == points2.size());
+    n      = points1.size();
+    stride = iAlignUp(n, 16);
+    data.assign(4 * stride, 0);
+
+    float* x1 = data.data();
+    float* y1 = x1 + stride;
+    float* x2 = y1 + stride;
+    float* y2 = x2 + stride;
+    for (int i = 0; i < n; ++i)
+    {
+        x1[i] = points1[i](0);
+        y1[i] = points1[i](1);
+        x2[i] = points2[i](0);
+        y2[i] = points2[i](1);
+    }
+}
+
+void RansacPointSet::Set(ArrayView<const Vec3> points1, ArrayView<const Vec2> points2)
+{
+    SAIGA_ASSERT(points1.size() == points2.size());
+    n      = points1.size();
+    stride = iAlignUp(n, 16);
+    data.assign(5 * stride, 0);
+
+    float* x = data.data();
+    float* y = x + stride;
+    float* z = y + stride;
+    float* u = z + stride;
+    float* v = u + stride;
+    for (int i = 0; i < n; ++i)
+    {
+        x[i] = points1[i](0);
+        y[i] = points1[i](1);
+        z[i] = points1[i](2);
+        u[i] = points2[i](0);
+        v[i] = points2[i](1);
+    }
+}
+
+namespace
+{
+// The model parameters in single precision
+struct KernelModel
+{
+    // Row-major 3x3 matrix and a translation
+    float m[12] = {};
+
+    KernelModel(const Mat3& M)
+    {
+        for (int r = 0; r < 3; ++r)
+            for (int c = 0; c < 3; ++c) m[r * 3 + c] = M(r, c);
+    }
+
+    KernelModel(const SE3& T) : KernelModel(Mat3(T.rotationMatrix()))
+    {
+        for (int r = 0; r < 3; ++r) m[9 + r] = T.translation()(r);
+    }
+};
+
+using KernelFunction = int (*)(const KernelModel& model, const RansacPointSet& points, int begin, int end,
+                               float threshold, char* mask);
+
+// ================= Scalar =================
+
+int EpipolarScalar(const KernelModel& model, const RansacPointSet& points, int begin, int end, float threshold,
+                   char* mask)
+{
+    const float* f  = model.m;
+    const float* x1 = points.Row(0);
+    const float* y1 = points.Row(1);
+    const float* x2 = points.Row(2);
+    const float* y2 = points.Row(3);
+
+    int count = 0;
+    for (int j = begin; j < end; ++j)
+    {
+        float l0 = f[0] * x1[j] + f[1] * y1[j] + f[2];
+        float l1 = f[3] * x1[j] + f[4] * y1[j] + f[5];
+        float l2 = f[6] * x1[j] + f[7] * y1[j] + f[8];
+        float d  = x2[j] * l0 + y2[j] * l1 + l2;
+
+        // d^2 / |l|^2 < threshold without the division
+        bool inl = d * d < threshold * (l0 * l0 + l1 * l1);
+        mask[j]  = inl;
+        count += inl;
+    }
+    return count;
+}
+
+int HomographyScalar(const KernelModel& model, const RansacPointSet& points, int begin, int end, float threshold,
+                     char* mask)
+{
+    const float* h  = model.m;
+    const float* x1 = points.Row(0);
+    const float* y1 = points.Row(1);
+    const float* x2 = points.Row(2);
+    const float* y2 = points.Row(3);
+
+    int count = 0;
+    for (int j = begin; j < end; ++j)
+    {
+        float px   = h[0] * x1[j] + h[1] * y1[j] + h[2];
+        float py   = h[3] * x1[j] + h[4] * y1[j] + h[5];
+        float pz   = h[6] * x1[j] + h[7] * y1[j] + h[8];
+        float invz = 1.0f / pz;
+        float rx   = x2[j] - px * invz;
+        float ry   = y2[j] - py * invz;
+
+        bool inl = rx * rx + ry * ry < threshold;
+        mask[j]  = inl;
+        count += inl;
+    }
+    return count;
+}
+
+int ReprojectionScalar(const KernelModel& model, const RansacPointSet& points, int begin, int end, float threshold,
+                       char* mask)
+{
+    const float* t = model.m;
+    const float* x = points.Row(0);
+    const float* y = points.Row(1);
+    const float* z = points.Row(2);
+    const float* u = points.Row(3);
+    const float* v = points.Row(4);
+
+    int count = 0;
+    for (int j = begin; j < end; ++j)
+    {
+        float qx   = t[0] * x[j] + t[1] * y[j] + t[2] * z[j] + t[9];
+        float qy   = t[3] * x[j] + t[4] * y[j] + t[5] * z[j] + t[10];
+        float qz   = t[6] * x[j] + t[7] * y[j] + t[8] * z[j] + t[11];
+        float invz = 1.0f / qz;
+        float ru   = qx * invz - u[j];
+        float rv   = qy * invz - v[j];
+
+        bool inl = ru * ru + rv * rv < threshold;
+        mask[j]  = inl;
+        count += inl;
+    }
+    return count;
+}
+
+#if defined(SAIGA_RANSAC_AVX2)
+// The 8 mask bytes of each 8-bit comparison result
+struct MaskBytes
+{
+    uint64_t bytes[256] = {};
+    constexpr MaskBytes()
+    {
+        for (int i = 0; i < 256; ++i)
+            for (int b = 0; b < 8; ++b)
+                if (i & (1 << b)) bytes[i] |= uint64_t(1) << (8 * b);
+    }
+};
+constexpr MaskBytes mask_bytes;
+
+inline void StoreMask8(char* mask, unsigned bits)
+{
+    std::memcpy(mask, &mask_bytes.bytes[bits], 8);
+}
+
+// ================= AVX2 =================
+// The range [begin, end) must be a multiple of 8.
+
+SAIGA_TARGET_AVX2 int EpipolarAVX2(const KernelModel& model, const RansacPointSet& points, int begin, int end,
+                                   float threshold, char* mask)
+{
+    __m256 f[9];
+    for (int k = 0; k < 9; ++k) f[k] = _mm256_set1_ps(model.m[k]);
+    __m256 th = _mm256_set1_ps(threshold);
+
+    int count = 0;
+    for (int j = begin; j < end; j += 8)
+    {
+        __m256 x1 = _mm256_loadu_ps(points.Row(0) + j);
+        __m256 y1 = _mm256_loadu_ps(points.Row(1) + j);
+        __m256 x2 = _mm256_loadu_ps(points.Row(2) + j);
+        __m256 y2 = _mm256_loadu_ps(points.Row(3) + j);
+
+        __m256 l0 = _mm256_fmadd_ps(f[0], x1, _mm256_fmadd_ps(f[1], y1, f[2]));
+        __m256 l1 = _mm256_fmadd_ps(f[3], x1, _mm256_fmadd_ps(f[4], y1, f[5]));
+        __m256 l2 = _mm256_fmadd_ps(f[6], x1, _mm256_fmadd_ps(f[7], y1, f[8]));
+        __m256 d  = _mm256_fmadd_ps(x2, l0, _mm256_fmadd_ps(y2, l1, l2));
+
+        __m256 len = _mm256_fmadd_ps(l0, l0, _mm256_mul_ps(l1, l1));
+        __m256 inl = _mm256_cmp_ps(_mm256_mul_ps(d, d), _mm256_mul_ps(th, len), _CMP_LT_OQ);
+
+        unsigned bits = _mm256_movemask_ps(inl);
+        StoreMask8(mask + j, bits);
+        count += _mm_popcnt_u32(bits);
+    }
+    return count;
+}
+
+SAIGA_TARGET_AVX2 int HomographyAVX2(const KernelModel& model, const RansacPointSet& points, int begin, int end,
+                                     float threshold, char* mask)
+{
+    __m256 h[9];
+    for (int k = 0; k < 9; ++k) h[k] = _mm256_set1_ps(model.m[k]);
+    __m256 th  = _mm256_set1_ps(threshold);
+    __m256 one = _mm256_set1_ps(1.0f);
+
+    int count = 0;
+    for (int j = begin; j < end; j += 8)
+    {
+        __m256 x1 = _mm256_loadu_ps(points.Row(0) + j);
+        __m256 y1 = _mm256_loadu_ps(points.Row(1) + j);
+        __m256 x2 = _mm256_loadu_ps(points.Row(2) + j);
+        __m256 y2 = _mm256_loadu_ps(points.Row(3) + j);
+
+        __m256 px   = _mm256_fmadd_ps(h[0], x1, _mm256_fmadd_ps(h[1], y1, h[2]));
+        __m256 py   = _mm256_fmadd_ps(h[3], x1, _mm256_fmadd_ps(h[4], y1, h[5]));
+        __m256 pz   = _mm256_fmadd_ps(h[6], x1, _mm256_fmadd_ps(h[7], y1, h[8]));
+        __m256 invz = _mm256_div_ps(one, pz);
+        __m256 rx   = _mm256_fnmadd_ps(px, invz, x2);
+        __m256 ry   = _mm256_fnmadd_ps(py, invz, y2);
+
+        __m256 r2  = _mm256_fmadd_ps(rx, rx, _mm256_mul_ps(ry, ry));
+        __m256 inl = _mm256_cmp_ps(r2, th, _CMP_LT_OQ);
+
+        unsigned bits = _mm256_movemask_ps(inl);
+        StoreMask8(mask + j, bits);
+        count += _mm_popcnt_u32(bits);
+    }
+    return count;
+}
+
+SAIGA_TARGET_AVX2 int ReprojectionAVX2(const KernelModel& model, const RansacPointSet& points, int begin, int end,
+                                       float threshold, char* mask)
+{
+    __m256 t[12];
+    for (int k = 0; k < 12; ++k) t[k] = _mm256_set1_ps(model.m[k]);
+    __m256 th  = _mm256_set1_ps(threshold);
+    __m256 one = _mm256_set1_ps(1.0f);
+
+    int count = 0;
+    for (int j = begin; j < end; j += 8)
+    {
+        __m256 x = _mm256_loadu_ps(points.Row(0) + j);
+        __m256 y = _mm256_loadu_ps(points.Row(1) + j);
+        __m256 z = _mm256_loadu_ps(points.Row(2) + j);
+        __m256 u = _mm256_loadu_ps(points.Row(3) + j);
+        __m256 v = _mm256_loadu_ps(points.Row(4) + j);
+
+        __m256 qx = _mm256_fmadd_ps(t[0], x, _mm256_fmadd_ps(t[1], y, _mm256_fmadd_ps(t[2], z, t[9])));
+        __m256 qy = _mm256_fmadd_ps(t[3], x, _mm256_fmadd_ps(t[4], y, _mm256_fmadd_ps(t[5], z, t[10])));
+        __m256 qz = _mm256_fmadd_ps(t[6], x, _mm256_fmadd_ps(t[7], y, _mm256_fmadd_ps(t[8], z, t[11])));
+
+        __m256 invz = _mm256_div_ps(one, qz);
+        __m256 ru   = _mm256_fmsub_ps(qx, invz, u);
+        __m256 rv   = _mm256_fmsub_ps(qy, invz, v);
+
+        __m256 r2  = _mm256_fmadd_ps(ru, ru, _mm256_mul_ps(rv, rv));
+        __m256 inl = _mm256_cmp_ps(r2, th, _CMP_LT_OQ);
+
+        unsigned bits = _mm256_movemask_ps(inl);
+        StoreMask8(mask + j, bits);
+        count += _mm_popcnt_u32(bits);
+    }
+    return count;
+}
+#endif
+
+#if defined(SAIGA_RANSAC_AVX512)
+// ================= AVX-512 =================
+// The range [begin, end) must be a multiple of 16.
+
+SAIGA_TARGET_AVX512 int EpipolarAVX512(const KernelModel& model, const RansacPointSet& points, int begin, int end,
+                                       float threshold, char* mask)
+{
+    __m512 f[9];
+    for (int k = 0; k < 9; ++k) f[k] = _mm512_set1_ps(model.m[k]);
+    __m512 th = _mm512_set1_ps(threshold);
+
+    int count = 0;
+    for (int j = begin; j < end; j += 16)
+    {
+        __m512 x1 = _mm512_loadu_ps(points.Row(0) + j);
+        __m512 y1 = _mm512_loadu_ps(points.Row(1) + j);
+        __m512 x2 = _mm512_loadu_ps(points.Row(2) + j);
+        __m512 y2 = _mm512_loadu_ps(points.Row(3) + j);
+
+        __m512 l0 = _mm512_fmadd_ps(f[0], x1, _mm512_fmadd_ps(f[1], y1, f[2]));
+        __m512 l1 = _mm512_fmadd_ps(f[3], x1, _mm512_fmadd_ps(f[4], y1, f[5]));
+        __m512 l2 = _mm512_fmadd_ps(f[6], x1, _mm512_fmadd_ps(f[7], y1, f[8]));
+        __m512 d  = _mm512_fmadd_ps(x2, l0, _mm512_fmadd_ps(y2, l1, l2));
+
+        __m512 len     = _mm512_fmadd_ps(l0, l0, _mm512_mul_ps(l1, l1));
+        __mmask16 bits = _mm512_cmp_ps_mask(_mm512_mul_ps(d, d), _mm512_mul_ps(th, len), _CMP_LT_OQ);
+
+        StoreMask8(mask + j, bits & 0xff);
+        StoreMask8(mask + j + 8, bits >> 8);
+        count += _mm_popcnt_u32(bits);
+    }
+    return count;
+}
+
+SAIGA_TARGET_AVX512 int HomographyAVX512(const KernelModel& model, const RansacPointSet& points, int begin, int end,
+                                         float threshold, char* mask)
+{
+    __m512 h[9];
+    for (int k = 0; k < 9; ++k) h[k] = _mm512_set1_ps(model.m[k]);
+    __m512 th  = _mm512_set1_ps(threshold);
+    __m512 one = _mm512_set1_ps(1.0f);
+
+    int count = 0;
+    for (int j = begin; j < end; j += 16)
+    {
+        __m512 x1 = _mm512_loadu_ps(points.Row(0) + j);
+        __m512 y1 = _mm512_loadu_ps(points.Row(1) + j);
+        __m512 x2 = _mm512_loadu_ps(points.Row(2) + j);
+        __m512 y2 = _mm512_loadu_ps(points.Row(3) + j);
+
+        __m512 px   = _mm512_fmadd_ps(h[0], x1, _mm512_fmadd_ps(h[1], y1, h[2]));
+        __m512 py   = _mm512_fmadd_ps(h[3], x1, _mm512_fmadd_ps(h[4], y1, h[5]));
+        __m512 pz   = _mm512_fmadd_ps(h[6], x1, _mm512_fmadd_ps(h[7], y1, h[8]));
+        __m512 invz = _mm512_div_ps(one, pz);
+        __m512 rx   = _mm512_fnmadd_ps(px, invz, x2);
+        __m512 ry   = _mm512_fnmadd_ps(py, invz, y2);
+
+        __m512 r2      = _mm512_fmadd_ps(rx, rx, _mm512_mul_ps(ry, ry));
+        __mmask16 bits = _mm512_cmp_ps_mask(r2, th, _CMP_LT_OQ);
+
+        StoreMask8(mask + j, bits & 0xff);
+        StoreMask8(mask + j + 8, bits >> 8);
+        count += _mm_popcnt_u32(bits);
+    }
+    return count;
+}
+
+SAIGA_TARGET_AVX512 int ReprojectionAVX512(const KernelModel& model, const RansacPointSet& points, int begin,
+                                           int end, float threshold, char* mask)
+{
+    __m512 t[12];
+    for (int k = 0; k < 12; ++k) t[k] = _mm512_set1_ps(model.m[k]);
+    __m512 th  = _mm512_set1_ps(threshold);
+    __m512 one = _mm512_set1_ps(1.0f);
+
+    int count = 0;
+    for (int j = begin; j < end; j += 16)
+    {
+        __m512 x = _mm512_loadu_ps(points.Row(0) + j);
+        __m512 y = _mm512_loadu_ps(points.Row(1) + j);
+        __m512 z = _mm512_loadu_ps(points.Row(2) + j);
+        __m512 u = _mm512_loadu_ps(points.Row(3) + j);
+        __m512 v = _mm512_loadu_ps(points.Row(4) + j);
+
+        __m512 qx = _mm512_fmadd_ps(t[0], x, _mm512_fmadd_ps(t[1], y, _mm512_fmadd_ps(t[2], z, t[9])));
+        __m512 qy = _mm512_fmadd_ps(t[3], x, _mm512_fmadd_ps(t[4], y, _mm512_fmadd_ps(t[5], z, t[10])));
+        __m512 qz = _mm512_fmadd_ps(t[6], x, _mm512_fmadd_ps(t[7], y, _mm512_fmadd_ps(t[8], z, t[11])));
+
+        __m512 invz = _mm512_div_ps(one, qz);
+        __m512 ru   = _mm512_fmsub_ps(qx, invz, u);
+        __m512 rv   = _mm512_fmsub_ps(qy, invz, v);
+
+        __m512 r2      = _mm512_fmadd_ps(ru, ru, _mm512_mul_ps(rv, rv));
+        __mmask16 bits = _mm512_cmp_ps_mask(r2, th, _CMP_LT_OQ);
+
+        StoreMask8(mask + j, bits & 0xff);
+        StoreMask8(mask + j + 8, bits >> 8);
+        count += _mm_popcnt_u32(bits);
+    }
+    return count;
+}
+#endif
+
+// Runs the SIMD kernel on the largest multiple of the vector width and the scalar kernel on the rest.
+int Dispatch(KernelFunction scalar, KernelFunction avx2, KernelFunction avx512, RansacKernel kernel,
+             const KernelModel& model, const RansacPointSet& points, int begin, int end, double threshold,
+             char* mask)
+{
+    SAIGA_DEBUG_ASSERT(begin >= 0 && end <= points.size());
+
+    int width           = 1;
+    KernelFunction simd = scalar;
+    if (kernel == RansacKernel::AVX512 && avx512)
+    {
+        width = 16;
+        simd  = avx512;
+    }
+    else if (kernel == RansacKernel::AVX2 && avx2)
+    {
+        width = 8;
+        simd  = avx2;
+    }
+
+    int simd_end = begin + (end - begin) / width * width;
+    int count    = simd(model, points, begin, simd_end, threshold, mask);
+    count += scalar(model, points, simd_end, end, threshold, mask);
+    return count;
+}
+
+#if defined(SAIGA_RANSAC_AVX2)
+#    define SAIGA_RANSAC_AVX2_KERNEL(_name) _name
+#else
+#    define SAIGA_RANSAC_AVX2_KERNEL(_name) nullptr
+#endif
+
+#if defined(SAIGA_RANSAC_AVX512)
+#    define SAIGA_RANSAC_AVX512_KERNEL(_name) _name
+#else
+#    define SAIGA_RANSAC_AVX512_KERNEL(_name) nullptr
+#endif
+
+}  // namespace
+
+int EpipolarInliers(const Mat3& F, const RansacPointSet& points, int begin, int end, double threshold, char* mask,
+                    RansacKernel kernel)
+{
+    return Dispatch(EpipolarScalar, SAIGA_RANSAC_AVX2_KERNEL(EpipolarAVX2), SAIGA_RANSAC_AVX512_KERNEL(EpipolarAVX512),
+                    kernel, KernelModel(F), points, begin, end, threshold, mask);
+}
+
+int HomographyInliers(const Mat3& H, const RansacPointSet& points, int begin, int end, double threshold, char* mask,
+                      RansacKernel kernel)
+{
+    return Dispatch(HomographyScalar, SAIGA_RANSAC_AVX2_KERNEL(HomographyAVX2),
+                    SAIGA_RANSAC_AVX512_KERNEL(HomographyAVX512), kernel, KernelModel(H), points, begin, end,
+                    threshold, mask);
+}
+
+int ReprojectionInliers(const SE3& T, const RansacPointSet& points, int begin, int end, double threshold, char* mask,
+                        RansacKernel kernel)
+{
+    return Dispatch(ReprojectionScalar, SAIGA_RANSAC_AVX2_KERNEL(ReprojectionAVX2),
+                    SAIGA_RANSAC_AVX512_KERNEL(ReprojectionAVX512), kernel, KernelModel(T), points, begin, end,
+                    threshold, mask);
+}
+
+}  // namespace Saiga
@@ -0,0 +1,75 @@
+/**
+ * Copyright (c) 2021 Darius Rückert
+ * Licensed under the MIT License.
+ * See LICENSE file for more information.
+ */
+
+#pragma once
+
+#include "saiga/vision/VisionTypes.h"
+
+#include <vector>
+
+namespace Saiga
+{
+/**
+ * Batched inlier tests for the hypothesis verification of the ransac solvers.
+ *
+ * The correspondences are stored once per solve in a single precision SoA layout (RansacPointSet). A kernel
+ * evaluates the residuals of a range of correspondences against one model and writes the inlier mask and the number
+ * of inliers in the same pass:
+ *   - AVX-512: 16 correspondences per instruction
+ *   - AVX2: 8 correspondences per instruction
+ *   - Scalar: one correspondence at a time
+ * The residuals are the same as EpipolarDistanceSquared(), homographyResidual() and P3PRansac::computeResidual(),
+ * but are computed in single precision. Correspondences very close to the threshold can therefore be classified
+ * differently than with the double precision functions.
+ */
+enum class RansacKernel
+{
+    Auto,
+    Scalar,
+    AVX2,
+    AVX512,
+};
+
+// Returns the requested kernel or the next best kernel supported by the cpu.
+SAIGA_VISION_API RansacKernel SupportedRansacKernel(RansacKernel kernel);
+
+
+class SAIGA_VISION_API RansacPointSet
+{
+   public:
+    // 2D-2D correspondences. Rows: x1, y1, x2, y2
+    void Set(ArrayView<const Vec2> points1, ArrayView<const Vec2> points2);
+
+    // 3D-2D correspondences. Rows: x, y, z, u, v
+    void Set(ArrayView<const Vec3> points1, ArrayView<const Vec2> points2);
+
+    int size() const { return n; }
+
+    // The rows are padded with zeros to a multiple of 16 elements.
+    const float* Row(int r) const { return data.data() + r * stride; }
+
+   private:
+    int n      = 0;
+    int stride = 0;
+    std::vector<float> data;
+};
+
+// The kernels evaluate the correspondences [begin, end) of 'points', set mask[j] = (residual_j < threshold) and
+// return the number of inliers. 'kernel' must be supported by the cpu (see SupportedRansacKernel).
+
+// Squared distance of p2 to the epipolar line F * p1 (see EpipolarDistanceSquared).
+SAIGA_VISION_API int EpipolarInliers(const Mat3& F, const RansacPointSet& points, int begin, int end,
+                                     double threshold, char* mask, RansacKernel kernel);
+
+// Squared transfer error |p2 - H * p1|^2 (see homographyResidual).
+SAIGA_VISION_API int HomographyInliers(const Mat3& H, const RansacPointSet& points, int begin, int end,
+                                       double threshold, char* mask, RansacKernel kernel);
+
+// Squared reprojection error |(T * p).hnormalized() - u|^2 of a world point p and a normalized image point u.
+SAIGA_VISION_API int ReprojectionInliers(const SE3& T, const RansacPointSet& points, int begin, int end,
+                                         double threshold, char* mask, RansacKernel kernel);
+
+}  // namespace Saiga
@@ -0,0 +1,185 @@
+﻿/**
+ * Copyright (c) 2021 Darius Rückert
+ * Licensed under the MIT License.
+ * See LICENSE file for more information.
+ */
+
+#include "saiga/config.h"
+#include "saiga/core/Core.h"
+#include "saiga/core/geometry/AccelerationStructure.h"
+#include "saiga/core/math/all.h"
+
+#include "gtest/gtest.h"
+
+using namespace Saiga;
+using namespace Saiga::AccelerationStructure;
+
+// Triangles of very different sizes in the unit cube
+std::vector<Triangle> RandomTriangles(int n)
+{
+    std::vector<Triangle> result;
+    for (int i = 0; i < n; ++i)
+    {
+        float size = i % 50 == 0 ? 0.5 : 0.03;
+        Triangle t;
+        t.a = Random::MatrixUniform<vec3>(-1, 1);
+        t.b = t.a + Random::MatrixUniform<vec3>(-size, size);
+        t.c = t.a + Random::MatrixUniform<vec3>(-size, size);
+        result.push_back(t);
+    }
+    return result;
+}
+
+// The rays of a 'w x h' image from a camera at 'origin' looking at the origin of the world
+std::vector<Ray> ImageRays(const vec3& origin, int w, int h)
+{
+    vec3 forward = -origin.normalized();
+    vec3 right   = forward.cross(vec3(0, 1, 0)).normalized();
+    vec3 up      = right.cross(forward);
+
+    std::vector<Ray> result;
+    for (int y = 0; y < h; ++y)
+    {
+        for (int x = 0; x < w; ++x)
+        {
+            vec2 p   = vec2(x + 0.5f, y + 0.5f).array() / vec2(w, h).array() * 2.f - 1.f;
+            vec3 dir = forward + 0.6f * p.x() * right + 0.6f * p.y() * up;
+            result.push_back(Ray(dir.normalized(), origin));
+        }
+    }
+    return result;
+}
+
+void CheckIntersection(const RayTriangleIntersection& expected, const RayTriangleIntersection& actual)
+{
+    ASSERT_EQ(expected.valid, actual.valid);
+    if (expected.valid)
+    {
+        EXPECT_EQ(expected.t, actual.t);
+        EXPECT_EQ(expected.triangleIndex, actual.triangleIndex);
+    }
+}
+
+TEST(BVH, Closest)
+{
+    Random::setSeed(9345723);
+    auto triangles = RandomTriangles(5000);
+    auto rays      = ImageRays(vec3(0.5, 1, 3), 40, 30);
+
+    BruteForce bf(triangles);
+    ObjectMedianBVH median(triangles);
+    SAHBVH sah(triangles, 4, 4);
+
+    for (auto& ray : rays)
+    {
+        auto expected = bf.getClosest(ray);
+        CheckIntersection(expected, median.getClosest(ray));
+        CheckIntersection(expected, sah.getClosest(ray));
+    }
+}
+
+TEST(BVH, Packet)
+{
+    Random::setSeed(3458763);
+    auto triangles = RandomTriangles(5000);
+
+    // 197 is not a multiple of the packet size
+    auto rays = ImageRays(vec3(-1, 0.5, 3), 197, 20);
+
+    // A few incoherent rays starting inside the mesh
+    for (int i = 0; i < 100; ++i)
+    {
+        rays.push_back(Ray(Random::MatrixUniform<vec3>(-1, 1).normalized(), Random::MatrixUniform<vec3>(-1, 1)));
+    }
+
+    // Axis aligned rays (infinite inverse direction in the slab test)
+    for (int i = 0; i < 21; ++i)
+    {
+        vec3 dir = vec3::Zero();
+        dir(i % 3) = i % 2 ? 1 : -1;
+        rays.push_back(Ray(dir, Random::MatrixUniform<vec3>(-1, 1)));
+    }
+
+    BruteForce bf(triangles);
+    SAHBVH sah(triangles, 4, 4);
+
+    std::vector<RayTriangleIntersection> result(rays.size());
+    sah.getClosest(rays, result, 4);
+
+    for (int i = 0; i < (int)rays.size(); ++i)
+    {
+        CheckIntersection(bf.getClosest(rays[i]), result[i]);
+        CheckIntersection(sah.getClosest(rays[i]), result[i]);
+    }
+}
+
+TEST(BVH, All)
+{
+    Random::setSeed(2398475);
+    auto triangles = RandomTriangles(2000);
+    auto rays      = ImageRays(vec3(1, 1, 3), 20, 20);
+
+    BruteForce bf(triangles);
+    SAHBVH sah(triangles);
+
+    auto indices = [](const std::vector<RayTriangleIntersection>& inters) {
+        std::vector<int> result;
+        for (auto& i : inters) result.push_back(i.triangleIndex);
+        std::sort(result.begin(), result.end());
+        return result;
+    };
+
+    for (auto& ray : rays)
+    {
+        EXPECT_EQ(indices(bf.getAll(ray)), indices(sah.getAll(ray)));
+    }
+}
+
+TEST(BVH, ClosestPoint)
+{
+    Random::setSeed(5987345);
+    auto triangles = RandomTriangles(2000);
+
+    SAHBVH sah(triangles, 2);
+    ObjectMedianBVH median(triangles);
+
+    for (int i = 0; i < 200; ++i)
+    {
+        vec3 p = Random::MatrixUniform<vec3>(-2, 2);
+
+        std::pair<float, int> expected = {std::numeric_limits<float>::infinity(), -1};
+        for (int j = 0; j < (int)triangles.size(); ++j)
+        {
+            float d = triangles[j].Distance(p);
+            if (d < expected.first) expected = {d, j};
+        }
+        for (auto result : {sah.ClosestPoint(p), median.ClosestPoint(p)})
+        {
+            EXPECT_FLOAT_EQ(expected.first, result.first);
+            EXPECT_EQ(expected.second, result.second);
+        }
+    }
+}
+
+TEST(BVH, Degenerate)
+{
+    // Identical triangles cannot be separated by the SAH splits
+    std::vector<Triangle> triangles(1000);
+    for (auto& t : triangles)
+    {
+        t.a = vec3(0, 0, 0);
+        t.b = vec3(1, 0, 0);
+        t.c = vec3(0, 1, 0);
+    }
+
+    SAHBVH sah(triangles, 4, 2);
+    Ray ray(vec3(0, 0, -1), vec3(0.2, 0.2, 1));
+    auto inter = sah.getClosest(ray);
+    EXPECT_TRUE(inter.valid);
+    EXPECT_FLOAT_EQ(inter.t, 1);
+    EXPECT_EQ(sah.getAll(ray).size(), triangles.size());
+
+    SAHBVH empty(std::vector<Triangle>{});
+    EXPECT_FALSE(empty.getClosest(ray).valid);
+    EXPECT_EQ(empty.NumNodes(), 0);
+}
@@ -0,0 +1,213 @@
+/**
+ * Copyright (c) 2021 Darius Rückert
+ * Licensed under the MIT License.
+ * See LICENSE file for more information.
+ */
+
+#include "saiga/core/image/imageTransformations.h"
+#include "saiga/core/math/random.h"
+
+#include "gtest/gtest.h"
+
+#include <cmath>
+
+namespace Saiga
+{
+using namespace ImageTransformation;
+
+// Odd widths to test the scalar tail of the SIMD kernels. The last size is processed in parallel.
+static const std::vector<ImageDimensions> test_sizes = {{1, 1}, {7, 37}, {64, 129}, {300, 301}};
+
+static std::vector<ImageKernel> TestKernels()
+{
+    std::vector<ImageKernel> kernels = {ImageKernel::Scalar};
+    if (SupportedImageKernel(ImageKernel::AVX2) == ImageKernel::AVX2) kernels.push_back(ImageKernel::AVX2);
+    return kernels;
+}
+
+// The pixels of the view are not continuous in memory.
+template <typename T>
+struct TestImage
+{
+    TemplatedImage<T> image;
+    ImageView<T> view;
+
+    TestImage(ImageDimensions dims)
+        : image(dims.h + 1, dims.w + 3), view(image.getImageView().subImageView(1, 1, dims.h, dims.w))
+    {
+    }
+
+    TestImage(ImageDimensions dims, int max_value) : TestImage(dims)
+    {
+        for (int i = 0; i < view.rows; ++i)
+        {
+            auto ptr = view.rowPtrElement(i);
+            for (int j = 0; j < view.cols * int(sizeof(T) / sizeof(*ptr)); ++j)
+            {
+                ptr[j] = Random::uniformInt(0, max_value);
+            }
+        }
+    }
+};
+
+template <typename T>
+static void ExpectEqual(ImageView<const T> a, ImageView<const T> b)
+{
+    ASSERT_EQ(a.dimensions(), b.dimensions());
+    for (int i = 0; i < a.rows; ++i)
+    {
+        for (int j = 0; j < a.cols; ++j)
+        {
+            EXPECT_EQ(a(i, j), b(i, j));
+        }
+    }
+}
+
+TEST(ImageTransformations, Gray)
+{
+    for (auto dims : test_sizes)
+    {
+        TestImage<ucvec4> rgba(dims, 255);
+        TestImage<unsigned char> gray8(dims), gray8_ref(dims);
+        TestImage<float> grayf(dims), grayf_ref(dims);
+        TestImage<ucvec4> rgba2(dims), rgba2_ref(dims);
+
+        SetImageKernel(ImageKernel::Scalar);
+        RGBAToGray8(rgba.view, gray8_ref.view);
+        RGBAToGrayF(rgba.view, grayf_ref.view, 1.f / 255.f);
+        Gray8ToRGBA(gray8_ref.view, rgba2_ref.view, 17);
+
+        for (auto kernel : TestKernels())
+        {
+            SetImageKernel(kernel);
+            RGBAToGray8(rgba.view, gray8.view);
+            RGBAToGrayF(rgba.view, grayf.view, 1.f / 255.f);
+            Gray8ToRGBA(gray8_ref.view, rgba2.view, 17);
+
+            for (int i = 0; i < dims.rows; ++i)
+            {
+                for (int j = 0; j < dims.cols; ++j)
+                {
+                    auto c = rgba.view(i, j).cast<float>();
+                    EXPECT_NEAR(grayf_ref.view(i, j), (0.299f * c(0) + 0.587f * c(1) + 0.114f * c(2)) / 255.f, 1e-5);
+                    EXPECT_NEAR(grayf.view(i, j), grayf_ref.view(i, j), 1e-5);
+                    EXPECT_LE(std::abs(gray8.view(i, j) - gray8_ref.view(i, j)), 1);
+
+                    auto g = gray8_ref.view(i, j);
+                    EXPECT_EQ(rgba2.view(i, j), ucvec4(g, g, g, 17));
+                }
+            }
+            ExpectEqual<ucvec4>(rgba2.view, rgba2_ref.view);
+        }
+    }
+    SetImageKernel(ImageKernel::Auto);
+}
+
+TEST(ImageTransformations, ScaleDown2)
+{
+    for (auto dims : test_sizes)
+    {
+        // The last row and column of odd sized images are ignored
+        TestImage<ucvec4> src(ImageDimensions(dims.h * 2 + 1, dims.w * 2 + 1), 255);
+        TestImage<ucvec4> dst(dims);
+
+        for (auto kernel : TestKernels())
+        {
+            SetImageKernel(kernel);
+            ScaleDown2(src.view, dst.view);
+
+            for (int i = 0; i < dims.rows; ++i)
+            {
+                for (int j = 0; j < dims.cols; ++j)
+                {
+                    ivec4 sum = src.view(2 * i, 2 * j).cast<int>() + src.view(2 * i + 1, 2 * j).cast<int>() +
+                                src.view(2 * i, 2 * j + 1).cast<int>() + src.view(2 * i + 1, 2 * j + 1).cast<int>();
+                    EXPECT_EQ(dst.view(i, j), (sum / 4).cast<unsigned char>());
+                }
+            }
+        }
+    }
+    SetImageKernel(ImageKernel::Auto);
+}
+
+TEST(ImageTransformations, Depth)
+{
+    for (auto dims : test_sizes)
+    {
+        // Includes values outside of [minD, maxD]
+        TestImage<uint16_t> depth16(dims, 5000);
+        TestImage<float> depth(dims);
+        for (int i = 0; i < dims.rows; ++i)
+        {
+            for (int j = 0; j < dims.cols; ++j)
+            {
+                depth.view(i, j) = Random::sampleDouble(-1, 8);
+            }
+        }
+        depth.view(0, 0) = std::nan("");
+
+        TestImage<ucvec4> rgba16(dims), rgba16_ref(dims);
+        TestImage<ucvec4> rgba(dims), rgba_ref(dims);
+
+        SetImageKernel(ImageKernel::Scalar);
+        depthToRGBA(depth16.view, rgba16_ref.view, 1000, 4000);
+        depthToRGBA(depth.view, rgba_ref.view, 0.5, 7);
+        EXPECT_EQ(rgba_ref.view(0, 0), ucvec4(0, 0, 0, 255));
+
+        for (auto kernel : TestKernels())
+        {
+            SetImageKernel(kernel);
+            depthToRGBA(depth16.view, rgba16.view, 1000, 4000);
+            depthToRGBA(depth.view, rgba.view, 0.5, 7);
+            ExpectEqual<ucvec4>(rgba16.view, rgba16_ref.view);
+            ExpectEqual<ucvec4>(rgba.view, rgba_ref.view);
+        }
+
+        for (int i = 0; i < dims.rows; ++i)
+        {
+            for (int j = 0; j < dims.cols; ++j)
+            {
+                float d         = clamp((depth16.view(i, j) - 1000.f) / 3000.f, 0.f, 1.f);
+                unsigned char c = d * 255;
+                EXPECT_EQ(rgba16_ref.view(i, j), ucvec4(c, c, c, 255));
+            }
+        }
+    }
+    SetImageKernel(ImageKernel::Auto);
+}
+
+TEST(ImageTransformations, Error)
+{
+    for (auto dims : test_sizes)
+    {
+        TestImage<ucvec3> rgb1(dims, 255), rgb2(dims, 255);
+        TestImage<unsigned char> gray1(dims, 255), gray2(dims, 255);
+
+        long l1_rgb = 0, l1_gray = 0;
+        TemplatedImage<unsigned char> error_rgb(dims), error_gray(dims);
+        for (int i = 0; i < dims.rows; ++i)
+        {
+            for (int j = 0; j < dims.cols; ++j)
+            {
+                ivec3 diff       = (rgb1.view(i, j).cast<int>() - rgb2.view(i, j).cast<int>()).array().abs();
+                int diff_gray    = std::abs(gray1.view(i, j) - gray2.view(i, j));
+                error_rgb(i, j)  = diff.maxCoeff();
+                error_gray(i, j) = diff_gray;
+                l1_rgb += diff.sum();
+                l1_gray += diff_gray;
+            }
+        }
+
+        for (auto kernel : TestKernels())
+        {
+            SetImageKernel(kernel);
+            EXPECT_EQ(L1Difference(rgb1.view, rgb2.view), l1_rgb);
+            EXPECT_EQ(L1Difference(gray1.view, gray2.view), l1_gray);
+            ExpectEqual<unsigned char>(AbsolutePixelError(rgb1.view, rgb2.view), error_rgb);
+            ExpectEqual<unsigned char>(AbsolutePixelError(gray1.view, gray2.view), error_gray);
+        }
+    }
+    SetImageKernel(ImageKernel::Auto);
+}
+
+}  // namespace Saiga
@@ -120,3 +120,77 @@ TEST(kdtree, RadiusSearch)
         EXPECT_EQ(RadiusSearch(points, sp, r), tree.RadiusSearch(sp, r));
     }
 }
+
+TEST(kdtree, LeafSize)
+{
+    Random::setSeed(30947643);
+    auto search_points = RandomPoints(10);
+
+    for (int n : {0, 1, 2, 7, 100})
+    {
+        auto points = RandomPoints(n);
+        for (int leaf_size : {1, 3, 8, 32})
+        {
+            KDT tree(points, leaf_size);
+            EXPECT_EQ(tree.size(), n);
+            for (auto sp : search_points)
+            {
+                EXPECT_EQ(n == 0 ? -1 : NearestNeighborBruteForce(points, sp), tree.NearestNeighborSearch(sp));
+                EXPECT_EQ(KNearestNeighborBruteForce(points, sp, std::min(n, 5)), tree.KNearestNeighborSearch(sp, 5));
+                EXPECT_EQ(RadiusSearch(points, sp, 0.5), tree.RadiusSearch(sp, 0.5));
+            }
+        }
+    }
+}
+
+TEST(kdtree, BatchedKNearestNeighbour)
+{
+    Random::setSeed(30947643);
+    auto points        = RandomPoints(5000);
+    auto search_points = RandomPoints(500);
+    int k              = 8;
+    KDT tree(points, 8, 4);
+
+    std::vector<int> indices(search_points.size() * k);
+    std::vector<float> distances(search_points.size() * k);
+    tree.KNearestNeighborSearch(search_points, k, indices.data(), distances.data(), 4);
+
+    for (int i = 0; i < (int)search_points.size(); ++i)
+    {
+        auto& sp = search_points[i];
+        std::vector<int> knn(indices.begin() + i * k, indices.begin() + (i + 1) * k);
+        EXPECT_EQ(KNearestNeighborBruteForce(points, sp, k), knn);
+        for (int j = 0; j < k; ++j)
+        {
+            EXPECT_FLOAT_EQ(distances[i * k + j], (points[knn[j]] - sp).squaredNorm());
+        }
+    }
+
+    // Less points than k
+    KDT small_tree(RandomPoints(3));
+    std::vector<int> small_indices(2 * 5);
+    small_tree.KNearestNeighborSearch(ArrayView<const vec3>(search_points.data(), 2), 5, small_indices.data());
+    EXPECT_EQ(small_indices[3], -1);
+    EXPECT_EQ(small_indices[4], -1);
+    EXPECT_NE(small_indices[2], -1);
+}
+
+TEST(kdtree, BatchedRadiusSearch)
+{
+    Random::setSeed(30947643);
+    auto points        = RandomPoints(5000);
+    auto search_points = RandomPoints(500);
+    float r            = 0.2;
+    KDT tree(points, 8, 4);
+
+    std::vector<int> offsets, indices;
+    tree.RadiusSearch(search_points, r, offsets, indices, 4);
+
+    ASSERT_EQ(offsets.size(), search_points.size() + 1);
+    EXPECT_EQ(offsets.back(), indices.size());
+    for (int i = 0; i < (int)search_points.size(); ++i)
+    {
+        std::vector<int> result(indices.begin() + offsets[i], indices.begin() + offsets[i + 1]);
+        EXPECT_EQ(RadiusSearch(points, search_points[i], r), result);
+    }
+}
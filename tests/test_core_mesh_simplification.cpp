@@ -0,0 +1,143 @@
+/**
+ * Copyright (c) 2021 Darius Rückert
+ * Licensed under the MIT License.
+ * See LICENSE file for more information.
+ */
+
+#include "saiga/core/geometry/sphere.h"
+#include "saiga/core/model/MeshSimplification.h"
+#include "saiga/core/model/model_from_shape.h"
+
+#include "gtest/gtest.h"
+
+#include <map>
+
+namespace Saiga
+{
+// A flat n x n grid in the xy-plane. The left half is red and the right half is blue.
+static UnifiedMesh Grid(int n)
+{
+    UnifiedMesh mesh;
+    for (int y = 0; y < n; ++y)
+    {
+        for (int x = 0; x < n; ++x)
+        {
+            mesh.position.push_back(vec3(x, y, 0));
+            mesh.color.push_back(x < n / 2 ? vec4(1, 0, 0, 1) : vec4(0, 0, 1, 1));
+        }
+    }
+    for (int y = 0; y < n - 1; ++y)
+    {
+        for (int x = 0; x < n - 1; ++x)
+        {
+            int i = y * n + x;
+            mesh.triangles.push_back(ivec3(i, i + 1, i + n));
+            mesh.triangles.push_back(ivec3(i + 1, i + n + 1, i + n));
+        }
+    }
+    return mesh;
+}
+
+static UnifiedMesh TestSphere(int resolution)
+{
+    auto mesh = IcoSphereMesh(Sphere(vec3(0, 0, 0), 1), resolution);
+    mesh.RemoveDoubles(1e-5);
+    return mesh;
+}
+
+// Every edge of a closed 2-manifold has exactly two triangles with opposite orientation.
+static void CheckClosedManifold(const UnifiedMesh& mesh)
+{
+    std::map<std::pair<int, int>, int> directed_edges;
+    for (auto t : mesh.triangles)
+    {
+        EXPECT_TRUE(t(0) != t(1) && t(0) != t(2) && t(1) != t(2));
+        for (int k = 0; k < 3; ++k)
+        {
+            directed_edges[{t(k), t((k + 1) % 3)}]++;
+        }
+    }
+    for (auto [e, count] : directed_edges)
+    {
+        EXPECT_EQ(count, 1);
+        EXPECT_EQ(directed_edges.count({e.second, e.first}), 1);
+    }
+}
+
+TEST(MeshSimplification, FlatGrid)
+{
+    auto mesh = Grid(40);
+
+    MeshSimplificationParams params;
+    params.target_triangles = 200;
+    auto result             = SimplifyMesh(mesh, params);
+
+    EXPECT_LE(result.NumFaces(), 200);
+    EXPECT_GE(result.NumFaces(), 150);
+    ASSERT_EQ(result.NumVertices(), result.color.size());
+
+    // The plane and its boundary are preserved
+    auto bb = result.BoundingBox();
+    EXPECT_EQ(bb.min, vec3(0, 0, 0));
+    EXPECT_EQ(bb.max, vec3(39, 39, 0));
+
+    // The color seam is not smeared across the grid
+    for (int i = 0; i < result.NumVertices(); ++i)
+    {
+        if (result.position[i].x() < 15)
+        {
+            EXPECT_EQ(result.color[i], vec4(1, 0, 0, 1));
+        }
+        if (result.position[i].x() > 24)
+        {
+            EXPECT_EQ(result.color[i], vec4(0, 0, 1, 1));
+        }
+    }
+}
+
+TEST(MeshSimplification, ErrorBound)
+{
+    auto mesh = TestSphere(4);
+    MeshSimplificationParams params;
+
+    // A tight bound on a curved surface allows almost no collapses
+    params.max_error = 1e-10;
+    EXPECT_GT(SimplifyMesh(mesh, params).NumFaces(), mesh.NumFaces() * 0.9);
+
+    // A flat surface can be reduced to a few triangles
+    EXPECT_LE(SimplifyMesh(Grid(20), params).NumFaces(), 10);
+}
+
+TEST(MeshSimplification, Sphere)
+{
+    auto mesh = TestSphere(4);
+    MeshSimplificationParams params;
+    params.target_triangles = mesh.NumFaces() / 10;
+    auto result             = SimplifyMesh(mesh, params);
+
+    EXPECT_LE(result.NumFaces(), params.target_triangles);
+    CheckClosedManifold(result);
+    for (auto& p : result.position)
+    {
+        EXPECT_NEAR(p.norm(), 1, 0.05);
+    }
+}
+
+TEST(MeshSimplification, Clusters)
+{
+    auto mesh = TestSphere(5);
+    MeshSimplificationParams params;
+    params.target_triangles = mesh.NumFaces() / 10;
+    params.clusters         = 8;
+    auto result             = SimplifyMesh(mesh, params);
+
+    EXPECT_LE(result.NumFaces(), params.target_triangles);
+    EXPECT_GE(result.NumFaces(), params.target_triangles * 0.9);
+    CheckClosedManifold(result);
+    for (auto& p : result.position)
+    {
+        EXPECT_NEAR(p.norm(), 1, 0.05);
+    }
+}
+
+}  // namespace Saiga
@@ -0,0 +1,179 @@
+/**
+ * Copyright (c) 2021 Darius Rückert
+ * Licensed under the MIT License.
+ * See LICENSE file for more information.
+ */
+
+#include "saiga/core/model/model_loader_obj.h"
+
+#include "gtest/gtest.h"
+
+#include <fstream>
+
+namespace Saiga
+{
+TEST(ObjLoader, Small)
+{
+    {
+        std::ofstream strm("obj_test.mtl");
+        strm << "newmtl red\nKd 1 0 0\nnewmtl blue\nKd 0 0 1\n";
+    }
+    {
+        std::ofstream strm("obj_test.obj");
+        strm << "# test file\r\n"
+             << "mtllib obj_test.mtl\r\n"
+             << "v 0 0 0 1 0 0\r\n"
+             << "v 1 0 0 0 1 0\r\n"
+             << "v 1 1 0 0 0 1\r\n"
+             << "v 0 1 0 1 1 1\r\n"
+             << "vt 0 0\nvt 1 0\nvt 1 1\nvt 0 1\n"
+             << "vn 0 0 1\n"
+             << "usemtl blue\n"
+             << "f 1/1/1 2/2/1 3/3/1 4/4/1\n"
+             << "usemtl red\n"
+             << "g group\n"
+             << "f -4//-1 -3//-1 -2//-1\n"
+             << "f 3//1 4//1 1//1\n";
+    }
+
+    ObjModelLoader loader("obj_test.obj");
+    auto& model = loader.out_model;
+
+    ASSERT_EQ(model.materials.size(), 2);
+    ASSERT_EQ(model.mesh.size(), 2);
+    ASSERT_EQ(model.material_groups.size(), 2);
+
+    // quad -> 2 triangles with 4 vertices
+    auto& m0 = model.mesh[0];
+    EXPECT_EQ(model.materials[m0.material_id].name, "blue");
+    EXPECT_EQ(m0.NumVertices(), 4);
+    EXPECT_EQ(m0.NumFaces(), 2);
+    EXPECT_TRUE(m0.HasNormal());
+    EXPECT_TRUE(m0.HasTC());
+    EXPECT_TRUE(m0.HasColor());
+    EXPECT_EQ(m0.triangles[0], ivec3(0, 1, 2));
+    EXPECT_EQ(m0.triangles[1], ivec3(2, 3, 0));
+    EXPECT_EQ(m0.position[2], vec3(1, 1, 0));
+    EXPECT_EQ(m0.texture_coordinates[3], vec2(0, 1));
+    EXPECT_EQ(m0.color[1], vec4(0, 1, 0, 1));
+
+    // The second group has its own vertices. The relative indices reference the same vertices as the absolute ones.
+    auto& m1 = model.mesh[1];
+    EXPECT_EQ(model.materials[m1.material_id].name, "red");
+    EXPECT_EQ(m1.NumVertices(), 4);
+    EXPECT_EQ(m1.NumFaces(), 2);
+    EXPECT_FALSE(m1.HasTC());
+    EXPECT_EQ(m1.triangles[0], ivec3(0, 1, 2));
+    EXPECT_EQ(m1.triangles[1], ivec3(2, 3, 0));
+    EXPECT_EQ(m1.normal[0], vec3(0, 0, 1));
+
+    EXPECT_EQ(model.material_groups[1].startFace, 2);
+    EXPECT_EQ(model.material_groups[1].numFaces, 2);
+}
+
+TEST(ObjLoader, Large)
+{
+    // A grid with relative indices, which is large enough to be split into multiple chunks
+    int n = 400;
+    {
+        std::ofstream strm("obj_test_large.obj");
+        for (int y = 0; y < n; ++y)
+        {
+            for (int x = 0; x < n; ++x)
+            {
+                strm << "v " << x << " " << y << " 0\n";
+            }
+        }
+        int num_vertices = n * n;
+        for (int y = 0; y < n - 1; ++y)
+        {
+            for (int x = 0; x < n - 1; ++x)
+            {
+                int i = y * n + x;
+                strm << "f " << i - num_vertices << " " << i + 1 - num_vertices << " " << i + n + 1 - num_vertices
+                     << " " << i + n + 1 << "\n";
+            }
+        }
+    }
+
+    ObjModelLoader loader("obj_test_large.obj");
+    auto& model = loader.out_model;
+    ASSERT_EQ(model.mesh.size(), 1);
+    auto& mesh = model.mesh[0];
+    EXPECT_EQ(mesh.NumVertices(), n * n);
+    ASSERT_EQ(mesh.NumFaces(), 2 * (n - 1) * (n - 1));
+    EXPECT_TRUE(mesh.HasNormal());
+
+    for (int y = 0; y < n - 1; ++y)
+    {
+        for (int x = 0; x < n - 1; ++x)
+        {
+            int f   = 2 * (y * (n - 1) + x);
+            auto t0 = mesh.triangles[f];
+            auto t1 = mesh.triangles[f + 1];
+            EXPECT_EQ(mesh.position[t0(0)], vec3(x, y, 0));
+            EXPECT_EQ(mesh.position[t0(1)], vec3(x + 1, y, 0));
+            EXPECT_EQ(mesh.position[t0(2)], vec3(x + 1, y + 1, 0));
+            EXPECT_EQ(mesh.position[t1(0)], vec3(x + 1, y + 1, 0));
+            EXPECT_EQ(mesh.position[t1(1)], vec3(x, y + 1, 0));
+            EXPECT_EQ(mesh.position[t1(2)], vec3(x, y, 0));
+        }
+    }
+}
+
+TEST(ObjLoader, VertexFormats)
+{
+    {
+        std::ofstream strm("obj_test_vertex.obj");
+        strm << "v 0 0 0 1\n"
+             << "v 1 0 0 0.5\n"
+             << "v 1 1 0\n"
+             << "f 1 2 3\n";
+    }
+    {
+        ObjModelLoader loader("obj_test_vertex.obj");
+        auto& model = loader.out_model;
+        ASSERT_EQ(model.mesh.size(), 1);
+        auto& mesh = model.mesh[0];
+        EXPECT_EQ(mesh.NumVertices(), 3);
+        EXPECT_FALSE(mesh.HasColor());
+        EXPECT_EQ(mesh.position[1], vec3(1, 0, 0));
+    }
+
+    {
+        std::ofstream strm("obj_test_vertex.obj");
+        strm << "v 0 0 0 1 0 0 0.5\n"
+             << "v 1 0 0\n"
+             << "v 1 1 0 0 0 1\n"
+             << "f 1 2 3\n";
+    }
+    {
+        ObjModelLoader loader("obj_test_vertex.obj");
+        auto& model = loader.out_model;
+        ASSERT_EQ(model.mesh.size(), 1);
+        auto& mesh = model.mesh[0];
+        ASSERT_TRUE(mesh.HasColor());
+        EXPECT_EQ(mesh.color[0], vec4(1, 0, 0, 0.5));
+        EXPECT_EQ(mesh.color[1], vec4(1, 1, 1, 1));
+        EXPECT_EQ(mesh.color[2], vec4(0, 0, 1, 1));
+    }
+
+    {
+        std::ofstream strm("obj_test_vertex.obj");
+        strm << "v 0 0 0 1 0\nv 1 0 0\nv 1 1 0\nf 1 2 3\n";
+    }
+    ObjModelLoader loader;
+    EXPECT_FALSE(loader.loadFile("obj_test_vertex.obj"));
+}
+
+TEST(ObjLoader, Invalid)
+{
+    {
+        std::ofstream strm("obj_test_invalid.obj");
+        strm << "v 0 0 0\nv 1 0 0\nv 1 1 0\nf 1 2 4\n";
+    }
+    ObjModelLoader loader;
+    EXPECT_FALSE(loader.loadFile("obj_test_invalid.obj"));
+}
+
+}  // namespace Saiga
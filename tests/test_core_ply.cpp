@@ -0,0 +1,243 @@
+/**
+ * Copyright (c) 2021 Darius Rückert
+ * Licensed under the MIT License.
+ * See LICENSE file for more information.
+ */
+
+#include "saiga/core/model/UnifiedModel.h"
+#include "saiga/core/model/model_loader_ply.h"
+
+#include "gtest/gtest.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+namespace Saiga
+{
+// A grid of n x n vertices with all attributes
+static UnifiedMesh TestMesh(int n)
+{
+    UnifiedMesh mesh;
+    for (int y = 0; y < n; ++y)
+    {
+        for (int x = 0; x < n; ++x)
+        {
+            mesh.position.push_back(vec3(x * 0.1f, y * 0.3f, 1.f / (x + y + 1)));
+            mesh.normal.push_back(vec3(0, 0, 1));
+            mesh.color.push_back(vec4((x % 256) / 255.f, (y % 256) / 255.f, 1, 1));
+            mesh.texture_coordinates.push_back(vec2(x / float(n), y / float(n)));
+        }
+    }
+    for (int y = 0; y < n - 1; ++y)
+    {
+        for (int x = 0; x < n - 1; ++x)
+        {
+            int i = y * n + x;
+            mesh.triangles.push_back(ivec3(i, i + 1, i + n));
+            mesh.triangles.push_back(ivec3(i + 1, i + n + 1, i + n));
+        }
+    }
+    return mesh;
+}
+
+static void CheckEqual(const UnifiedMesh& a, const UnifiedMesh& b)
+{
+    ASSERT_EQ(a.NumVertices(), b.NumVertices());
+    ASSERT_EQ(a.NumFaces(), b.NumFaces());
+    ASSERT_EQ(a.HasNormal(), b.HasNormal());
+    ASSERT_EQ(a.HasColor(), b.HasColor());
+    ASSERT_EQ(a.HasTC(), b.HasTC());
+    for (int i = 0; i < a.NumVertices(); ++i)
+    {
+        EXPECT_EQ(a.position[i], b.position[i]);
+        if (a.HasNormal())
+        {
+            EXPECT_EQ(a.normal[i], b.normal[i]);
+        }
+        if (a.HasColor())
+        {
+            EXPECT_NEAR((a.color[i] - b.color[i]).norm(), 0, 1e-5);
+        }
+        if (a.HasTC())
+        {
+            EXPECT_EQ(a.texture_coordinates[i], b.texture_coordinates[i]);
+        }
+    }
+    for (int i = 0; i < a.NumFaces(); ++i)
+    {
+        EXPECT_EQ(a.triangles[i], b.triangles[i]);
+    }
+}
+
+TEST(PLY, RoundTrip)
+{
+    // Large enough to be split into multiple chunks
+    auto mesh = TestMesh(300);
+    for (bool binary : {true, false})
+    {
+        SavePLY("ply_test.ply", mesh, binary);
+        PLYLoader loader("ply_test.ply");
+        EXPECT_EQ(loader.format, binary ? PLYLoader::Format::BinaryLittleEndian : PLYLoader::Format::Ascii);
+        CheckEqual(mesh, loader.mesh);
+    }
+}
+
+TEST(PLY, StreamingWriter)
+{
+    auto mesh = TestMesh(50);
+    {
+        // Write the vertices in 3 chunks
+        PLYWriter writer("ply_test_stream.ply", VERTEX_POSITION | VERTEX_COLOR, false);
+        int n = mesh.NumVertices();
+        for (int begin : {0, n / 3, 2 * n / 3})
+        {
+            int end = begin == 2 * n / 3 ? n : begin + n / 3;
+            UnifiedMesh chunk;
+            chunk.position = std::vector<vec3>(mesh.position.begin() + begin, mesh.position.begin() + end);
+            chunk.color    = std::vector<vec4>(mesh.color.begin() + begin, mesh.color.begin() + end);
+            writer.AddVertices(chunk);
+        }
+        writer.AddFaces(mesh.triangles);
+        EXPECT_EQ(writer.NumVertices(), n);
+    }
+
+    PLYLoader loader("ply_test_stream.ply");
+    mesh.texture_coordinates.clear();
+    // missing normals are computed from the faces
+    mesh.normal = loader.mesh.normal;
+    CheckEqual(mesh, loader.mesh);
+}
+
+TEST(PLY, Projection)
+{
+    auto mesh = TestMesh(20);
+    SavePLY("ply_test_projection.ply", mesh);
+
+    PLYLoader loader("ply_test_projection.ply", VERTEX_POSITION | VERTEX_TEXTURE_COORDINATES, false);
+    EXPECT_EQ(loader.mesh.NumVertices(), mesh.NumVertices());
+    EXPECT_EQ(loader.mesh.NumFaces(), 0);
+    EXPECT_FALSE(loader.mesh.HasNormal());
+    EXPECT_FALSE(loader.mesh.HasColor());
+    EXPECT_TRUE(loader.mesh.HasTC());
+    EXPECT_EQ(loader.mesh.texture_coordinates[25], mesh.texture_coordinates[25]);
+    EXPECT_EQ(loader.elements.size(), 2);
+    EXPECT_EQ(loader.elements[0].properties.size(), 12);
+}
+
+TEST(PLY, AsciiPolygons)
+{
+    {
+        std::ofstream strm("ply_test_ascii.ply");
+        strm << "ply\r\n"
+             << "format ascii 1.0\r\n"
+             << "comment quads and an unused element\r\n"
+             << "element vertex 5\r\n"
+             << "property double x\nproperty double y\nproperty double z\n"
+             << "property uchar red\nproperty uchar green\nproperty uchar blue\n"
+             << "element face 3\n"
+             << "property uchar flags\n"
+             << "property list uchar uint vertex_index\n"
+             << "element edge 1\n"
+             << "property int vertex1\nproperty int vertex2\n"
+             << "end_header\n"
+             << "0 0 0 255 0 0\n"
+             << "1 0 0 0 255 0\n"
+             << "1 1 0 0 0 255\n"
+             << "0 1 0 255 255 255\n"
+             << "2 2 2 0 0 0\n"
+             << "0 4 0 1 2 3\n"
+             << "1 2 4 1\n"
+             << "0 3 1 2 4\n"
+             << "0 1";
+    }
+
+    PLYLoader loader("ply_test_ascii.ply");
+    auto& mesh = loader.mesh;
+    ASSERT_EQ(mesh.NumVertices(), 5);
+    ASSERT_EQ(mesh.NumFaces(), 3);
+    EXPECT_EQ(mesh.position[2], vec3(1, 1, 0));
+    EXPECT_EQ(mesh.color[1], vec4(0, 1, 0, 1));
+    EXPECT_EQ(mesh.triangles[0], ivec3(0, 1, 2));
+    EXPECT_EQ(mesh.triangles[1], ivec3(1, 2, 4));
+    // the second triangle of the quad is added to the end
+    EXPECT_EQ(mesh.triangles[2], ivec3(0, 2, 3));
+    EXPECT_TRUE(mesh.HasNormal());
+}
+
+TEST(PLY, BigEndian)
+{
+    auto put = [](std::ofstream& strm, auto value) {
+        char tmp[sizeof(value)];
+        std::memcpy(tmp, &value, sizeof(value));
+        std::reverse(tmp, tmp + sizeof(value));
+        strm.write(tmp, sizeof(value));
+    };
+    {
+        std::ofstream strm("ply_test_be.ply", std::ios::binary);
+        strm << "ply\nformat binary_big_endian 1.0\n"
+             << "element vertex 4\nproperty float x\nproperty float y\nproperty float z\nproperty ushort red\n"
+             << "property ushort green\nproperty ushort blue\n"
+             << "element face 1\nproperty list uchar int vertex_indices\nend_header\n";
+        for (int i = 0; i < 4; ++i)
+        {
+            put(strm, float(i));
+            put(strm, float(i * 2));
+            put(strm, float(-i));
+            put(strm, uint16_t(65535));
+            put(strm, uint16_t(0));
+            put(strm, uint16_t(i == 0 ? 65535 : 0));
+        }
+        put(strm, uint8_t(4));
+        for (int i = 0; i < 4; ++i) put(strm, int32_t(i));
+    }
+
+    PLYLoader loader("ply_test_be.ply", VERTEX_POSITION | VERTEX_COLOR);
+    auto& mesh = loader.mesh;
+    ASSERT_EQ(mesh.NumVertices(), 4);
+    ASSERT_EQ(mesh.NumFaces(), 2);
+    EXPECT_EQ(mesh.position[3], vec3(3, 6, -3));
+    EXPECT_EQ(mesh.color[0], vec4(1, 0, 1, 1));
+    EXPECT_EQ(mesh.color[1], vec4(1, 0, 0, 1));
+    EXPECT_EQ(mesh.triangles[0], ivec3(0, 1, 2));
+    EXPECT_EQ(mesh.triangles[1], ivec3(0, 2, 3));
+}
+
+TEST(PLY, UnifiedModel)
+{
+    // Without vertex colors the color is taken from the default material
+    auto mesh = TestMesh(10);
+    mesh.color.clear();
+    SavePLY("ply_test_model.ply", mesh);
+
+    UnifiedModel model("ply_test_model.ply");
+    ASSERT_EQ(model.mesh.size(), 1);
+    ASSERT_EQ(model.materials.size(), 1);
+    ASSERT_EQ(model.material_groups.size(), 1);
+    EXPECT_EQ(model.mesh[0].material_id, 0);
+    EXPECT_EQ(model.material_groups[0].numFaces, mesh.NumFaces());
+
+    model.ComputeColor();
+    ASSERT_EQ(model.mesh[0].color.size(), mesh.NumVertices());
+    EXPECT_EQ(model.mesh[0].color[0], model.materials[0].color_diffuse);
+}
+
+TEST(PLY, Invalid)
+{
+    {
+        std::ofstream strm("ply_test_invalid.ply");
+        strm << "ply\nformat ascii 1.0\nelement vertex 2\nproperty float x\nproperty float y\nproperty float z\n"
+             << "element face 1\nproperty list uchar int vertex_indices\nend_header\n"
+             << "0 0 0\n1 1 1\n3 0 1 2\n";
+    }
+    EXPECT_THROW(PLYLoader("ply_test_invalid.ply"), std::runtime_error);
+
+    {
+        std::ofstream strm("ply_test_invalid.ply");
+        strm << "ply\nformat binary_little_endian 1.0\nelement vertex 100\nproperty float x\nproperty float y\n"
+             << "property float z\nend_header\n0000";
+    }
+    EXPECT_THROW(PLYLoader("ply_test_invalid.ply"), std::runtime_error);
+}
+
+}  // namespace Saiga
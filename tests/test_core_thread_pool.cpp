@@ -0,0 +1,167 @@
+/**
+ * Copyright (c) 2021 Darius Rückert
+ * Licensed under the MIT License.
+ * See LICENSE file for more information.
+ */
+
+#include "saiga/core/util/Thread/threadPool.h"
+
+#include "gtest/gtest.h"
+
+#include <numeric>
+
+using namespace Saiga;
+
+TEST(ThreadPool, Task)
+{
+    // Small callables are stored inline, large callables on the heap
+    int a = 0;
+    Task small([&a]() { a += 1; });
+    std::array<int, 100> big_data;
+    big_data.fill(2);
+    Task big([&a, big_data]() { a += big_data[99]; });
+
+    Task moved = std::move(small);
+    EXPECT_FALSE(small);
+    moved();
+    big();
+    EXPECT_EQ(a, 3);
+
+    // Move only
+    auto ptr = std::make_unique<int>(5);
+    Task unique([p = std::move(ptr), &a]() { a += *p; });
+    unique();
+    EXPECT_EQ(a, 8);
+}
+
+TEST(ThreadPool, WorkStealingQueue)
+{
+    WorkStealingQueue<int> queue(4);
+    const int n = 100000;
+
+    std::atomic<int64_t> stolen_sum{0};
+    std::atomic<bool> done{false};
+    std::vector<std::thread> thieves;
+    for (int t = 0; t < 3; ++t)
+    {
+        thieves.emplace_back([&]() {
+            int item;
+            while (!done || !queue.empty())
+            {
+                if (queue.steal(item)) stolen_sum += item;
+            }
+        });
+    }
+
+    // The owner pushes (with growing buffers) and pops concurrently to the thieves
+    int64_t popped_sum = 0;
+    for (int i = 1; i <= n; ++i)
+    {
+        queue.push(i);
+        int item;
+        if (i % 3 == 0 && queue.pop(item)) popped_sum += item;
+    }
+    done = true;
+    for (auto& t : thieves) t.join();
+
+    int item;
+    while (queue.pop(item)) popped_sum += item;
+    EXPECT_EQ(popped_sum + stolen_sum, int64_t(n) * (n + 1) / 2);
+}
+
+TEST(ThreadPool, Enqueue)
+{
+    for (int threads : {0, 1, 4})
+    {
+        ThreadPool pool(threads);
+        std::vector<std::future<int>> futures;
+        for (int i = 0; i < 1000; ++i)
+        {
+            futures.push_back(pool.enqueue([](int x, int y) { return x * y; }, i, 2));
+        }
+        for (int i = 0; i < 1000; ++i)
+        {
+            EXPECT_EQ(futures[i].get(), i * 2);
+        }
+
+        auto f = pool.enqueue([]() -> int { throw std::runtime_error("test"); });
+        EXPECT_THROW(f.get(), std::runtime_error);
+    }
+}
+
+TEST(ThreadPool, ParallelFor)
+{
+    ThreadPool pool(4);
+    for (int grain_size : {1, 7, 1000, 100000})
+    {
+        std::vector<int> data(12345, 0);
+        pool.parallel_for(0, data.size(), [&](int64_t i) { data[i] += i; }, grain_size);
+        for (int i = 0; i < (int)data.size(); ++i)
+        {
+            ASSERT_EQ(data[i], i);
+        }
+    }
+
+    // Nested loops: the inner loops are executed by the workers
+    std::vector<std::atomic<int>> counts(100);
+    for (auto& c : counts) c = 0;
+    pool.parallel_for(0, 100, [&](int64_t i) { pool.parallel_for(0, 1000, [&](int64_t j) { counts[i]++; }, 10); });
+    for (auto& c : counts) EXPECT_EQ(c, 1000);
+}
+
+TEST(ThreadPool, TaskGroup)
+{
+    ThreadPool pool(4);
+
+    // Recursive fibonacci with nested groups
+    std::function<int64_t(int)> fib = [&](int n) -> int64_t {
+        if (n < 2) return n;
+        int64_t a, b;
+        TaskGroup group(pool);
+        group.run([&]() { a = fib(n - 1); });
+        b = fib(n - 2);
+        group.wait();
+        return a + b;
+    };
+    EXPECT_EQ(fib(22), 17711);
+
+    // Exceptions are rethrown by wait
+    TaskGroup group(pool);
+    for (int i = 0; i < 10; ++i)
+    {
+        group.run([i]() {
+            if (i == 5) throw std::runtime_error("test");
+        });
+    }
+    EXPECT_THROW(group.wait(), std::runtime_error);
+}
+
+TEST(ThreadPool, Continuation)
+{
+    ThreadPool pool(4);
+    for (int it = 0; it < 100; ++it)
+    {
+        std::atomic<int> sum{0};
+        std::promise<int> result;
+        auto future = result.get_future();
+        {
+            TaskGroup group(pool);
+            for (int i = 0; i < 100; ++i) group.run([&sum, i]() { sum += i; });
+            group.then([&]() { result.set_value(sum); });
+            group.wait();
+        }
+        // The continuation sees the result of all tasks
+        EXPECT_EQ(future.get(), 4950);
+    }
+}
+
+TEST(ThreadPool, GlobalThreadPool)
+{
+    createGlobalThreadPool(2);
+    ASSERT_TRUE(globalThreadPool);
+    EXPECT_EQ(globalThreadPool->numThreads(), 2);
+    std::atomic<int> count{0};
+    globalThreadPool->parallel_for(0, 1000, [&](int64_t) { count++; });
+    EXPECT_EQ(count, 1000);
+    globalThreadPool.reset();
+}
@@ -0,0 +1,113 @@
+/**
+ * Copyright (c) 2021 Darius Rückert
+ * Licensed under the MIT License.
+ * See LICENSE file for more information.
+ */
+
+#include "saiga/core/math/random.h"
+#include "saiga/core/model/UnifiedMesh.h"
+
+#include "gtest/gtest.h"
+
+#include <numeric>
+
+namespace Saiga
+{
+TEST(UnifiedMesh, RemoveDoublesTriangleSoup)
+{
+    // A grid stored as a triangle soup, similar to the output of marching cubes.
+    int n = 100;
+    UnifiedMesh mesh;
+    for (int y = 0; y < n - 1; ++y)
+    {
+        for (int x = 0; x < n - 1; ++x)
+        {
+            vec3 p00(x, y, 0), p10(x + 1, y, 0), p01(x, y + 1, 0), p11(x + 1, y + 1, 0);
+            for (auto p : {p00, p10, p01, p10, p11, p01})
+            {
+                mesh.position.push_back(p);
+                mesh.color.push_back(make_vec4(p, 1));
+            }
+            int i = mesh.NumVertices() - 6;
+            mesh.triangles.push_back(ivec3(i, i + 1, i + 2));
+            mesh.triangles.push_back(ivec3(i + 3, i + 4, i + 5));
+        }
+    }
+    auto soup = mesh.TriangleSoup();
+
+    mesh.RemoveDoubles(0.01);
+    EXPECT_EQ(mesh.NumVertices(), n * n);
+    EXPECT_EQ(mesh.NumFaces(), 2 * (n - 1) * (n - 1));
+    EXPECT_EQ(mesh.color.size(), n * n);
+
+    // The geometry is unchanged and the attributes are moved with the positions
+    auto soup2 = mesh.TriangleSoup();
+    for (int i = 0; i < mesh.NumFaces(); ++i)
+    {
+        EXPECT_EQ(soup[i].a, soup2[i].a);
+        EXPECT_EQ(soup[i].b, soup2[i].b);
+        EXPECT_EQ(soup[i].c, soup2[i].c);
+    }
+    for (int i = 0; i < mesh.NumVertices(); ++i)
+    {
+        EXPECT_EQ(make_vec4(mesh.position[i], 1), mesh.color[i]);
+    }
+}
+
+TEST(UnifiedMesh, RemoveDoublesRandom)
+{
+    int n          = 5000;
+    float distance = 0.05;
+    UnifiedMesh mesh;
+    for (int i = 0; i < n; ++i)
+    {
+        mesh.position.push_back(Random::MatrixUniform<vec3>(-1, 1));
+    }
+    for (int i = 0; i < n; ++i)
+    {
+        mesh.lines.push_back(ivec2(i, (i * 7) % n));
+    }
+    auto input = mesh;
+    mesh.RemoveDoubles(distance);
+
+    // Reference: the transitive closure of all pairs closer than 'distance' with the smallest index as representative
+    std::vector<int> rep(n);
+    std::iota(rep.begin(), rep.end(), 0);
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (int i = 0; i < n; ++i)
+        {
+            for (int j = i + 1; j < n; ++j)
+            {
+                if ((input.position[i] - input.position[j]).norm() < distance && rep[i] != rep[j])
+                {
+                    rep[i] = rep[j] = std::min(rep[i], rep[j]);
+                    changed         = true;
+                }
+            }
+        }
+    }
+
+    std::vector<int> kept;
+    for (int i = 0; i < n; ++i)
+    {
+        if (rep[i] == i) kept.push_back(i);
+    }
+    ASSERT_EQ(mesh.NumVertices(), kept.size());
+    EXPECT_LT(kept.size(), n);
+    for (int i = 0; i < (int)kept.size(); ++i)
+    {
+        EXPECT_EQ(mesh.position[i], input.position[kept[i]]);
+    }
+    for (int i = 0; i < n; ++i)
+    {
+        for (int k = 0; k < 2; ++k)
+        {
+            EXPECT_EQ(mesh.position[mesh.lines[i](k)], input.position[rep[input.lines[i](k)]]);
+        }
+    }
+}
+
+}  // namespace Saiga
@@ -0,0 +1,181 @@
+/**
+ * Copyright (c) 2021 Darius Rückert
+ * Licensed under the MIT License.
+ * See LICENSE file for more information.
+ */
+
+#include "saiga/config.h"
+#include "saiga/core/Core.h"
+#include "saiga/vision/scene/BALDataset.h"
+
+#include "gtest/gtest.h"
+
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+#ifdef SAIGA_USE_ZLIB
+#    include <zlib.h>
+#endif
+
+#ifdef SAIGA_USE_BZIP2
+#    include <bzlib.h>
+#endif
+
+namespace Saiga
+{
+// A small synthetic problem in the BAL text format. The observations are the exact (distorted) projections.
+std::string TestBALFile()
+{
+    Random::setSeed(38456);
+    int num_cameras = 8, num_points = 300;
+
+    AlignedVector<BALDataset::BALCamera> cameras(num_cameras);
+    std::vector<Vec3> rotations(num_cameras);
+    for (int i = 0; i < num_cameras; ++i)
+    {
+        rotations[i] = Vec3::Random() * 0.1;
+        auto& c      = cameras[i];
+        Vec3 t       = Vec3(Random::sampleDouble(-1, 1), Random::sampleDouble(-1, 1), -10);
+        c.se3        = SE3(Sophus::SO3d::exp(rotations[i]), t);
+        c.f          = 500 + i;
+        c.k1         = 1e-7;
+        c.k2         = -1e-13;
+    }
+
+    std::vector<Vec3> points(num_points);
+    for (auto& p : points) p = Vec3::Random();
+
+    std::stringstream strm;
+    strm << num_cameras << " " << num_points << " " << num_cameras * num_points << "\n";
+    strm << std::scientific << std::setprecision(16);
+    for (int j = 0; j < num_points; ++j)
+    {
+        for (int i = 0; i < num_cameras; ++i)
+        {
+            Vec2 ip = cameras[i].projectPoint(points[j]);
+            strm << i << " " << j << "     " << ip(0) << " " << ip(1) << "\n";
+        }
+    }
+    for (int i = 0; i < num_cameras; ++i)
+    {
+        auto& c = cameras[i];
+        for (int k = 0; k < 3; ++k) strm << rotations[i](k) << "\n";
+        for (int k = 0; k < 3; ++k) strm << c.se3.translation()(k) << "\n";
+        strm << c.f << "\n" << c.k1 << "\n" << c.k2 << "\n";
+    }
+    for (auto& p : points)
+    {
+        strm << p(0) << "\n" << p(1) << "\n" << p(2) << "\n";
+    }
+    return strm.str();
+}
+
+void ExpectEqualScenes(Scene& a, Scene& b)
+{
+    ASSERT_EQ(a.images.size(), b.images.size());
+    ASSERT_EQ(a.worldPoints.size(), b.worldPoints.size());
+    for (int i = 0; i < (int)a.images.size(); ++i)
+    {
+        EXPECT_EQ(a.images[i].se3.params(), b.images[i].se3.params());
+        ASSERT_EQ(a.images[i].stereoPoints.size(), b.images[i].stereoPoints.size());
+        for (int j = 0; j < (int)a.images[i].stereoPoints.size(); ++j)
+        {
+            EXPECT_EQ(a.images[i].stereoPoints[j].wp, b.images[i].stereoPoints[j].wp);
+            EXPECT_EQ(a.images[i].stereoPoints[j].point, b.images[i].stereoPoints[j].point);
+        }
+    }
+    for (int i = 0; i < (int)a.worldPoints.size(); ++i)
+    {
+        EXPECT_EQ(a.worldPoints[i].p, b.worldPoints[i].p);
+    }
+}
+
+TEST(BALDataset, Load)
+{
+    {
+        std::ofstream strm("bal_test.txt");
+        strm << TestBALFile();
+    }
+
+    BALDataset bal("bal_test.txt");
+    EXPECT_LT(bal.rms(), 1e-6);
+
+    Scene scene = bal.makeScene();
+    EXPECT_EQ(scene.images.size(), 8);
+    EXPECT_EQ(scene.worldPoints.size(), 300);
+    for (auto& img : scene.images)
+    {
+        EXPECT_EQ(img.stereoPoints.size(), 300);
+    }
+    EXPECT_LT(scene.rms(), 1e-6);
+}
+
+TEST(BALDataset, BlockBoundaries)
+{
+    std::string data = TestBALFile();
+    {
+        std::ofstream strm("bal_test.txt");
+        strm << data;
+    }
+    Scene reference = BALDataset("bal_test.txt").makeScene();
+
+    // Small blocks, so that observation lines and the camera/point parameters are split over many blocks. A block
+    // smaller than one line is extended by the following blocks.
+    for (size_t block_size : {size_t(16), size_t(1000), size_t(4093)})
+    {
+        ASSERT_GT(data.size(), 10 * block_size);
+        // the first block ends in the middle of a line
+        EXPECT_NE(data[block_size - 1], '\n');
+
+        Scene scene = BALDataset("bal_test.txt", block_size).makeScene();
+        ExpectEqualScenes(reference, scene);
+    }
+}
+
+#ifdef SAIGA_USE_ZLIB
+TEST(BALDataset, Gzip)
+{
+    std::string data = TestBALFile();
+    {
+        std::ofstream strm("bal_test.txt");
+        strm << data;
+    }
+    {
+        gzFile f = gzopen("bal_test.txt.gz", "wb");
+        ASSERT_TRUE(f);
+        gzwrite(f, data.data(), data.size());
+        gzclose(f);
+    }
+
+    Scene a = BALDataset("bal_test.txt").makeScene();
+    Scene b = BALDataset("bal_test.txt.gz").makeScene();
+    ExpectEqualScenes(a, b);
+}
+#endif
+
+#ifdef SAIGA_USE_BZIP2
+TEST(BALDataset, Bzip2)
+{
+    std::string data = TestBALFile();
+    {
+        std::ofstream strm("bal_test.txt");
+        strm << data;
+    }
+    {
+        FILE* f = fopen("bal_test.txt.bz2", "wb");
+        ASSERT_TRUE(f);
+        int error;
+        BZFILE* bz = BZ2_bzWriteOpen(&error, f, 9, 0, 0);
+        BZ2_bzWrite(&error, bz, data.data(), data.size());
+        BZ2_bzWriteClose(&error, bz, 0, nullptr, nullptr);
+        fclose(f);
+    }
+
+    Scene a = BALDataset("bal_test.txt").makeScene();
+    Scene b = BALDataset("bal_test.txt.bz2").makeScene();
+    ExpectEqualScenes(a, b);
+}
+#endif
+
+}  // namespace Saiga
@@ -8,6 +8,7 @@
 
 #include "saiga/core/time/all.h"
 #include "saiga/vision/VisionTypes.h"
+#include "saiga/vision/slam/BowDatabase.h"
 #include "saiga/vision/slam/MiniBow.h"
 #include "saiga/vision/slam/MiniBow2.h"
 #include "saiga/vision/util/Random.h"
@@ -15,6 +16,12 @@
 #include "gtest/gtest.h"
 
 #include "compare_numbers.h"
+
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <functional>
+
 namespace Saiga
 {
 using Descriptor    = MiniBow::FORB::TDescriptor;
@@ -200,7 +207,9 @@ TEST(BoW, Full)
 
 
     //    OrbVocabulary2 orbVoc2("ORBvoc.minibow");
-    OrbVocabulary2 orbVoc2 = trainedVoc2;
+    // The training of MiniBow2 uses different random numbers, therefore the tree of MiniBow is loaded.
+    trainedVoc.saveRaw("testvoc.minibow");
+    OrbVocabulary2 orbVoc2("testvoc.minibow");
     std::cout << orbVoc2 << std::endl;
 
 
@@ -291,4 +300,233 @@ TEST(BoW, Orb)
     //    auto stat = measureObject(50, [&]() { orbVoc2.transform(features.front(), bv2, fv2, 4, 4); });
     //    std::cout << stat << std::endl;
 }
+
+TEST(BoW, Training)
+{
+    std::vector<std::vector<Descriptor>> features;
+    loadFeatures(features);
+
+    auto same_vocabulary = [&](const OrbVocabulary2& a, const OrbVocabulary2& b) {
+        ASSERT_EQ(a.size(), b.size());
+        for (MiniBow2::WordId wid = 0; wid < (int)a.size(); ++wid)
+        {
+            EXPECT_EQ(a.getWord(wid), b.getWord(wid));
+            EXPECT_EQ(a.getWordWeight(wid), b.getWordWeight(wid));
+        }
+    };
+
+    MiniBow2::VocabularyTrainingOptions options;
+    options.seed = 1234;
+
+    OrbVocabulary2 ref(9, 3);
+    ref.create(features, options);
+    EXPECT_GT(ref.size(), 9 * 9 * 8);
+
+    // The result is independent of the number of threads
+    int progress_calls = 0;
+    options.num_threads = 4;
+    options.progress    = [&](const MiniBow2::VocabularyTrainingProgress& p) {
+        EXPECT_GE(p.level, 1);
+        EXPECT_LE(p.level, 4);
+        progress_calls++;
+    };
+    OrbVocabulary2 parallel(9, 3);
+    parallel.create(features, options);
+    same_vocabulary(ref, parallel);
+    EXPECT_GE(progress_calls, 4);
+
+    // Streaming without sampling is identical to the in-memory training
+    OrbVocabulary2 streaming(9, 3);
+    streaming.create(
+        [&](const std::function<void(const std::vector<Descriptor>&)>& f) {
+            for (auto& image : features) f(image);
+        },
+        options);
+    same_vocabulary(ref, streaming);
+
+    // Mini-batch and sampling only approximate the clustering, but all words must still be used
+    options.mini_batch_size      = 500;
+    options.max_samples_per_node = 2000;
+    OrbVocabulary2 mini_batch(9, 3);
+    mini_batch.create(
+        [&](const std::function<void(const std::vector<Descriptor>&)>& f) {
+            for (auto& image : features) f(image);
+        },
+        options);
+    EXPECT_GT(mini_batch.size(), 9 * 9 * 8);
+    EXPECT_GT(mini_batch.getEffectiveLevels(), 2.9);
+}
+
+TEST(BoW, FlatFile)
+{
+    std::vector<std::vector<Descriptor>> features;
+    loadFeatures(features);
+
+    srand(23053250);
+    OrbVocabulary2 voc(9, 3);
+    voc.create(features);
+
+    voc.saveRaw("testvoc.minibow");
+    voc.saveFlat("testvoc_flat.minibow");
+
+    // The second file is memory mapped
+    OrbVocabulary2 voc_raw("testvoc.minibow");
+    OrbVocabulary2 voc_flat("testvoc_flat.minibow");
+
+    for (auto* v : {&voc_raw, &voc_flat})
+    {
+        ASSERT_EQ(v->size(), voc.size());
+        EXPECT_EQ(v->getBranchingFactor(), voc.getBranchingFactor());
+        EXPECT_EQ(v->getDepthLevels(), voc.getDepthLevels());
+        EXPECT_EQ(v->getEffectiveLevels(), voc.getEffectiveLevels());
+        for (MiniBow2::WordId wid = 0; wid < (int)voc.size(); ++wid)
+        {
+            EXPECT_EQ(v->getWord(wid), voc.getWord(wid));
+            EXPECT_EQ(v->getWordWeight(wid), voc.getWordWeight(wid));
+            EXPECT_EQ(v->getParentNode(wid, 1), voc.getParentNode(wid, 1));
+        }
+
+        std::vector<MiniBow2::WordId> words, ref_words;
+        v->getWordsFromNode(voc.getParentNode(0, 2), words);
+        voc.getWordsFromNode(voc.getParentNode(0, 2), ref_words);
+        EXPECT_EQ(words, ref_words);
+
+        MiniBow2::BowVector bv, ref_bv;
+        MiniBow2::FeatureVector fv, ref_fv;
+        v->transform(features.front(), bv, fv, 2);
+        voc.transform(features.front(), ref_bv, ref_fv, 2);
+        EXPECT_EQ(bv, ref_bv);
+        EXPECT_EQ(fv, ref_fv);
+    }
+
+    // A copy must not depend on the original
+    OrbVocabulary2 copy = voc_flat;
+    voc_flat            = OrbVocabulary2();
+    EXPECT_EQ(copy.size(), voc.size());
+    EXPECT_EQ(copy.getWord(5), voc.getWord(5));
+}
+
+TEST(BoW, FlatFileInvalid)
+{
+    std::vector<std::vector<Descriptor>> features;
+    loadFeatures(features);
+
+    srand(23053250);
+    OrbVocabulary2 voc(9, 3);
+    voc.create(features);
+    voc.saveFlat("testvoc_flat.minibow");
+
+    std::vector<char> data;
+    {
+        std::ifstream strm("testvoc_flat.minibow", std::ios::binary);
+        data.assign(std::istreambuf_iterator<char>(strm), std::istreambuf_iterator<char>());
+    }
+    using Header = OrbVocabulary2::FlatHeader;
+    Header h;
+    ASSERT_GE(data.size(), sizeof(h));
+    std::memcpy(&h, data.data(), sizeof(h));
+
+    auto load_modified = [&](std::function<void(std::vector<char>&)> modify) {
+        auto copy = data;
+        modify(copy);
+        {
+            std::ofstream strm("testvoc_flat_invalid.minibow", std::ios::binary);
+            strm.write(copy.data(), copy.size());
+        }
+        OrbVocabulary2 v("testvoc_flat_invalid.minibow");
+    };
+    auto set_int = [](std::vector<char>& d, uint64_t offset, int32_t value) {
+        std::memcpy(d.data() + offset, &value, sizeof(value));
+    };
+
+    EXPECT_NO_THROW(load_modified([](auto&) {}));
+
+    // Truncated file
+    EXPECT_THROW(load_modified([](auto& d) { d.resize(d.size() - 64); }), std::runtime_error);
+
+    // Counts which do not fit into the file or are negative
+    EXPECT_THROW(load_modified([&](auto& d) { set_int(d, offsetof(Header, num_blocks), 1 << 30); }),
+                 std::runtime_error);
+    EXPECT_THROW(load_modified([&](auto& d) { set_int(d, offsetof(Header, num_nodes), -5); }), std::runtime_error);
+
+    // Invalid indices
+    EXPECT_THROW(load_modified([&](auto& d) { set_int(d, h.block_children, h.num_nodes); }), std::runtime_error);
+    EXPECT_THROW(load_modified([&](auto& d) { set_int(d, h.block_num_children, 0); }), std::runtime_error);
+    EXPECT_THROW(load_modified([&](auto& d) { set_int(d, h.word_node + 4, -1); }), std::runtime_error);
+    // A cycle in the tree
+    EXPECT_THROW(load_modified([&](auto& d) { set_int(d, h.node_parent + 4, 1); }), std::runtime_error);
+}
+
+TEST(BoW, Database)
+{
+    std::vector<std::vector<Descriptor>> features;
+    loadFeatures(features);
+
+    srand(23053250);
+    OrbVocabulary2 voc(9, 3);
+    voc.create(features);
+
+    // Each image is a random subset of the training features, so that images share some words
+    const int num_images = 200;
+    std::vector<MiniBow2::BowVector> bows(num_images);
+    std::vector<MiniBow2::FeatureVector> fvs(num_images);
+    for (int i = 0; i < num_images; ++i)
+    {
+        std::vector<Descriptor> desc;
+        for (int j = 0; j < 100; ++j)
+        {
+            desc.push_back(features[Random::uniformInt(0, images - 1)][Random::uniformInt(0, featuresPerImage - 1)]);
+        }
+        voc.transform(desc, bows[i], fvs[i], 2);
+    }
+
+    MiniBow2::BowDatabase db(voc, true);
+    for (int i = 0; i < num_images; ++i) db.add(i, bows[i], fvs[i]);
+    EXPECT_EQ(db.size(), num_images);
+
+    // Remove every third image
+    for (int i = 0; i < num_images; i += 3) db.remove(i);
+    EXPECT_EQ(db.size(), num_images - iDivUp(num_images, 3));
+    EXPECT_FALSE(db.contains(0));
+    EXPECT_TRUE(db.contains(1));
+    EXPECT_EQ(db.featureVector(1), fvs[1]);
+
+    // And add some of them again
+    for (int i = 0; i < num_images / 2; i += 3) db.add(i, bows[i], fvs[i]);
+
+    auto linear_search = [&](int q, int k) {
+        std::vector<MiniBow2::BowDatabase::QueryResult> result;
+        for (int i = 0; i < num_images; ++i)
+        {
+            if (!db.contains(i) || i == q) continue;
+            result.push_back({i, voc.score(bows[q], bows[i])});
+        }
+        std::sort(result.begin(), result.end(), [](auto a, auto b) { return a.score > b.score; });
+        result.resize(k);
+        return result;
+    };
+
+    const int k = 10;
+    std::vector<int> ignore(num_images);
+    std::iota(ignore.begin(), ignore.end(), 0);
+    std::vector<std::vector<MiniBow2::BowDatabase::QueryResult>> results;
+    db.query(bows, k, results, 0, ignore, 4);
+
+    for (int q = 0; q < num_images; ++q)
+    {
+        auto ref = linear_search(q, k);
+        ASSERT_EQ(results[q].size(), k);
+        for (int i = 0; i < k; ++i)
+        {
+            EXPECT_NEAR(results[q][i].score, ref[i].score, 1e-5);
+            EXPECT_NEAR(results[q][i].score, voc.score(bows[q], bows[results[q][i].id]), 1e-5);
+        }
+    }
+
+    // Without the ignore id, the best match of an image is the image itself
+    std::vector<MiniBow2::BowDatabase::QueryResult> result;
+    db.query(bows[1], 1, result);
+    EXPECT_EQ(result.front().id, 1);
+    EXPECT_NEAR(result.front().score, 1, 1e-5);
+}
 }  // namespace Saiga
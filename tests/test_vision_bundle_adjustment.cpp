@@ -12,6 +12,7 @@
 #include "saiga/vision/recursive/BAPointOnly.h"
 #include "saiga/vision/recursive/BARecursive.h"
 #include "saiga/vision/recursive/BARecursiveRel.h"
+#include "saiga/vision/recursive/BASlidingWindow.h"
 #include "saiga/vision/scene/SynteticScene.h"
 //#include "saiga/vision/scene/SynteticScene.h"
 
@@ -51,6 +52,18 @@ class BundleAdjustmentTest
         return cpy;
     }
 
+    Scene solveSlidingWindow(const BAOptions& options)
+    {
+        Scene cpy = scene;
+        BASlidingWindow ba;
+        ba.optimizationOptions = opoptions;
+        ba.baOptions           = options;
+        ba.create(cpy);
+        for (int i = 0; i < (int)cpy.images.size(); ++i) ba.AddKeyframe(i);
+        ba.initAndSolve();
+        return cpy;
+    }
+
     Scene solveRecRel(const BAOptions& options)
     {
         Scene cpy = scene;
@@ -296,6 +309,41 @@ TEST(BundleAdjustment, DefaultParallel)
     //    exit(0);
 }
 
+TEST(BundleAdjustment, Precision)
+{
+    for (int i = 0; i < 4; ++i)
+    {
+        BundleAdjustmentTest test;
+        test.buildScene(false);
+        if (i % 2 == 1)
+        {
+            // Consistent depth values. The constant depth of buildScene(true) results in a badly conditioned system,
+            // on which the float solvers stop at a higher error.
+            for (auto& img : test.scene.images)
+            {
+                for (auto& obs : img.stereoPoints)
+                {
+                    obs.depth = test.scene.depth(img, obs);
+                }
+            }
+        }
+        if (i >= 2) test.opoptions.solverType = OptimizationOptions::SolverType::Direct;
+
+        BAOptions options;
+        auto ref = test.solveRec(options);
+
+        options.precision = BAOptions::Precision::Mixed;
+        auto mixed        = test.solveRec(options);
+
+        options.precision = BAOptions::Precision::Float;
+        auto single       = test.solveRec(options);
+
+        double chi2 = ref.chi2();
+        ExpectClose(chi2, mixed.chi2(), chi2 * 1e-3);
+        ExpectClose(chi2, single.chi2(), chi2 * 1e-2);
+    }
+}
+
 
 TEST(BundleAdjustment, DefaultDepth)
 {
@@ -330,6 +378,86 @@ TEST(BundleAdjustment, PartialConstant)
 }
 
 
+TEST(BundleAdjustment, SlidingWindow)
+{
+    // A window with all keyframes is a normal BA
+    for (int i = 0; i < 4; ++i)
+    {
+        BundleAdjustmentTest test;
+        test.buildScene(i % 2 == 1);
+        test.scene.images[0].constant = true;
+        BAOptions options;
+        auto ref    = test.solveRec(options);
+        auto window = test.solveSlidingWindow(options);
+        ExpectClose(ref.chi2(), window.chi2(), ref.chi2() * 1e-3);
+    }
+
+    // Marginalization at the optimum keeps the remaining keyframes at the optimum.
+    // The depth values fix the scale, which is otherwise a free direction of the prior.
+    {
+        BundleAdjustmentTest test;
+        test.scene.images[0].constant = true;
+        Scene scene                   = test.scene;
+        for (auto& img : scene.images)
+        {
+            for (auto& obs : img.stereoPoints)
+            {
+                obs.depth = scene.depth(img, obs);
+            }
+        }
+
+        BASlidingWindow ba;
+        ba.optimizationOptions = test.opoptions;
+        ba.create(scene);
+        for (int i = 0; i < (int)scene.images.size(); ++i) ba.AddKeyframe(i);
+        ba.initAndSolve();
+
+        ba.MarginalizeKeyframe(1);
+        EXPECT_EQ(ba.Keyframes().size(), scene.images.size() - 1);
+
+        auto result = ba.initAndSolve();
+        ExpectCloseRelative(result.cost_initial, result.cost_final, 1e-3);
+    }
+
+    // Streaming keyframes through a small window
+    {
+        Scene scene = SynteticScene::CircleSphere(1000, 30, 100);
+        for (auto& img : scene.images)
+        {
+            for (auto& obs : img.stereoPoints)
+            {
+                obs.depth = scene.depth(img, obs);
+            }
+        }
+        scene.images[0].constant = true;
+        scene.addWorldPointNoise(0.01);
+        scene.addImagePointNoise(1.0);
+        scene.addExtrinsicNoise(0.01);
+
+        int window_size = 5;
+        BASlidingWindow ba;
+        ba.optimizationOptions               = defaultBAOptimizationOptions();
+        ba.optimizationOptions.maxIterations = 10;
+        ba.create(scene);
+        for (int i = 0; i < (int)scene.images.size(); ++i)
+        {
+            ba.AddKeyframe(i);
+            if ((int)ba.Keyframes().size() > window_size)
+            {
+                ba.MarginalizeKeyframe(ba.Keyframes().front());
+            }
+            auto result = ba.initAndSolve();
+            EXPECT_LE(result.cost_final, result.cost_initial);
+            EXPECT_LE((int)ba.Keyframes().size(), window_size);
+
+            int window_observations = 0;
+            for (auto kf : ba.Keyframes()) window_observations += scene.images[kf].stereoPoints.size();
+            EXPECT_LE(ba.NumObservations(), window_observations);
+        }
+        EXPECT_EQ(ba.Keyframes().back(), (int)scene.images.size() - 1);
+    }
+}
+
 TEST(BundleAdjustment, Huber)
 {
     Random::setSeed(923652);
@@ -0,0 +1,192 @@
+/**
+ * Copyright (c) 2021 Darius Rückert
+ * Licensed under the MIT License.
+ * See LICENSE file for more information.
+ */
+
+#include "saiga/vision/camera/CameraBase.h"
+
+#include "gtest/gtest.h"
+
+#include <atomic>
+
+namespace Saiga
+{
+// Generates 'num_frames' gray images of size 1024x1024 (1 MB). Every pixel is set to the frame id.
+// Loading a frame takes 'load_ms' and every 10th frame (starting at frame 5) 'slow_ms'.
+class MockDataset : public DatasetCameraBase
+{
+   public:
+    MockDataset(const DatasetParameters& params, int num_frames, int load_ms, int slow_ms = 0)
+        : DatasetCameraBase(params),
+          num_frames(num_frames),
+          load_ms(load_ms),
+          slow_ms(slow_ms),
+          load_count(num_frames, 0)
+    {
+        camera_type = CameraInputType::Mono;
+        Load();
+    }
+    ~MockDataset() { StopPrefetch(); }
+
+    int LoadMetaData() override
+    {
+        frames.resize(num_frames);
+        for (int i = 0; i < num_frames; ++i) frames[i].id = i;
+        return num_frames;
+    }
+
+    void LoadImageData(FrameData& data) override
+    {
+        {
+            std::unique_lock l(mutex);
+            max_ahead = std::max(max_ahead, data.id - requested.load());
+            load_count[data.id]++;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(data.id % 10 == 5 ? slow_ms : load_ms));
+        data.image.create(1024, 1024);
+        data.image.getImageView().set(data.id % 256);
+    }
+
+    // Set by the test before getImageSync() is called for this frame.
+    std::atomic<int> requested = 0;
+
+    std::mutex mutex;
+    int num_frames;
+    int load_ms;
+    int slow_ms;
+    int max_ahead = 0;
+    std::vector<int> load_count;
+};
+
+static DatasetParameters PrefetchParams(int frames, int threads, double memory_mb)
+{
+    // Without pacing every frame is returned
+    DatasetParameters params;
+    params.playback_fps       = 0;
+    params.preload            = false;
+    params.prefetch_frames    = frames;
+    params.prefetch_threads   = threads;
+    params.prefetch_memory_mb = memory_mb;
+    return params;
+}
+
+static void ExpectFrame(FrameData& frame, int id)
+{
+    EXPECT_EQ(frame.id, id);
+    ASSERT_EQ(frame.image.rows, 1024);
+    EXPECT_EQ(frame.image(0, 0), id % 256);
+    EXPECT_EQ(frame.image(1023, 1023), id % 256);
+}
+
+TEST(DatasetPrefetch, Order)
+{
+    for (int prefetch_frames : {0, 8})
+    {
+        MockDataset dataset(PrefetchParams(prefetch_frames, 3, 1024), 100, 1);
+        for (int i = 0; i < 100; ++i)
+        {
+            FrameData frame;
+            dataset.requested = i;
+            ASSERT_TRUE(dataset.getImageSync(frame));
+            ExpectFrame(frame, i);
+        }
+        FrameData frame;
+        EXPECT_FALSE(dataset.getImageSync(frame));
+        EXPECT_FALSE(dataset.isOpened());
+
+        for (int c : dataset.load_count) EXPECT_EQ(c, 1);
+        EXPECT_LE(dataset.max_ahead, prefetch_frames);
+    }
+}
+
+TEST(DatasetPrefetch, Budget)
+{
+    // The window is limited by prefetch_frames or by the memory budget. A slow consumer lets the background thread
+    // fill the window.
+    for (auto [prefetch_frames, memory_mb, expected_ahead] : {std::tuple{4, 1024., 4}, std::tuple{50, 3., 3}})
+    {
+        MockDataset dataset(PrefetchParams(prefetch_frames, 1, memory_mb), 30, 0);
+        for (int i = 0; i < 30; ++i)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            FrameData frame;
+            dataset.requested = i;
+            ASSERT_TRUE(dataset.getImageSync(frame));
+            ExpectFrame(frame, i);
+        }
+        EXPECT_LE(dataset.max_ahead, expected_ahead);
+        EXPECT_GE(dataset.max_ahead, 2);
+    }
+
+    // A budget smaller than one frame still loads the current frame.
+    MockDataset dataset(PrefetchParams(8, 2, 0.1), 10, 0);
+    for (int i = 0; i < 10; ++i)
+    {
+        FrameData frame;
+        dataset.requested = i;
+        ASSERT_TRUE(dataset.getImageSync(frame));
+        ExpectFrame(frame, i);
+    }
+}
+
+TEST(DatasetPrefetch, Stop)
+{
+    // Destroy the dataset while the background threads are loading.
+    {
+        MockDataset dataset(PrefetchParams(16, 4, 1024), 100, 2);
+        for (int i = 0; i < 3; ++i)
+        {
+            FrameData frame;
+            ASSERT_TRUE(dataset.getImageSync(frame));
+            ExpectFrame(frame, i);
+        }
+    }
+
+    // After close() the remaining frames are loaded synchronously. Prefetched frames are not loaded again.
+    MockDataset dataset(PrefetchParams(16, 4, 1024), 50, 1);
+    for (int i = 0; i < 50; ++i)
+    {
+        if (i == 10) dataset.close();
+        FrameData frame;
+        ASSERT_TRUE(dataset.getImageSync(frame));
+        ExpectFrame(frame, i);
+    }
+    for (int c : dataset.load_count) EXPECT_EQ(c, 1);
+}
+
+TEST(DatasetPrefetch, RealTime)
+{
+    // 50 fps playback. Frames 5, 15, 25, ... take much longer to load than one frame period.
+    const int period_ms = 20;
+    auto params         = PrefetchParams(4, 2, 1024);
+    params.playback_fps = 1000.0 / period_ms;
+    MockDataset dataset(params, 50, 1, 200);
+
+    int last_id = -1, num_frames = 0;
+    double max_block_ms = 0;
+    while (true)
+    {
+        FrameData frame;
+        Timer timer;
+        bool ok = dataset.getImageSync(frame);
+        max_block_ms = std::max(max_block_ms, timer.stop().count() / 1e6);
+        if (!ok) break;
+
+        EXPECT_GT(frame.id, last_id);
+        ExpectFrame(frame, frame.id);
+        last_id = frame.id;
+        num_frames++;
+
+        // The processing of a frame takes one frame period. Therefore getImageSync() does not have to wait for the
+        // pacing clock and the measured time is spent waiting for the frame.
+        std::this_thread::sleep_for(std::chrono::milliseconds(period_ms));
+    }
+
+    // The slow frames are skipped instead of stalling the playback. The last frame is always returned.
+    EXPECT_EQ(last_id, 49);
+    EXPECT_LT(num_frames, 50);
+    EXPECT_LT(max_block_ms, period_ms + 10);
+}
+
+}  // namespace Saiga
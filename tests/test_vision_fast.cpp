@@ -0,0 +1,207 @@
+/**
+ * Copyright (c) 2021 Darius Rückert
+ * Licensed under the MIT License.
+ * See LICENSE file for more information.
+ */
+
+#include "saiga/core/image/all.h"
+#include "saiga/core/math/random.h"
+#include "saiga/vision/features/FastDetector.h"
+#include "saiga/vision/features/ORBExtractor.h"
+#include "saiga/vision/features/OrbDescriptors.h"
+
+#include "gtest/gtest.h"
+
+using namespace Saiga;
+
+// Straight forward segment test: 9 contiguous pixels on the circle must be all brighter or all darker.
+bool IsCornerBruteForce(ImageView<const unsigned char> img, int y, int x, int t)
+{
+    static const int offsets[16][2] = {{0, 3},  {1, 3},   {2, 2},   {3, 1},   {3, 0},  {3, -1}, {2, -2}, {1, -3},
+                                       {0, -3}, {-1, -3}, {-2, -2}, {-3, -1}, {-3, 0}, {-3, 1}, {-2, 2}, {-1, 3}};
+    int v = img(y, x);
+    for (int start = 0; start < 16; ++start)
+    {
+        bool bright = true, dark = true;
+        for (int k = 0; k < 9; ++k)
+        {
+            auto o = offsets[(start + k) % 16];
+            int p  = img(y + o[1], x + o[0]);
+            bright &= p > v + t;
+            dark &= p < v - t;
+        }
+        if (bright || dark) return true;
+    }
+    return false;
+}
+
+TemplatedImage<unsigned char> RandomImage(int h, int w)
+{
+    TemplatedImage<unsigned char> img(h, w);
+    for (int y = 0; y < h; ++y)
+    {
+        for (int x = 0; x < w; ++x)
+        {
+            // Blocks with noise to get a mix of flat regions and corners
+            img(y, x) = ((x / 7 + y / 5) * 47) % 256 ^ Random::uniformInt(0, 15);
+        }
+    }
+    return img;
+}
+
+TEST(FastDetector, SegmentTest)
+{
+    FastDetector fast;
+    for (int size : {7, 40, 77, 131})
+    {
+        auto img = RandomImage(size + 3, size);
+        ImageView<const unsigned char> view = img.getConstImageView();
+        for (int threshold : {5, 20, 60})
+        {
+            int ref_count = 0;
+            for (int y = 3; y < img.h - 3; ++y)
+            {
+                for (int x = 3; x < img.w - 3; ++x)
+                {
+                    ref_count += IsCornerBruteForce(view, y, x, threshold);
+                }
+            }
+
+            std::vector<KeyPoint<float>> keypoints;
+            fast.Detect(view, threshold, false, keypoints);
+            EXPECT_EQ(keypoints.size(), ref_count);
+
+            for (auto& kp : keypoints)
+            {
+                int x = kp.point.x(), y = kp.point.y();
+                EXPECT_TRUE(IsCornerBruteForce(view, y, x, threshold));
+
+                // The score is the largest threshold which still detects this corner
+                EXPECT_TRUE(IsCornerBruteForce(view, y, x, kp.response));
+                EXPECT_FALSE(IsCornerBruteForce(view, y, x, kp.response + 1));
+            }
+        }
+    }
+}
+
+TEST(FastDetector, NonMaxSuppression)
+{
+    FastDetector fast;
+    auto img = RandomImage(100, 120);
+
+    std::vector<KeyPoint<float>> all, suppressed;
+    fast.Detect(img.getConstImageView(), 10, false, all);
+    fast.Detect(img.getConstImageView(), 10, true, suppressed);
+
+    TemplatedImage<float> scores(img.h, img.w);
+    scores.getImageView().set(0);
+    for (auto& kp : all) scores(kp.point.y(), kp.point.x()) = kp.response;
+
+    int ref_count = 0;
+    for (auto& kp : all)
+    {
+        int x = kp.point.x(), y = kp.point.y();
+        bool is_max = true;
+        for (int dy = -1; dy <= 1; ++dy)
+        {
+            for (int dx = -1; dx <= 1; ++dx)
+            {
+                if ((dx != 0 || dy != 0) && scores(y + dy, x + dx) >= kp.response) is_max = false;
+            }
+        }
+        ref_count += is_max;
+    }
+    EXPECT_EQ(suppressed.size(), ref_count);
+}
+
+TEST(ORB, ComputeDescriptors)
+{
+    auto img = RandomImage(200, 300);
+    ORB orb;
+
+    std::vector<KeyPoint<float>> keypoints;
+    for (int i = 0; i < 500; ++i)
+    {
+        KeyPoint<float> kp;
+        kp.point = vec2(Random::uniformInt(19, img.w - 20), Random::uniformInt(19, img.h - 20));
+        kp.angle = Random::sampleDouble(0, 360);
+        // Every second keypoint exactly at the center of an angle bin
+        if (i % 2 == 0) kp.angle = Random::uniformInt(0, ORB::kNumAngleBins - 1) * (360.f / ORB::kNumAngleBins);
+        keypoints.push_back(kp);
+    }
+
+    std::vector<DescriptorORB> descriptors(keypoints.size());
+    orb.ComputeDescriptors(img.getConstImageView(), keypoints, descriptors);
+
+    double average_distance = 0;
+    for (int i = 0; i < keypoints.size(); ++i)
+    {
+        auto ref = orb.ComputeDescriptor(img.getImageView(), keypoints[i].point, keypoints[i].angle);
+        if (i % 2 == 0)
+        {
+            // Same rotation, but the float rounding of the absolute position can differ for a few samples
+            EXPECT_LE(distance(descriptors[i], ref), 8);
+        }
+        average_distance += distance(descriptors[i], ref);
+    }
+    average_distance /= keypoints.size();
+    // The quantization of the angle changes only a few bits
+    EXPECT_LT(average_distance, 10);
+}
+
+TEST(ORBExtractor, Detect)
+{
+    auto img = RandomImage(480, 640);
+    ORBExtractor extractor(1000, 1.2, 8, 20, 7, 2);
+
+    std::vector<KeyPoint<float>> keypoints;
+    std::vector<DescriptorORB> descriptors;
+    extractor.Detect(img.getImageView(), keypoints, descriptors);
+
+    EXPECT_GT(keypoints.size(), 500);
+    EXPECT_EQ(keypoints.size(), descriptors.size());
+    for (auto& kp : keypoints)
+    {
+        EXPECT_TRUE(kp.octave >= 0 && kp.octave < 8);
+        EXPECT_TRUE(kp.point.x() >= 0 && kp.point.x() < img.w);
+        EXPECT_TRUE(kp.point.y() >= 0 && kp.point.y() < img.h);
+    }
+
+    // A second call must reuse all buffers and produce the same result
+    std::vector<KeyPoint<float>> keypoints2;
+    std::vector<DescriptorORB> descriptors2;
+    extractor.Detect(img.getImageView(), keypoints2, descriptors2);
+    EXPECT_EQ(keypoints, keypoints2);
+    EXPECT_EQ(descriptors, descriptors2);
+}
+
+TEST(ORBExtractor, DetectBatch)
+{
+    std::vector<TemplatedImage<unsigned char>> imgs = {RandomImage(480, 640), RandomImage(480, 640),
+                                                       RandomImage(300, 1000)};
+    std::vector<ImageView<unsigned char>> views;
+    for (auto& img : imgs) views.push_back(img.getImageView());
+
+    ORBExtractor extractor(1000, 1.2, 8, 20, 7, 4);
+    std::vector<std::vector<KeyPoint<float>>> keypoints;
+    std::vector<std::vector<DescriptorORB>> descriptors;
+
+    // Twice to check that the buffers of the first call are reused correctly
+    for (int it = 0; it < 2; ++it)
+    {
+        extractor.DetectBatch(views, keypoints, descriptors);
+        ASSERT_EQ(keypoints.size(), imgs.size());
+        ASSERT_EQ(descriptors.size(), imgs.size());
+
+        // The result of each image must be identical to a single image detection
+        for (int i = 0; i < imgs.size(); ++i)
+        {
+            ORBExtractor single(1000, 1.2, 8, 20, 7, 1);
+            std::vector<KeyPoint<float>> ref_keypoints;
+            std::vector<DescriptorORB> ref_descriptors;
+            single.Detect(views[i], ref_keypoints, ref_descriptors);
+            EXPECT_EQ(keypoints[i], ref_keypoints);
+            EXPECT_EQ(descriptors[i], ref_descriptors);
+        }
+    }
+}
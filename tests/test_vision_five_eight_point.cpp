@@ -15,10 +15,13 @@
 #include "saiga/vision/features/Features.h"
 #include "saiga/vision/reconstruction/EightPoint.h"
 #include "saiga/vision/reconstruction/FivePoint.h"
+#include "saiga/vision/reconstruction/Homography.h"
+#include "saiga/vision/reconstruction/P3P.h"
 #include "saiga/vision/reconstruction/TwoViewReconstruction.h"
 #include "saiga/vision/scene/Scene.h"
 #include "saiga/vision/scene/SynteticScene.h"
 #include "saiga/vision/util/Random.h"
+#include "saiga/vision/util/RansacKernels.h"
 
 #include "gtest/gtest.h"
 
@@ -232,6 +235,152 @@ TEST(EpipolarGeometry, FivePointAlgorithm)
     std::cout << "failed " << failed << std::endl;
 }
 
+TEST(EpipolarGeometry, Ransac)
+{
+    FiveEightPointTest test;
+
+    // Replace 40% of the matches by outliers. The inliers are moved to the front so that the order can be used as
+    // match quality for PROSAC.
+    int num_inliers = test.N * 0.6;
+    std::vector<Vec2> points1, points2;
+    for (int i = 0; i < test.N; ++i)
+    {
+        points1.push_back(test.normalized_points1[i]);
+        points2.push_back(i < num_inliers ? test.normalized_points2[i] : Vec2(Vec2::Random() * 0.5));
+    }
+
+    double epipolarTheshold = 1.5 / test.K1.fx;
+
+    auto solve = [&](RansacParameters params) {
+        params.maxIterations     = 2000;
+        params.residualThreshold = epipolarTheshold * epipolarTheshold;
+        params.reserveN          = test.N;
+        params.threads           = 4;
+
+        FivePointRansac fpr(params);
+        Mat3 E;
+        SE3 T;
+        std::vector<int> inliers;
+        std::vector<char> inlierMask;
+        int num;
+#pragma omp parallel num_threads(params.threads)
+        {
+            num = fpr.solve(points1, points2, E, T, inliers, inlierMask);
+        }
+
+        EXPECT_EQ(num, inliers.size());
+        EXPECT_EQ(num, std::count(inlierMask.begin(), inlierMask.end(), 1));
+        EXPECT_GE(num, 0.95 * num_inliers);
+        EXPECT_LE(fpr.NumIterations(), params.maxIterations);
+
+        int outliers_in_set = std::count_if(inliers.begin(), inliers.end(), [&](int i) { return i >= num_inliers; });
+        EXPECT_LE(outliers_in_set, 0.05 * num_inliers);
+        return fpr.NumIterations();
+    };
+
+    RansacParameters params;
+    EXPECT_EQ(solve(params), 2000);
+
+    params.confidence = 0.999;
+    int adaptive_iterations = solve(params);
+    EXPECT_LT(adaptive_iterations, 2000);
+
+    params.verification = RansacParameters::Verification::Tdd;
+    solve(params);
+
+    params.verification = RansacParameters::Verification::SPRT;
+    solve(params);
+
+    params.verification = RansacParameters::Verification::Full;
+    params.prosac       = true;
+    EXPECT_LE(solve(params), adaptive_iterations);
+}
+
+TEST(EpipolarGeometry, RansacKernels)
+{
+    FiveEightPointTest test;
+
+    // Compares the inlier masks of all kernels with the double precision residuals.
+    // Residuals very close to the threshold are skipped, because the kernels use single precision.
+    auto check = [](const std::vector<double>& residuals, double threshold, auto&& kernel_function) {
+        int n = residuals.size();
+        for (auto kernel : {RansacKernel::Scalar, RansacKernel::AVX2, RansacKernel::AVX512})
+        {
+            if (SupportedRansacKernel(kernel) != kernel) continue;
+
+            // An unaligned range to test the scalar remainder
+            int begin = 3;
+            int end   = n - 5;
+            std::vector<char> mask(n, 2);
+            int count = kernel_function(begin, end, threshold, mask.data(), kernel);
+
+            int expected_count = 0;
+            for (int j = begin; j < end; ++j)
+            {
+                bool expected = residuals[j] < threshold;
+                expected_count += mask[j];
+                if (std::abs(residuals[j] - threshold) > 1e-3 * threshold)
+                {
+                    EXPECT_EQ(mask[j], expected) << j << " " << residuals[j];
+                }
+            }
+            EXPECT_EQ(count, expected_count);
+            EXPECT_EQ(mask[begin - 1], 2);
+            EXPECT_EQ(mask[end], 2);
+        }
+    };
+
+    int N = test.N;
+    std::vector<Vec2> points1, points2;
+    for (int i = 0; i < N; ++i)
+    {
+        points1.push_back(test.normalized_points1[i]);
+        points2.push_back(test.normalized_points2[i] + Vec2(Vec2::Random() * 0.01));
+    }
+    RansacPointSet point_set;
+    point_set.Set(points1, points2);
+
+    {
+        std::vector<double> residuals;
+        for (int i = 0; i < N; ++i)
+            residuals.push_back(EpipolarDistanceSquared(points1[i], points2[i], test.reference_E));
+        check(residuals, 1e-5, [&](int begin, int end, double th, char* mask, RansacKernel kernel) {
+            return EpipolarInliers(test.reference_E, point_set, begin, end, th, mask, kernel);
+        });
+    }
+
+    {
+        Mat3 H = Mat3::Identity() + Mat3::Random() * 0.1;
+        std::vector<double> residuals;
+        for (int i = 0; i < N; ++i) residuals.push_back(homographyResidual(points1[i], points2[i], H));
+        check(residuals, 1e-2, [&](int begin, int end, double th, char* mask, RansacKernel kernel) {
+            return HomographyInliers(H, point_set, begin, end, th, mask, kernel);
+        });
+    }
+
+    {
+        auto& img = test.scene.images[0];
+        std::vector<Vec3> world_points;
+        std::vector<Vec2> image_points;
+        for (auto& ip : img.stereoPoints)
+        {
+            world_points.push_back(test.scene.worldPoints[ip.wp].p);
+            image_points.push_back(test.K1.unproject2(ip.point) + Vec2(Vec2::Random() * 0.01));
+        }
+        RansacPointSet point_set3;
+        point_set3.Set(world_points, image_points);
+
+        std::vector<double> residuals;
+        for (int i = 0; i < (int)world_points.size(); ++i)
+        {
+            residuals.push_back(((img.se3 * world_points[i]).hnormalized() - image_points[i]).squaredNorm());
+        }
+        check(residuals, 5e-5, [&](int begin, int end, double th, char* mask, RansacKernel kernel) {
+            return ReprojectionInliers(img.se3, point_set3, begin, end, th, mask, kernel);
+        });
+    }
+}
+
 TEST(EpipolarGeometry, Benchmark)
 {
     int its = 50;
@@ -0,0 +1,158 @@
+/**
+ * Copyright (c) 2021 Darius Rückert
+ * Licensed under the MIT License.
+ * See LICENSE file for more information.
+ */
+
+#include "saiga/core/math/random.h"
+#include "saiga/vision/features/HammingMatcher.h"
+
+#include "gtest/gtest.h"
+
+using namespace Saiga;
+
+std::vector<DescriptorORB> RandomDescriptors(int n)
+{
+    std::vector<DescriptorORB> result(n);
+    for (auto& d : result)
+    {
+        for (auto& w : d) w = Random::urand64();
+    }
+    return result;
+}
+
+// A noisy copy of each descriptor, so that the matcher has something to find
+std::vector<DescriptorORB> FlipBits(const std::vector<DescriptorORB>& descriptors, int bits)
+{
+    auto result = descriptors;
+    for (auto& d : result)
+    {
+        for (int i = 0; i < bits; ++i)
+        {
+            int b = Random::uniformInt(0, 255);
+            d[b / 64] ^= uint64_t(1) << (b % 64);
+        }
+    }
+    return result;
+}
+
+std::vector<HammingMatcher::Kernel> AllKernels()
+{
+    return {HammingMatcher::Kernel::Scalar, HammingMatcher::Kernel::AVX2, HammingMatcher::Kernel::AVX512};
+}
+
+TEST(HammingMatcher, Distances)
+{
+    for (int m : {0, 1, 7, 8, 9, 100})
+    {
+        auto train = RandomDescriptors(m);
+        auto query = RandomDescriptors(13);
+        HammingDescriptorSet set(train);
+        ASSERT_EQ(set.size(), m);
+        for (int j = 0; j < m; ++j) EXPECT_EQ(set.Get(j), train[j]);
+
+        for (auto kernel : AllKernels())
+        {
+            HammingMatcher matcher(kernel, 2);
+            std::vector<int> distances;
+            matcher.Distances(query, set, distances);
+            ASSERT_EQ(distances.size(), query.size() * m);
+            for (int i = 0; i < query.size(); ++i)
+            {
+                for (int j = 0; j < m; ++j)
+                {
+                    EXPECT_EQ(distances[i * m + j], distance(query[i], train[j]));
+                }
+            }
+        }
+    }
+}
+
+TEST(HammingMatcher, Knn)
+{
+    auto train = RandomDescriptors(300);
+    auto query = RandomDescriptors(50);
+    HammingDescriptorSet set(train);
+
+    const int k = 5;
+    for (auto kernel : AllKernels())
+    {
+        HammingMatcher matcher(kernel, 2);
+        std::vector<HammingMatch> knn;
+        matcher.MatchKnn(query, set, k, knn);
+        ASSERT_EQ(knn.size(), query.size() * k);
+
+        for (int i = 0; i < query.size(); ++i)
+        {
+            std::vector<std::pair<int, int>> ref;
+            for (int j = 0; j < train.size(); ++j) ref.push_back({distance(query[i], train[j]), j});
+            std::sort(ref.begin(), ref.end());
+            for (int l = 0; l < k; ++l)
+            {
+                EXPECT_EQ(knn[i * k + l].query, i);
+                EXPECT_EQ(knn[i * k + l].distance, ref[l].first);
+                EXPECT_EQ(knn[i * k + l].train, ref[l].second);
+            }
+        }
+    }
+
+    // Less train descriptors than k
+    HammingMatcher matcher;
+    std::vector<HammingMatch> knn;
+    auto small_train = RandomDescriptors(2);
+    matcher.MatchKnn(query, HammingDescriptorSet(small_train), 3, knn);
+    EXPECT_EQ(knn[2].train, -1);
+}
+
+TEST(HammingMatcher, Match)
+{
+    auto train = RandomDescriptors(500);
+    auto query = FlipBits(train, 10);
+    HammingDescriptorSet set(train);
+
+    std::vector<HammingMatch> reference;
+    for (auto kernel : AllKernels())
+    {
+        HammingMatcher matcher(kernel, 3);
+        std::vector<HammingMatch> matches;
+
+        HammingMatchOptions options;
+        options.max_distance = 50;
+        options.ratio        = 0.8;
+        options.mutual_check = true;
+        int n                = matcher.Match(query, set, options, matches);
+        EXPECT_EQ(n, query.size());
+        for (auto& m : matches)
+        {
+            EXPECT_EQ(m.query, m.train);
+            EXPECT_LE(m.distance, 10);
+        }
+
+        if (reference.empty()) reference = matches;
+        EXPECT_EQ(matches, reference);
+    }
+
+    // Random queries don't pass the threshold
+    HammingMatcher matcher;
+    std::vector<HammingMatch> matches;
+    HammingMatchOptions options;
+    options.max_distance = 50;
+    auto random_query = RandomDescriptors(100);
+    EXPECT_EQ(matcher.Match(random_query, set, options, matches), 0);
+
+    // Duplicated train descriptors fail the ratio test
+    auto train2 = train;
+    train2.insert(train2.end(), train.begin(), train.end());
+    options.ratio = 0.8;
+    EXPECT_EQ(matcher.Match(query, HammingDescriptorSet(train2), options, matches), 0);
+
+    // Two queries for the same train descriptor: only the better one survives the mutual check
+    auto query2 = query;
+    query2.push_back(train[0]);
+    options              = HammingMatchOptions();
+    options.mutual_check = true;
+    matcher.Match(query2, set, options, matches);
+    EXPECT_EQ(matches.size(), query.size());
+    EXPECT_EQ(matches.back().query, query2.size() - 1);
+    EXPECT_EQ(matches.back().train, 0);
+}
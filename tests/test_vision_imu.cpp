@@ -4,6 +4,7 @@
  * See LICENSE file for more information.
  */
 
+#include "saiga/vision/imu/DecoupledImuScene.h"
 #include "saiga/vision/imu/Solver.h"
 #include "saiga/vision/util/Random.h"
 
@@ -276,4 +277,64 @@ TEST(Imu, SolveGravityScale)
     }
 }
 
+TEST(Imu, PreintAll)
+{
+    Imu::DecoupledImuScene scene;
+    scene.MakeRandom(50, 20, 1.0 / 100.0);
+    for (auto& s : scene.states)
+    {
+        s.velocity_and_bias.acc_bias  = Vec3::Random() * 0.1;
+        s.velocity_and_bias.gyro_bias = Vec3::Random() * 0.1;
+    }
+    scene.PreintAll();
+
+    for (auto& e : scene.edges)
+    {
+        auto& s = scene.states[e.from];
+        Imu::Preintegration ref(s.velocity_and_bias);
+        ref.IntegrateMidPoint(*e.data, true);
+
+        EXPECT_EQ(e.preint->delta_t, ref.delta_t);
+        EXPECT_EQ(e.preint->delta_R.params(), ref.delta_R.params());
+        EXPECT_EQ(e.preint->delta_x, ref.delta_x);
+        EXPECT_EQ(e.preint->delta_v, ref.delta_v);
+        EXPECT_EQ(e.preint->J_R_Biasg, ref.J_R_Biasg);
+        EXPECT_EQ(e.preint->J_P_Biasa, ref.J_P_Biasa);
+        EXPECT_EQ(e.preint->J_P_Biasg, ref.J_P_Biasg);
+        EXPECT_EQ(e.preint->J_V_Biasa, ref.J_V_Biasa);
+        EXPECT_EQ(e.preint->J_V_Biasg, ref.J_V_Biasg);
+    }
+}
+
+TEST(Imu, BiasCorrection)
+{
+    // A small bias change is approximated by the first order correction in ImuError.
+    Imu::DecoupledImuScene scene;
+    scene.MakeRandom(20, 20, 1.0 / 100.0);
+    scene.PreintAll();
+
+    for (auto& e : scene.edges)
+    {
+        auto& s1 = scene.states[e.from];
+        auto& s2 = scene.states[e.to];
+
+        Imu::VelocityAndBias delta;
+        delta.acc_bias  = Vec3::Random() * 1e-3;
+        delta.gyro_bias = Vec3::Random() * 1e-3;
+
+        Imu::VelocityAndBias new_bias = s1.velocity_and_bias;
+        new_bias.acc_bias += delta.acc_bias;
+        new_bias.gyro_bias += delta.gyro_bias;
+        Imu::Preintegration ref(new_bias);
+        ref.IntegrateMidPoint(*e.data, true);
+
+        Vec3 w(1, 1, 1);
+        Vec9 r1 = e.preint->ImuError(delta, s1.velocity_and_bias.velocity, s1.pose, s2.velocity_and_bias.velocity,
+                                     s2.pose, scene.gravity, 1, w);
+        Vec9 r2 = ref.ImuError(Imu::VelocityAndBias(), s1.velocity_and_bias.velocity, s1.pose,
+                               s2.velocity_and_bias.velocity, s2.pose, scene.gravity, 1, w);
+        EXPECT_LT((r1 - r2).norm(), 1e-6);
+    }
+}
+
 }  // namespace Saiga
@@ -0,0 +1,213 @@
+﻿/**
+ * Copyright (c) 2021 Darius Rückert
+ * Licensed under the MIT License.
+ * See LICENSE file for more information.
+ */
+
+#include "saiga/config.h"
+#include "saiga/core/Core.h"
+#include "saiga/vision/scene/SynteticScene.h"
+
+#include "gtest/gtest.h"
+
+#include <fstream>
+
+namespace Saiga
+{
+void ExpectEqualScenes(const Scene& a, const Scene& b)
+{
+    EXPECT_EQ(a.bf, b.bf);
+    EXPECT_EQ(a.globalScale, b.globalScale);
+
+    ASSERT_EQ(a.intrinsics.size(), b.intrinsics.size());
+    for (int i = 0; i < (int)a.intrinsics.size(); ++i)
+    {
+        EXPECT_EQ(a.intrinsics[i].coeffs(), b.intrinsics[i].coeffs());
+    }
+
+    ASSERT_EQ(a.images.size(), b.images.size());
+    for (int i = 0; i < (int)a.images.size(); ++i)
+    {
+        auto& ia = a.images[i];
+        auto& ib = b.images[i];
+        EXPECT_EQ(ia.se3.params(), ib.se3.params());
+        EXPECT_EQ(ia.velocity.params(), ib.velocity.params());
+        EXPECT_EQ(ia.constant, ib.constant);
+        EXPECT_EQ(ia.intr, ib.intr);
+        EXPECT_EQ(ia.validPoints, ib.validPoints);
+        ASSERT_EQ(ia.stereoPoints.size(), ib.stereoPoints.size());
+        for (int j = 0; j < (int)ia.stereoPoints.size(); ++j)
+        {
+            auto& pa = ia.stereoPoints[j];
+            auto& pb = ib.stereoPoints[j];
+            EXPECT_EQ(pa.wp, pb.wp);
+            EXPECT_EQ(pa.depth, pb.depth);
+            EXPECT_EQ(pa.point, pb.point);
+            EXPECT_EQ(pa.weight, pb.weight);
+        }
+    }
+
+    ASSERT_EQ(a.worldPoints.size(), b.worldPoints.size());
+    for (int i = 0; i < (int)a.worldPoints.size(); ++i)
+    {
+        EXPECT_EQ(a.worldPoints[i].p, b.worldPoints[i].p);
+        EXPECT_EQ(a.worldPoints[i].valid, b.worldPoints[i].valid);
+        EXPECT_EQ(a.worldPoints[i].stereoreferences, b.worldPoints[i].stereoreferences);
+    }
+}
+
+Scene TestScene()
+{
+    Random::setSeed(926457);
+    Scene scene = SynteticScene::CircleSphere(500, 10, 80);
+    scene.addImagePointNoise(0.5);
+    scene.bf                             = 0.3;
+    scene.images[3].constant             = true;
+    scene.images[2].stereoPoints[5].depth = 2.5;
+    scene.images[4].stereoPoints[7].wp    = -1;
+    scene.fixWorldPointReferences();
+    return scene;
+}
+
+TEST(SceneIO, BinaryRoundTrip)
+{
+    Scene scene = TestScene();
+
+    for (bool compress : {false, true})
+    {
+        scene.saveBinary("scene_test.bin", compress);
+
+        Scene loaded;
+        EXPECT_TRUE(loaded.loadBinary("scene_test.bin"));
+        ExpectEqualScenes(scene, loaded);
+
+        // load() detects the binary format
+        Scene loaded2;
+        loaded2.load("scene_test.bin");
+        ExpectEqualScenes(scene, loaded2);
+    }
+}
+
+TEST(SceneIO, TextToBinary)
+{
+    Scene scene = TestScene();
+
+    scene.save("scene_test.txt");
+    Scene text;
+    text.load("scene_test.txt");
+    ExpectEqualScenes(scene, text);
+
+    text.saveBinary("scene_test.bin");
+    Scene binary;
+    EXPECT_TRUE(binary.loadBinary("scene_test.bin"));
+    ExpectEqualScenes(text, binary);
+
+    binary.save("scene_test2.txt");
+    Scene text2;
+    text2.load("scene_test2.txt");
+    ExpectEqualScenes(text, text2);
+}
+
+TEST(SceneIO, InvalidBinary)
+{
+    Scene scene = TestScene();
+    scene.saveBinary("scene_test.bin");
+
+    std::vector<char> data;
+    {
+        std::ifstream strm("scene_test.bin", std::ios_base::binary);
+        data.assign(std::istreambuf_iterator<char>(strm), std::istreambuf_iterator<char>());
+    }
+
+    auto write = [](const std::vector<char>& d) {
+        std::ofstream strm("scene_test_invalid.bin", std::ios_base::binary);
+        strm.write(d.data(), d.size());
+    };
+
+    // Truncated file
+    write(std::vector<char>(data.begin(), data.begin() + data.size() / 2));
+    Scene loaded;
+    EXPECT_FALSE(loaded.loadBinary("scene_test_invalid.bin"));
+    EXPECT_TRUE(loaded.images.empty());
+
+    // Wrong version
+    auto wrong_version = data;
+    wrong_version[8]++;
+    write(wrong_version);
+    EXPECT_FALSE(loaded.loadBinary("scene_test_invalid.bin"));
+
+    // An observation with an invalid world point index
+    auto wrong_index = data;
+    int64_t num_world_points;
+    std::memcpy(&num_world_points, data.data() + 32, sizeof(int64_t));
+    int32_t index = num_world_points + 10;
+    size_t observations_offset;
+    std::memcpy(&observations_offset, data.data() + 64 + 4 * 32, sizeof(size_t));
+    std::memcpy(wrong_index.data() + observations_offset, &index, sizeof(int32_t));
+    write(wrong_index);
+    EXPECT_FALSE(loaded.loadBinary("scene_test_invalid.bin"));
+}
+
+TEST(SceneIO, InvalidCompressedBinary)
+{
+    Scene scene = TestScene();
+    scene.saveBinary("scene_test.bin", true);
+
+    std::vector<char> data;
+    {
+        std::ifstream strm("scene_test.bin", std::ios_base::binary);
+        data.assign(std::istreambuf_iterator<char>(strm), std::istreambuf_iterator<char>());
+    }
+
+    // The section table starts at byte 64 with 32 bytes per section: offset, stored size, size, compressed flag
+    int compressed_sections = 0;
+    bool tested_size        = false;
+    for (int s = 0; s < 6; ++s)
+    {
+        uint64_t offset, stored_size;
+        int32_t compressed;
+        std::memcpy(&offset, data.data() + 64 + 32 * s, sizeof(uint64_t));
+        std::memcpy(&stored_size, data.data() + 64 + 32 * s + 8, sizeof(uint64_t));
+        std::memcpy(&compressed, data.data() + 64 + 32 * s + 24, sizeof(int32_t));
+        if (!compressed) continue;
+        compressed_sections++;
+
+        auto write_and_load = [&](const std::vector<char>& d) {
+            {
+                std::ofstream strm("scene_test_invalid.bin", std::ios_base::binary);
+                strm.write(d.data(), d.size());
+            }
+            Scene loaded;
+            EXPECT_FALSE(loaded.loadBinary("scene_test_invalid.bin"));
+            EXPECT_TRUE(loaded.images.empty());
+        };
+
+        // Wrong magic number of the compressed block
+        auto wrong_magic = data;
+        wrong_magic[offset]++;
+        write_and_load(wrong_magic);
+
+        // Corrupted zlib stream
+        auto wrong_stream = data;
+        for (uint64_t i = 24; i < stored_size; ++i) wrong_stream[offset + i] = char(0xAB);
+        write_and_load(wrong_stream);
+
+        // The world point section of a header with 2^30 points. The counts and sizes are consistent, but the
+        // uncompressed size (24 GB) is impossible for the compressed size.
+        if (s == 5)
+        {
+            auto wrong_size       = data;
+            int64_t num_points    = int64_t(1) << 30;
+            uint64_t section_size = 3 * sizeof(double) * num_points;
+            std::memcpy(wrong_size.data() + 32, &num_points, sizeof(int64_t));
+            std::memcpy(wrong_size.data() + 64 + 32 * s + 16, &section_size, sizeof(uint64_t));
+            std::memcpy(wrong_size.data() + offset + 16, &section_size, sizeof(uint64_t));
+            write_and_load(wrong_size);
+            tested_size = true;
+        }
+    }
+    EXPECT_GT(compressed_sections, 0);
+    EXPECT_TRUE(tested_size);
+}
+
+}  // namespace Saiga
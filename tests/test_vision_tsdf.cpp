@@ -177,6 +177,33 @@ TEST(TSDF, Crop)
 }
 
 
+TEST(TSDF, ConcurrentInsert)
+{
+    // The reserved size is much smaller than the number of inserted blocks
+    SparseTSDF tsdf(1, 10, 1000);
+    int n = 20;
+
+    // Every block is inserted 4 times to provoke insertion races
+#pragma omp parallel for num_threads(8)
+    for (int k = 0; k < n * n * n * 4; ++k)
+    {
+        int i = (k / 4) % (n * n * n);
+        ivec3 id(i % n, (i / n) % n, i / (n * n));
+        auto* block = tsdf.InsertBlockConcurrent(id);
+        EXPECT_EQ(block->index, id);
+    }
+    tsdf.FinishConcurrentInsertion();
+
+    EXPECT_EQ(tsdf.current_blocks, n * n * n);
+    EXPECT_GE((int)tsdf.blocks.size(), n * n * n);
+    EXPECT_EQ(tsdf.NumBlocksInRect(tsdf.Bounds()), n * n * n);
+    for (int i = 0; i < tsdf.current_blocks; ++i)
+    {
+        EXPECT_EQ(tsdf.GetBlockId(tsdf.blocks[i].index), i);
+    }
+}
+
+
 TEST(TSDF, VirtualVoxelIndex)
 {
     {
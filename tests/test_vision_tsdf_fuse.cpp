@@ -5,6 +5,7 @@
  */
 
 #include "saiga/core/Core.h"
+#include "saiga/vision/reconstruction/IncrementalFusion.h"
 #include "saiga/vision/reconstruction/MarchingCubes.h"
 #include "saiga/vision/reconstruction/SparseTSDF.h"
 #include "saiga/vision/reconstruction/VoxelFusion.h"
@@ -116,7 +117,67 @@ TEST(TSDF, IncrementalFuse)
     EXPECT_EQ(test->scene.tsdf->current_blocks, scene2.tsdf->current_blocks);
 }
 
+TEST(TSDF, OnlineFusion)
+{
+    // Reference: batch fusion with the weighted average update
+    FusionScene scene2;
+    scene2                          = test->scene;
+    scene2.params.ground_truth_fuse = false;
+    scene2.params.out_file          = "";
+    scene2.Fuse();
 
+    auto& image = test->scene.images.front();
+    IncrementalFusion fusion(scene2.K, scene2.dis, image.depthMap.w, image.depthMap.h, scene2.params);
+    fusion.Integrate(image.depthMap, image.V);
+    EXPECT_EQ(fusion.tsdf->current_blocks, scene2.tsdf->current_blocks);
+    EXPECT_EQ(fusion.LastFrame().allocated_blocks, fusion.tsdf->current_blocks);
+    EXPECT_GT(fusion.LastFrame().changed_blocks, 0);
+
+    // All voxels observed by both must be (almost) identical
+    int compared = 0, different = 0;
+    for (int b = 0; b < scene2.tsdf->current_blocks; ++b)
+    {
+        auto& block  = scene2.tsdf->blocks[b];
+        auto* block2 = fusion.tsdf->GetBlock(block.index);
+        ASSERT_TRUE(block2);
+        for (int z = 0; z < SparseTSDF::VOXEL_BLOCK_SIZE; ++z)
+            for (int y = 0; y < SparseTSDF::VOXEL_BLOCK_SIZE; ++y)
+                for (int x = 0; x < SparseTSDF::VOXEL_BLOCK_SIZE; ++x)
+                {
+                    auto v1 = block.data[z][y][x];
+                    auto v2 = block2->data[z][y][x];
+                    if (v1.weight == 0 || v2.weight == 0) continue;
+                    compared++;
+                    if (std::abs(v1.distance - v2.distance) > 1e-3 || std::abs(v1.weight - v2.weight) > 1e-3)
+                        different++;
+                }
+    }
+    EXPECT_GT(compared, 0);
+    EXPECT_LT(different, compared * 0.01);
+
+    EXPECT_GT(fusion.UpdateMesh(), 0);
+    EXPECT_EQ(fusion.UpdateMesh(), 0);
+
+    // A second view -> only the changed blocks are re-triangulated.
+    // The cached mesh must be identical to a full extraction.
+    auto V2 = image.V;
+    V2.translation() += Vec3(0.02, 0, 0.01);
+    fusion.Integrate(image.depthMap, V2);
+    EXPECT_GE(fusion.NumDirtyBlocks(), fusion.LastFrame().changed_blocks);
+    int dirty = fusion.NumDirtyBlocks();
+    EXPECT_EQ(fusion.UpdateMesh(), dirty);
+    EXPECT_EQ(fusion.NumDirtyBlocks(), 0);
+
+    auto& p      = scene2.params;
+    auto full    = fusion.tsdf->ExtractSurface(p.extract_iso, p.extract_outlier_factor, 0, 4, false);
+    auto& cached = fusion.TrianglesPerBlock();
+    ASSERT_EQ(full.size(), cached.size());
+    for (int b = 0; b < (int)full.size(); ++b)
+    {
+        EXPECT_EQ(full[b].size(), cached[b].size());
+    }
+    EXPECT_GT(fusion.Mesh().NumFaces(), 0);
+}
 
 TEST(TSDF, LoadStore)
 {